@@ -0,0 +1,172 @@
+// Benchmarks for the firmware's hot paths, run on the host port: the whole
+// app is booted against the stand-ins, then each path is timed in wall-clock
+// time while the virtual clock stands still. Every case is run REPEATS
+// times and the best is reported, so numbers are comparable between runs.
+#include "host.h"
+
+#include "esp_log.h"
+#include "esp_rom_crc.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "safety.h"
+#include "storage.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define REPEATS 5
+
+static char s_base[64];
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+typedef void (*bench_fn_t)(int iters);
+
+static void run(const char* name, bench_fn_t fn, int iters) {
+    double best = 1e9;
+    fn(iters / 10 + 1); // warm caches
+    for (int r = 0; r < REPEATS; ++r) {
+        double t0 = now_s();
+        fn(iters);
+        double dt = now_s() - t0;
+        if (dt < best) best = dt;
+    }
+    printf("%-28s %10.1f ns/op  (%d ops)\n", name, best * 1e9 / iters, iters);
+}
+
+static void deliver(const char* suffix, const char* payload) {
+    char topic[128];
+    snprintf(topic, sizeof(topic), "%s/%s", s_base, suffix);
+    if (!host_mqtt_deliver(topic, payload, (int)strlen(payload))) {
+        fprintf(stderr, "not subscribed: %s\n", topic);
+        exit(1);
+    }
+}
+
+// ---- Cases ---------------------------------------------------------------------------
+
+// Last topic compared before the OTA ones; the payload is rejected, so this
+// is the cost of matching alone
+static void bench_dispatch_miss(int iters) {
+    for (int i = 0; i < iters; ++i) deliver("schedule/w2_end/set", "x");
+}
+
+// Relay command through the control task, including the state echo
+static void bench_dispatch_relay(int iters) {
+    for (int i = 0; i < iters; ++i) deliver("relay/1/set", (i & 1) ? "OFF" : "ON");
+    host_run_idle();
+}
+
+// Session restart: availability, discovery, initial states, subscriptions
+static void bench_discovery(int iters) {
+    for (int i = 0; i < iters; ++i) host_mqtt_session_restart();
+    host_run_idle();
+}
+
+static uint8_t s_buf[4096];
+static volatile uint32_t s_sink;
+
+static void bench_crc_small(int iters) {
+    uint32_t c = 0;
+    for (int i = 0; i < iters; ++i) c = esp_rom_crc32_le(c, s_buf, 32);
+    s_sink = c;
+}
+
+static void bench_crc_sector(int iters) {
+    uint32_t c = 0;
+    for (int i = 0; i < iters; ++i) c = esp_rom_crc32_le(c, s_buf, sizeof(s_buf));
+    s_sink = c;
+}
+
+static void bench_schedule_check(int iters) {
+    uint32_t n = 0;
+    for (int i = 0; i < iters; ++i) n += safety_can_turn_on(1 + (i & 3));
+    s_sink = n;
+}
+
+static void bench_schedule_apply(int iters) {
+    for (int i = 0; i < iters; ++i) safety_apply_policy_now();
+}
+
+// Setter plus read-back, served by the RAM cache
+static void bench_storage_cached(int iters) {
+    uint32_t v = 0;
+    for (int i = 0; i < iters; ++i) {
+        storage_set_u32("bench", (uint32_t)i);
+        storage_get_u32("bench", &v, 0);
+    }
+    s_sink = v;
+}
+
+// Setter plus forced commit, as after a safety-critical change
+static void bench_storage_commit(int iters) {
+    for (int i = 0; i < iters; ++i) {
+        storage_set_u32("bench", (uint32_t)i);
+        storage_flush();
+    }
+}
+
+// Local API: a state snapshot, and a relay command through the control task
+static void bench_http_state(int iters) {
+    char out[768];
+    for (int i = 0; i < iters; ++i) {
+        if (host_http_request("GET", "/api/state", NULL, NULL, out, sizeof(out)) != 200) {
+            fprintf(stderr, "GET /api/state failed\n");
+            exit(1);
+        }
+    }
+}
+
+static void bench_http_relay(int iters) {
+    char out[64];
+    for (int i = 0; i < iters; ++i) {
+        if (host_http_request("POST", "/api/relay/1", i & 1 ? "OFF" : "ON", NULL, out, sizeof(out)) != 202) {
+            fprintf(stderr, "POST /api/relay/1 failed: %s\n", out);
+            exit(1);
+        }
+        host_run_idle();
+    }
+}
+
+// ---- Main ------------------------------------------------------------------------------
+
+int main(int argc, char** argv) {
+    // Reconnects log warnings; $HOST_LOG_LEVEL still overrides this
+    host_log_level(ESP_LOG_ERROR);
+    // NVS in a file when given a directory, so commits include the file write
+    host_init(argc > 1 ? argv[1] : NULL);
+    host_start_app();
+
+    // Boot until MQTT is up, then sync to midday, inside the default window
+    for (int i = 0; i < 100 && !host_mqtt_connected(); ++i) host_run_for(100000);
+    if (!host_mqtt_connected() || !host_sntp_reply(1718000000 + 12 * 3600)) {
+        fprintf(stderr, "boot did not reach MQTT and SNTP\n");
+        return 1;
+    }
+    host_run_for(1000000);
+
+    uint8_t mac[6] = { 0x24, 0x0a, 0xc4, 0x12, 0x34, 0x56 };
+    snprintf(s_base, sizeof(s_base), "greenhouse/esp32s3-%02x%02x%02x", mac[3], mac[4], mac[5]);
+    for (size_t i = 0; i < sizeof(s_buf); ++i) s_buf[i] = (uint8_t)(i * 31 + 7);
+
+    run("dispatch (no match)", bench_dispatch_miss, 200000);
+    run("dispatch relay command", bench_dispatch_relay, 20000);
+    run("discovery + resubscribe", bench_discovery, 5000);
+    run("http GET state", bench_http_state, 50000);
+    run("http POST relay", bench_http_relay, 20000);
+    run("crc32 32 B", bench_crc_small, 1000000);
+    run("crc32 4 KiB", bench_crc_sector, 20000);
+    run("schedule check", bench_schedule_check, 1000000);
+    run("schedule apply policy", bench_schedule_apply, 200000);
+    run("storage set+get (cached)", bench_storage_cached, 500000);
+    run("storage set+commit", bench_storage_commit, argc > 1 ? 2000 : 100000);
+    printf("published %u messages, virtual clock %.1f s\n", (unsigned)host_mqtt_publish_count(),
+           host_now_us() / 1e6);
+    return 0;
+}
@@ -0,0 +1,113 @@
+// Encode/decode benchmark for main/tsdb.c: 24 h of synthetic 5 s samples
+#include "tsdb.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define SAMPLES (24 * 3600 / 5)
+#define BLOCKS 64
+
+static uint8_t s_blocks[BLOCKS * TSDB_BLOCK_SIZE];
+static tsdb_block_meta_t s_meta[BLOCKS];
+static tsdb_point_t s_in[SAMPLES];
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// Sensor-like data: diurnal temperature/RH, CO2 random walk, 1 s jitter,
+// occasional gaps, relays switching every few minutes
+static void generate(void) {
+    srand(42);
+    uint32_t ts = 1700000000;
+    double co2 = 600;
+    int32_t relays = 0;
+    for (int i = 0; i < SAMPLES; ++i) {
+        ts += 5 + (rand() % 20 == 0 ? 1 : 0) + (rand() % 2000 == 0 ? 60 : 0);
+        double day = 2 * M_PI * (i % 17280) / 17280.0;
+        co2 += (rand() % 21 - 10) * 0.5;
+        if (co2 < 400) co2 = 400;
+        double t = 22 + 6 * sin(day) + (rand() % 5 - 2) * 0.05;
+        double rh = 60 - 15 * sin(day) + (rand() % 5 - 2) * 0.1;
+        if (rand() % 60 == 0) relays ^= 1 << (rand() % 4);
+        s_in[i].ts = ts;
+        s_in[i].v[TSDB_CO2] = (int32_t)lround(co2);
+        s_in[i].v[TSDB_TEMP] = (int32_t)lround(t * 10);
+        s_in[i].v[TSDB_RH] = (int32_t)lround(rh * 10);
+        s_in[i].v[TSDB_RELAYS] = relays;
+    }
+}
+
+typedef struct {
+    int idx;
+    int errors;
+} verify_ctx_t;
+
+static bool verify(const tsdb_point_t* p, void* arg) {
+    verify_ctx_t* c = arg;
+    if (memcmp(p, &s_in[c->idx], sizeof(*p)) != 0) c->errors++;
+    c->idx++;
+    return true;
+}
+
+static bool count(const tsdb_point_t* p, void* arg) {
+    (void)p;
+    (*(int*)arg)++;
+    return true;
+}
+
+static bool rollup(const tsdb_point_t* p, void* arg) {
+    tsdb_rollup_add(arg, p);
+    return true;
+}
+
+int main(void) {
+    generate();
+    tsdb_t db;
+    const int reps = 20;
+
+    double t0 = now_s();
+    for (int r = 0; r < reps; ++r) {
+        tsdb_init(&db, s_blocks, s_meta, BLOCKS);
+        for (int i = 0; i < SAMPLES; ++i) tsdb_append(&db, &s_in[i]);
+    }
+    double enc = (now_s() - t0) / reps;
+
+    tsdb_stats_t st;
+    tsdb_get_stats(&db, &st);
+    int first = SAMPLES - (int)st.points;
+
+    verify_ctx_t vc = { .idx = first };
+    tsdb_query(&db, 0, UINT32_MAX, verify, &vc);
+
+    int n = 0;
+    t0 = now_s();
+    for (int r = 0; r < reps; ++r) {
+        n = 0;
+        tsdb_query(&db, 0, UINT32_MAX, count, &n);
+    }
+    double dec = (now_s() - t0) / reps;
+
+    tsdb_rollup_t ru;
+    t0 = now_s();
+    for (int r = 0; r < reps; ++r) {
+        tsdb_rollup_reset(&ru);
+        tsdb_query(&db, s_in[SAMPLES - 720].ts, UINT32_MAX, rollup, &ru);
+    }
+    double roll = (now_s() - t0) / reps;
+
+    printf("samples:        %d (24 h at 5 s)\n", SAMPLES);
+    printf("stored:         %u points in %u bytes (%d blocks of %d)\n",
+           (unsigned)st.points, (unsigned)st.bytes, BLOCKS, TSDB_BLOCK_SIZE);
+    printf("size:           %.2f bytes/point (raw %zu)\n", (double)st.bytes / st.points, sizeof(tsdb_point_t));
+    printf("encode:         %.1f ns/point\n", enc * 1e9 / SAMPLES);
+    printf("decode:         %.1f ns/point\n", dec * 1e9 / n);
+    printf("rollup last 1h: %.1f us (%u points, co2 avg %lld)\n", roll * 1e6, (unsigned)ru.n,
+           ru.n ? (long long)(ru.sum[TSDB_CO2] / ru.n) : 0);
+    printf("roundtrip:      %s (%d points, %d mismatches)\n", vc.errors ? "FAIL" : "ok", vc.idx - first, vc.errors);
+    return vc.errors || vc.idx != SAMPLES ? 1 : 0;
+}
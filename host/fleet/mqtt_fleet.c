@@ -0,0 +1,463 @@
+// Fleet load harness: N firmware instances, each a child process running
+// main/ on the host port in real time with its own MAC (so its own
+// make_device_identity() id and client id), against a real MQTT broker.
+// The parent is an observer client subscribed to everything. It measures,
+// per phase:
+//   boot      spawn to ready, with every device starting at once
+//   commands  relay command round trip: relay/1/set to relay/1/state
+//   restart   broker stopped and started again: reconnect to ready,
+//             availability flaps and the discovery burst
+// A device is ready when it answers a probe, a relay/4/max_on/set echoed
+// on relay/4/max_on, which needs its subscriptions in place. Probes repeat
+// until one is answered; under load an echo may be for an earlier one. Message rates are what the broker routes to the observer.
+//
+//   mqtt_fleet [-n devices] [--uri mqtt://127.0.0.1:1883]
+//              [--broker "mosquitto -p 1883"] [--commands K] [--down S]
+// Without --broker the broker must already run and the restart phase is
+// skipped.
+#include "host.h"
+#include "mqtt_wire.h"
+
+#include "sdkconfig.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/prctl.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_DEVICES     2000
+#define PROBE_EVERY_US  1000000
+#define CMD_TIMEOUT_US  5000000
+#define PHASE_TIMEOUT_S 120
+#define MAX_SECONDS     3600
+
+// The probe sets relay 4's max-on time to its default, leaving config alone
+#define STR_(x)       #x
+#define STR(x)        STR_(x)
+#define PROBE_PAYLOAD STR(CONFIG_SAFETY_RELAY4_MAX_ON_MIN_DEFAULT)
+
+typedef struct {
+    char base[64];
+    pid_t pid;
+    int64_t t0_us;    // start of the phase
+    int64_t ready_us; // probe answered, 0 = not yet
+    int64_t probe_at_us; // last probe sent this phase, 0 = none
+    bool online;
+    uint32_t flaps; // availability changes seen
+    int64_t cmd_at_us; // outstanding command, 0 = none
+    int cmds;
+} device_t;
+
+typedef struct {
+    const char* name;
+    uint32_t per_s[MAX_SECONDS];
+    int64_t start_us;
+    uint32_t total;
+    uint32_t discovery, status, state, sensors, other;
+} rate_t;
+
+static device_t s_dev[MAX_DEVICES];
+static int s_n = 10;
+static const char* s_uri = "mqtt://127.0.0.1:1883";
+static const char* s_broker_cmd;
+static pid_t s_broker = -1;
+static int s_fd = -1;
+static mqtt_wire_reader_t s_rd;
+static rate_t* s_rate;
+static int64_t s_ping_at_us;
+
+static int64_t mono_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static int64_t real_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts); // time() follows the host port's clock
+    return ts.tv_sec;
+}
+
+static void device_mac(int i, uint8_t mac[6]) {
+    const uint8_t m[6] = { 0x24, 0x0a, 0xc4, (uint8_t)(0xf0 | ((i >> 16) & 0x0f)), (uint8_t)(i >> 8), (uint8_t)i };
+    memcpy(mac, m, 6);
+}
+
+// ---- Device process ----------------------------------------------------------------------
+
+static void run_device(int i) {
+    prctl(PR_SET_PDEATHSIG, SIGTERM);
+    char seed[16];
+    snprintf(seed, sizeof(seed), "%d", i + 1); // backoff jitter differs per device
+    setenv("HOST_SEED", seed, 1);
+    uint8_t mac[6];
+    device_mac(i, mac);
+
+    host_log_level(1);
+    host_init(NULL);
+    host_set_mac(mac);
+    host_set_wall_time(real_s());
+    host_set_realtime(true);
+    host_mqtt_use_network(s_uri);
+    host_start_app();
+    bool synced = false;
+    for (;;) {
+        host_run_for(1000000);
+        if (!synced) synced = host_sntp_reply(real_s());
+    }
+}
+
+static void spawn_devices(void) {
+    fflush(NULL);
+    for (int i = 0; i < s_n; ++i) {
+        device_t* d = &s_dev[i];
+        uint8_t mac[6];
+        device_mac(i, mac);
+        snprintf(d->base, sizeof(d->base), "%s/esp32s3-%02x%02x%02x", CONFIG_MQTT_BASE_TOPIC, mac[3], mac[4], mac[5]);
+        d->t0_us = mono_us();
+        d->pid = fork();
+        if (d->pid == 0) run_device(i);
+        if (d->pid < 0) {
+            perror("fork");
+            exit(1);
+        }
+    }
+}
+
+// ---- Broker process ----------------------------------------------------------------------
+
+static void broker_start(void) {
+    fflush(NULL);
+    s_broker = fork();
+    if (s_broker == 0) {
+        setpgid(0, 0);
+        prctl(PR_SET_PDEATHSIG, SIGTERM);
+        execl("/bin/sh", "sh", "-c", s_broker_cmd, (char*)NULL);
+        _exit(127);
+    }
+}
+
+static void broker_stop(void) {
+    if (s_broker <= 0) return;
+    kill(-s_broker, SIGTERM);
+    kill(s_broker, SIGTERM);
+    waitpid(s_broker, NULL, 0);
+    s_broker = -1;
+}
+
+// ---- Observer client ----------------------------------------------------------------------
+
+static bool send_pkt(const uint8_t* buf, size_t len) {
+    return s_fd >= 0 && len && mqtt_wire_write(s_fd, buf, len);
+}
+
+static void command(const device_t* d, const char* suffix, const char* payload) {
+    char topic[128];
+    uint8_t buf[256];
+    snprintf(topic, sizeof(topic), "%.63s/%.60s", d->base, suffix);
+    send_pkt(buf, mqtt_wire_publish(buf, sizeof(buf), topic, payload, (int)strlen(payload), 0, false, 0));
+}
+
+static bool observer_connect(int64_t timeout_us) {
+    int64_t until = mono_us() + timeout_us;
+    while ((s_fd = mqtt_wire_dial(s_uri)) < 0) {
+        if (mono_us() > until) return false;
+        usleep(50000);
+    }
+    uint8_t buf[256];
+    mqtt_wire_connect_t c = { .client_id = "fleet-observer", .keepalive_s = 60 };
+    mqtt_wire_pkt_t p;
+    if (!send_pkt(buf, mqtt_wire_connect(buf, sizeof(buf), &c)) || !mqtt_wire_read(&s_rd, s_fd, &p) ||
+        p.type != MQTT_PKT_CONNACK || mqtt_wire_ack_id(&p) != 0) {
+        close(s_fd);
+        s_fd = -1;
+        return false;
+    }
+    s_ping_at_us = mono_us() + 30000000;
+    return send_pkt(buf, mqtt_wire_subscribe(buf, sizeof(buf), 1, "#", 0));
+}
+
+static device_t* device_for(const char* topic, int tlen, const char** suffix) {
+    size_t plen = strlen(CONFIG_MQTT_BASE_TOPIC);
+    if (tlen < (int)plen + 16 || strncmp(topic, CONFIG_MQTT_BASE_TOPIC, plen) != 0 ||
+        strncmp(topic + plen, "/esp32s3-", 9) != 0) {
+        return NULL;
+    }
+    char hex[7];
+    memcpy(hex, topic + plen + 9, 6);
+    hex[6] = 0;
+    int i = (int)(strtoul(hex, NULL, 16) & 0xfffff);
+    if (i >= s_n || topic[plen + 15] != '/') return NULL;
+    *suffix = topic + plen + 16;
+    return &s_dev[i];
+}
+
+static bool suffix_is(const char* suffix, const char* end, const char* want) {
+    return (size_t)(end - suffix) == strlen(want) && strncmp(suffix, want, (size_t)(end - suffix)) == 0;
+}
+
+static uint32_t s_rtt_n;
+static int64_t* s_rtt;
+
+static void on_message(const mqtt_wire_publish_t* m) {
+    int64_t now = mono_us();
+    rate_t* r = s_rate;
+    if (r) {
+        int64_t sec = (now - r->start_us) / 1000000;
+        if (sec >= 0 && sec < MAX_SECONDS) r->per_s[sec]++;
+        r->total++;
+    }
+    const char* end = m->topic + m->topic_len;
+    size_t hlen = strlen(CONFIG_HA_PREFIX);
+    if (m->topic_len > (int)hlen && strncmp(m->topic, CONFIG_HA_PREFIX, hlen) == 0) {
+        if (r) r->discovery++;
+        return;
+    }
+    const char* suffix;
+    device_t* d = device_for(m->topic, m->topic_len, &suffix);
+    if (!d) {
+        if (r) r->other++;
+        return;
+    }
+    // Retained copies come with the subscription, not from the device
+    if (suffix_is(suffix, end, "status")) {
+        if (r) r->status++;
+        if (m->retain) return;
+        bool online = m->len == 6 && strncmp(m->data, "online", 6) == 0;
+        if (online != d->online) d->flaps++;
+        d->online = online;
+    } else if (suffix_is(suffix, end, "relay/4/max_on")) {
+        if (r) r->state++;
+        if (!m->retain && d->probe_at_us && !d->ready_us) d->ready_us = now;
+    } else if (suffix_is(suffix, end, "relay/1/state")) {
+        if (r) r->state++;
+        if (!m->retain && d->cmd_at_us) {
+            s_rtt[s_rtt_n++] = now - d->cmd_at_us;
+            d->cmd_at_us = 0;
+            d->cmds++;
+        }
+    } else if (r && strncmp(suffix, "scd41/", 6) == 0) {
+        r->sensors++;
+    } else if (r) {
+        r->other++;
+    }
+}
+
+// Process what arrives within timeout_us; false when the broker is gone
+static bool pump(int timeout_us) {
+    if (s_fd < 0) {
+        usleep((useconds_t)timeout_us);
+        return false;
+    }
+    struct pollfd pfd = { .fd = s_fd, .events = POLLIN };
+    int64_t until = mono_us() + timeout_us;
+    for (;;) {
+        int left = (int)((until - mono_us()) / 1000);
+        int n = poll(&pfd, 1, left > 0 ? left : 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        mqtt_wire_pkt_t p;
+        mqtt_wire_publish_t m;
+        if (!mqtt_wire_read(&s_rd, s_fd, &p)) {
+            close(s_fd);
+            s_fd = -1;
+            return false;
+        }
+        if (mqtt_wire_parse_publish(&p, &m)) on_message(&m);
+    }
+    if (mono_us() >= s_ping_at_us) {
+        uint8_t buf[2];
+        send_pkt(buf, mqtt_wire_short(buf, sizeof(buf), MQTT_PKT_PINGREQ, 0));
+        s_ping_at_us = mono_us() + 30000000;
+    }
+    return true;
+}
+
+// ---- Phases ----------------------------------------------------------------------------
+
+static int cmp_i64(const void* a, const void* b) {
+    int64_t x = *(const int64_t*)a, y = *(const int64_t*)b;
+    return x < y ? -1 : x > y;
+}
+
+static void report_dist(const char* what, int64_t* v, int n, int of) {
+    if (!n) {
+        printf("  %-22s none of %d\n", what, of);
+        return;
+    }
+    qsort(v, (size_t)n, sizeof(*v), cmp_i64);
+    printf("  %-22s n=%d/%d  p50 %.1f  p90 %.1f  p99 %.1f  max %.1f ms\n", what, n, of, v[n / 2] / 1e3,
+           v[n * 9 / 10] / 1e3, v[n * 99 / 100] / 1e3, v[n - 1] / 1e3);
+}
+
+static void report_rate(const rate_t* r, int64_t end_us) {
+    int secs = (int)((end_us - r->start_us) / 1000000) + 1;
+    if (secs > MAX_SECONDS) secs = MAX_SECONDS;
+    uint32_t peak = 0;
+    for (int i = 0; i < secs; ++i) {
+        if (r->per_s[i] > peak) peak = r->per_s[i];
+    }
+    printf("  messages %u in %d s: mean %.0f/s, peak %u/s (discovery %u, status %u, state %u, sensors %u, other %u)\n",
+           r->total, secs, (double)r->total / secs, peak, r->discovery, r->status, r->state, r->sensors, r->other);
+}
+
+static rate_t* phase_begin(const char* name) {
+    rate_t* r = calloc(1, sizeof(*r));
+    r->name = name;
+    r->start_us = mono_us();
+    s_rate = r;
+    printf("%s\n", name);
+    return r;
+}
+
+// Probe every online device until all answer; returns how many did
+static int wait_ready(int64_t timeout_us) {
+    int64_t until = mono_us() + timeout_us;
+    int ready = 0;
+    while (mono_us() < until) {
+        pump(20000);
+        int64_t now = mono_us();
+        ready = 0;
+        for (int i = 0; i < s_n; ++i) {
+            device_t* d = &s_dev[i];
+            if (d->ready_us) {
+                ready++;
+                continue;
+            }
+            if (!d->online || now - d->probe_at_us < PROBE_EVERY_US) continue;
+            d->probe_at_us = now;
+            command(d, "relay/4/max_on/set", PROBE_PAYLOAD);
+        }
+        if (ready == s_n) break;
+    }
+    return ready;
+}
+
+static void report_ready(const char* what) {
+    int64_t* v = calloc((size_t)s_n, sizeof(*v));
+    int n = 0;
+    for (int i = 0; i < s_n; ++i) {
+        if (s_dev[i].ready_us) v[n++] = s_dev[i].ready_us - s_dev[i].t0_us;
+    }
+    report_dist(what, v, n, s_n);
+    free(v);
+}
+
+static void phase_boot(void) {
+    rate_t* r = phase_begin("boot: all devices powered on at once");
+    spawn_devices();
+    wait_ready(PHASE_TIMEOUT_S * 1000000LL);
+    report_ready("spawn to ready");
+    report_rate(r, mono_us());
+}
+
+static void phase_commands(int per_device) {
+    rate_t* r = phase_begin("commands: relay/1/set, one outstanding per device");
+    s_rtt = calloc((size_t)s_n * (size_t)per_device, sizeof(*s_rtt));
+    s_rtt_n = 0;
+    uint32_t lost = 0;
+    int64_t until = mono_us() + PHASE_TIMEOUT_S * 1000000LL;
+    for (;;) {
+        int64_t now = mono_us();
+        int busy = 0;
+        for (int i = 0; i < s_n; ++i) {
+            device_t* d = &s_dev[i];
+            if (!d->ready_us || d->cmds >= per_device) continue;
+            busy++;
+            if (d->cmd_at_us && now - d->cmd_at_us < CMD_TIMEOUT_US) continue;
+            if (d->cmd_at_us) {
+                lost++;
+                d->cmds++;
+                d->cmd_at_us = 0;
+                continue;
+            }
+            d->cmd_at_us = now;
+            command(d, "relay/1/set", d->cmds & 1 ? "OFF" : "ON");
+        }
+        if (!busy || now > until) break;
+        pump(2000);
+    }
+    int64_t end = mono_us();
+    report_dist("command round trip", s_rtt, (int)s_rtt_n, (int)(s_rtt_n + lost));
+    printf("  %.0f commands/s across the fleet\n", s_rtt_n / ((end - r->start_us) / 1e6));
+    report_rate(r, end);
+    free(s_rtt);
+}
+
+static void phase_restart(int down_s) {
+    rate_t* r = phase_begin("restart: broker stopped and started again");
+    for (int i = 0; i < s_n; ++i) s_dev[i].flaps = 0;
+    broker_stop();
+    close(s_fd);
+    s_fd = -1;
+    for (int64_t until = mono_us() + down_s * 1000000LL; mono_us() < until;) pump(50000);
+    broker_start();
+    if (!observer_connect(10000000)) {
+        fprintf(stderr, "broker did not come back\n");
+        return;
+    }
+    int64_t t0 = mono_us();
+    for (int i = 0; i < s_n; ++i) {
+        device_t* d = &s_dev[i];
+        d->t0_us = t0;
+        d->ready_us = d->probe_at_us = d->cmd_at_us = 0;
+    }
+    wait_ready(PHASE_TIMEOUT_S * 1000000LL);
+    report_ready("broker up to ready");
+    // Stragglers and late flaps
+    for (int64_t until = mono_us() + 5000000; mono_us() < until;) pump(50000);
+    uint32_t flaps = 0, max_flaps = 0;
+    for (int i = 0; i < s_n; ++i) {
+        flaps += s_dev[i].flaps;
+        if (s_dev[i].flaps > max_flaps) max_flaps = s_dev[i].flaps;
+    }
+    printf("  availability changes   %u (max %u on one device)\n", flaps, max_flaps);
+    report_rate(r, mono_us());
+}
+
+static void usage(void) {
+    fprintf(stderr, "usage: mqtt_fleet [-n devices] [--uri mqtt://host:port] [--broker \"cmd\"] [--commands K] "
+                    "[--down S]\n");
+    exit(2);
+}
+
+int main(int argc, char** argv) {
+    int per_device = 20, down_s = 2;
+    for (int i = 1; i < argc; ++i) {
+        const char* v = i + 1 < argc ? argv[i + 1] : NULL;
+        if (!v) usage();
+        if (strcmp(argv[i], "-n") == 0) s_n = atoi(v);
+        else if (strcmp(argv[i], "--uri") == 0) s_uri = v;
+        else if (strcmp(argv[i], "--broker") == 0) s_broker_cmd = v;
+        else if (strcmp(argv[i], "--commands") == 0) per_device = atoi(v);
+        else if (strcmp(argv[i], "--down") == 0) down_s = atoi(v);
+        else usage();
+        ++i;
+    }
+    if (s_n < 1 || s_n > MAX_DEVICES) usage();
+    signal(SIGPIPE, SIG_IGN);
+
+    if (s_broker_cmd) broker_start();
+    if (!observer_connect(10000000)) {
+        fprintf(stderr, "no broker at %s\n", s_uri);
+        broker_stop();
+        return 1;
+    }
+    pump(200000); // retained state from earlier runs
+    printf("%d devices against %s\n", s_n, s_uri);
+
+    phase_boot();
+    phase_commands(per_device);
+    if (s_broker_cmd) phase_restart(down_s);
+
+    for (int i = 0; i < s_n; ++i) kill(s_dev[i].pid, SIGTERM);
+    for (int i = 0; i < s_n; ++i) waitpid(s_dev[i].pid, NULL, 0);
+    broker_stop();
+    return 0;
+}
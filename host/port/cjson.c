@@ -0,0 +1,317 @@
+// Recursive-descent JSON parser behind the cJSON API subset in cJSON.h.
+// Strict RFC 8259 input, \u escapes encoded as UTF-8, nesting capped like
+// cJSON's CJSON_NESTING_LIMIT.
+#include "cJSON.h"
+
+#include <ctype.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#define NESTING_LIMIT 1000
+
+typedef struct {
+    const char* p;
+    const char* end;
+    int depth;
+} parser_t;
+
+static cJSON* parse_value(parser_t* ps);
+
+static void skip_ws(parser_t* ps) {
+    while (ps->p < ps->end && (*ps->p == ' ' || *ps->p == '\t' || *ps->p == '\n' || *ps->p == '\r')) ps->p++;
+}
+
+static bool take(parser_t* ps, const char* lit) {
+    size_t n = strlen(lit);
+    if ((size_t)(ps->end - ps->p) < n || memcmp(ps->p, lit, n) != 0) return false;
+    ps->p += n;
+    return true;
+}
+
+static int hex4(const char* s) {
+    int v = 0;
+    for (int i = 0; i < 4; ++i) {
+        int c = s[i];
+        v <<= 4;
+        if (c >= '0' && c <= '9') v |= c - '0';
+        else if (c >= 'a' && c <= 'f') v |= c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F') v |= c - 'A' + 10;
+        else return -1;
+    }
+    return v;
+}
+
+static size_t put_utf8(char* out, unsigned cp) {
+    if (cp < 0x80) {
+        out[0] = (char)cp;
+        return 1;
+    }
+    if (cp < 0x800) {
+        out[0] = (char)(0xC0 | cp >> 6);
+        out[1] = (char)(0x80 | (cp & 0x3F));
+        return 2;
+    }
+    if (cp < 0x10000) {
+        out[0] = (char)(0xE0 | cp >> 12);
+        out[1] = (char)(0x80 | ((cp >> 6) & 0x3F));
+        out[2] = (char)(0x80 | (cp & 0x3F));
+        return 3;
+    }
+    out[0] = (char)(0xF0 | cp >> 18);
+    out[1] = (char)(0x80 | ((cp >> 12) & 0x3F));
+    out[2] = (char)(0x80 | ((cp >> 6) & 0x3F));
+    out[3] = (char)(0x80 | (cp & 0x3F));
+    return 4;
+}
+
+// Decoded output is never longer than the escaped input
+static char* parse_string(parser_t* ps) {
+    if (ps->p >= ps->end || *ps->p != '"') return NULL;
+    const char* s = ++ps->p;
+    while (ps->p < ps->end && *ps->p != '"') {
+        if (*ps->p == '\\') ps->p++;
+        ps->p++;
+    }
+    if (ps->p >= ps->end) return NULL;
+    const char* e = ps->p++;
+    char* out = malloc((size_t)(e - s) + 1);
+    if (!out) return NULL;
+    size_t n = 0;
+    while (s < e) {
+        unsigned char c = (unsigned char)*s++;
+        if (c < 0x20) goto fail;
+        if (c != '\\') {
+            out[n++] = (char)c;
+            continue;
+        }
+        switch (*s++) {
+            case '"': out[n++] = '"'; break;
+            case '\\': out[n++] = '\\'; break;
+            case '/': out[n++] = '/'; break;
+            case 'b': out[n++] = '\b'; break;
+            case 'f': out[n++] = '\f'; break;
+            case 'n': out[n++] = '\n'; break;
+            case 'r': out[n++] = '\r'; break;
+            case 't': out[n++] = '\t'; break;
+            case 'u': {
+                if (e - s < 4) goto fail;
+                int cp = hex4(s);
+                s += 4;
+                if (cp < 0) goto fail;
+                if (cp >= 0xD800 && cp < 0xDC00) {
+                    if (e - s < 6 || s[0] != '\\' || s[1] != 'u') goto fail;
+                    int lo = hex4(s + 2);
+                    if (lo < 0xDC00 || lo > 0xDFFF) goto fail;
+                    s += 6;
+                    cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+                } else if (cp >= 0xDC00 && cp <= 0xDFFF) {
+                    goto fail;
+                }
+                n += put_utf8(out + n, (unsigned)cp);
+                break;
+            }
+            default: goto fail;
+        }
+    }
+    out[n] = 0;
+    return out;
+fail:
+    free(out);
+    return NULL;
+}
+
+static bool parse_number(parser_t* ps, cJSON* item) {
+    const char* s = ps->p;
+    const char* q = s;
+    if (q < ps->end && *q == '-') q++;
+    if (q >= ps->end || !isdigit((unsigned char)*q)) return false;
+    if (*q == '0') q++;
+    else while (q < ps->end && isdigit((unsigned char)*q)) q++;
+    if (q < ps->end && *q == '.') {
+        if (++q >= ps->end || !isdigit((unsigned char)*q)) return false;
+        while (q < ps->end && isdigit((unsigned char)*q)) q++;
+    }
+    if (q < ps->end && (*q == 'e' || *q == 'E')) {
+        q++;
+        if (q < ps->end && (*q == '+' || *q == '-')) q++;
+        if (q >= ps->end || !isdigit((unsigned char)*q)) return false;
+        while (q < ps->end && isdigit((unsigned char)*q)) q++;
+    }
+    char buf[64];
+    size_t n = (size_t)(q - s);
+    if (n >= sizeof(buf)) return false;
+    memcpy(buf, s, n);
+    buf[n] = 0;
+    double d = strtod(buf, NULL);
+    item->type = cJSON_Number;
+    item->valuedouble = d;
+    item->valueint = d >= 2147483647.0 ? 2147483647 : d <= -2147483648.0 ? -2147483647 - 1 : (int)d;
+    ps->p = q;
+    return true;
+}
+
+// Parses "[...]" or "{...}" into item->child; object members get ->string
+static bool parse_container(parser_t* ps, cJSON* item, bool object) {
+    if (++ps->depth > NESTING_LIMIT) return false;
+    item->type = object ? cJSON_Object : cJSON_Array;
+    ps->p++;
+    skip_ws(ps);
+    char close = object ? '}' : ']';
+    if (ps->p < ps->end && *ps->p == close) {
+        ps->p++;
+        ps->depth--;
+        return true;
+    }
+    cJSON* tail = NULL;
+    for (;;) {
+        char* key = NULL;
+        if (object) {
+            skip_ws(ps);
+            key = parse_string(ps);
+            if (!key) return false;
+            skip_ws(ps);
+            if (ps->p >= ps->end || *ps->p != ':') {
+                free(key);
+                return false;
+            }
+            ps->p++;
+        }
+        cJSON* child = parse_value(ps);
+        if (!child) {
+            free(key);
+            return false;
+        }
+        child->string = key;
+        if (tail) {
+            tail->next = child;
+            child->prev = tail;
+        } else {
+            item->child = child;
+        }
+        tail = child;
+        item->child->prev = tail; // cJSON keeps the last element in child->prev
+        skip_ws(ps);
+        if (ps->p < ps->end && *ps->p == ',') {
+            ps->p++;
+            continue;
+        }
+        if (ps->p < ps->end && *ps->p == close) {
+            ps->p++;
+            ps->depth--;
+            return true;
+        }
+        return false;
+    }
+}
+
+static cJSON* parse_value(parser_t* ps) {
+    skip_ws(ps);
+    if (ps->p >= ps->end) return NULL;
+    cJSON* item = calloc(1, sizeof(*item));
+    if (!item) return NULL;
+    bool ok;
+    switch (*ps->p) {
+        case '{': ok = parse_container(ps, item, true); break;
+        case '[': ok = parse_container(ps, item, false); break;
+        case '"':
+            item->type = cJSON_String;
+            item->valuestring = parse_string(ps);
+            ok = item->valuestring != NULL;
+            break;
+        case 't':
+            item->type = cJSON_True;
+            item->valueint = 1;
+            ok = take(ps, "true");
+            break;
+        case 'f':
+            item->type = cJSON_False;
+            ok = take(ps, "false");
+            break;
+        case 'n':
+            item->type = cJSON_NULL;
+            ok = take(ps, "null");
+            break;
+        default: ok = parse_number(ps, item); break;
+    }
+    if (!ok) {
+        cJSON_Delete(item);
+        return NULL;
+    }
+    return item;
+}
+
+cJSON* cJSON_ParseWithLength(const char* value, size_t len) {
+    if (!value) return NULL;
+    parser_t ps = { value, value + len, 0 };
+    // Like cJSON, a terminating NUL inside the buffer ends the input
+    const char* nul = memchr(value, 0, len);
+    if (nul) ps.end = nul;
+    cJSON* root = parse_value(&ps);
+    skip_ws(&ps);
+    if (root && ps.p != ps.end) {
+        cJSON_Delete(root);
+        return NULL;
+    }
+    return root;
+}
+
+cJSON* cJSON_Parse(const char* value) {
+    return value ? cJSON_ParseWithLength(value, strlen(value)) : NULL;
+}
+
+void cJSON_Delete(cJSON* item) {
+    while (item) {
+        cJSON* next = item->next;
+        cJSON_Delete(item->child);
+        free(item->valuestring);
+        free(item->string);
+        free(item);
+        item = next;
+    }
+}
+
+cJSON* cJSON_GetObjectItemCaseSensitive(const cJSON* object, const char* key) {
+    if (!object || !key) return NULL;
+    for (cJSON* c = object->child; c; c = c->next) {
+        if (c->string && strcmp(c->string, key) == 0) return c;
+    }
+    return NULL;
+}
+
+cJSON* cJSON_GetObjectItem(const cJSON* object, const char* key) {
+    if (!object || !key) return NULL;
+    for (cJSON* c = object->child; c; c = c->next) {
+        if (c->string && strcasecmp(c->string, key) == 0) return c;
+    }
+    return NULL;
+}
+
+int cJSON_GetArraySize(const cJSON* array) {
+    int n = 0;
+    for (cJSON* c = array ? array->child : NULL; c; c = c->next) n++;
+    return n;
+}
+
+cJSON* cJSON_GetArrayItem(const cJSON* array, int index) {
+    if (index < 0) return NULL;
+    cJSON* c = array ? array->child : NULL;
+    while (c && index--) c = c->next;
+    return c;
+}
+
+#define TYPE_IS(name, mask) \
+    cJSON_bool cJSON_Is##name(const cJSON* item) { return item != NULL && (item->type & 0xFF & (mask)) != 0; }
+
+cJSON_bool cJSON_IsInvalid(const cJSON* item) {
+    return item == NULL || (item->type & 0xFF) == cJSON_Invalid;
+}
+TYPE_IS(False, cJSON_False)
+TYPE_IS(True, cJSON_True)
+TYPE_IS(Bool, cJSON_True | cJSON_False)
+TYPE_IS(Null, cJSON_NULL)
+TYPE_IS(Number, cJSON_Number)
+TYPE_IS(String, cJSON_String)
+TYPE_IS(Array, cJSON_Array)
+TYPE_IS(Object, cJSON_Object)
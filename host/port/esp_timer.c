@@ -0,0 +1,121 @@
+// esp_timer on the virtual clock. Callbacks run in an "esp_timer" task at
+// the same priority as on target (22), so they preempt application tasks.
+#include "esp_timer.h"
+#include "host_kernel.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define TIMER_TASK_PRIO 22
+
+struct esp_timer {
+    esp_timer_cb_t callback;
+    void* arg;
+    const char* name;
+    int64_t at_us;
+    uint64_t period_us; // 0 = one-shot
+    bool armed;
+    struct esp_timer* next;
+};
+
+static struct esp_timer* s_timers;
+static int64_t s_task_wake_us = KERNEL_FOREVER; // what the timer task waits for
+
+static struct esp_timer* earliest(void) {
+    struct esp_timer* best = NULL;
+    for (struct esp_timer* t = s_timers; t; t = t->next) {
+        if (t->armed && (!best || t->at_us < best->at_us)) best = t;
+    }
+    return best;
+}
+
+static void timer_task(void* arg) {
+    (void)arg;
+    for (;;) {
+        struct esp_timer* t = earliest();
+        int64_t now = kernel_now_us();
+        if (!t || t->at_us > now) {
+            s_task_wake_us = t ? t->at_us : KERNEL_FOREVER;
+            kernel_wait(&s_timers, s_task_wake_us);
+            continue;
+        }
+        if (t->period_us) {
+            t->at_us += (int64_t)t->period_us;
+            if (t->at_us <= now) t->at_us = now + (int64_t)t->period_us; // missed periods are dropped
+        } else {
+            t->armed = false;
+        }
+        t->callback(t->arg);
+    }
+}
+
+void host_timer_init(void) {
+    static bool started;
+    if (started) return;
+    started = true;
+    xTaskCreatePinnedToCore(timer_task, "esp_timer", 4096, NULL, TIMER_TASK_PRIO, NULL, 0);
+}
+
+int64_t esp_timer_get_time(void) {
+    return kernel_now_us();
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t* args, esp_timer_handle_t* out) {
+    if (!args || !args->callback || !out) return ESP_ERR_INVALID_ARG;
+    struct esp_timer* t = calloc(1, sizeof(*t));
+    if (!t) return ESP_ERR_NO_MEM;
+    t->callback = args->callback;
+    t->arg = args->arg;
+    t->name = args->name;
+    struct esp_timer** p = &s_timers;
+    while (*p) p = &(*p)->next;
+    *p = t;
+    *out = t;
+    return ESP_OK;
+}
+
+static esp_err_t arm(esp_timer_handle_t t, uint64_t timeout_us, uint64_t period_us) {
+    if (!t) return ESP_ERR_INVALID_ARG;
+    if (t->armed) return ESP_ERR_INVALID_STATE;
+    t->at_us = kernel_now_us() + (int64_t)timeout_us;
+    t->period_us = period_us;
+    t->armed = true;
+    // Only wake the timer task when it would otherwise sleep past this one
+    if (t->at_us < s_task_wake_us) {
+        s_task_wake_us = t->at_us;
+        kernel_signal(&s_timers);
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t t, uint64_t timeout_us) {
+    return arm(t, timeout_us, 0);
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t t, uint64_t period_us) {
+    return arm(t, period_us, period_us);
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t t) {
+    if (!t) return ESP_ERR_INVALID_ARG;
+    if (!t->armed) return ESP_ERR_INVALID_STATE;
+    t->armed = false;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t t) {
+    if (!t) return ESP_ERR_INVALID_ARG;
+    if (t->armed) return ESP_ERR_INVALID_STATE;
+    for (struct esp_timer** p = &s_timers; *p; p = &(*p)->next) {
+        if (*p == t) {
+            *p = t->next;
+            break;
+        }
+    }
+    free(t);
+    return ESP_OK;
+}
+
+bool esp_timer_is_active(esp_timer_handle_t t) {
+    return t && t->armed;
+}
@@ -0,0 +1,137 @@
+// Partitions from partitions.csv, held in RAM with NOR flash rules: erase
+// sets whole sectors to 0xff, writes can only clear bits. OTA writes go to
+// the inactive app slot; the image is only checked for its header magic.
+#include "esp_ota_ops.h"
+#include "esp_partition.h"
+#include "esp_app_format.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define SECTOR 4096
+
+typedef struct {
+    esp_partition_t p;
+    uint8_t* mem; // allocated on first access
+} part_t;
+
+static part_t s_parts[] = {
+    { .p = { .type = ESP_PARTITION_TYPE_APP, .subtype = 0x10, .address = 0x20000, .size = 0x1B0000, .erase_size = SECTOR, .label = "ota_0" } },
+    { .p = { .type = ESP_PARTITION_TYPE_APP, .subtype = 0x11, .address = 0x1D0000, .size = 0x1B0000, .erase_size = SECTOR, .label = "ota_1" } },
+    { .p = { .type = ESP_PARTITION_TYPE_DATA, .subtype = 0x40, .address = 0x380000, .size = 0x80000, .erase_size = SECTOR, .label = "spool" } },
+};
+#define NPARTS (sizeof(s_parts) / sizeof(s_parts[0]))
+
+static part_t* lookup(const esp_partition_t* p) {
+    for (size_t i = 0; i < NPARTS; ++i) {
+        if (&s_parts[i].p == p) {
+            if (!s_parts[i].mem) {
+                s_parts[i].mem = malloc(p->size);
+                if (s_parts[i].mem) memset(s_parts[i].mem, 0xff, p->size);
+            }
+            return s_parts[i].mem ? &s_parts[i] : NULL;
+        }
+    }
+    return NULL;
+}
+
+const esp_partition_t* esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype,
+                                                const char* label) {
+    for (size_t i = 0; i < NPARTS; ++i) {
+        const esp_partition_t* p = &s_parts[i].p;
+        if (type != ESP_PARTITION_TYPE_ANY && p->type != type) continue;
+        if (subtype != ESP_PARTITION_SUBTYPE_ANY && p->subtype != subtype) continue;
+        if (label && strcmp(label, p->label) != 0) continue;
+        return p;
+    }
+    return NULL;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t* p, size_t off, void* dst, size_t len) {
+    part_t* part = lookup(p);
+    if (!part || !dst) return ESP_ERR_INVALID_ARG;
+    if (off > p->size || len > p->size - off) return ESP_ERR_INVALID_SIZE;
+    memcpy(dst, part->mem + off, len);
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t* p, size_t off, const void* src, size_t len) {
+    part_t* part = lookup(p);
+    if (!part || !src) return ESP_ERR_INVALID_ARG;
+    if (off > p->size || len > p->size - off) return ESP_ERR_INVALID_SIZE;
+    const uint8_t* s = src;
+    for (size_t i = 0; i < len; ++i) part->mem[off + i] &= s[i];
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t* p, size_t off, size_t len) {
+    part_t* part = lookup(p);
+    if (!part) return ESP_ERR_INVALID_ARG;
+    if (off % SECTOR || len % SECTOR) return ESP_ERR_INVALID_ARG;
+    if (off > p->size || len > p->size - off) return ESP_ERR_INVALID_SIZE;
+    memset(part->mem + off, 0xff, len);
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_get_sha256(const esp_partition_t* p, uint8_t* sha) {
+    (void)p;
+    (void)sha;
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+// ---- OTA -------------------------------------------------------------------------
+
+static const esp_partition_t* s_running = &s_parts[0].p;
+static const esp_partition_t* s_boot = &s_parts[0].p;
+static const esp_partition_t* s_ota_part;
+static size_t s_ota_written;
+
+const esp_partition_t* esp_ota_get_running_partition(void) {
+    return s_running;
+}
+
+const esp_partition_t* esp_ota_get_next_update_partition(const esp_partition_t* start) {
+    const esp_partition_t* from = start ? start : s_running;
+    return from == &s_parts[0].p ? &s_parts[1].p : &s_parts[0].p;
+}
+
+esp_err_t esp_ota_begin(const esp_partition_t* p, size_t image_size, esp_ota_handle_t* out) {
+    (void)image_size;
+    if (!p || p == s_running || p->type != ESP_PARTITION_TYPE_APP || !out) return ESP_ERR_INVALID_ARG;
+    if (s_ota_part) return ESP_ERR_INVALID_STATE;
+    esp_err_t err = esp_partition_erase_range(p, 0, p->size);
+    if (err != ESP_OK) return err;
+    s_ota_part = p;
+    s_ota_written = 0;
+    *out = 1;
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_write(esp_ota_handle_t h, const void* data, size_t len) {
+    if (h != 1 || !s_ota_part) return ESP_ERR_INVALID_ARG;
+    esp_err_t err = esp_partition_write(s_ota_part, s_ota_written, data, len);
+    if (err == ESP_OK) s_ota_written += len;
+    return err;
+}
+
+esp_err_t esp_ota_end(esp_ota_handle_t h) {
+    if (h != 1 || !s_ota_part) return ESP_ERR_INVALID_ARG;
+    uint8_t magic = 0;
+    esp_partition_read(s_ota_part, 0, &magic, 1);
+    bool ok = s_ota_written > 0 && magic == ESP_IMAGE_HEADER_MAGIC;
+    if (!ok) s_ota_part = NULL;
+    return ok ? ESP_OK : ESP_ERR_OTA_VALIDATE_FAILED;
+}
+
+esp_err_t esp_ota_abort(esp_ota_handle_t h) {
+    (void)h;
+    s_ota_part = NULL;
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_set_boot_partition(const esp_partition_t* p) {
+    if (!p || p != s_ota_part) return ESP_ERR_INVALID_ARG;
+    s_boot = p;
+    s_ota_part = NULL;
+    return ESP_OK;
+}
@@ -0,0 +1,595 @@
+// FreeRTOS on the host. Every task is a thread, but a single token decides
+// which one runs: the others wait on their own condition variable. A task
+// gives the token up only when it blocks (or wakes a higher-priority task),
+// so firmware code never runs concurrently and never needs real locking.
+// When nothing is ready the virtual clock jumps to the earliest wake-up; in
+// real-time mode it follows CLOCK_MONOTONIC instead and the idle kernel
+// sleeps until then, or until a thread outside the kernel (a socket reader)
+// signals a waiting task.
+#include "host_kernel.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+typedef enum {
+    T_READY,
+    T_BLOCKED,
+    T_IDLE_WAIT, // kernel_run_idle(): ready again once nothing else is
+    T_DELETED,
+} task_state_t;
+
+struct tskTaskControlBlock {
+    char name[16];
+    UBaseType_t prio;
+    BaseType_t core;
+    uint32_t stack_bytes;
+    UBaseType_t number;
+    TaskFunction_t fn;
+    void* arg;
+    pthread_cond_t cond;
+    task_state_t state;
+    const void* wait_obj;
+    int64_t wake_us;
+    uint64_t ready_seq; // FIFO among equal priorities
+    uint32_t notify;
+    struct tskTaskControlBlock* next;
+};
+typedef struct tskTaskControlBlock tcb_t;
+
+static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
+static tcb_t s_main;
+static tcb_t* s_tasks;    // creation order
+static tcb_t* s_current;  // holder of the token
+static int64_t s_now_us = 1000; // the bootloader has run
+static uint64_t s_seq;
+static UBaseType_t s_numbers;
+static bool s_realtime;
+static int64_t s_mono_base_us; // monotonic time at s_now_us when switched on
+static pthread_cond_t s_external; // on CLOCK_MONOTONIC, see kernel_init()
+
+static int64_t mono_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// Real-time mode: catch the clock up with the monotonic one
+static void sync_clock(void) {
+    if (!s_realtime) return;
+    int64_t t = mono_us() - s_mono_base_us;
+    if (t > s_now_us) s_now_us = t;
+}
+
+// Sleep until the monotonic clock reaches wake_us or an external signal
+static void sleep_until(int64_t wake_us) {
+    if (wake_us == KERNEL_FOREVER) {
+        pthread_cond_wait(&s_external, &s_lock);
+        return;
+    }
+    int64_t abs_us = wake_us + s_mono_base_us;
+    struct timespec ts = { .tv_sec = abs_us / 1000000, .tv_nsec = (abs_us % 1000000) * 1000 };
+    pthread_cond_timedwait(&s_external, &s_lock, &ts);
+}
+
+// ---- Scheduler (s_lock held) -------------------------------------------------
+
+static void make_ready(tcb_t* t) {
+    t->state = T_READY;
+    t->wait_obj = NULL;
+    t->wake_us = KERNEL_FOREVER;
+    t->ready_seq = ++s_seq;
+}
+
+static void append(tcb_t* t) {
+    tcb_t** p = &s_tasks;
+    while (*p) p = &(*p)->next;
+    *p = t;
+}
+
+static void dump_tasks(void) {
+    for (tcb_t* t = s_tasks; t; t = t->next) {
+        if (t->state == T_DELETED) continue;
+        fprintf(stderr, "  %-16s prio %2u  %s\n", t->name, t->prio,
+                t->state == T_READY ? "ready" : t->wake_us == KERNEL_FOREVER ? "blocked" : "delayed");
+    }
+}
+
+static void wake_expired(void) {
+    for (tcb_t* t = s_tasks; t; t = t->next) {
+        if (t->state == T_BLOCKED && t->wake_us <= s_now_us) make_ready(t);
+    }
+}
+
+static tcb_t* next_task(void) {
+    for (;;) {
+        if (s_realtime) {
+            sync_clock();
+            wake_expired();
+        }
+        tcb_t* best = NULL;
+        tcb_t* idle = NULL;
+        for (tcb_t* t = s_tasks; t; t = t->next) {
+            if (t->state == T_IDLE_WAIT && !idle) idle = t;
+            if (t->state != T_READY) continue;
+            if (!best || t->prio > best->prio || (t->prio == best->prio && t->ready_seq < best->ready_seq)) best = t;
+        }
+        if (best) return best;
+        if (idle) {
+            make_ready(idle);
+            return idle;
+        }
+        int64_t wake = KERNEL_FOREVER;
+        for (tcb_t* t = s_tasks; t; t = t->next) {
+            if (t->state == T_BLOCKED && t->wake_us < wake) wake = t->wake_us;
+        }
+        if (s_realtime) {
+            sleep_until(wake);
+            continue;
+        } else if (wake == KERNEL_FOREVER) {
+            fprintf(stderr, "host: deadlock at %lld us, every task is blocked forever:\n", (long long)s_now_us);
+            dump_tasks();
+            abort();
+        } else if (wake > s_now_us) {
+            s_now_us = wake;
+        }
+        wake_expired();
+    }
+}
+
+// Hand the token to the next task and wait to get it back. A deleted task
+// returns right away and must then exit its thread.
+static void reschedule(tcb_t* self) {
+    tcb_t* next = next_task();
+    if (next == self) return;
+    s_current = next;
+    pthread_cond_signal(&next->cond);
+    if (self->state == T_DELETED) return;
+    while (s_current != self) pthread_cond_wait(&self->cond, &s_lock);
+}
+
+static void preempt_if_needed(tcb_t* self, UBaseType_t woken_prio) {
+    if (woken_prio <= self->prio) return;
+    make_ready(self);
+    reschedule(self);
+}
+
+// ---- Kernel primitives ---------------------------------------------------------
+
+void kernel_init(void) {
+    if (s_current) return;
+    snprintf(s_main.name, sizeof(s_main.name), "main");
+    s_main.prio = 1;
+    s_main.stack_bytes = 8192;
+    s_main.number = ++s_numbers;
+    pthread_cond_init(&s_main.cond, NULL);
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&s_external, &attr);
+    pthread_condattr_destroy(&attr);
+    make_ready(&s_main);
+    append(&s_main);
+    s_current = &s_main;
+}
+
+// Only the running task calls these, so the clock is not shared
+int64_t kernel_now_us(void) {
+    sync_clock();
+    return s_now_us;
+}
+
+int64_t kernel_deadline(TickType_t ticks) {
+    if (ticks == portMAX_DELAY) return KERNEL_FOREVER;
+    return kernel_now_us() + (int64_t)ticks * (1000000 / configTICK_RATE_HZ);
+}
+
+void kernel_wait(const void* obj, int64_t wake_us) {
+    pthread_mutex_lock(&s_lock);
+    tcb_t* self = s_current;
+    sync_clock();
+    if (wake_us <= s_now_us) {
+        make_ready(self); // zero timeout: just a yield
+    } else {
+        self->state = T_BLOCKED;
+        self->wait_obj = obj;
+        self->wake_us = wake_us;
+    }
+    reschedule(self);
+    pthread_mutex_unlock(&s_lock);
+}
+
+void kernel_signal(const void* obj) {
+    pthread_mutex_lock(&s_lock);
+    UBaseType_t top = 0;
+    for (tcb_t* t = s_tasks; t; t = t->next) {
+        if (t->state == T_BLOCKED && t->wait_obj == obj) {
+            make_ready(t);
+            if (t->prio > top) top = t->prio;
+        }
+    }
+    preempt_if_needed(s_current, top);
+    pthread_mutex_unlock(&s_lock);
+}
+
+void kernel_signal_external(const void* obj) {
+    pthread_mutex_lock(&s_lock);
+    for (tcb_t* t = s_tasks; t; t = t->next) {
+        if (t->state == T_BLOCKED && t->wait_obj == obj) make_ready(t);
+    }
+    pthread_cond_signal(&s_external);
+    pthread_mutex_unlock(&s_lock);
+}
+
+void kernel_set_realtime(bool on) {
+    pthread_mutex_lock(&s_lock);
+    if (on && !s_realtime) s_mono_base_us = mono_us() - s_now_us;
+    s_realtime = on;
+    pthread_mutex_unlock(&s_lock);
+}
+
+void kernel_run_idle(void) {
+    pthread_mutex_lock(&s_lock);
+    tcb_t* self = s_current;
+    self->state = T_IDLE_WAIT;
+    reschedule(self);
+    pthread_mutex_unlock(&s_lock);
+}
+
+void vPortEnterCritical(portMUX_TYPE* mux) {
+    (void)mux;
+}
+
+void vPortExitCritical(portMUX_TYPE* mux) {
+    (void)mux;
+}
+
+// ---- Tasks ---------------------------------------------------------------------
+
+static void* task_entry(void* arg) {
+    tcb_t* t = arg;
+    pthread_mutex_lock(&s_lock);
+    while (s_current != t) pthread_cond_wait(&t->cond, &s_lock);
+    pthread_mutex_unlock(&s_lock);
+    t->fn(t->arg);
+    // FreeRTOS tasks must not return; treat it as deleting itself
+    vTaskDelete(NULL);
+    return NULL;
+}
+
+static tcb_t* create(TaskFunction_t fn, const char* name, uint32_t stack_bytes, void* arg, UBaseType_t prio,
+                     BaseType_t core) {
+    tcb_t* t = calloc(1, sizeof(*t));
+    if (!t) return NULL;
+    snprintf(t->name, sizeof(t->name), "%s", name ? name : "");
+    t->prio = prio < configMAX_PRIORITIES ? prio : configMAX_PRIORITIES - 1;
+    t->core = core;
+    t->stack_bytes = stack_bytes;
+    t->fn = fn;
+    t->arg = arg;
+    pthread_cond_init(&t->cond, NULL);
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    pthread_t th;
+    pthread_mutex_lock(&s_lock);
+    t->number = ++s_numbers;
+    make_ready(t);
+    append(t);
+    if (pthread_create(&th, &attr, task_entry, t) != 0) {
+        t->state = T_DELETED;
+        t = NULL;
+    } else {
+        preempt_if_needed(s_current, t->prio);
+    }
+    pthread_mutex_unlock(&s_lock);
+    pthread_attr_destroy(&attr);
+    return t;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char* name, uint32_t stack_bytes, void* arg,
+                                   UBaseType_t prio, TaskHandle_t* handle, BaseType_t core) {
+    tcb_t* t = create(fn, name, stack_bytes, arg, prio, core);
+    if (handle) *handle = t;
+    return t ? pdPASS : pdFAIL;
+}
+
+TaskHandle_t xTaskCreateStaticPinnedToCore(TaskFunction_t fn, const char* name, uint32_t stack_bytes, void* arg,
+                                           UBaseType_t prio, StackType_t* stack, StaticTask_t* tcb, BaseType_t core) {
+    // The thread has its own stack; the static buffers only matter on target
+    (void)stack;
+    (void)tcb;
+    return create(fn, name, stack_bytes, arg, prio, core);
+}
+
+void vTaskDelete(TaskHandle_t task) {
+    pthread_mutex_lock(&s_lock);
+    tcb_t* self = s_current;
+    tcb_t* t = task ? task : self;
+    t->state = T_DELETED;
+    if (t != self) {
+        // Its thread stays parked on its condition variable for good
+        pthread_mutex_unlock(&s_lock);
+        return;
+    }
+    if (self == &s_main) {
+        fprintf(stderr, "host: main must not delete itself\n");
+        abort();
+    }
+    reschedule(self);
+    pthread_mutex_unlock(&s_lock);
+    pthread_exit(NULL);
+}
+
+void vTaskDelay(TickType_t ticks) {
+    kernel_wait(NULL, kernel_deadline(ticks));
+}
+
+void vTaskDelayUntil(TickType_t* prev_wake, TickType_t increment) {
+    *prev_wake += increment;
+    int64_t wake = (int64_t)*prev_wake * (1000000 / configTICK_RATE_HZ);
+    if (wake > s_now_us) kernel_wait(NULL, wake);
+}
+
+TickType_t xTaskGetTickCount(void) {
+    return (TickType_t)(s_now_us / (1000000 / configTICK_RATE_HZ));
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void) {
+    return s_current;
+}
+
+const char* pcTaskGetName(TaskHandle_t task) {
+    return (task ? task : s_current)->name;
+}
+
+UBaseType_t uxTaskPriorityGet(TaskHandle_t task) {
+    return (task ? task : s_current)->prio;
+}
+
+BaseType_t host_task_core(void) {
+    return s_current && s_current->core != tskNO_AFFINITY ? s_current->core : 0;
+}
+
+UBaseType_t uxTaskGetNumberOfTasks(void) {
+    UBaseType_t n = 0;
+    pthread_mutex_lock(&s_lock);
+    for (tcb_t* t = s_tasks; t; t = t->next) n += t->state != T_DELETED;
+    pthread_mutex_unlock(&s_lock);
+    return n;
+}
+
+UBaseType_t uxTaskGetSystemState(TaskStatus_t* out, UBaseType_t max, uint32_t* total_runtime) {
+    if (uxTaskGetNumberOfTasks() > max) return 0;
+    UBaseType_t n = 0;
+    pthread_mutex_lock(&s_lock);
+    for (tcb_t* t = s_tasks; t; t = t->next) {
+        if (t->state == T_DELETED) continue;
+        // Host stacks are not the firmware's; report the configured size
+        out[n++] = (TaskStatus_t){
+            .xHandle = t,
+            .pcTaskName = t->name,
+            .xTaskNumber = t->number,
+            .eCurrentState = t == s_current ? eRunning : t->state == T_READY ? eReady : eBlocked,
+            .uxCurrentPriority = t->prio,
+            .uxBasePriority = t->prio,
+            .usStackHighWaterMark = t->stack_bytes,
+            .xCoreID = t->core,
+        };
+    }
+    pthread_mutex_unlock(&s_lock);
+    if (total_runtime) *total_runtime = (uint32_t)s_now_us;
+    return n;
+}
+
+TaskHandle_t xTaskGetIdleTaskHandleForCore(BaseType_t core) {
+    (void)core;
+    return NULL;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+    task->notify++;
+    kernel_signal(&task->notify);
+    return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks) {
+    tcb_t* self = s_current;
+    int64_t deadline = kernel_deadline(ticks);
+    while (self->notify == 0) {
+        if (s_now_us >= deadline) return 0;
+        kernel_wait(&self->notify, deadline);
+    }
+    uint32_t v = self->notify;
+    self->notify = clear_on_exit ? 0 : v - 1;
+    return v;
+}
+
+// ---- Queues and semaphores -----------------------------------------------------------
+
+typedef enum {
+    Q_QUEUE,
+    Q_MUTEX,
+    Q_RECURSIVE,
+    Q_BINARY,
+} queue_kind_t;
+
+struct QueueDefinition {
+    queue_kind_t kind;
+    UBaseType_t length;
+    UBaseType_t item_size;
+    UBaseType_t head;
+    UBaseType_t count;
+    tcb_t* owner;       // mutexes
+    UBaseType_t depth;  // recursive mutex
+    uint8_t* items;
+};
+
+static QueueHandle_t queue_new(queue_kind_t kind, UBaseType_t length, UBaseType_t item_size) {
+    QueueHandle_t q = calloc(1, sizeof(*q) + (size_t)length * item_size);
+    if (!q) return NULL;
+    q->kind = kind;
+    q->length = length;
+    q->item_size = item_size;
+    q->items = (uint8_t*)(q + 1);
+    return q;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size) {
+    return queue_new(Q_QUEUE, length, item_size);
+}
+
+void vQueueDelete(QueueHandle_t q) {
+    free(q);
+}
+
+BaseType_t xQueueSend(QueueHandle_t q, const void* item, TickType_t ticks) {
+    int64_t deadline = kernel_deadline(ticks);
+    while (q->count == q->length) {
+        if (s_now_us >= deadline) return errQUEUE_FULL;
+        kernel_wait(q, deadline);
+    }
+    memcpy(q->items + ((q->head + q->count) % q->length) * q->item_size, item, q->item_size);
+    q->count++;
+    kernel_signal(q);
+    return pdTRUE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t q, void* item, TickType_t ticks) {
+    int64_t deadline = kernel_deadline(ticks);
+    while (q->count == 0) {
+        if (s_now_us >= deadline) return errQUEUE_EMPTY;
+        kernel_wait(q, deadline);
+    }
+    memcpy(item, q->items + q->head * q->item_size, q->item_size);
+    q->head = (q->head + 1) % q->length;
+    q->count--;
+    kernel_signal(q);
+    return pdTRUE;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t q) {
+    return q->count;
+}
+
+BaseType_t xQueueReset(QueueHandle_t q) {
+    q->head = q->count = 0;
+    kernel_signal(q);
+    return pdPASS;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void) {
+    return queue_new(Q_MUTEX, 1, 0);
+}
+
+SemaphoreHandle_t xSemaphoreCreateRecursiveMutex(void) {
+    return queue_new(Q_RECURSIVE, 1, 0);
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void) {
+    return queue_new(Q_BINARY, 1, 0);
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks) {
+    int64_t deadline = kernel_deadline(ticks);
+    if (sem->kind == Q_BINARY) {
+        while (sem->count == 0) {
+            if (s_now_us >= deadline) return pdFALSE;
+            kernel_wait(sem, deadline);
+        }
+        sem->count = 0;
+        return pdTRUE;
+    }
+    while (sem->owner) {
+        if (sem->owner == s_current) {
+            fprintf(stderr, "host: %s takes a mutex it already holds\n", s_current->name);
+            abort();
+        }
+        if (s_now_us >= deadline) return pdFALSE;
+        kernel_wait(sem, deadline);
+    }
+    sem->owner = s_current;
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem) {
+    if (sem->kind == Q_BINARY) {
+        if (sem->count) return pdFALSE;
+        sem->count = 1;
+    } else {
+        if (sem->owner != s_current) return pdFALSE;
+        sem->owner = NULL;
+    }
+    kernel_signal(sem);
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreTakeRecursive(SemaphoreHandle_t sem, TickType_t ticks) {
+    int64_t deadline = kernel_deadline(ticks);
+    while (sem->owner && sem->owner != s_current) {
+        if (s_now_us >= deadline) return pdFALSE;
+        kernel_wait(sem, deadline);
+    }
+    sem->owner = s_current;
+    sem->depth++;
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGiveRecursive(SemaphoreHandle_t sem) {
+    if (sem->owner != s_current || sem->depth == 0) return pdFALSE;
+    if (--sem->depth == 0) {
+        sem->owner = NULL;
+        kernel_signal(sem);
+    }
+    return pdTRUE;
+}
+
+// ---- Event groups ----------------------------------------------------------------------
+
+struct EventGroupDef_t {
+    EventBits_t bits;
+};
+
+EventGroupHandle_t xEventGroupCreate(void) {
+    return calloc(1, sizeof(struct EventGroupDef_t));
+}
+
+EventBits_t xEventGroupSetBits(EventGroupHandle_t group, EventBits_t bits) {
+    group->bits |= bits;
+    EventBits_t now = group->bits;
+    kernel_signal(group);
+    return now;
+}
+
+EventBits_t xEventGroupClearBits(EventGroupHandle_t group, EventBits_t bits) {
+    EventBits_t before = group->bits;
+    group->bits &= ~bits;
+    return before;
+}
+
+EventBits_t xEventGroupGetBits(EventGroupHandle_t group) {
+    return group->bits;
+}
+
+EventBits_t xEventGroupWaitBits(EventGroupHandle_t group, EventBits_t bits, BaseType_t clear_on_exit,
+                                BaseType_t wait_for_all, TickType_t ticks) {
+    int64_t deadline = kernel_deadline(ticks);
+    for (;;) {
+        EventBits_t now = group->bits;
+        bool done = wait_for_all ? (now & bits) == bits : (now & bits) != 0;
+        if (done) {
+            if (clear_on_exit) group->bits &= ~bits;
+            return now;
+        }
+        if (s_now_us >= deadline) return now;
+        kernel_wait(group, deadline);
+    }
+}
@@ -0,0 +1,38 @@
+// GPIO: output levels are recorded for the test or simulation to read
+#include "driver/gpio.h"
+#include "host.h"
+
+#define GPIO_COUNT 49
+
+static uint8_t s_level[GPIO_COUNT];
+static uint64_t s_outputs;
+static uint32_t s_writes;
+static host_gpio_hook_t s_hook;
+static void* s_hook_ctx;
+
+esp_err_t gpio_config(const gpio_config_t* cfg) {
+    if (!cfg || (cfg->pin_bit_mask >> GPIO_COUNT)) return ESP_ERR_INVALID_ARG;
+    if (cfg->mode == GPIO_MODE_OUTPUT) s_outputs |= cfg->pin_bit_mask;
+    return ESP_OK;
+}
+
+esp_err_t gpio_set_level(gpio_num_t gpio, uint32_t level) {
+    if (gpio < 0 || gpio >= GPIO_COUNT) return ESP_ERR_INVALID_ARG;
+    s_level[gpio] = level ? 1 : 0;
+    s_writes++;
+    if (s_hook) s_hook(gpio, s_level[gpio], s_hook_ctx);
+    return ESP_OK;
+}
+
+int host_gpio_get(int gpio) {
+    return gpio >= 0 && gpio < GPIO_COUNT ? s_level[gpio] : -1;
+}
+
+uint32_t host_gpio_writes(void) {
+    return s_writes;
+}
+
+void host_gpio_set_hook(host_gpio_hook_t hook, void* ctx) {
+    s_hook = hook;
+    s_hook_ctx = ctx;
+}
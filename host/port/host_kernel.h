@@ -0,0 +1,34 @@
+#pragma once
+// Internal to the host port: the scheduler primitives the stand-ins block on
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+#define KERNEL_FOREVER INT64_MAX
+
+void kernel_init(void);
+int64_t kernel_now_us(void);
+// Absolute wake-up time for a FreeRTOS timeout in ticks
+int64_t kernel_deadline(TickType_t ticks);
+// Block the running task until kernel_signal(obj) or the clock reaches
+// wake_us, whichever is first. Callers re-check their condition.
+void kernel_wait(const void* obj, int64_t wake_us);
+// Make every task waiting on obj ready; a higher-priority one runs at once
+void kernel_signal(const void* obj);
+// Same, from a thread that is not a task (a socket reader); the woken tasks
+// run at the next scheduling point, as after an ISR without a yield
+void kernel_signal_external(const void* obj);
+// Run ready tasks until all are blocked, without moving the clock
+void kernel_run_idle(void);
+// Follow the monotonic clock instead of jumping to the next wake-up
+void kernel_set_realtime(bool on);
+// Core the running task is pinned to (0 when unpinned)
+BaseType_t host_task_core(void);
+
+// The station's IP link, from the event loop; the MQTT session needs it
+void host_mqtt_link(bool up);
+
+// Stand-in setup, called from host_init()
+void host_timer_init(void);
+void host_nvs_set_dir(const char* dir);
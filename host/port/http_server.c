@@ -0,0 +1,321 @@
+// esp_http_server without sockets. Requests and WebSocket handshakes are
+// injected with host_http_request()/host_http_ws_open() and, like queued
+// work, run in an "httpd" task while the caller waits, so handlers see the
+// same task context as on the device. Frames the firmware sends to
+// WebSocket clients go to a hook.
+#include "esp_http_server.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "host.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#define MAX_HANDLERS 16
+#define MAX_SESSIONS 8
+#define WORK_QUEUE   8
+#define FD_BASE      60000 // well clear of real descriptors; close() just fails
+
+typedef struct {
+    bool used;
+    bool ws;
+    int fd;
+} session_t;
+
+typedef struct {
+    httpd_work_fn_t fn;
+    void* arg;
+} work_t;
+
+typedef struct {
+    httpd_req_t req;
+    const char* body;
+    size_t body_off;
+    const char* auth;
+    char status[32];
+    char* out;
+    size_t out_sz;
+    int fd;
+    bool ws_handshake;
+    esp_err_t err;
+    SemaphoreHandle_t done;
+} pending_t;
+
+static struct {
+    bool running;
+    httpd_config_t cfg;
+    httpd_uri_t uris[MAX_HANDLERS];
+    int nuris;
+    session_t sess[MAX_SESSIONS];
+    int next_fd;
+    QueueHandle_t q;
+} s_srv;
+
+static host_http_ws_hook_t s_ws_hook;
+static void* s_ws_ctx;
+
+static void httpd_task(void* arg) {
+    (void)arg;
+    work_t w;
+    while (1) {
+        if (xQueueReceive(s_srv.q, &w, portMAX_DELAY) == pdTRUE) w.fn(w.arg);
+    }
+}
+
+esp_err_t httpd_start(httpd_handle_t* handle, const httpd_config_t* config) {
+    if (s_srv.running) return ESP_ERR_INVALID_STATE;
+    s_srv.cfg = *config;
+    s_srv.next_fd = FD_BASE;
+    s_srv.q = xQueueCreate(WORK_QUEUE, sizeof(work_t));
+    if (!s_srv.q || xTaskCreatePinnedToCore(httpd_task, "httpd", config->stack_size, NULL, config->task_priority,
+                                            NULL, 0) != pdPASS) {
+        return ESP_FAIL;
+    }
+    s_srv.running = true;
+    *handle = &s_srv;
+    return ESP_OK;
+}
+
+esp_err_t httpd_stop(httpd_handle_t handle) {
+    (void)handle;
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t httpd_register_uri_handler(httpd_handle_t handle, const httpd_uri_t* uri_handler) {
+    (void)handle;
+    if (s_srv.nuris >= MAX_HANDLERS || s_srv.nuris >= s_srv.cfg.max_uri_handlers) return ESP_ERR_HTTPD_HANDLERS_FULL;
+    s_srv.uris[s_srv.nuris++] = *uri_handler;
+    return ESP_OK;
+}
+
+bool httpd_uri_match_wildcard(const char* reference_uri, const char* uri_to_match, size_t match_upto) {
+    size_t n = strlen(reference_uri);
+    if (n && reference_uri[n - 1] == '*') return match_upto >= n - 1 && strncmp(reference_uri, uri_to_match, n - 1) == 0;
+    return match_upto == n && strncmp(reference_uri, uri_to_match, n) == 0;
+}
+
+static session_t* session(int fd) {
+    for (int i = 0; i < MAX_SESSIONS; ++i) {
+        if (s_srv.sess[i].used && s_srv.sess[i].fd == fd) return &s_srv.sess[i];
+    }
+    return NULL;
+}
+
+static void session_close(session_t* s) {
+    s->used = false;
+    if (s_srv.cfg.close_fn) s_srv.cfg.close_fn(&s_srv, s->fd);
+}
+
+// A new connection, evicting the oldest one when full and LRU purge is on
+static session_t* session_open(void) {
+    int open = 0;
+    session_t *free = NULL, *oldest = NULL;
+    for (int i = 0; i < MAX_SESSIONS; ++i) {
+        session_t* s = &s_srv.sess[i];
+        if (!s->used) {
+            if (!free) free = s;
+            continue;
+        }
+        open++;
+        if (!oldest || s->fd < oldest->fd) oldest = s;
+    }
+    if (open >= s_srv.cfg.max_open_sockets || !free) {
+        if (!s_srv.cfg.lru_purge_enable || !oldest) return NULL;
+        session_close(oldest);
+        free = oldest;
+    }
+    *free = (session_t){ .used = true, .fd = s_srv.next_fd++ };
+    return free;
+}
+
+static void run_request(void* arg) {
+    pending_t* p = arg;
+    size_t path = strcspn(p->req.uri, "?");
+    const httpd_uri_t* h = NULL;
+    for (int i = 0; i < s_srv.nuris && !h; ++i) {
+        const httpd_uri_t* u = &s_srv.uris[i];
+        bool match = s_srv.cfg.uri_match_fn ? s_srv.cfg.uri_match_fn(u->uri, p->req.uri, path)
+                                            : strlen(u->uri) == path && strncmp(u->uri, p->req.uri, path) == 0;
+        if (match && (int)u->method == p->req.method && u->is_websocket == p->ws_handshake) h = u;
+    }
+    session_t* s = session_open();
+    if (!s) {
+        snprintf(p->status, sizeof(p->status), "503 Service Unavailable");
+    } else if (!h) {
+        httpd_resp_send_err(&p->req, HTTPD_404_NOT_FOUND, NULL);
+    } else {
+        p->fd = s->fd;
+        p->req.user_ctx = h->user_ctx;
+        p->err = h->handler(&p->req);
+        if (p->ws_handshake && p->err == ESP_OK) {
+            s->ws = true; // stays open for pushes
+            snprintf(p->status, sizeof(p->status), "101 Switching Protocols");
+        }
+    }
+    if (s && !s->ws) session_close(s);
+    xSemaphoreGive(p->done);
+}
+
+static int submit(pending_t* p) {
+    if (!s_srv.running) return -1;
+    p->done = xSemaphoreCreateBinary();
+    snprintf(p->status, sizeof(p->status), "200 OK");
+    p->fd = -1;
+    p->req.handle = &s_srv;
+    if (httpd_queue_work(&s_srv, run_request, p) != ESP_OK) {
+        vSemaphoreDelete(p->done);
+        return -1;
+    }
+    xSemaphoreTake(p->done, portMAX_DELAY);
+    vSemaphoreDelete(p->done);
+    return atoi(p->status);
+}
+
+int host_http_request(const char* method, const char* uri, const char* body, const char* auth, char* out,
+                      size_t out_sz) {
+    pending_t p = { .body = body, .auth = auth, .out = out, .out_sz = out_sz };
+    p.req.method = strcmp(method, "POST") == 0 ? HTTP_POST : strcmp(method, "PUT") == 0 ? HTTP_PUT : HTTP_GET;
+    snprintf(p.req.uri, sizeof(p.req.uri), "%s", uri);
+    p.req.content_len = body ? strlen(body) : 0;
+    if (out && out_sz) out[0] = 0;
+    return submit(&p);
+}
+
+int host_http_ws_open(const char* uri, const char* auth) {
+    pending_t p = { .auth = auth, .ws_handshake = true };
+    p.req.method = HTTP_GET;
+    snprintf(p.req.uri, sizeof(p.req.uri), "%s", uri);
+    return submit(&p) == 101 ? p.fd : -1;
+}
+
+static void close_work(void* arg) {
+    session_t* s = session((int)(intptr_t)arg);
+    if (s) session_close(s);
+}
+
+void host_http_ws_close(int fd) {
+    if (s_srv.running) httpd_queue_work(&s_srv, close_work, (void*)(intptr_t)fd);
+}
+
+void host_http_set_ws_hook(host_http_ws_hook_t hook, void* ctx) {
+    s_ws_hook = hook;
+    s_ws_ctx = ctx;
+}
+
+// ---- Request API -------------------------------------------------------------
+
+int httpd_req_recv(httpd_req_t* r, char* buf, size_t buf_len) {
+    pending_t* p = (pending_t*)r;
+    size_t left = r->content_len - p->body_off;
+    if (!left) return 0;
+    if (buf_len > left) buf_len = left;
+    memcpy(buf, p->body + p->body_off, buf_len);
+    p->body_off += buf_len;
+    return (int)buf_len;
+}
+
+int httpd_req_to_sockfd(httpd_req_t* r) {
+    return ((pending_t*)r)->fd;
+}
+
+esp_err_t httpd_req_get_hdr_value_str(httpd_req_t* r, const char* field, char* val, size_t val_size) {
+    pending_t* p = (pending_t*)r;
+    if (strcasecmp(field, "Authorization") != 0 || !p->auth) return ESP_ERR_NOT_FOUND;
+    if (strlen(p->auth) >= val_size) return ESP_ERR_HTTPD_RESULT_TRUNC;
+    strcpy(val, p->auth);
+    return ESP_OK;
+}
+
+esp_err_t httpd_req_get_url_query_str(httpd_req_t* r, char* buf, size_t buf_len) {
+    const char* q = strchr(r->uri, '?');
+    if (!q) return ESP_ERR_NOT_FOUND;
+    if (strlen(q + 1) >= buf_len) return ESP_ERR_HTTPD_RESULT_TRUNC;
+    strcpy(buf, q + 1);
+    return ESP_OK;
+}
+
+esp_err_t httpd_query_key_value(const char* qry, const char* key, char* val, size_t val_size) {
+    size_t klen = strlen(key);
+    for (const char* p = qry; p && *p; p = strchr(p, '&') ? strchr(p, '&') + 1 : NULL) {
+        if (strncmp(p, key, klen) != 0 || p[klen] != '=') continue;
+        size_t n = strcspn(p + klen + 1, "&");
+        if (n >= val_size) return ESP_ERR_HTTPD_RESULT_TRUNC;
+        memcpy(val, p + klen + 1, n);
+        val[n] = 0;
+        return ESP_OK;
+    }
+    return ESP_ERR_NOT_FOUND;
+}
+
+esp_err_t httpd_resp_set_status(httpd_req_t* r, const char* status) {
+    pending_t* p = (pending_t*)r;
+    snprintf(p->status, sizeof(p->status), "%s", status);
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_set_type(httpd_req_t* r, const char* type) {
+    (void)r;
+    (void)type;
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_send(httpd_req_t* r, const char* buf, ssize_t buf_len) {
+    pending_t* p = (pending_t*)r;
+    size_t n = buf_len == HTTPD_RESP_USE_STRLEN ? strlen(buf) : (size_t)buf_len;
+    if (p->out && p->out_sz) snprintf(p->out, p->out_sz, "%.*s", (int)n, buf);
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_send_err(httpd_req_t* req, httpd_err_code_t error, const char* msg) {
+    static const char* const k_status[] = {
+        [HTTPD_400_BAD_REQUEST] = "400 Bad Request",
+        [HTTPD_401_UNAUTHORIZED] = "401 Unauthorized",
+        [HTTPD_404_NOT_FOUND] = "404 Not Found",
+        [HTTPD_405_METHOD_NOT_ALLOWED] = "405 Method Not Allowed",
+        [HTTPD_408_REQ_TIMEOUT] = "408 Request Timeout",
+        [HTTPD_500_INTERNAL_SERVER_ERROR] = "500 Internal Server Error",
+    };
+    httpd_resp_set_status(req, k_status[error]);
+    return httpd_resp_send(req, msg ? msg : k_status[error], HTTPD_RESP_USE_STRLEN);
+}
+
+// ---- WebSocket ---------------------------------------------------------------
+
+esp_err_t httpd_ws_recv_frame(httpd_req_t* req, httpd_ws_frame_t* pkt, size_t max_len) {
+    (void)req;
+    (void)pkt;
+    (void)max_len;
+    return ESP_FAIL; // clients here never send
+}
+
+esp_err_t httpd_ws_send_frame_async(httpd_handle_t hd, int fd, httpd_ws_frame_t* frame) {
+    (void)hd;
+    session_t* s = session(fd);
+    if (!s || !s->ws) return ESP_FAIL;
+    if (s_ws_hook) s_ws_hook(fd, (const char*)frame->payload, (int)frame->len, s_ws_ctx);
+    return ESP_OK;
+}
+
+httpd_ws_client_info_t httpd_ws_get_fd_info(httpd_handle_t hd, int fd) {
+    (void)hd;
+    session_t* s = session(fd);
+    return !s ? HTTPD_WS_CLIENT_INVALID : s->ws ? HTTPD_WS_CLIENT_WEBSOCKET : HTTPD_WS_CLIENT_HTTP;
+}
+
+esp_err_t httpd_queue_work(httpd_handle_t handle, httpd_work_fn_t work, void* arg) {
+    (void)handle;
+    work_t w = { .fn = work, .arg = arg };
+    return s_srv.running && xQueueSend(s_srv.q, &w, 0) == pdTRUE ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t httpd_sess_trigger_close(httpd_handle_t handle, int sockfd) {
+    (void)handle;
+    session_t* s = session(sockfd);
+    if (!s) return ESP_ERR_NOT_FOUND;
+    session_close(s);
+    return ESP_OK;
+}
@@ -0,0 +1,53 @@
+#pragma once
+// Subset of the cJSON API used by main/, with the same struct layout
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define cJSON_Invalid (0)
+#define cJSON_False   (1 << 0)
+#define cJSON_True    (1 << 1)
+#define cJSON_NULL    (1 << 2)
+#define cJSON_Number  (1 << 3)
+#define cJSON_String  (1 << 4)
+#define cJSON_Array   (1 << 5)
+#define cJSON_Object  (1 << 6)
+
+typedef struct cJSON {
+    struct cJSON *next, *prev, *child;
+    int type;
+    char* valuestring;
+    int valueint;
+    double valuedouble;
+    char* string;
+} cJSON;
+
+typedef int cJSON_bool;
+
+cJSON* cJSON_Parse(const char* value);
+cJSON* cJSON_ParseWithLength(const char* value, size_t len);
+void cJSON_Delete(cJSON* item);
+
+cJSON* cJSON_GetObjectItemCaseSensitive(const cJSON* object, const char* key);
+cJSON* cJSON_GetObjectItem(const cJSON* object, const char* key);
+int cJSON_GetArraySize(const cJSON* array);
+cJSON* cJSON_GetArrayItem(const cJSON* array, int index);
+
+cJSON_bool cJSON_IsInvalid(const cJSON* item);
+cJSON_bool cJSON_IsFalse(const cJSON* item);
+cJSON_bool cJSON_IsTrue(const cJSON* item);
+cJSON_bool cJSON_IsBool(const cJSON* item);
+cJSON_bool cJSON_IsNull(const cJSON* item);
+cJSON_bool cJSON_IsNumber(const cJSON* item);
+cJSON_bool cJSON_IsString(const cJSON* item);
+cJSON_bool cJSON_IsArray(const cJSON* item);
+cJSON_bool cJSON_IsObject(const cJSON* item);
+
+#define cJSON_ArrayForEach(element, array) \
+    for (element = (array) != NULL ? (array)->child : NULL; element != NULL; element = element->next)
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,11 @@
+#pragma once
+#include "esp_err.h"
+#include "driver/gpio.h"
+#include "freertos/FreeRTOS.h"
+typedef int i2c_port_t;
+typedef enum { I2C_MODE_SLAVE, I2C_MODE_MASTER } i2c_mode_t;
+typedef struct { i2c_mode_t mode; int sda_io_num; int scl_io_num; bool sda_pullup_en; bool scl_pullup_en; union { struct { uint32_t clk_speed; } master; }; uint32_t clk_flags; } i2c_config_t;
+esp_err_t i2c_param_config(i2c_port_t, const i2c_config_t*);
+esp_err_t i2c_driver_install(i2c_port_t, i2c_mode_t, size_t, size_t, int);
+esp_err_t i2c_master_write_to_device(i2c_port_t, uint8_t, const uint8_t*, size_t, TickType_t);
+esp_err_t i2c_master_read_from_device(i2c_port_t, uint8_t, uint8_t*, size_t, TickType_t);
@@ -0,0 +1,6 @@
+#pragma once
+#include <stdint.h>
+#define ESP_IMAGE_HEADER_MAGIC 0xE9
+#define ESP_APP_DESC_MAGIC_WORD 0xABCD5432
+typedef struct { uint8_t magic; uint8_t segment_count; uint8_t spi_mode; uint8_t spi_speed_size; uint32_t entry_addr; uint8_t rest[16]; } esp_image_header_t;
+typedef struct { uint32_t load_addr; uint32_t data_len; } esp_image_segment_header_t;
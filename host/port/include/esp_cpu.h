@@ -0,0 +1,4 @@
+#pragma once
+#include <stdint.h>
+int esp_cpu_get_core_id(void);
+uint32_t esp_cpu_get_cycle_count(void);
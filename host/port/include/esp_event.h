@@ -0,0 +1,10 @@
+#pragma once
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+typedef const char* esp_event_base_t;
+typedef void (*esp_event_handler_t)(void*, esp_event_base_t, int32_t, void*);
+typedef struct esp_event_handler_instance_context_t* esp_event_handler_instance_t;
+#define ESP_EVENT_ANY_ID -1
+esp_err_t esp_event_loop_create_default(void);
+esp_err_t esp_event_handler_register(esp_event_base_t, int32_t, esp_event_handler_t, void*);
+esp_err_t esp_event_handler_instance_register(esp_event_base_t, int32_t, esp_event_handler_t, void*, esp_event_handler_instance_t*);
@@ -0,0 +1,18 @@
+#pragma once
+#include "esp_err.h"
+typedef struct esp_http_client* esp_http_client_handle_t;
+typedef enum { HTTP_METHOD_GET = 0, HTTP_METHOD_POST, HTTP_METHOD_HEAD } esp_http_client_method_t;
+typedef struct { const char* url; const char* cert_pem; int timeout_ms; int buffer_size; int buffer_size_tx; bool keep_alive_enable; esp_http_client_method_t method; } esp_http_client_config_t;
+esp_http_client_handle_t esp_http_client_init(const esp_http_client_config_t*);
+esp_err_t esp_http_client_open(esp_http_client_handle_t, int);
+int64_t esp_http_client_fetch_headers(esp_http_client_handle_t);
+int esp_http_client_read(esp_http_client_handle_t, char*, int);
+int esp_http_client_get_status_code(esp_http_client_handle_t);
+int64_t esp_http_client_get_content_length(esp_http_client_handle_t);
+esp_err_t esp_http_client_get_header(esp_http_client_handle_t, const char*, char**);
+esp_err_t esp_http_client_set_header(esp_http_client_handle_t, const char*, const char*);
+esp_err_t esp_http_client_delete_header(esp_http_client_handle_t, const char*);
+esp_err_t esp_http_client_set_url(esp_http_client_handle_t, const char*);
+esp_err_t esp_http_client_close(esp_http_client_handle_t);
+esp_err_t esp_http_client_cleanup(esp_http_client_handle_t);
+bool esp_http_client_is_complete_data_received(esp_http_client_handle_t);
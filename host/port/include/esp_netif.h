@@ -0,0 +1,22 @@
+#pragma once
+#include "esp_err.h"
+#include "esp_event.h"
+typedef struct esp_netif_obj esp_netif_t;
+typedef struct { uint32_t addr; } esp_ip4_addr_t;
+typedef struct { esp_ip4_addr_t ip, netmask, gw; } esp_netif_ip_info_t;
+typedef struct { esp_netif_t* esp_netif; esp_netif_ip_info_t ip_info; bool ip_changed; } ip_event_got_ip_t;
+typedef enum { ESP_NETIF_DNS_MAIN, ESP_NETIF_DNS_BACKUP } esp_netif_dns_type_t;
+typedef struct { union { struct { union { esp_ip4_addr_t ip4; } u_addr; uint8_t type; } ip; }; } esp_netif_dns_info_t;
+extern esp_event_base_t IP_EVENT;
+enum { IP_EVENT_STA_GOT_IP, IP_EVENT_STA_LOST_IP };
+#define IP2STR(a) (int)((a)->addr & 0xff), (int)(((a)->addr >> 8) & 0xff), (int)(((a)->addr >> 16) & 0xff), (int)(((a)->addr >> 24) & 0xff)
+#define IPSTR "%d.%d.%d.%d"
+esp_err_t esp_netif_init(void);
+esp_netif_t* esp_netif_create_default_wifi_sta(void);
+esp_err_t esp_netif_dhcpc_stop(esp_netif_t*);
+esp_err_t esp_netif_dhcpc_start(esp_netif_t*);
+esp_err_t esp_netif_set_ip_info(esp_netif_t*, const esp_netif_ip_info_t*);
+esp_err_t esp_netif_get_ip_info(esp_netif_t*, esp_netif_ip_info_t*);
+esp_err_t esp_netif_set_dns_info(esp_netif_t*, esp_netif_dns_type_t, esp_netif_dns_info_t*);
+esp_err_t esp_netif_get_dns_info(esp_netif_t*, esp_netif_dns_type_t, esp_netif_dns_info_t*);
+#define ESP_IPADDR_TYPE_V4 0
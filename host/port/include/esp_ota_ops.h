@@ -0,0 +1,16 @@
+#pragma once
+#include "esp_err.h"
+#include "esp_partition.h"
+#include "esp_app_desc.h"
+typedef uint32_t esp_ota_handle_t;
+#define OTA_SIZE_UNKNOWN 0xffffffff
+#define OTA_WITH_SEQUENTIAL_WRITES 0xfffffffe
+#define ESP_ERR_OTA_VALIDATE_FAILED 0x1503
+typedef enum { ESP_OTA_IMG_NEW, ESP_OTA_IMG_PENDING_VERIFY, ESP_OTA_IMG_VALID, ESP_OTA_IMG_INVALID, ESP_OTA_IMG_ABORTED, ESP_OTA_IMG_UNDEFINED = 0xffffffff } esp_ota_img_states_t;
+esp_err_t esp_ota_begin(const esp_partition_t*, size_t, esp_ota_handle_t*);
+esp_err_t esp_ota_write(esp_ota_handle_t, const void*, size_t);
+esp_err_t esp_ota_end(esp_ota_handle_t);
+esp_err_t esp_ota_abort(esp_ota_handle_t);
+esp_err_t esp_ota_set_boot_partition(const esp_partition_t*);
+const esp_partition_t* esp_ota_get_running_partition(void);
+const esp_partition_t* esp_ota_get_next_update_partition(const esp_partition_t*);
@@ -0,0 +1,42 @@
+#pragma once
+// FreeRTOS on the host: see host/port/freertos.c for the scheduling model
+#include "sdkconfig.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+typedef uint8_t StackType_t;
+
+typedef struct { void* dummy[32]; } StaticTask_t;
+typedef struct { void* dummy[16]; } StaticQueue_t;
+typedef struct { void* dummy[8]; } StaticEventGroup_t;
+typedef StaticQueue_t StaticSemaphore_t;
+
+#define pdPASS   1
+#define pdFAIL   0
+#define pdTRUE   1
+#define pdFALSE  0
+
+#define configTICK_RATE_HZ   1000
+#define configMAX_PRIORITIES 25
+#define configNUM_CORES      2
+#define portNUM_PROCESSORS   2
+#define portMAX_DELAY        0xffffffffu
+#define portTICK_PERIOD_MS   (1000 / configTICK_RATE_HZ)
+#define pdMS_TO_TICKS(ms)    ((TickType_t)(((uint64_t)(ms) * configTICK_RATE_HZ) / 1000))
+#define pdTICKS_TO_MS(t)     ((uint32_t)(((uint64_t)(t) * 1000) / configTICK_RATE_HZ))
+#define tskNO_AFFINITY       0x7fffffff
+#define tskIDLE_PRIORITY     0
+
+// Only one task runs at a time on the host, so critical sections are no-ops
+typedef struct { int unused; } portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED { 0 }
+void vPortEnterCritical(portMUX_TYPE* mux);
+void vPortExitCritical(portMUX_TYPE* mux);
+#define portENTER_CRITICAL(m)     vPortEnterCritical(m)
+#define portEXIT_CRITICAL(m)      vPortExitCritical(m)
+#define portENTER_CRITICAL_ISR(m) vPortEnterCritical(m)
+#define portEXIT_CRITICAL_ISR(m)  vPortExitCritical(m)
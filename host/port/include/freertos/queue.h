@@ -0,0 +1,15 @@
+#pragma once
+#include "freertos/FreeRTOS.h"
+
+typedef struct QueueDefinition* QueueHandle_t;
+
+#define errQUEUE_FULL  ((BaseType_t)0)
+#define errQUEUE_EMPTY ((BaseType_t)0)
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size);
+BaseType_t xQueueSend(QueueHandle_t q, const void* item, TickType_t ticks);
+#define xQueueSendToBack(q, item, ticks) xQueueSend((q), (item), (ticks))
+BaseType_t xQueueReceive(QueueHandle_t q, void* item, TickType_t ticks);
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t q);
+BaseType_t xQueueReset(QueueHandle_t q);
+void vQueueDelete(QueueHandle_t q);
@@ -0,0 +1,145 @@
+#pragma once
+// Control surface of the host port: the stand-ins below replace the IDF
+// drivers for benchmarks and simulations that link the real main/ sources.
+#include "esp_err.h"
+#include "esp_event.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// ---- Kernel and clock ------------------------------------------------------
+// Tasks are threads, but only one runs at a time and they switch only when
+// the running one blocks, highest priority first. The clock is virtual: it
+// moves only when every task is blocked, straight to the next wake-up, so a
+// day of firmware time runs in well under a second and every run with the
+// same inputs takes the same path.
+
+// Call once from main(); the calling thread becomes task "main" (priority 1,
+// like app_main). state_dir holds the NVS file; NULL keeps NVS in RAM.
+void host_init(const char* state_dir);
+
+// Block the calling task for us of virtual time, letting every other task
+// run (equivalent to vTaskDelay in microseconds)
+void host_run_for(int64_t us);
+// Let every ready task run until all are blocked; the clock does not move
+void host_run_idle(void);
+
+// Run app_main() in its own task (priority 1, like the IDF main task); it
+// brings up everything up to the point where it idles
+void host_start_app(void);
+
+// Let the clock follow real time from now on, for runs that talk to the
+// outside world (host_mqtt_use_network); idle time is then slept through
+void host_set_realtime(bool on);
+
+int64_t host_now_us(void);
+// Wall clock seen by time()/gettimeofday(), as Unix seconds (0 = never set)
+void host_set_wall_time(int64_t epoch_s);
+// Factory MAC, which the device id and MQTT client id derive from; set it
+// before host_start_app()
+void host_set_mac(const uint8_t mac[6]);
+
+// ---- GPIO ------------------------------------------------------------------
+typedef void (*host_gpio_hook_t)(int gpio, int level, void* ctx);
+
+int host_gpio_get(int gpio);
+uint32_t host_gpio_writes(void);
+// Called on every gpio_set_level, from the writing task
+void host_gpio_set_hook(host_gpio_hook_t hook, void* ctx);
+
+// ---- SCD41 on I2C ----------------------------------------------------------
+typedef struct {
+    float co2_ppm;
+    float temperature_c;
+    float humidity_rh;
+} host_scd41_sample_t;
+
+// Supplies the reading for a measurement completed at now_us
+typedef host_scd41_sample_t (*host_scd41_source_t)(int64_t now_us, void* ctx);
+
+// Readings cycle through samples[0..n) (copied); replaces any source
+void host_scd41_script(const host_scd41_sample_t* samples, size_t n);
+void host_scd41_set_source(host_scd41_source_t source, void* ctx);
+// The next n transfers are NACKed, or return a word with a bad CRC
+void host_scd41_fail_next(uint32_t n);
+void host_scd41_corrupt_next(uint32_t n);
+uint32_t host_scd41_measurements(void);
+
+// ---- MQTT client -------------------------------------------------------------
+typedef struct {
+    const char* topic;
+    const char* data;
+    int len;
+    int qos;
+    bool retain;
+    int msg_id;
+} host_mqtt_msg_t;
+
+typedef void (*host_mqtt_hook_t)(const host_mqtt_msg_t* msg, void* ctx);
+
+// Talk MQTT 3.1.1 over TCP to a real broker (mqtt://host[:port], NULL for
+// CONFIG_MQTT_BROKER_URI) instead of the model; call before host_start_app()
+// and run in real time. host_mqtt_deliver() and the broker controls below
+// then do nothing useful: the broker is the other side.
+void host_mqtt_use_network(const char* uri);
+// Broker reachability. Going down while connected emits DISCONNECTED.
+void host_mqtt_set_broker(bool up);
+// Virtual time from start/reconnect to CONNECTED (default 30 ms)
+void host_mqtt_set_connect_latency(int64_t us);
+bool host_mqtt_connected(void);
+// DISCONNECTED then CONNECTED, both from the calling task, as when the broker
+// drops the session and the client is straight back; subscriptions are reset
+void host_mqtt_session_restart(void);
+// Deliver a message to the client's event handler from the calling task, as
+// MQTT_EVENT_DATA; false if not connected or no subscription matches
+bool host_mqtt_deliver(const char* topic, const void* data, int len);
+// Same, split into MQTT_EVENT_DATA fragments of at most frag bytes the way
+// esp-mqtt splits payloads larger than its receive buffer
+bool host_mqtt_deliver_fragmented(const char* topic, const void* data, int len, int frag);
+// Called for every publish/enqueue, from the publishing task
+void host_mqtt_set_publish_hook(host_mqtt_hook_t hook, void* ctx);
+// QoS 1 publishes are acknowledged (MQTT_EVENT_PUBLISHED) automatically by
+// default; with auto-ack off they wait for host_mqtt_ack_all()
+void host_mqtt_set_auto_ack(bool on);
+int host_mqtt_ack_all(void);
+// Last retained payload on topic, or NULL
+const char* host_mqtt_retained(const char* topic);
+uint32_t host_mqtt_publish_count(void);
+// Drops the publish log kept for host_mqtt_retained() and the counters
+void host_mqtt_reset_log(void);
+
+// ---- HTTP server --------------------------------------------------------------
+// One request to the firmware's esp_http_server, handled in its "httpd" task
+// while the caller waits. auth is the Authorization header (NULL: none); the
+// response body goes to out. Returns the status code, or -1 if no server is
+// running or its work queue is full.
+int host_http_request(const char* method, const char* uri, const char* body, const char* auth, char* out,
+                      size_t out_sz);
+// WebSocket handshake on uri (query string included); the session's fd, or
+// -1 if the firmware refused it
+int host_http_ws_open(const char* uri, const char* auth);
+void host_http_ws_close(int fd);
+typedef void (*host_http_ws_hook_t)(int fd, const char* data, int len, void* ctx);
+// Called for every frame sent to a WebSocket client, from the httpd task
+void host_http_set_ws_hook(host_http_ws_hook_t hook, void* ctx);
+
+// ---- Wi-Fi and IP ----------------------------------------------------------
+// Access point availability; losing it while associated emits a disconnect
+void host_wifi_set_ap(bool up);
+
+// ---- SNTP ------------------------------------------------------------------
+// Hand a server time to the firmware's sntp_sync_time() and sync callback,
+// as lwIP would when a reply arrives (only while SNTP is running)
+bool host_sntp_reply(int64_t epoch_s);
+
+// ---- Logging ---------------------------------------------------------------
+// Global level (default: ESP_LOG_WARN, or $HOST_LOG_LEVEL as 0..5)
+void host_log_level(int level);
+
+#ifdef __cplusplus
+}
+#endif
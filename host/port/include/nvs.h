@@ -0,0 +1,27 @@
+#pragma once
+#include "esp_err.h"
+
+typedef uint32_t nvs_handle_t;
+typedef enum { NVS_READONLY, NVS_READWRITE } nvs_open_mode_t;
+
+#define NVS_KEY_NAME_MAX_SIZE 16
+
+#define ESP_ERR_NVS_NOT_INITIALIZED   0x1101
+#define ESP_ERR_NVS_NOT_FOUND         0x1102
+#define ESP_ERR_NVS_READ_ONLY         0x1104
+#define ESP_ERR_NVS_INVALID_HANDLE    0x1107
+#define ESP_ERR_NVS_KEY_TOO_LONG      0x1109
+#define ESP_ERR_NVS_INVALID_LENGTH    0x110c
+#define ESP_ERR_NVS_NO_FREE_PAGES     0x110d
+#define ESP_ERR_NVS_NEW_VERSION_FOUND 0x1110
+
+esp_err_t nvs_open(const char* ns, nvs_open_mode_t mode, nvs_handle_t* out);
+void nvs_close(nvs_handle_t h);
+esp_err_t nvs_set_u32(nvs_handle_t h, const char* key, uint32_t v);
+esp_err_t nvs_get_u32(nvs_handle_t h, const char* key, uint32_t* out);
+esp_err_t nvs_set_str(nvs_handle_t h, const char* key, const char* v);
+esp_err_t nvs_get_str(nvs_handle_t h, const char* key, char* out, size_t* len);
+esp_err_t nvs_set_blob(nvs_handle_t h, const char* key, const void* v, size_t len);
+esp_err_t nvs_get_blob(nvs_handle_t h, const char* key, void* out, size_t* len);
+esp_err_t nvs_erase_key(nvs_handle_t h, const char* key);
+esp_err_t nvs_commit(nvs_handle_t h);
@@ -0,0 +1,24 @@
+#pragma once
+#include <string.h>
+// Host shim: tinfl API on top of zlib, for the host build
+#include <stddef.h>
+#include <stdint.h>
+#include <zlib.h>
+#define TINFL_LZ_DICT_SIZE 32768
+#define TINFL_FLAG_PARSE_ZLIB_HEADER 1
+#define TINFL_FLAG_HAS_MORE_INPUT 2
+typedef enum { TINFL_STATUS_FAILED = -1, TINFL_STATUS_DONE = 0, TINFL_STATUS_NEEDS_MORE_INPUT = 1, TINFL_STATUS_HAS_MORE_OUTPUT = 2 } tinfl_status;
+typedef struct { z_stream z; int init; int done; } tinfl_decompressor;
+#define tinfl_init(r) do { (r)->init = 0; (r)->done = 0; } while (0)
+static inline tinfl_status tinfl_decompress(tinfl_decompressor* r, const uint8_t* in, size_t* in_sz, uint8_t* start, uint8_t* next, size_t* out_sz, uint32_t flags) {
+    (void)start; (void)flags;
+    if (!r->init) { memset(&r->z, 0, sizeof(r->z)); inflateInit(&r->z); r->init = 1; }
+    if (r->done) { *in_sz = 0; *out_sz = 0; return TINFL_STATUS_DONE; }
+    r->z.next_in = (Bytef*)in; r->z.avail_in = (uInt)*in_sz;
+    r->z.next_out = next; r->z.avail_out = (uInt)*out_sz;
+    int rc = inflate(&r->z, Z_NO_FLUSH);
+    *in_sz -= r->z.avail_in; *out_sz -= r->z.avail_out;
+    if (rc == Z_STREAM_END) { r->done = 1; return TINFL_STATUS_DONE; }
+    if (rc != Z_OK && rc != Z_BUF_ERROR) return TINFL_STATUS_FAILED;
+    return r->z.avail_out == 0 ? TINFL_STATUS_HAS_MORE_OUTPUT : TINFL_STATUS_NEEDS_MORE_INPUT;
+}
@@ -0,0 +1,109 @@
+#!/usr/bin/env python3
+"""Generate sdkconfig.h for the host build from main/Kconfig.projbuild.
+
+    host/port/kconfig_defaults.py main/Kconfig.projbuild build/sdkconfig.h \\
+        [host/port/sdkconfig.host]
+
+Takes each option's first default, drops options whose `depends on` symbol
+is off, then applies overrides written as sdkconfig lines (CONFIG_X=y,
+CONFIG_X=123, CONFIG_X="text", "# CONFIG_X is not set").
+"""
+import re
+import sys
+
+ATTR = re.compile(r"^(\s*)(bool|int|hex|string|default|depends on|help|range)\b\s*(.*)$")
+
+
+def parse(path):
+    opts = {}  # name -> {"type", "default", "depends"}
+    cur = None
+    help_indent = None
+    with open(path) as f:
+        for raw in f:
+            line = raw.rstrip("\n")
+            stripped = line.strip()
+            indent = len(line) - len(line.lstrip())
+            if help_indent is not None:
+                if not stripped or indent > help_indent:
+                    continue
+                help_indent = None
+            m = re.match(r"^\s*(?:menu)?config\s+(\w+)", line)
+            if m:
+                cur = opts.setdefault(m.group(1), {"type": None, "default": None, "depends": None})
+                continue
+            if re.match(r"^\s*(menu|endmenu|choice|endchoice|if|endif|comment)\b", line):
+                cur = None
+                continue
+            m = ATTR.match(line)
+            if not m or cur is None:
+                continue
+            key, rest = m.group(2), m.group(3).strip()
+            if key == "help":
+                help_indent = indent
+            elif key in ("bool", "int", "hex", "string"):
+                cur["type"] = key
+            elif key == "default" and cur["default"] is None:
+                if not rest.startswith('"'):
+                    rest = re.sub(r"\s*#.*$", "", rest)
+                cur["default"] = re.sub(r"\s+if\s+.*$", "", rest)
+            elif key == "depends on":
+                cur["depends"] = rest
+    return opts
+
+
+def value(opt, raw):
+    if opt["type"] == "bool":
+        return raw == "y"
+    if opt["type"] == "string":
+        return raw[1:-1] if raw.startswith('"') else raw
+    return raw
+
+
+def main():
+    if len(sys.argv) < 3:
+        sys.exit(__doc__)
+    opts = parse(sys.argv[1])
+    vals = {name: value(o, o["default"] or ("n" if o["type"] == "bool" else "")) for name, o in opts.items()}
+
+    if len(sys.argv) > 3:
+        with open(sys.argv[3]) as f:
+            for line in f:
+                line = line.strip()
+                m = re.match(r"^# CONFIG_(\w+) is not set$", line)
+                if m and m.group(1) in opts:
+                    vals[m.group(1)] = False
+                    continue
+                m = re.match(r"^CONFIG_(\w+)=(.*)$", line)
+                if m and m.group(1) in opts:
+                    vals[m.group(1)] = value(opts[m.group(1)], m.group(2))
+                elif m:
+                    sys.exit("%s: unknown option CONFIG_%s" % (sys.argv[3], m.group(1)))
+
+    out = ["// Generated from main/Kconfig.projbuild by host/port/kconfig_defaults.py", "#pragma once"]
+    for name, o in opts.items():
+        dep = o["depends"]
+        if dep and not all(vals.get(d.strip()) is True for d in dep.split("&&")):
+            continue
+        v = vals[name]
+        if o["type"] == "bool":
+            if v:
+                out.append("#define CONFIG_%s 1" % name)
+        elif o["type"] == "string":
+            out.append('#define CONFIG_%s "%s"' % (name, v.replace("\\", "\\\\").replace('"', '\\"')))
+        else:
+            out.append("#define CONFIG_%s %s" % (name, v))
+    text = "\n".join(out) + "\n"
+
+    # Leave the file alone when unchanged so the library isn't rebuilt
+    try:
+        with open(sys.argv[2]) as f:
+            if f.read() == text:
+                return
+    except OSError:
+        pass
+    with open(sys.argv[2], "w") as f:
+        f.write(text)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,663 @@
+// esp-mqtt client talking to an in-process broker model. Connects, drops
+// and PUBLISHED acks are raised from an "mqtt_task" like the real client;
+// incoming data is delivered with host_mqtt_deliver() from the caller.
+// After host_mqtt_use_network() it speaks MQTT 3.1.1 to a real broker
+// instead: a reader thread per connection queues incoming packets and the
+// mqtt_task dispatches them, so events still come from that task.
+#include "mqtt_client.h"
+#include "esp_system.h"
+#include "host.h"
+#include "host_kernel.h"
+#include "mqtt_wire.h"
+#include "sdkconfig.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define MQTT_TASK_PRIO 5
+#define MAX_SUBS       64
+#define MAX_ACKS       256
+#define ACK_RTT_US     4000 // broker round trip for QoS 1
+#define NET_TX_BUF     4096 // packets larger than this are built on the heap
+
+// Packet from the reader thread; type 0 means the connection is gone
+typedef struct rx {
+    uint32_t conn; // connection it arrived on
+    mqtt_wire_pkt_t pkt;
+    struct rx* next;
+} rx_t;
+
+// Enqueued while disconnected; sent once connected, as from esp-mqtt's outbox
+typedef struct held {
+    char* topic;
+    char* data;
+    int len;
+    int qos;
+    bool retain;
+    int msg_id;
+    struct held* next;
+} held_t;
+
+typedef struct retained {
+    char* topic;
+    char* payload;
+    struct retained* next;
+} retained_t;
+
+struct esp_mqtt_client {
+    esp_event_handler_t handler;
+    void* handler_arg;
+    bool auto_reconnect;
+    int reconnect_ms;
+    char* lwt_topic;
+    char* lwt_msg;
+    bool lwt_retain;
+    bool started;
+    bool connected;
+    int64_t connect_at_us; // 0 = no attempt pending
+    bool drop_pending;
+    int next_id;
+    char* subs[MAX_SUBS];
+    int nsubs;
+    struct {
+        int msg_id;
+        int64_t due_us;
+    } acks[MAX_ACKS]; // ring, due times in order
+    int ack_head;
+    int nacks;
+    int64_t wake_us; // when mqtt_task next looks at the clock
+    held_t* held;
+    held_t** held_tail;
+
+    // Network mode
+    char client_id[32];
+    char* username;
+    char* password;
+    int lwt_qos;
+    int keepalive_s;
+    int rx_frag; // receive buffer size: larger payloads arrive in pieces
+    int fd;
+    uint32_t conn;
+    int64_t ping_at_us;
+    pthread_mutex_t rx_lock;
+    rx_t* rx;
+    rx_t** rx_tail;
+};
+
+static esp_mqtt_client_handle_t s_client;
+static bool s_broker_up = true;
+static bool s_link_up;
+static bool s_auto_ack = true;
+static int64_t s_connect_latency_us = 30000;
+static host_mqtt_hook_t s_hook;
+static void* s_hook_ctx;
+static retained_t* s_retained;
+static uint32_t s_publishes;
+static char* s_net_uri; // NULL: the broker model
+
+static char* dup_str(const char* s) {
+    return s ? strdup(s) : NULL;
+}
+
+static void dispatch(esp_mqtt_client_handle_t c, esp_mqtt_event_t* ev) {
+    ev->client = c;
+    if (c->handler) c->handler(c->handler_arg, "MQTT_EVENTS", ev->event_id, ev);
+}
+
+static void dispatch_id(esp_mqtt_client_handle_t c, esp_mqtt_event_id_t id, int msg_id) {
+    esp_mqtt_event_t ev = { .event_id = id, .msg_id = msg_id };
+    dispatch(c, &ev);
+}
+
+// '+' matches one level, a trailing '#' the rest
+static bool topic_matches(const char* filter, const char* topic) {
+    while (*filter) {
+        if (*filter == '#') return true;
+        if (*filter == '+') {
+            while (*topic && *topic != '/') topic++;
+            filter++;
+            continue;
+        }
+        if (*filter != *topic) return false;
+        filter++;
+        topic++;
+    }
+    return *topic == 0;
+}
+
+static void log_publish(const char* topic, const char* data, int len, int qos, bool retain, int msg_id) {
+    s_publishes++;
+    if (retain) {
+        retained_t* r = s_retained;
+        while (r && strcmp(r->topic, topic) != 0) r = r->next;
+        if (!r) {
+            r = calloc(1, sizeof(*r));
+            r->topic = strdup(topic);
+            r->next = s_retained;
+            s_retained = r;
+        }
+        free(r->payload);
+        r->payload = malloc((size_t)len + 1);
+        memcpy(r->payload, data, (size_t)len);
+        r->payload[len] = 0;
+    }
+    if (s_hook) {
+        host_mqtt_msg_t m = { topic, data, len, qos, retain, msg_id };
+        s_hook(&m, s_hook_ctx);
+    }
+}
+
+// Outgoing publishes don't wake the task unless its next deadline moves
+// forward, as on the target where the publishing task writes the socket
+static void wake_task(esp_mqtt_client_handle_t c, int64_t due_us) {
+    if (due_us < c->wake_us) {
+        c->wake_us = due_us;
+        kernel_signal(c);
+    }
+}
+
+static void schedule_ack(esp_mqtt_client_handle_t c, int msg_id) {
+    if (c->nacks == MAX_ACKS) {
+        // Oldest ack is lost, like an outbox entry expiring
+        c->ack_head = (c->ack_head + 1) % MAX_ACKS;
+        c->nacks--;
+    }
+    int i = (c->ack_head + c->nacks++) % MAX_ACKS;
+    c->acks[i].msg_id = msg_id;
+    c->acks[i].due_us = s_auto_ack ? kernel_now_us() + ACK_RTT_US : KERNEL_FOREVER;
+    wake_task(c, c->acks[i].due_us);
+}
+
+// Clean session: in-flight acks and subscriptions don't survive a drop
+static void reset_session(esp_mqtt_client_handle_t c) {
+    c->connected = false;
+    c->nacks = 0;
+    for (int i = 0; i < c->nsubs; ++i) free(c->subs[i]);
+    c->nsubs = 0;
+}
+
+static void net_close(esp_mqtt_client_handle_t c) {
+    if (c->fd < 0) return;
+    shutdown(c->fd, SHUT_RDWR); // the reader sees EOF and closes it
+    c->fd = -1;
+    c->conn++;
+}
+
+static void lost(esp_mqtt_client_handle_t c) {
+    reset_session(c);
+    net_close(c);
+    if (!s_net_uri && c->lwt_topic && c->lwt_msg) { // a real broker sends the will itself
+        log_publish(c->lwt_topic, c->lwt_msg, (int)strlen(c->lwt_msg), 1, c->lwt_retain, 0);
+    }
+    dispatch_id(c, MQTT_EVENT_DISCONNECTED, 0);
+    if (c->auto_reconnect) c->connect_at_us = kernel_now_us() + (int64_t)c->reconnect_ms * 1000;
+}
+
+// ---- Network mode ------------------------------------------------------------------
+
+static void send_held(esp_mqtt_client_handle_t c);
+
+// A failed write drops the connection; the reader reports it
+static void net_send(esp_mqtt_client_handle_t c, const uint8_t* buf, size_t len) {
+    if (c->fd >= 0 && !mqtt_wire_write(c->fd, buf, len)) shutdown(c->fd, SHUT_RDWR);
+}
+
+static void net_publish(esp_mqtt_client_handle_t c, const char* topic, const char* data, int len, int qos,
+                        bool retain, int msg_id) {
+    uint8_t stack[NET_TX_BUF];
+    size_t cap = strlen(topic) + (size_t)len + 16;
+    uint8_t* buf = cap <= sizeof(stack) ? stack : malloc(cap);
+    if (!buf) return;
+    net_send(c, buf, mqtt_wire_publish(buf, cap, topic, data, len, qos, retain, msg_id));
+    if (buf != stack) free(buf);
+}
+
+typedef struct {
+    esp_mqtt_client_handle_t c;
+    int fd;
+    uint32_t conn;
+} reader_arg_t;
+
+static void rx_push(esp_mqtt_client_handle_t c, uint32_t conn, const mqtt_wire_pkt_t* p) {
+    rx_t* r = calloc(1, sizeof(*r) + (p ? p->len + 1 : 0));
+    if (!r) return;
+    r->conn = conn;
+    if (p) {
+        r->pkt = *p;
+        r->pkt.body = (uint8_t*)(r + 1);
+        memcpy(r->pkt.body, p->body, p->len + 1);
+    }
+    pthread_mutex_lock(&c->rx_lock);
+    *c->rx_tail = r;
+    c->rx_tail = &r->next;
+    pthread_mutex_unlock(&c->rx_lock);
+    kernel_signal_external(c);
+}
+
+static rx_t* rx_pop(esp_mqtt_client_handle_t c) {
+    pthread_mutex_lock(&c->rx_lock);
+    rx_t* r = c->rx;
+    if (r) {
+        c->rx = r->next;
+        if (!c->rx) c->rx_tail = &c->rx;
+    }
+    pthread_mutex_unlock(&c->rx_lock);
+    return r;
+}
+
+// Not a task: it only blocks in recv() and hands packets over
+static void* reader_thread(void* arg) {
+    reader_arg_t a = *(reader_arg_t*)arg;
+    free(arg);
+    mqtt_wire_reader_t rd = { 0 };
+    mqtt_wire_pkt_t p;
+    while (mqtt_wire_read(&rd, a.fd, &p)) rx_push(a.c, a.conn, &p);
+    rx_push(a.c, a.conn, NULL);
+    mqtt_wire_reader_free(&rd);
+    close(a.fd);
+    return NULL;
+}
+
+static bool net_connect(esp_mqtt_client_handle_t c) {
+    int fd = mqtt_wire_dial(s_net_uri);
+    if (fd < 0) return false;
+    mqtt_wire_connect_t cp = {
+        .client_id = c->client_id,
+        .username = c->username,
+        .password = c->password,
+        .will_topic = c->lwt_topic,
+        .will_msg = c->lwt_msg,
+        .will_qos = c->lwt_qos,
+        .will_retain = c->lwt_retain,
+        .keepalive_s = c->keepalive_s,
+    };
+    uint8_t buf[512];
+    size_t n = mqtt_wire_connect(buf, sizeof(buf), &cp);
+    reader_arg_t* a = malloc(sizeof(*a));
+    pthread_t t;
+    if (!n || !a || !mqtt_wire_write(fd, buf, n)) {
+        free(a);
+        close(fd);
+        return false;
+    }
+    c->fd = fd;
+    *a = (reader_arg_t){ c, fd, ++c->conn };
+    if (pthread_create(&t, NULL, reader_thread, a) != 0) {
+        free(a);
+        close(fd);
+        c->fd = -1;
+        return false;
+    }
+    pthread_detach(t);
+    return true;
+}
+
+static void deliver(esp_mqtt_client_handle_t c, const char* topic, int tlen, const char* data, int len, int frag,
+                    int qos) {
+    if (frag <= 0 || frag > len) frag = len;
+    int off = 0;
+    do {
+        int n = len - off < frag ? len - off : frag;
+        // Only the first fragment carries the topic
+        esp_mqtt_event_t ev = {
+            .event_id = MQTT_EVENT_DATA,
+            .topic = off ? NULL : (char*)topic,
+            .topic_len = off ? 0 : tlen,
+            .data = (char*)data + off,
+            .data_len = n,
+            .total_data_len = len,
+            .current_data_offset = off,
+            .qos = qos,
+        };
+        dispatch(c, &ev);
+        off += n;
+    } while (off < len);
+}
+
+static void net_handle(esp_mqtt_client_handle_t c, rx_t* r) {
+    mqtt_wire_pkt_t* p = &r->pkt;
+    mqtt_wire_publish_t pub;
+    uint8_t buf[8];
+    switch (p->type) {
+        case 0:
+            if (c->connected) {
+                lost(c);
+            } else {
+                // Refused or dropped before CONNACK: a failed attempt
+                net_close(c);
+                dispatch_id(c, MQTT_EVENT_ERROR, 0);
+                dispatch_id(c, MQTT_EVENT_DISCONNECTED, 0);
+                if (c->auto_reconnect) c->connect_at_us = kernel_now_us() + (int64_t)c->reconnect_ms * 1000;
+            }
+            break;
+        case MQTT_PKT_CONNACK:
+            if (mqtt_wire_ack_id(p) != 0) {
+                net_close(c); // the reader reports it
+                break;
+            }
+            c->connected = true;
+            c->ping_at_us = kernel_now_us() + (int64_t)c->keepalive_s * 500000;
+            dispatch_id(c, MQTT_EVENT_CONNECTED, 0);
+            send_held(c);
+            break;
+        case MQTT_PKT_PUBLISH:
+            if (!c->connected || !mqtt_wire_parse_publish(p, &pub)) break;
+            if (pub.qos) net_send(c, buf, mqtt_wire_short(buf, sizeof(buf), MQTT_PKT_PUBACK, pub.msg_id));
+            deliver(c, pub.topic, pub.topic_len, pub.data, pub.len, c->rx_frag, pub.qos);
+            break;
+        case MQTT_PKT_PUBACK:
+            dispatch_id(c, MQTT_EVENT_PUBLISHED, mqtt_wire_ack_id(p));
+            break;
+        case MQTT_PKT_SUBACK:
+            dispatch_id(c, MQTT_EVENT_SUBSCRIBED, mqtt_wire_ack_id(p));
+            break;
+    }
+}
+
+static void send_held(esp_mqtt_client_handle_t c) {
+    while (c->held && c->connected) {
+        held_t* h = c->held;
+        c->held = h->next;
+        if (s_net_uri) net_publish(c, h->topic, h->data, h->len, h->qos, h->retain, h->msg_id);
+        else schedule_ack(c, h->msg_id);
+        log_publish(h->topic, h->data, h->len, h->qos, h->retain, h->msg_id);
+        free(h->topic);
+        free(h->data);
+        free(h);
+    }
+    if (!c->held) c->held_tail = &c->held;
+}
+
+static void mqtt_task(void* arg) {
+    esp_mqtt_client_handle_t c = arg;
+    for (;;) {
+        int64_t now = kernel_now_us();
+        if (c->drop_pending) {
+            c->drop_pending = false;
+            if (c->connected) lost(c);
+            continue;
+        }
+        rx_t* r = s_net_uri ? rx_pop(c) : NULL;
+        if (r) {
+            if (r->conn == c->conn) net_handle(c, r);
+            free(r);
+            continue;
+        }
+        if (s_net_uri && c->connected && c->ping_at_us <= now) {
+            uint8_t buf[2];
+            net_send(c, buf, mqtt_wire_short(buf, sizeof(buf), MQTT_PKT_PINGREQ, 0));
+            c->ping_at_us = now + (int64_t)c->keepalive_s * 500000;
+            continue;
+        }
+        if (c->connect_at_us && c->connect_at_us <= now) {
+            c->connect_at_us = 0;
+            if (s_net_uri) {
+                // Connected once the CONNACK arrives
+                if (!s_link_up || !net_connect(c)) {
+                    dispatch_id(c, MQTT_EVENT_ERROR, 0);
+                    dispatch_id(c, MQTT_EVENT_DISCONNECTED, 0);
+                    if (c->auto_reconnect) c->connect_at_us = now + (int64_t)c->reconnect_ms * 1000;
+                }
+            } else if (s_broker_up && s_link_up) {
+                c->connected = true;
+                dispatch_id(c, MQTT_EVENT_CONNECTED, 0);
+                send_held(c);
+            } else {
+                dispatch_id(c, MQTT_EVENT_ERROR, 0);
+                c->connected = true; // so lost() reports it like a failed attempt
+                lost(c);
+            }
+            continue;
+        }
+        if (c->nacks && c->acks[c->ack_head].due_us <= now) {
+            int msg_id = c->acks[c->ack_head].msg_id;
+            c->ack_head = (c->ack_head + 1) % MAX_ACKS;
+            c->nacks--;
+            dispatch_id(c, MQTT_EVENT_PUBLISHED, msg_id);
+            continue;
+        }
+        int64_t wake = KERNEL_FOREVER;
+        if (c->connect_at_us) wake = c->connect_at_us;
+        if (c->nacks && c->acks[c->ack_head].due_us < wake) wake = c->acks[c->ack_head].due_us;
+        if (s_net_uri && c->connected && c->ping_at_us < wake) wake = c->ping_at_us;
+        c->wake_us = wake;
+        kernel_wait(c, wake);
+        c->wake_us = 0; // running: nothing to signal
+    }
+}
+
+esp_mqtt_client_handle_t esp_mqtt_client_init(const esp_mqtt_client_config_t* cfg) {
+    esp_mqtt_client_handle_t c = calloc(1, sizeof(*c));
+    if (!c) return NULL;
+    c->auto_reconnect = !cfg->network.disable_auto_reconnect;
+    c->reconnect_ms = cfg->network.reconnect_timeout_ms ? cfg->network.reconnect_timeout_ms : 10000;
+    c->lwt_topic = dup_str(cfg->session.last_will.topic);
+    c->lwt_msg = dup_str(cfg->session.last_will.msg);
+    c->lwt_retain = cfg->session.last_will.retain;
+    c->lwt_qos = cfg->session.last_will.qos;
+    c->held_tail = &c->held;
+    c->username = dup_str(cfg->credentials.username);
+    c->password = dup_str(cfg->credentials.authentication.password);
+    c->keepalive_s = cfg->session.keepalive ? cfg->session.keepalive : 120;
+    c->rx_frag = cfg->buffer.size ? cfg->buffer.size : 1024;
+    c->fd = -1;
+    pthread_mutex_init(&c->rx_lock, NULL);
+    c->rx_tail = &c->rx;
+    if (cfg->credentials.client_id) {
+        snprintf(c->client_id, sizeof(c->client_id), "%s", cfg->credentials.client_id);
+    } else {
+        // esp-mqtt's default, from the chip's MAC
+        uint8_t mac[6];
+        esp_efuse_mac_get_default(mac);
+        snprintf(c->client_id, sizeof(c->client_id), "ESP32_%02X%02X%02X", mac[3], mac[4], mac[5]);
+    }
+    s_client = c;
+    if (xTaskCreatePinnedToCore(mqtt_task, "mqtt_task", 6144, c, MQTT_TASK_PRIO, NULL, 0) != pdPASS) {
+        free(c);
+        return NULL;
+    }
+    return c;
+}
+
+esp_err_t esp_mqtt_client_register_event(esp_mqtt_client_handle_t c, esp_mqtt_event_id_t id,
+                                         esp_event_handler_t handler, void* arg) {
+    (void)id;
+    if (!c) return ESP_ERR_INVALID_ARG;
+    c->handler = handler;
+    c->handler_arg = arg;
+    return ESP_OK;
+}
+
+static void connect_later(esp_mqtt_client_handle_t c) {
+    c->connect_at_us = kernel_now_us() + s_connect_latency_us;
+    wake_task(c, c->connect_at_us);
+}
+
+esp_err_t esp_mqtt_client_start(esp_mqtt_client_handle_t c) {
+    if (!c) return ESP_ERR_INVALID_ARG;
+    if (c->started) return ESP_FAIL;
+    c->started = true;
+    connect_later(c);
+    return ESP_OK;
+}
+
+esp_err_t esp_mqtt_client_reconnect(esp_mqtt_client_handle_t c) {
+    if (!c || !c->started) return ESP_ERR_INVALID_STATE;
+    if (!c->connected && !c->connect_at_us) connect_later(c);
+    return ESP_OK;
+}
+
+static int next_msg_id(esp_mqtt_client_handle_t c) {
+    c->next_id = c->next_id % 65535 + 1;
+    return c->next_id;
+}
+
+static int publish(esp_mqtt_client_handle_t c, const char* topic, const char* data, int len, int qos, int retain,
+                   bool store) {
+    if (!c || !topic) return -1;
+    if (!data) data = "";
+    if (len <= 0) len = (int)strlen(data);
+    if (!c->connected) {
+        if (!store || qos == 0) return -1;
+        held_t* h = calloc(1, sizeof(*h));
+        h->topic = strdup(topic);
+        h->data = malloc((size_t)len);
+        memcpy(h->data, data, (size_t)len);
+        h->len = len;
+        h->qos = qos;
+        h->retain = retain != 0;
+        h->msg_id = next_msg_id(c);
+        *c->held_tail = h;
+        c->held_tail = &h->next;
+        return h->msg_id;
+    }
+    int msg_id = qos > 0 ? next_msg_id(c) : 0;
+    if (s_net_uri) net_publish(c, topic, data, len, qos, retain != 0, msg_id);
+    else if (qos > 0) schedule_ack(c, msg_id);
+    log_publish(topic, data, len, qos, retain != 0, msg_id);
+    return msg_id;
+}
+
+int esp_mqtt_client_publish(esp_mqtt_client_handle_t c, const char* topic, const char* data, int len, int qos,
+                            int retain) {
+    return publish(c, topic, data, len, qos, retain, false);
+}
+
+int esp_mqtt_client_enqueue(esp_mqtt_client_handle_t c, const char* topic, const char* data, int len, int qos,
+                            int retain, bool store) {
+    return publish(c, topic, data, len, qos, retain, store);
+}
+
+int esp_mqtt_client_subscribe(esp_mqtt_client_handle_t c, const char* topic, int qos) {
+    if (!c || !c->connected || !topic) return -1;
+    for (int i = 0; i < c->nsubs; ++i) {
+        if (strcmp(c->subs[i], topic) == 0) return 0;
+    }
+    if (c->nsubs == MAX_SUBS) return -1;
+    c->subs[c->nsubs++] = strdup(topic);
+    int msg_id = next_msg_id(c);
+    if (s_net_uri) {
+        uint8_t buf[256];
+        net_send(c, buf, mqtt_wire_subscribe(buf, sizeof(buf), msg_id, topic, qos));
+    }
+    return msg_id;
+}
+
+int esp_mqtt_client_unsubscribe(esp_mqtt_client_handle_t c, const char* topic) {
+    if (!c || !c->connected || !topic) return -1;
+    for (int i = 0; i < c->nsubs; ++i) {
+        if (strcmp(c->subs[i], topic) != 0) continue;
+        free(c->subs[i]);
+        c->subs[i] = c->subs[--c->nsubs];
+        int msg_id = next_msg_id(c);
+        if (s_net_uri) {
+            uint8_t buf[256];
+            net_send(c, buf, mqtt_wire_unsubscribe(buf, sizeof(buf), msg_id, topic));
+        }
+        return msg_id;
+    }
+    return -1;
+}
+
+// ---- Host side -----------------------------------------------------------------------
+
+static void drop(void) {
+    if (s_client && s_client->connected) {
+        s_client->drop_pending = true;
+        kernel_signal(s_client);
+    }
+}
+
+void host_mqtt_set_broker(bool up) {
+    s_broker_up = up;
+    if (!up) drop();
+}
+
+// Losing the link is noticed at once rather than after the keepalive
+void host_mqtt_link(bool up) {
+    s_link_up = up;
+    if (!up) drop();
+}
+
+void host_mqtt_use_network(const char* uri) {
+    free(s_net_uri);
+    s_net_uri = strdup(uri ? uri : CONFIG_MQTT_BROKER_URI);
+}
+
+void host_mqtt_set_connect_latency(int64_t us) {
+    s_connect_latency_us = us;
+}
+
+bool host_mqtt_connected(void) {
+    return s_client && s_client->connected;
+}
+
+void host_mqtt_session_restart(void) {
+    esp_mqtt_client_handle_t c = s_client;
+    if (!c || !c->connected) return;
+    reset_session(c);
+    dispatch_id(c, MQTT_EVENT_DISCONNECTED, 0);
+    c->connected = true;
+    dispatch_id(c, MQTT_EVENT_CONNECTED, 0);
+    send_held(c);
+}
+
+static bool subscribed(const char* topic) {
+    for (int i = 0; i < s_client->nsubs; ++i) {
+        if (topic_matches(s_client->subs[i], topic)) return true;
+    }
+    return false;
+}
+
+bool host_mqtt_deliver_fragmented(const char* topic, const void* data, int len, int frag) {
+    if (!host_mqtt_connected() || !subscribed(topic)) return false;
+    deliver(s_client, topic, (int)strlen(topic), data, len, frag, 1);
+    return true;
+}
+
+bool host_mqtt_deliver(const char* topic, const void* data, int len) {
+    return host_mqtt_deliver_fragmented(topic, data, len, len);
+}
+
+void host_mqtt_set_publish_hook(host_mqtt_hook_t hook, void* ctx) {
+    s_hook = hook;
+    s_hook_ctx = ctx;
+}
+
+void host_mqtt_set_auto_ack(bool on) {
+    s_auto_ack = on;
+}
+
+int host_mqtt_ack_all(void) {
+    if (!s_client || !s_client->nacks) return 0;
+    int n = s_client->nacks;
+    for (int i = 0; i < n; ++i) s_client->acks[(s_client->ack_head + i) % MAX_ACKS].due_us = kernel_now_us();
+    wake_task(s_client, kernel_now_us());
+    return n;
+}
+
+const char* host_mqtt_retained(const char* topic) {
+    for (retained_t* r = s_retained; r; r = r->next) {
+        if (strcmp(r->topic, topic) == 0) return r->payload;
+    }
+    return NULL;
+}
+
+uint32_t host_mqtt_publish_count(void) {
+    return s_publishes;
+}
+
+void host_mqtt_reset_log(void) {
+    while (s_retained) {
+        retained_t* r = s_retained;
+        s_retained = r->next;
+        free(r->topic);
+        free(r->payload);
+        free(r);
+    }
+    s_publishes = 0;
+}
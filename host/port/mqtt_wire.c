@@ -0,0 +1,240 @@
+// MQTT 3.1.1 packets over plain TCP, just what the client stand-in and the
+// fleet tools need: QoS 0/1, retained messages, a will, keepalive pings.
+#include "mqtt_wire.h"
+
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+int mqtt_wire_dial(const char* uri) {
+    char host[128];
+    int port = 1883;
+    if (strncmp(uri, "mqtt://", 7) == 0) uri += 7;
+    snprintf(host, sizeof(host), "%s", uri);
+    char* colon = strrchr(host, ':');
+    if (colon) {
+        *colon = 0;
+        port = atoi(colon + 1);
+    }
+    char* slash = strchr(colon ? colon + 1 : host, '/');
+    if (slash) *slash = 0;
+
+    char service[8];
+    snprintf(service, sizeof(service), "%d", port);
+    struct addrinfo hints = { .ai_family = AF_UNSPEC, .ai_socktype = SOCK_STREAM };
+    struct addrinfo* res = NULL;
+    if (getaddrinfo(host, service, &hints, &res) != 0) return -1;
+    int fd = -1;
+    for (struct addrinfo* a = res; a; a = a->ai_next) {
+        fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+        if (fd < 0) continue;
+        if (connect(fd, a->ai_addr, a->ai_addrlen) == 0) break;
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(res);
+    if (fd >= 0) {
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+    return fd;
+}
+
+bool mqtt_wire_write(int fd, const void* buf, size_t len) {
+    const uint8_t* p = buf;
+    while (len) {
+        ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        len -= (size_t)n;
+    }
+    return true;
+}
+
+// ---- Encoding ----------------------------------------------------------------------
+
+typedef struct {
+    uint8_t* p;
+    size_t len;
+    size_t cap;
+} out_t;
+
+static void put(out_t* o, const void* src, size_t n) {
+    if (o->len + n <= o->cap) memcpy(o->p + o->len, src, n);
+    o->len += n;
+}
+
+static void put_u8(out_t* o, uint8_t v) {
+    put(o, &v, 1);
+}
+
+static void put_u16(out_t* o, uint16_t v) {
+    uint8_t b[2] = { (uint8_t)(v >> 8), (uint8_t)v };
+    put(o, b, 2);
+}
+
+static void put_str(out_t* o, const char* s, size_t n) {
+    put_u16(o, (uint16_t)n);
+    put(o, s, n);
+}
+
+// Fixed header in front of a body of body_len bytes
+static void put_header(out_t* o, uint8_t first, size_t body_len) {
+    put_u8(o, first);
+    do {
+        uint8_t b = body_len % 128;
+        body_len /= 128;
+        put_u8(o, body_len ? b | 0x80 : b);
+    } while (body_len);
+}
+
+static size_t done(const out_t* o) {
+    return o->len <= o->cap ? o->len : 0;
+}
+
+size_t mqtt_wire_connect(uint8_t* buf, size_t cap, const mqtt_wire_connect_t* c) {
+    size_t id = strlen(c->client_id);
+    size_t body = 10 + 2 + id;
+    uint8_t flags = 0x02; // clean session
+    if (c->will_topic) {
+        body += 2 + strlen(c->will_topic) + 2 + strlen(c->will_msg);
+        flags |= 0x04 | (uint8_t)(c->will_qos << 3) | (c->will_retain ? 0x20 : 0);
+    }
+    if (c->username) {
+        body += 2 + strlen(c->username);
+        flags |= 0x80;
+    }
+    if (c->username && c->password) {
+        body += 2 + strlen(c->password);
+        flags |= 0x40;
+    }
+    out_t o = { buf, 0, cap };
+    put_header(&o, MQTT_PKT_CONNECT << 4, body);
+    put_str(&o, "MQTT", 4);
+    put_u8(&o, 4); // 3.1.1
+    put_u8(&o, flags);
+    put_u16(&o, (uint16_t)c->keepalive_s);
+    put_str(&o, c->client_id, id);
+    if (c->will_topic) {
+        put_str(&o, c->will_topic, strlen(c->will_topic));
+        put_str(&o, c->will_msg, strlen(c->will_msg));
+    }
+    if (c->username) put_str(&o, c->username, strlen(c->username));
+    if (c->username && c->password) put_str(&o, c->password, strlen(c->password));
+    return done(&o);
+}
+
+size_t mqtt_wire_publish(uint8_t* buf, size_t cap, const char* topic, const void* data, int len, int qos,
+                         bool retain, int msg_id) {
+    size_t tlen = strlen(topic);
+    size_t body = 2 + tlen + (qos ? 2 : 0) + (size_t)len;
+    out_t o = { buf, 0, cap };
+    put_header(&o, (uint8_t)(MQTT_PKT_PUBLISH << 4 | qos << 1 | (retain ? 1 : 0)), body);
+    put_str(&o, topic, tlen);
+    if (qos) put_u16(&o, (uint16_t)msg_id);
+    put(&o, data, (size_t)len);
+    return done(&o);
+}
+
+size_t mqtt_wire_subscribe(uint8_t* buf, size_t cap, int msg_id, const char* filter, int qos) {
+    size_t flen = strlen(filter);
+    out_t o = { buf, 0, cap };
+    put_header(&o, MQTT_PKT_SUBSCRIBE << 4 | 0x02, 2 + 2 + flen + 1);
+    put_u16(&o, (uint16_t)msg_id);
+    put_str(&o, filter, flen);
+    put_u8(&o, (uint8_t)qos);
+    return done(&o);
+}
+
+size_t mqtt_wire_unsubscribe(uint8_t* buf, size_t cap, int msg_id, const char* filter) {
+    size_t flen = strlen(filter);
+    out_t o = { buf, 0, cap };
+    put_header(&o, MQTT_PKT_UNSUBSCRIBE << 4 | 0x02, 2 + 2 + flen);
+    put_u16(&o, (uint16_t)msg_id);
+    put_str(&o, filter, flen);
+    return done(&o);
+}
+
+size_t mqtt_wire_short(uint8_t* buf, size_t cap, int type, int msg_id) {
+    out_t o = { buf, 0, cap };
+    if (type == MQTT_PKT_PUBACK) {
+        put_header(&o, MQTT_PKT_PUBACK << 4, 2);
+        put_u16(&o, (uint16_t)msg_id);
+    } else {
+        put_header(&o, (uint8_t)(type << 4), 0);
+    }
+    return done(&o);
+}
+
+// ---- Decoding ----------------------------------------------------------------------
+
+static bool read_full(int fd, void* buf, size_t len) {
+    uint8_t* p = buf;
+    while (len) {
+        ssize_t n = recv(fd, p, len, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        len -= (size_t)n;
+    }
+    return true;
+}
+
+bool mqtt_wire_read(mqtt_wire_reader_t* r, int fd, mqtt_wire_pkt_t* out) {
+    uint8_t first;
+    if (!read_full(fd, &first, 1)) return false;
+    uint32_t len = 0;
+    for (int shift = 0;; shift += 7) {
+        uint8_t b;
+        if (shift > 21 || !read_full(fd, &b, 1)) return false;
+        len |= (uint32_t)(b & 0x7f) << shift;
+        if (!(b & 0x80)) break;
+    }
+    if (len + 1 > r->cap) {
+        uint8_t* p = realloc(r->buf, len + 1);
+        if (!p) return false;
+        r->buf = p;
+        r->cap = len + 1;
+    }
+    if (!read_full(fd, r->buf, len)) return false;
+    r->buf[len] = 0;
+    *out = (mqtt_wire_pkt_t){ .type = first >> 4, .flags = first & 0x0f, .body = r->buf, .len = len };
+    return true;
+}
+
+void mqtt_wire_reader_free(mqtt_wire_reader_t* r) {
+    free(r->buf);
+    r->buf = NULL;
+    r->cap = 0;
+}
+
+bool mqtt_wire_parse_publish(const mqtt_wire_pkt_t* p, mqtt_wire_publish_t* out) {
+    if (p->type != MQTT_PKT_PUBLISH || p->len < 2) return false;
+    int tlen = p->body[0] << 8 | p->body[1];
+    int qos = (p->flags >> 1) & 3;
+    uint32_t head = 2 + (uint32_t)tlen + (qos ? 2 : 0);
+    if (head > p->len) return false;
+    *out = (mqtt_wire_publish_t){
+        .topic = (const char*)p->body + 2,
+        .topic_len = tlen,
+        .data = (const char*)p->body + head,
+        .len = (int)(p->len - head),
+        .qos = qos,
+        .retain = p->flags & 1,
+        .msg_id = qos ? p->body[2 + tlen] << 8 | p->body[3 + tlen] : 0,
+    };
+    return true;
+}
+
+int mqtt_wire_ack_id(const mqtt_wire_pkt_t* p) {
+    if (p->len < 2) return -1;
+    if (p->type == MQTT_PKT_CONNACK) return p->body[1];
+    return p->body[0] << 8 | p->body[1];
+}
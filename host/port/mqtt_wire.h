@@ -0,0 +1,75 @@
+#pragma once
+// MQTT 3.1.1 over a blocking TCP socket: packet encoding and a reader.
+// Independent of the task kernel, so tools outside the firmware (the fleet
+// harness's observer) use it as well as the client stand-in.
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+enum {
+    MQTT_PKT_CONNECT = 1,
+    MQTT_PKT_CONNACK = 2,
+    MQTT_PKT_PUBLISH = 3,
+    MQTT_PKT_PUBACK = 4,
+    MQTT_PKT_SUBSCRIBE = 8,
+    MQTT_PKT_SUBACK = 9,
+    MQTT_PKT_UNSUBSCRIBE = 10,
+    MQTT_PKT_UNSUBACK = 11,
+    MQTT_PKT_PINGREQ = 12,
+    MQTT_PKT_PINGRESP = 13,
+    MQTT_PKT_DISCONNECT = 14,
+};
+
+typedef struct {
+    const char* client_id;
+    const char* username; // NULL for none
+    const char* password;
+    const char* will_topic; // NULL for no will
+    const char* will_msg;
+    int will_qos;
+    bool will_retain;
+    int keepalive_s;
+} mqtt_wire_connect_t;
+
+typedef struct {
+    uint8_t type; // MQTT_PKT_*
+    uint8_t flags;
+    uint8_t* body;
+    uint32_t len;
+} mqtt_wire_pkt_t;
+
+typedef struct {
+    const char* topic; // not terminated
+    int topic_len;
+    const char* data;
+    int len;
+    int qos;
+    bool retain;
+    int msg_id;
+} mqtt_wire_publish_t;
+
+// mqtt://host[:port] (port 1883 by default); -1 when unreachable
+int mqtt_wire_dial(const char* uri);
+// Whole buffer, or false once the peer is gone
+bool mqtt_wire_write(int fd, const void* buf, size_t len);
+
+// Each returns the packet length in buf, 0 if it does not fit in cap
+size_t mqtt_wire_connect(uint8_t* buf, size_t cap, const mqtt_wire_connect_t* c);
+size_t mqtt_wire_publish(uint8_t* buf, size_t cap, const char* topic, const void* data, int len, int qos,
+                         bool retain, int msg_id);
+size_t mqtt_wire_subscribe(uint8_t* buf, size_t cap, int msg_id, const char* filter, int qos);
+size_t mqtt_wire_unsubscribe(uint8_t* buf, size_t cap, int msg_id, const char* filter);
+size_t mqtt_wire_short(uint8_t* buf, size_t cap, int type, int msg_id); // PUBACK, PINGREQ, DISCONNECT
+
+// Next whole packet; the body stays valid until the next call. False on
+// EOF, a socket error or a malformed length.
+typedef struct {
+    uint8_t* buf;
+    size_t cap;
+} mqtt_wire_reader_t;
+
+bool mqtt_wire_read(mqtt_wire_reader_t* r, int fd, mqtt_wire_pkt_t* out);
+void mqtt_wire_reader_free(mqtt_wire_reader_t* r);
+bool mqtt_wire_parse_publish(const mqtt_wire_pkt_t* p, mqtt_wire_publish_t* out);
+// Packet identifier of a PUBACK/SUBACK, or the CONNACK return code
+int mqtt_wire_ack_id(const mqtt_wire_pkt_t* p);
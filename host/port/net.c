@@ -0,0 +1,399 @@
+// Default event loop, Wi-Fi station, netif, SNTP and HTTP client. Wi-Fi
+// association and DHCP are modelled as fixed latencies on the virtual clock;
+// there is no real network, so HTTP requests fail to connect.
+#include "esp_event.h"
+#include "esp_http_client.h"
+#include "esp_netif.h"
+#include "esp_sntp.h"
+#include "esp_wifi.h"
+#include "host.h"
+#include "host_kernel.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+esp_event_base_t WIFI_EVENT = "WIFI_EVENT";
+esp_event_base_t IP_EVENT = "IP_EVENT";
+
+// ---- Event loop --------------------------------------------------------------------
+// Events are copied and run from a "sys_evt" task at the IDF default priority
+
+#define EVT_TASK_PRIO 20
+#define EVT_HANDLERS  16
+#define EVT_QUEUE     32
+
+typedef union {
+    wifi_event_sta_connected_t connected;
+    wifi_event_sta_disconnected_t disconnected;
+    ip_event_got_ip_t got_ip;
+} evt_data_t;
+
+typedef struct {
+    esp_event_base_t base;
+    int32_t id;
+    int64_t due_us;
+    evt_data_t data;
+} evt_t;
+
+static struct {
+    esp_event_base_t base;
+    int32_t id;
+    esp_event_handler_t fn;
+    void* arg;
+} s_handlers[EVT_HANDLERS];
+static int s_nhandlers;
+static evt_t s_events[EVT_QUEUE];
+static int s_nevents;
+static bool s_loop;
+
+static void evt_task(void* arg) {
+    (void)arg;
+    for (;;) {
+        int64_t wake = KERNEL_FOREVER;
+        int due = -1;
+        for (int i = 0; i < s_nevents; ++i) {
+            if (s_events[i].due_us < wake) {
+                wake = s_events[i].due_us;
+                due = i;
+            }
+        }
+        if (due < 0 || wake > kernel_now_us()) {
+            kernel_wait(s_events, wake);
+            continue;
+        }
+        evt_t ev = s_events[due];
+        memmove(&s_events[due], &s_events[due + 1], sizeof(ev) * (size_t)(s_nevents - due - 1));
+        s_nevents--;
+        if (ev.base == IP_EVENT && ev.id == IP_EVENT_STA_GOT_IP) host_mqtt_link(true);
+        if (ev.base == WIFI_EVENT && ev.id == WIFI_EVENT_STA_DISCONNECTED) host_mqtt_link(false);
+        for (int i = 0; i < s_nhandlers; ++i) {
+            if (s_handlers[i].base == ev.base && (s_handlers[i].id == ESP_EVENT_ANY_ID || s_handlers[i].id == ev.id)) {
+                s_handlers[i].fn(s_handlers[i].arg, ev.base, ev.id, &ev.data);
+            }
+        }
+    }
+}
+
+// Earlier-posted events with the same due time are delivered first
+static void post_after(esp_event_base_t base, int32_t id, const void* data, size_t len, int64_t delay_us) {
+    if (s_nevents == EVT_QUEUE) return; // dropped, like a full IDF event queue
+    evt_t* ev = &s_events[s_nevents++];
+    memset(ev, 0, sizeof(*ev));
+    ev->base = base;
+    ev->id = id;
+    ev->due_us = kernel_now_us() + delay_us;
+    if (data) memcpy(&ev->data, data, len);
+    kernel_signal(s_events);
+}
+
+esp_err_t esp_event_loop_create_default(void) {
+    if (s_loop) return ESP_ERR_INVALID_STATE;
+    s_loop = true;
+    return xTaskCreatePinnedToCore(evt_task, "sys_evt", 2304, NULL, EVT_TASK_PRIO, NULL, 0) == pdPASS
+               ? ESP_OK
+               : ESP_ERR_NO_MEM;
+}
+
+esp_err_t esp_event_handler_register(esp_event_base_t base, int32_t id, esp_event_handler_t fn, void* arg) {
+    if (!fn) return ESP_ERR_INVALID_ARG;
+    if (s_nhandlers == EVT_HANDLERS) return ESP_ERR_NO_MEM;
+    s_handlers[s_nhandlers].base = base;
+    s_handlers[s_nhandlers].id = id;
+    s_handlers[s_nhandlers].fn = fn;
+    s_handlers[s_nhandlers].arg = arg;
+    s_nhandlers++;
+    return ESP_OK;
+}
+
+esp_err_t esp_event_handler_instance_register(esp_event_base_t base, int32_t id, esp_event_handler_t fn, void* arg,
+                                              esp_event_handler_instance_t* out) {
+    if (out) *out = NULL;
+    return esp_event_handler_register(base, id, fn, arg);
+}
+
+// ---- Wi-Fi ---------------------------------------------------------------------------
+
+#define WIFI_SCAN_US    2500000 // full scan before NO_AP_FOUND
+#define WIFI_ASSOC_US   400000  // scan + auth + assoc
+#define WIFI_FAST_US    120000  // known BSSID and channel
+#define WIFI_BEACON_US  6000000 // AP lost to BEACON_TIMEOUT
+#define DHCP_US         80000
+
+static const uint8_t s_bssid[6] = { 0x02, 0x11, 0x22, 0x33, 0x44, 0x55 };
+static const uint8_t s_channel = 6;
+
+static wifi_config_t s_wifi_cfg;
+static bool s_ap_up = true;
+static bool s_started;
+static bool s_associated;
+static bool s_dhcp = true;
+static esp_netif_ip_info_t s_ip;
+static esp_netif_dns_info_t s_dns;
+
+void host_wifi_set_ap(bool up) {
+    s_ap_up = up;
+    if (!up && s_associated) {
+        s_associated = false;
+        wifi_event_sta_disconnected_t ev = { .reason = WIFI_REASON_BEACON_TIMEOUT, .rssi = -90 };
+        post_after(WIFI_EVENT, WIFI_EVENT_STA_DISCONNECTED, &ev, sizeof(ev), WIFI_BEACON_US);
+    }
+}
+
+esp_err_t esp_wifi_init(const wifi_init_config_t* cfg) {
+    (void)cfg;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_mode(wifi_mode_t mode) {
+    (void)mode;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_storage(wifi_storage_t storage) {
+    (void)storage;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_ps(wifi_ps_type_t type) {
+    (void)type;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_config(wifi_interface_t iface, wifi_config_t* cfg) {
+    (void)iface;
+    if (!cfg) return ESP_ERR_INVALID_ARG;
+    s_wifi_cfg = *cfg;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_get_config(wifi_interface_t iface, wifi_config_t* cfg) {
+    (void)iface;
+    if (!cfg) return ESP_ERR_INVALID_ARG;
+    *cfg = s_wifi_cfg;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_start(void) {
+    if (s_started) return ESP_OK;
+    s_started = true;
+    post_after(WIFI_EVENT, WIFI_EVENT_STA_START, NULL, 0, 1000);
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_connect(void) {
+    if (!s_started) return ESP_ERR_INVALID_STATE;
+    if (s_associated) return ESP_OK;
+    const wifi_sta_config_t* sta = &s_wifi_cfg.sta;
+    if (!s_ap_up) {
+        wifi_event_sta_disconnected_t ev = { .reason = WIFI_REASON_NO_AP_FOUND };
+        post_after(WIFI_EVENT, WIFI_EVENT_STA_DISCONNECTED, &ev, sizeof(ev), WIFI_SCAN_US);
+        return ESP_OK;
+    }
+    // A stale BSSID/channel hint fails like the real driver's directed probe
+    bool hinted = sta->bssid_set || sta->channel;
+    bool hint_ok = (!sta->bssid_set || memcmp(sta->bssid, s_bssid, 6) == 0) &&
+                   (!sta->channel || sta->channel == s_channel);
+    if (hinted && !hint_ok) {
+        wifi_event_sta_disconnected_t ev = { .reason = WIFI_REASON_NO_AP_FOUND };
+        post_after(WIFI_EVENT, WIFI_EVENT_STA_DISCONNECTED, &ev, sizeof(ev), WIFI_FAST_US);
+        return ESP_OK;
+    }
+    int64_t t = hinted ? WIFI_FAST_US : WIFI_ASSOC_US;
+    s_associated = true;
+    wifi_event_sta_connected_t conn = { .channel = s_channel, .authmode = WIFI_AUTH_WPA2_PSK };
+    memcpy(conn.bssid, s_bssid, 6);
+    post_after(WIFI_EVENT, WIFI_EVENT_STA_CONNECTED, &conn, sizeof(conn), t);
+    if (s_dhcp) {
+        s_ip.ip.addr = 0x6401a8c0; // 192.168.1.100
+        s_ip.gw.addr = 0x0101a8c0;
+        s_ip.netmask.addr = 0x00ffffff;
+        s_dns.ip.u_addr.ip4.addr = 0x0101a8c0;
+    }
+    ip_event_got_ip_t ip = { .ip_info = s_ip, .ip_changed = true };
+    post_after(IP_EVENT, IP_EVENT_STA_GOT_IP, &ip, sizeof(ip), t + (s_dhcp ? DHCP_US : 1000));
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_disconnect(void) {
+    if (!s_associated) return ESP_OK;
+    s_associated = false;
+    wifi_event_sta_disconnected_t ev = { .reason = WIFI_REASON_ASSOC_LEAVE };
+    post_after(WIFI_EVENT, WIFI_EVENT_STA_DISCONNECTED, &ev, sizeof(ev), 1000);
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_sta_get_ap_info(wifi_ap_record_t* info) {
+    if (!s_associated) return ESP_ERR_INVALID_STATE;
+    memset(info, 0, sizeof(*info));
+    memcpy(info->bssid, s_bssid, 6);
+    info->primary = s_channel;
+    info->rssi = -55;
+    return ESP_OK;
+}
+
+// ---- Netif ---------------------------------------------------------------------------
+
+static int s_netif_obj;
+
+esp_err_t esp_netif_init(void) {
+    return ESP_OK;
+}
+
+esp_netif_t* esp_netif_create_default_wifi_sta(void) {
+    return (esp_netif_t*)&s_netif_obj;
+}
+
+esp_err_t esp_netif_dhcpc_stop(esp_netif_t* netif) {
+    (void)netif;
+    s_dhcp = false;
+    return ESP_OK;
+}
+
+esp_err_t esp_netif_dhcpc_start(esp_netif_t* netif) {
+    (void)netif;
+    s_dhcp = true;
+    return ESP_OK;
+}
+
+esp_err_t esp_netif_set_ip_info(esp_netif_t* netif, const esp_netif_ip_info_t* info) {
+    (void)netif;
+    if (!info || s_dhcp) return ESP_ERR_INVALID_STATE;
+    s_ip = *info;
+    return ESP_OK;
+}
+
+esp_err_t esp_netif_get_ip_info(esp_netif_t* netif, esp_netif_ip_info_t* info) {
+    (void)netif;
+    *info = s_ip;
+    return ESP_OK;
+}
+
+esp_err_t esp_netif_set_dns_info(esp_netif_t* netif, esp_netif_dns_type_t type, esp_netif_dns_info_t* dns) {
+    (void)netif;
+    if (type != ESP_NETIF_DNS_MAIN || !dns) return ESP_ERR_INVALID_ARG;
+    s_dns = *dns;
+    return ESP_OK;
+}
+
+esp_err_t esp_netif_get_dns_info(esp_netif_t* netif, esp_netif_dns_type_t type, esp_netif_dns_info_t* dns) {
+    (void)netif;
+    if (type != ESP_NETIF_DNS_MAIN || !dns) return ESP_ERR_INVALID_ARG;
+    *dns = s_dns;
+    return ESP_OK;
+}
+
+// ---- SNTP ------------------------------------------------------------------------------
+// sntp_sync_time() comes from main/time_sync.c, as on the target
+
+static bool s_sntp_on;
+static sntp_sync_time_cb_t s_sntp_cb;
+static sntp_sync_status_t s_sntp_status;
+
+void sntp_setoperatingmode(int mode) {
+    (void)mode;
+}
+
+void sntp_setservername(int idx, const char* name) {
+    (void)idx;
+    (void)name;
+}
+
+void sntp_init(void) {
+    s_sntp_on = true;
+}
+
+void sntp_stop(void) {
+    s_sntp_on = false;
+}
+
+bool sntp_restart(void) {
+    return s_sntp_on;
+}
+
+bool sntp_enabled(void) {
+    return s_sntp_on;
+}
+
+void sntp_set_time_sync_notification_cb(sntp_sync_time_cb_t cb) {
+    s_sntp_cb = cb;
+}
+
+void sntp_set_sync_mode(sntp_sync_mode_t mode) {
+    (void)mode;
+}
+
+void sntp_set_sync_status(sntp_sync_status_t status) {
+    s_sntp_status = status;
+}
+
+sntp_sync_status_t sntp_get_sync_status(void) {
+    return s_sntp_status;
+}
+
+void sntp_set_sync_interval(uint32_t ms) {
+    (void)ms;
+}
+
+bool host_sntp_reply(int64_t epoch_s) {
+    if (!s_sntp_on) return false;
+    struct timeval tv = { .tv_sec = (time_t)epoch_s };
+    // As in lwIP: only sntp_sync_time() runs the notification callback
+    sntp_sync_time(&tv);
+    return true;
+}
+
+// ---- HTTP client ---------------------------------------------------------------------
+
+struct esp_http_client {
+    int unused;
+};
+
+esp_http_client_handle_t esp_http_client_init(const esp_http_client_config_t* cfg) {
+    (void)cfg;
+    return calloc(1, sizeof(struct esp_http_client));
+}
+
+esp_err_t esp_http_client_open(esp_http_client_handle_t c, int write_len) {
+    (void)c;
+    (void)write_len;
+    return ESP_FAIL;
+}
+
+int64_t esp_http_client_fetch_headers(esp_http_client_handle_t c) {
+    (void)c;
+    return -1;
+}
+
+int esp_http_client_read(esp_http_client_handle_t c, char* buf, int len) {
+    (void)c;
+    (void)buf;
+    (void)len;
+    return -1;
+}
+
+int esp_http_client_get_status_code(esp_http_client_handle_t c) {
+    (void)c;
+    return 0;
+}
+
+esp_err_t esp_http_client_set_header(esp_http_client_handle_t c, const char* key, const char* value) {
+    (void)c;
+    (void)key;
+    (void)value;
+    return ESP_OK;
+}
+
+bool esp_http_client_is_complete_data_received(esp_http_client_handle_t c) {
+    (void)c;
+    return false;
+}
+
+esp_err_t esp_http_client_close(esp_http_client_handle_t c) {
+    (void)c;
+    return ESP_OK;
+}
+
+esp_err_t esp_http_client_cleanup(esp_http_client_handle_t c) {
+    free(c);
+    return ESP_OK;
+}
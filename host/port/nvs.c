@@ -0,0 +1,251 @@
+// NVS backed by one file per state directory (<dir>/nvs.bin), rewritten on
+// every nvs_commit(), so settings survive between runs like flash would.
+// Without a directory the store lives in RAM only.
+#include "nvs.h"
+#include "nvs_flash.h"
+#include "host_kernel.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NVS_MAGIC      0x31564e48 // "HNV1"
+#define NVS_NAMESPACES 8
+
+typedef enum {
+    T_U32 = 1,
+    T_STR,
+    T_BLOB,
+} item_type_t;
+
+typedef struct item {
+    uint8_t type;
+    char ns[NVS_KEY_NAME_MAX_SIZE];
+    char key[NVS_KEY_NAME_MAX_SIZE];
+    uint32_t len;
+    uint8_t* data;
+    struct item* next;
+} item_t;
+
+static char s_path[512];
+static bool s_init;
+static item_t* s_items;
+static char s_ns[NVS_NAMESPACES][NVS_KEY_NAME_MAX_SIZE];
+static bool s_ns_rw[NVS_NAMESPACES];
+
+void host_nvs_set_dir(const char* dir) {
+    s_path[0] = 0;
+    if (dir) snprintf(s_path, sizeof(s_path), "%s/nvs.bin", dir);
+}
+
+static void clear(void) {
+    while (s_items) {
+        item_t* it = s_items;
+        s_items = it->next;
+        free(it->data);
+        free(it);
+    }
+}
+
+static item_t* find(const char* ns, const char* key) {
+    for (item_t* it = s_items; it; it = it->next) {
+        if (strcmp(it->ns, ns) == 0 && strcmp(it->key, key) == 0) return it;
+    }
+    return NULL;
+}
+
+static esp_err_t put(const char* ns, const char* key, uint8_t type, const void* data, uint32_t len) {
+    item_t* it = find(ns, key);
+    uint8_t* copy = malloc(len ? len : 1);
+    if (!copy) return ESP_ERR_NO_MEM;
+    memcpy(copy, data, len);
+    if (!it) {
+        it = calloc(1, sizeof(*it));
+        if (!it) {
+            free(copy);
+            return ESP_ERR_NO_MEM;
+        }
+        snprintf(it->ns, sizeof(it->ns), "%s", ns);
+        snprintf(it->key, sizeof(it->key), "%s", key);
+        it->next = s_items;
+        s_items = it;
+    }
+    free(it->data);
+    it->type = type;
+    it->data = copy;
+    it->len = len;
+    return ESP_OK;
+}
+
+static esp_err_t load(void) {
+    clear();
+    if (!s_path[0]) return ESP_OK;
+    FILE* f = fopen(s_path, "rb");
+    if (!f) return ESP_OK; // first boot
+    uint32_t magic = 0;
+    esp_err_t err = ESP_OK;
+    if (fread(&magic, sizeof(magic), 1, f) != 1 || magic != NVS_MAGIC) {
+        err = ESP_ERR_NVS_NEW_VERSION_FOUND;
+    }
+    item_t hdr;
+    while (err == ESP_OK && fread(&hdr.type, 1, 1, f) == 1) {
+        if (fread(hdr.ns, sizeof(hdr.ns), 1, f) != 1 || fread(hdr.key, sizeof(hdr.key), 1, f) != 1 ||
+            fread(&hdr.len, sizeof(hdr.len), 1, f) != 1 || hdr.len > 64 * 1024) {
+            err = ESP_ERR_NVS_NEW_VERSION_FOUND;
+            break;
+        }
+        uint8_t* data = malloc(hdr.len ? hdr.len : 1);
+        if (!data || fread(data, 1, hdr.len, f) != hdr.len) {
+            free(data);
+            err = ESP_ERR_NVS_NEW_VERSION_FOUND;
+            break;
+        }
+        hdr.ns[sizeof(hdr.ns) - 1] = hdr.key[sizeof(hdr.key) - 1] = 0;
+        err = put(hdr.ns, hdr.key, hdr.type, data, hdr.len);
+        free(data);
+    }
+    fclose(f);
+    return err;
+}
+
+static esp_err_t save(void) {
+    if (!s_path[0]) return ESP_OK;
+    char tmp[sizeof(s_path) + 4];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", s_path);
+    FILE* f = fopen(tmp, "wb");
+    if (!f) return ESP_FAIL;
+    uint32_t magic = NVS_MAGIC;
+    bool ok = fwrite(&magic, sizeof(magic), 1, f) == 1;
+    for (item_t* it = s_items; it && ok; it = it->next) {
+        ok = fwrite(&it->type, 1, 1, f) == 1 && fwrite(it->ns, sizeof(it->ns), 1, f) == 1 &&
+             fwrite(it->key, sizeof(it->key), 1, f) == 1 && fwrite(&it->len, sizeof(it->len), 1, f) == 1 &&
+             fwrite(it->data, 1, it->len, f) == it->len;
+    }
+    ok = fclose(f) == 0 && ok;
+    if (!ok || rename(tmp, s_path) != 0) {
+        remove(tmp);
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+esp_err_t nvs_flash_init(void) {
+    if (s_init) return ESP_OK;
+    esp_err_t err = load();
+    s_init = err == ESP_OK;
+    return err;
+}
+
+esp_err_t nvs_flash_erase(void) {
+    clear();
+    s_init = false;
+    if (s_path[0]) remove(s_path);
+    return ESP_OK;
+}
+
+esp_err_t nvs_open(const char* ns, nvs_open_mode_t mode, nvs_handle_t* out) {
+    if (!s_init) return ESP_ERR_NVS_NOT_INITIALIZED;
+    if (!ns || strlen(ns) >= NVS_KEY_NAME_MAX_SIZE || !out) return ESP_ERR_INVALID_ARG;
+    for (int i = 0; i < NVS_NAMESPACES; ++i) {
+        if (!s_ns[i][0] || strcmp(s_ns[i], ns) == 0) {
+            snprintf(s_ns[i], sizeof(s_ns[i]), "%s", ns);
+            s_ns_rw[i] = s_ns_rw[i] || mode == NVS_READWRITE;
+            *out = (nvs_handle_t)(i + 1);
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_NO_MEM;
+}
+
+void nvs_close(nvs_handle_t h) {
+    (void)h;
+}
+
+static const char* handle_ns(nvs_handle_t h) {
+    return h >= 1 && h <= NVS_NAMESPACES && s_ns[h - 1][0] ? s_ns[h - 1] : NULL;
+}
+
+static esp_err_t check(nvs_handle_t h, const char* key, bool write) {
+    if (!s_init) return ESP_ERR_NVS_NOT_INITIALIZED;
+    if (!handle_ns(h)) return ESP_ERR_NVS_INVALID_HANDLE;
+    if (!key) return ESP_ERR_INVALID_ARG;
+    if (strlen(key) >= NVS_KEY_NAME_MAX_SIZE) return ESP_ERR_NVS_KEY_TOO_LONG;
+    if (write && !s_ns_rw[h - 1]) return ESP_ERR_NVS_READ_ONLY;
+    return ESP_OK;
+}
+
+static esp_err_t get(nvs_handle_t h, const char* key, uint8_t type, const item_t** out) {
+    esp_err_t err = check(h, key, false);
+    if (err != ESP_OK) return err;
+    const item_t* it = find(handle_ns(h), key);
+    if (!it || it->type != type) return ESP_ERR_NVS_NOT_FOUND;
+    *out = it;
+    return ESP_OK;
+}
+
+esp_err_t nvs_set_u32(nvs_handle_t h, const char* key, uint32_t v) {
+    esp_err_t err = check(h, key, true);
+    return err != ESP_OK ? err : put(handle_ns(h), key, T_U32, &v, sizeof(v));
+}
+
+esp_err_t nvs_get_u32(nvs_handle_t h, const char* key, uint32_t* out) {
+    const item_t* it;
+    esp_err_t err = get(h, key, T_U32, &it);
+    if (err == ESP_OK) memcpy(out, it->data, sizeof(*out));
+    return err;
+}
+
+esp_err_t nvs_set_str(nvs_handle_t h, const char* key, const char* v) {
+    esp_err_t err = check(h, key, true);
+    return err != ESP_OK ? err : put(handle_ns(h), key, T_STR, v, (uint32_t)strlen(v) + 1);
+}
+
+static esp_err_t get_sized(nvs_handle_t h, const char* key, uint8_t type, void* out, size_t* len) {
+    const item_t* it;
+    esp_err_t err = get(h, key, type, &it);
+    if (err != ESP_OK) return err;
+    if (!out) {
+        *len = it->len;
+        return ESP_OK;
+    }
+    if (*len < it->len) {
+        *len = it->len;
+        return ESP_ERR_NVS_INVALID_LENGTH;
+    }
+    memcpy(out, it->data, it->len);
+    *len = it->len;
+    return ESP_OK;
+}
+
+esp_err_t nvs_get_str(nvs_handle_t h, const char* key, char* out, size_t* len) {
+    return get_sized(h, key, T_STR, out, len);
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t h, const char* key, const void* v, size_t len) {
+    esp_err_t err = check(h, key, true);
+    return err != ESP_OK ? err : put(handle_ns(h), key, T_BLOB, v, (uint32_t)len);
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t h, const char* key, void* out, size_t* len) {
+    return get_sized(h, key, T_BLOB, out, len);
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t h, const char* key) {
+    esp_err_t err = check(h, key, true);
+    if (err != ESP_OK) return err;
+    for (item_t** p = &s_items; *p; p = &(*p)->next) {
+        item_t* it = *p;
+        if (strcmp(it->ns, handle_ns(h)) == 0 && strcmp(it->key, key) == 0) {
+            *p = it->next;
+            free(it->data);
+            free(it);
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_NVS_NOT_FOUND;
+}
+
+esp_err_t nvs_commit(nvs_handle_t h) {
+    if (!handle_ns(h)) return ESP_ERR_NVS_INVALID_HANDLE;
+    return save();
+}
@@ -0,0 +1,190 @@
+// I2C master with a simulated SCD41 at 0x62. Implements the commands
+// main/scd4x.c uses, with the sensor's 5 s measurement period, Sensirion
+// CRC-8 words, NACKs for commands the sensor rejects, and bus time at the
+// configured clock (the calling task blocks for it, as with the IDF driver).
+#include "driver/i2c.h"
+#include "host.h"
+#include "host_kernel.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SCD41_ADDR      0x62
+#define SCD41_PERIOD_US 5000000
+
+#define CMD_START_PERIODIC 0x21B1
+#define CMD_STOP_PERIODIC  0x3F86
+#define CMD_READ_MEAS      0xEC05
+#define CMD_REINIT         0x3646
+#define CMD_SERIAL         0x3682
+#define CMD_DATA_READY     0xE4B8
+
+static uint32_t s_clk_hz = 100000;
+static bool s_installed;
+static bool s_periodic;
+static int64_t s_start_us;
+static uint32_t s_consumed;    // measurements read since start
+static uint16_t s_pending_cmd; // command whose response the next read returns
+static uint32_t s_fail_next, s_corrupt_next;
+static uint32_t s_measurements;
+
+static host_scd41_sample_t* s_script;
+static size_t s_script_len, s_script_pos;
+static host_scd41_source_t s_source;
+static void* s_source_ctx;
+
+void host_scd41_script(const host_scd41_sample_t* samples, size_t n) {
+    free(s_script);
+    s_script = n ? malloc(n * sizeof(*samples)) : NULL;
+    if (s_script) memcpy(s_script, samples, n * sizeof(*samples));
+    s_script_len = s_script ? n : 0;
+    s_script_pos = 0;
+    s_source = NULL;
+}
+
+void host_scd41_set_source(host_scd41_source_t source, void* ctx) {
+    s_source = source;
+    s_source_ctx = ctx;
+}
+
+void host_scd41_fail_next(uint32_t n) {
+    s_fail_next = n;
+}
+
+void host_scd41_corrupt_next(uint32_t n) {
+    s_corrupt_next = n;
+}
+
+uint32_t host_scd41_measurements(void) {
+    return s_measurements;
+}
+
+static uint8_t crc8(const uint8_t* data, int len) {
+    uint8_t crc = 0xFF;
+    for (int i = 0; i < len; ++i) {
+        crc ^= data[i];
+        for (int b = 0; b < 8; ++b) crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x31) : (uint8_t)(crc << 1);
+    }
+    return crc;
+}
+
+static void put_word(uint8_t* out, uint16_t w) {
+    out[0] = (uint8_t)(w >> 8);
+    out[1] = (uint8_t)w;
+    out[2] = crc8(out, 2);
+}
+
+static uint16_t clamp_u16(double v) {
+    return v <= 0 ? 0 : v >= 65535 ? 65535 : (uint16_t)lround(v);
+}
+
+static uint32_t completed(void) {
+    return s_periodic ? (uint32_t)((kernel_now_us() - s_start_us) / SCD41_PERIOD_US) : 0;
+}
+
+static host_scd41_sample_t sample_at(int64_t t_us) {
+    if (s_source) return s_source(t_us, s_source_ctx);
+    if (s_script_len) {
+        host_scd41_sample_t s = s_script[s_script_pos];
+        s_script_pos = (s_script_pos + 1) % s_script_len;
+        return s;
+    }
+    return (host_scd41_sample_t){ 800.0f, 22.5f, 55.0f };
+}
+
+// Bus time for one transfer: address byte plus payload, 9 clocks per byte
+static void bus_delay(size_t bytes) {
+    int64_t us = (int64_t)(bytes + 1) * 9 * 1000000 / s_clk_hz;
+    kernel_wait(NULL, kernel_now_us() + us);
+}
+
+static bool nack(void) {
+    if (!s_fail_next) return false;
+    s_fail_next--;
+    return true;
+}
+
+esp_err_t i2c_param_config(i2c_port_t port, const i2c_config_t* conf) {
+    (void)port;
+    if (!conf || conf->mode != I2C_MODE_MASTER || !conf->master.clk_speed) return ESP_ERR_INVALID_ARG;
+    s_clk_hz = conf->master.clk_speed;
+    return ESP_OK;
+}
+
+esp_err_t i2c_driver_install(i2c_port_t port, i2c_mode_t mode, size_t rx, size_t tx, int flags) {
+    (void)port; (void)mode; (void)rx; (void)tx; (void)flags;
+    if (s_installed) return ESP_ERR_INVALID_STATE;
+    s_installed = true;
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_write_to_device(i2c_port_t port, uint8_t addr, const uint8_t* buf, size_t len, TickType_t ticks) {
+    (void)port; (void)ticks;
+    if (!s_installed) return ESP_ERR_INVALID_STATE;
+    bus_delay(len);
+    if (addr != SCD41_ADDR || len < 2 || nack()) return ESP_FAIL;
+    uint16_t cmd = (uint16_t)(buf[0] << 8 | buf[1]);
+    s_pending_cmd = 0;
+    switch (cmd) {
+        case CMD_START_PERIODIC:
+            if (s_periodic) return ESP_FAIL;
+            s_periodic = true;
+            s_start_us = kernel_now_us();
+            s_consumed = 0;
+            return ESP_OK;
+        case CMD_STOP_PERIODIC:
+            s_periodic = false;
+            return ESP_OK;
+        case CMD_REINIT:
+            // Only accepted in idle mode
+            return s_periodic ? ESP_FAIL : ESP_OK;
+        case CMD_READ_MEAS:
+        case CMD_DATA_READY:
+        case CMD_SERIAL:
+            s_pending_cmd = cmd;
+            return ESP_OK;
+        default:
+            return ESP_FAIL;
+    }
+}
+
+esp_err_t i2c_master_read_from_device(i2c_port_t port, uint8_t addr, uint8_t* buf, size_t len, TickType_t ticks) {
+    (void)port; (void)ticks;
+    if (!s_installed) return ESP_ERR_INVALID_STATE;
+    bus_delay(len);
+    uint16_t cmd = s_pending_cmd;
+    s_pending_cmd = 0;
+    if (addr != SCD41_ADDR || !cmd || nack()) return ESP_FAIL;
+
+    uint16_t words[3] = { 0 };
+    uint32_t done = completed();
+    switch (cmd) {
+        case CMD_DATA_READY:
+            words[0] = done > s_consumed ? 0x8006 : 0x8000;
+            break;
+        case CMD_SERIAL:
+            words[0] = 0xbe1a;
+            words[1] = 0x07fb;
+            words[2] = 0x3b0f;
+            break;
+        case CMD_READ_MEAS: {
+            // No new measurement: the sensor NACKs the read
+            if (done <= s_consumed) return ESP_FAIL;
+            s_consumed = done;
+            s_measurements++;
+            host_scd41_sample_t s = sample_at(s_start_us + (int64_t)done * SCD41_PERIOD_US);
+            words[0] = clamp_u16(s.co2_ppm);
+            words[1] = clamp_u16((s.temperature_c + 45.0) * 65535.0 / 175.0);
+            words[2] = clamp_u16(s.humidity_rh * 65535.0 / 100.0);
+            break;
+        }
+    }
+    memset(buf, 0xff, len);
+    for (size_t i = 0; i < 3 && i * 3 + 3 <= len; ++i) put_word(buf + i * 3, words[i]);
+    if (s_corrupt_next && len >= 3) {
+        s_corrupt_next--;
+        buf[2] ^= 0x5a;
+    }
+    return ESP_OK;
+}
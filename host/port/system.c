@@ -0,0 +1,267 @@
+// System services: logging, errors, identity, randomness, ROM CRC, the wall
+// clock on top of the virtual clock, and host_init().
+#include "host.h"
+#include "host_kernel.h"
+
+#include "esp_app_desc.h"
+#include "esp_cpu.h"
+#include "esp_log.h"
+#include "esp_rom_crc.h"
+#include "esp_system.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <time.h>
+
+// ---- Logging -------------------------------------------------------------------
+
+#define LOG_TAG_LEVELS 16
+
+static int s_log_level = ESP_LOG_WARN;
+static struct {
+    char tag[24];
+    int level;
+} s_tag_levels[LOG_TAG_LEVELS];
+
+void host_log_level(int level) {
+    s_log_level = level;
+}
+
+void esp_log_level_set(const char* tag, esp_log_level_t level) {
+    if (strcmp(tag, "*") == 0) {
+        s_log_level = level;
+        return;
+    }
+    for (int i = 0; i < LOG_TAG_LEVELS; ++i) {
+        if (!s_tag_levels[i].tag[0] || strcmp(s_tag_levels[i].tag, tag) == 0) {
+            snprintf(s_tag_levels[i].tag, sizeof(s_tag_levels[i].tag), "%s", tag);
+            s_tag_levels[i].level = level;
+            return;
+        }
+    }
+}
+
+static int tag_level(const char* tag) {
+    for (int i = 0; i < LOG_TAG_LEVELS && s_tag_levels[i].tag[0]; ++i) {
+        if (strcmp(s_tag_levels[i].tag, tag) == 0) return s_tag_levels[i].level;
+    }
+    return s_log_level;
+}
+
+uint32_t esp_log_timestamp(void) {
+    return (uint32_t)(kernel_now_us() / 1000);
+}
+
+void esp_log_writev(esp_log_level_t level, const char* tag, const char* format, va_list args) {
+    if (level == ESP_LOG_NONE || (int)level > tag_level(tag)) return;
+    static const char letters[] = "NEWIDV";
+    fprintf(stderr, "%c (%u) %s: ", letters[level], (unsigned)esp_log_timestamp(), tag);
+    vfprintf(stderr, format, args);
+    fputc('\n', stderr);
+}
+
+void esp_log_write(esp_log_level_t level, const char* tag, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    esp_log_writev(level, tag, format, args);
+    va_end(args);
+}
+
+// ---- Errors ----------------------------------------------------------------------
+
+const char* esp_err_to_name(esp_err_t code) {
+    switch (code) {
+        case ESP_OK: return "ESP_OK";
+        case ESP_FAIL: return "ESP_FAIL";
+        case ESP_ERR_NO_MEM: return "ESP_ERR_NO_MEM";
+        case ESP_ERR_INVALID_ARG: return "ESP_ERR_INVALID_ARG";
+        case ESP_ERR_INVALID_STATE: return "ESP_ERR_INVALID_STATE";
+        case ESP_ERR_INVALID_SIZE: return "ESP_ERR_INVALID_SIZE";
+        case ESP_ERR_NOT_FOUND: return "ESP_ERR_NOT_FOUND";
+        case ESP_ERR_NOT_SUPPORTED: return "ESP_ERR_NOT_SUPPORTED";
+        case ESP_ERR_TIMEOUT: return "ESP_ERR_TIMEOUT";
+        case ESP_ERR_INVALID_RESPONSE: return "ESP_ERR_INVALID_RESPONSE";
+        case ESP_ERR_INVALID_CRC: return "ESP_ERR_INVALID_CRC";
+        case ESP_ERR_INVALID_VERSION: return "ESP_ERR_INVALID_VERSION";
+        case ESP_ERR_NOT_FINISHED: return "ESP_ERR_NOT_FINISHED";
+        case ESP_ERR_NOT_ALLOWED: return "ESP_ERR_NOT_ALLOWED";
+        default: return "UNKNOWN ERROR";
+    }
+}
+
+void host_abort_on_error(esp_err_t err, const char* file, int line, const char* expr) {
+    fprintf(stderr, "ESP_ERROR_CHECK failed: %s (0x%x) at %s:%d\n  %s\n", esp_err_to_name(err), err, file, line, expr);
+    abort();
+}
+
+// ---- System ------------------------------------------------------------------------
+
+#define SHUTDOWN_HANDLERS 8
+
+static shutdown_handler_t s_shutdown[SHUTDOWN_HANDLERS];
+static uint32_t s_rand_state = 0x9e3779b9;
+static uint8_t s_mac[6] = { 0x24, 0x0a, 0xc4, 0x12, 0x34, 0x56 };
+
+esp_err_t esp_register_shutdown_handler(shutdown_handler_t handler) {
+    for (int i = 0; i < SHUTDOWN_HANDLERS; ++i) {
+        if (!s_shutdown[i]) {
+            s_shutdown[i] = handler;
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_NO_MEM;
+}
+
+// A restart ends the process; the caller decides whether to boot again
+void esp_restart(void) {
+    for (int i = SHUTDOWN_HANDLERS - 1; i >= 0; --i) {
+        if (s_shutdown[i]) s_shutdown[i]();
+    }
+    fprintf(stderr, "esp_restart() at %lld us\n", (long long)kernel_now_us());
+    exit(3);
+}
+
+esp_reset_reason_t esp_reset_reason(void) {
+    return ESP_RST_POWERON;
+}
+
+// Host heap usage says nothing about the target's; report a fixed figure
+uint32_t esp_get_free_heap_size(void) {
+    return 200 * 1024;
+}
+
+uint32_t esp_get_minimum_free_heap_size(void) {
+    return 200 * 1024;
+}
+
+// Deterministic so runs are repeatable; $HOST_SEED changes the sequence
+uint32_t esp_random(void) {
+    uint32_t x = s_rand_state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return s_rand_state = x;
+}
+
+void host_set_mac(const uint8_t mac[6]) {
+    memcpy(s_mac, mac, sizeof(s_mac));
+}
+
+esp_err_t esp_efuse_mac_get_default(uint8_t* mac) {
+    memcpy(mac, s_mac, sizeof(s_mac));
+    return ESP_OK;
+}
+
+const esp_app_desc_t* esp_app_get_description(void) {
+    static const esp_app_desc_t desc = {
+        .magic_word = 0xABCD5432,
+        .version = "host",
+        .project_name = "relay_scd41",
+        .idf_ver = "host",
+    };
+    return &desc;
+}
+
+int esp_cpu_get_core_id(void) {
+    return (int)host_task_core();
+}
+
+uint32_t esp_cpu_get_cycle_count(void) {
+    return (uint32_t)(kernel_now_us() * 240); // 240 MHz
+}
+
+// Byte-wise table CRC, as in ROM (same results as zlib's crc32)
+uint32_t esp_rom_crc32_le(uint32_t crc, uint8_t const* buf, uint32_t len) {
+    static uint32_t table[256];
+    if (!table[1]) {
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; ++k) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            table[i] = c;
+        }
+    }
+    crc = ~crc;
+    while (len--) crc = table[(crc ^ *buf++) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
+
+// ---- Wall clock ------------------------------------------------------------------------
+// The firmware's time(), gettimeofday() and settimeofday() resolve to these
+// instead of libc, so schedules and timestamps follow the virtual clock.
+
+static int64_t s_wall_offset_us; // wall time = offset + virtual clock
+
+void host_set_wall_time(int64_t epoch_s) {
+    s_wall_offset_us = epoch_s * 1000000LL - kernel_now_us();
+}
+
+time_t time(time_t* out) {
+    time_t t = (time_t)((s_wall_offset_us + kernel_now_us()) / 1000000LL);
+    if (out) *out = t;
+    return t;
+}
+
+int gettimeofday(struct timeval* restrict tv, void* restrict tz) {
+    (void)tz;
+    int64_t us = s_wall_offset_us + kernel_now_us();
+    tv->tv_sec = (time_t)(us / 1000000LL);
+    tv->tv_usec = (suseconds_t)(us % 1000000LL);
+    return 0;
+}
+
+int settimeofday(const struct timeval* tv, const struct timezone* tz) {
+    (void)tz;
+    if (tv) s_wall_offset_us = (int64_t)tv->tv_sec * 1000000LL + tv->tv_usec - kernel_now_us();
+    return 0;
+}
+
+// Applied at once rather than slewed; the firmware only sees the end result
+int adjtime(const struct timeval* delta, struct timeval* olddelta) {
+    if (delta) s_wall_offset_us += (int64_t)delta->tv_sec * 1000000LL + delta->tv_usec;
+    if (olddelta) *olddelta = (struct timeval){ 0 };
+    return 0;
+}
+
+// ---- Entry -----------------------------------------------------------------------------
+
+void host_init(const char* state_dir) {
+    const char* lvl = getenv("HOST_LOG_LEVEL");
+    if (lvl) s_log_level = atoi(lvl);
+    const char* seed = getenv("HOST_SEED");
+    if (seed && strtoul(seed, NULL, 0)) s_rand_state = (uint32_t)strtoul(seed, NULL, 0);
+    kernel_init();
+    host_timer_init();
+    host_nvs_set_dir(state_dir);
+}
+
+extern void app_main(void);
+
+static void app_main_task(void* arg) {
+    (void)arg;
+    app_main();
+    vTaskDelete(NULL);
+}
+
+void host_start_app(void) {
+    xTaskCreatePinnedToCore(app_main_task, "app_main", 8192, NULL, 1, NULL, 0);
+}
+
+void host_run_for(int64_t us) {
+    kernel_wait(NULL, kernel_now_us() + us);
+    kernel_run_idle();
+}
+
+void host_run_idle(void) {
+    kernel_run_idle();
+}
+
+void host_set_realtime(bool on) {
+    kernel_set_realtime(on);
+}
+
+int64_t host_now_us(void) {
+    return kernel_now_us();
+}
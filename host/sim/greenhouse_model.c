@@ -0,0 +1,90 @@
+// First-order exchange with the outside plus actuator terms, integrated
+// with explicit Euler in steps of at most 10 s. The constants give a small
+// hobby greenhouse: the heater holds it up to 14 C above outside, the fan
+// turns the air over in ten minutes.
+#include "greenhouse_model.h"
+
+#include <math.h>
+
+#define STEP_S 10.0
+
+#define LOSS_TAU_S     3600.0 // envelope heat loss
+#define SUN_HEAT_C_H   12.0
+#define HEATER_C_H     14.0
+#define FAN_TAU_S      600.0
+#define LEAK_TAU_S     7200.0 // infiltration with the fan off
+#define CO2_OUTSIDE    420.0
+#define CO2_DOSE_PPM_H 1500.0
+#define CO2_UPTAKE_H   500.0  // photosynthesis at full sun
+#define MIST_RH_H      40.0
+#define TRANSPIRE_RH_H 6.0
+
+static double sun_at(double hour) {
+    return hour > 6.0 && hour < 20.0 ? sin(M_PI * (hour - 6.0) / 14.0) : 0.0;
+}
+
+static double outside_temp(double hour) {
+    return 11.0 + 7.0 * sin(2.0 * M_PI * (hour - 9.0) / 24.0); // coldest ~03:00
+}
+
+static double outside_rh(double hour) {
+    return 75.0 - 20.0 * sin(2.0 * M_PI * (hour - 9.0) / 24.0);
+}
+
+void gh_model_init(gh_model_t* m, int64_t t_us, uint32_t seed) {
+    *m = (gh_model_t){
+        .in = { .temp_c = 16.0, .co2_ppm = 600.0, .rh = 70.0 },
+        .t_us = t_us,
+        .rng = seed ? seed : 1,
+    };
+}
+
+void gh_model_advance(gh_model_t* m, int64_t t_us, double local_hour) {
+    double left = (double)(t_us - m->t_us) / 1e6;
+    if (left <= 0) return;
+    // The hour is for t_us; walk it back to the start of the interval
+    double hour = local_hour - left / 3600.0;
+    gh_climate_t* c = &m->in;
+    while (left > 0) {
+        double dt = left < STEP_S ? left : STEP_S;
+        double h = fmod(hour + 24.0, 24.0);
+        double sun = sun_at(h);
+        double to = outside_temp(h);
+        double rho = outside_rh(h);
+        double fan = m->on[GH_FAN] ? 1.0 / FAN_TAU_S : 0.0;
+        double vent = 1.0 / LEAK_TAU_S + fan;
+
+        double dT = (to - c->temp_c) * (1.0 / LOSS_TAU_S + fan) +
+                    (sun * SUN_HEAT_C_H + (m->on[GH_HEATER] ? HEATER_C_H : 0.0)) / 3600.0;
+        double dC = (CO2_OUTSIDE - c->co2_ppm) * vent +
+                    ((m->on[GH_CO2] ? CO2_DOSE_PPM_H : 0.0) - sun * CO2_UPTAKE_H) / 3600.0;
+        double dRH = (rho - c->rh) * vent +
+                     ((m->on[GH_MISTER] ? MIST_RH_H : 0.0) + sun * TRANSPIRE_RH_H -
+                      (m->on[GH_HEATER] ? 4.0 : 0.0)) / 3600.0;
+
+        c->temp_c += dT * dt;
+        c->co2_ppm = fmax(250.0, c->co2_ppm + dC * dt);
+        c->rh = fmin(100.0, fmax(5.0, c->rh + dRH * dt));
+        c->sun = sun;
+        c->outside_c = to;
+        hour += dt / 3600.0;
+        left -= dt;
+    }
+    m->t_us = t_us;
+}
+
+static double noise(gh_model_t* m) {
+    uint32_t x = m->rng;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    m->rng = x;
+    return (double)x / 4294967296.0 * 2.0 - 1.0;
+}
+
+void gh_model_read(gh_model_t* m, float* co2, float* temp, float* rh) {
+    // Typical SCD41 repeatability: ±10 ppm, ±0.1 C, ±0.4 %RH
+    *co2 = (float)(m->in.co2_ppm + 10.0 * noise(m));
+    *temp = (float)(m->in.temp_c + 0.1 * noise(m));
+    *rh = (float)(m->in.rh + 0.4 * noise(m));
+}
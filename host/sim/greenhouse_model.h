@@ -0,0 +1,34 @@
+#pragma once
+// Lumped greenhouse climate: one air volume exchanging heat, CO2 and
+// moisture with the outside, driven by the sun and by the four relays.
+#include <stdbool.h>
+#include <stdint.h>
+
+enum {
+    GH_HEATER = 0, // relay 1
+    GH_FAN,        // relay 2: ventilation
+    GH_CO2,        // relay 3: CO2 dosing valve
+    GH_MISTER,     // relay 4
+    GH_ACTUATORS,
+};
+
+typedef struct {
+    double temp_c;
+    double co2_ppm;
+    double rh;
+    double sun; // 0..1
+    double outside_c;
+} gh_climate_t;
+
+typedef struct {
+    gh_climate_t in;
+    bool on[GH_ACTUATORS];
+    int64_t t_us; // model time the state is valid for
+    uint32_t rng;
+} gh_model_t;
+
+void gh_model_init(gh_model_t* m, int64_t t_us, uint32_t seed);
+// Integrate up to t_us; local_hour gives the sun position at that time
+void gh_model_advance(gh_model_t* m, int64_t t_us, double local_hour);
+// Sensor reading of the current state, with SCD41-like noise
+void gh_model_read(gh_model_t* m, float* co2, float* temp, float* rh);
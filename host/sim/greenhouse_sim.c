@@ -0,0 +1,496 @@
+// Greenhouse simulator: boots the firmware on the host port, with the SCD41
+// reading a greenhouse model whose heater, fan, CO2 valve and mister are the
+// four relays. A Home Assistant-like automation drives the relays over MQTT
+// from the published readings, so commands take the same path as in the
+// field: ha_mqtt dispatch, the control task, safety.c, relay.c, GPIO.
+//
+// Safety invariants are checked against the configuration the simulator
+// commanded, independently of safety.c:
+//   - no relay turns on while away mode is set, outside the schedule
+//     windows (when enforced) or before the clock was synced;
+//   - an on relay is switched off within GRACE_S of away mode, of its
+//     window closing, or of reaching its max-on time;
+//   - the retained relay states match the GPIOs while the broker is up,
+//     and availability is "offline" while it is down.
+//
+//   greenhouse_sim <scenario> [--days N] [--seed N] [--trace out.csv]
+#include "host.h"
+#include "greenhouse_model.h"
+
+#include "sdkconfig.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define STEP_S      1
+#define GRACE_S     2
+#define SYNC_EVERY  3600
+#define RELAY_GPIO0 8 // relays 1..4 are GPIO 8..11
+
+#ifndef CONFIG_SAFETY_AWAY_DEFAULT
+#define CONFIG_SAFETY_AWAY_DEFAULT 0
+#endif
+#ifndef CONFIG_SAFETY_SCHEDULE_ENFORCE_DEFAULT
+#define CONFIG_SAFETY_SCHEDULE_ENFORCE_DEFAULT 0
+#endif
+
+// ---- Scenarios ---------------------------------------------------------------------
+
+typedef enum {
+    ACT_MQTT,   // deliver payload on <base>/<topic>
+    ACT_BROKER, // broker reachable (arg 1) or not
+    ACT_AP,     // Wi-Fi access point up or down
+} act_kind_t;
+
+typedef struct {
+    int64_t at_s; // from the start of the run
+    act_kind_t kind;
+    const char* topic;
+    const char* payload;
+    int arg;
+} action_t;
+
+typedef struct {
+    const char* name;
+    const char* about;
+    const char* tz;
+    int64_t start; // UTC
+    int days;
+    double heat_on_below, heat_off_above;
+    int retry_s; // automation re-sends a state the device didn't take
+    void (*script)(int days);
+} scenario_t;
+
+#define MAX_ACTIONS 256
+static action_t s_actions[MAX_ACTIONS];
+static int s_nactions;
+
+static void at(int64_t at_s, act_kind_t kind, const char* topic, const char* payload, int arg) {
+    if (s_nactions < MAX_ACTIONS) s_actions[s_nactions++] = (action_t){ at_s, kind, topic, payload, arg };
+}
+
+static void script_max_on(int days) {
+    (void)days;
+    at(60, ACT_MQTT, "relay/1/max_on/set", "5", 0);
+    at(60, ACT_MQTT, "relay/2/max_on/set", "3", 0);
+    at(60, ACT_MQTT, "schedule/enforce/set", "OFF", 0);
+}
+
+// 22:00-02:00 local, plus nothing in the day
+static void script_midnight(int days) {
+    (void)days;
+    at(60, ACT_MQTT, "schedule/w1_start/set", "1320", 0);
+    at(60, ACT_MQTT, "schedule/w1_end/set", "120", 0);
+    at(60, ACT_MQTT, "schedule/w2_start/set", "0", 0);
+    at(60, ACT_MQTT, "schedule/w2_end/set", "0", 0);
+}
+
+// Windows straddling the 02:00-03:00 hour that is skipped or repeated
+static void script_dst(int days) {
+    (void)days;
+    at(60, ACT_MQTT, "schedule/w1_start/set", "90", 0);   // 01:30
+    at(60, ACT_MQTT, "schedule/w1_end/set", "210", 0);    // 03:30
+    at(60, ACT_MQTT, "schedule/w2_start/set", "1080", 0); // 18:00
+    at(60, ACT_MQTT, "schedule/w2_end/set", "1380", 0);   // 23:00
+}
+
+// Away 09:00-13:00 every day, from a UTC-midnight start
+static void script_away(int days) {
+    for (int d = 0; d < days; ++d) {
+        at(d * 86400 + 9 * 3600, ACT_MQTT, "mode/away/set", "ON", 0);
+        at(d * 86400 + 13 * 3600, ACT_MQTT, "mode/away/set", "OFF", 0);
+    }
+}
+
+static void script_outage(int days) {
+    for (int d = 0; d < days; ++d) {
+        int64_t day = d * 86400;
+        at(day + 7 * 3600, ACT_BROKER, NULL, NULL, 0);
+        at(day + 7 * 3600 + 900, ACT_BROKER, NULL, NULL, 1);
+        at(day + 14 * 3600, ACT_AP, NULL, NULL, 0);
+        at(day + 14 * 3600 + 1800, ACT_AP, NULL, NULL, 1);
+        at(day + 21 * 3600, ACT_BROKER, NULL, NULL, 0);
+        at(day + 23 * 3600, ACT_BROKER, NULL, NULL, 1);
+    }
+}
+
+static const scenario_t s_scenarios[] = {
+    { "baseline", "default config, automation only", "UTC0", 1717977600, 3, 17, 19, 300, NULL },
+    { "max_on", "heater demanded all day, 5/3 min limits on relays 1/2", "UTC0", 1717977600, 1, 40, 45, 60,
+      script_max_on },
+    { "midnight", "schedule window across midnight", "UTC0", 1718046000, 2, 17, 19, 300, script_midnight },
+    { "dst_spring", "CET to CEST with windows around 02:00", "CET-1CEST,M3.5.0,M10.5.0/3", 1711800000, 2, 17, 19, 300,
+      script_dst },
+    { "dst_autumn", "CEST to CET with windows around 02:00", "CET-1CEST,M3.5.0,M10.5.0/3", 1729944000, 2, 17, 19, 300,
+      script_dst },
+    { "away", "away mode 09:00-13:00 daily", "UTC0", 1717977600, 3, 17, 19, 300, script_away },
+    { "outage", "broker and Wi-Fi outages", "UTC0", 1717977600, 2, 17, 19, 300, script_outage },
+};
+#define NSCENARIOS (sizeof(s_scenarios) / sizeof(s_scenarios[0]))
+
+// ---- State ---------------------------------------------------------------------------
+
+typedef struct {
+    // Configuration as commanded
+    bool away;
+    bool enforce;
+    uint16_t win[4]; // w1 start/end, w2 start/end, minutes
+    uint32_t max_on_s[4];
+    int64_t away_since_us;
+    int64_t closed_since_us; // schedule currently closed since, 0 when open
+    bool synced;
+
+    // Relays as seen on the GPIOs
+    bool on[4];
+    int64_t on_since_us[4];
+    int64_t on_total_us[4];
+    int64_t on_longest_us[4];
+    uint32_t activations[4];
+    bool flagged[4]; // one violation per on period
+
+    // Latest published readings, for the automation
+    float co2, temp, rh;
+    bool fresh;
+    bool want[4];
+    int64_t sent_us[4];
+
+    bool broker_up;
+    int64_t broker_change_us;
+    uint32_t commands, violations, samples;
+    double t_min, t_max, t_sum, co2_sum;
+} sim_t;
+
+static sim_t s;
+static gh_model_t s_model;
+static const scenario_t* s_sc;
+static char s_base[64];
+static char s_avail[80];
+static FILE* s_trace;
+static int64_t s_start_us;
+
+static int64_t wall_at(int64_t t_us) {
+    return time(NULL) - (host_now_us() - t_us) / 1000000;
+}
+
+// Sun position follows standard time, whatever the clocks say
+static double solar_hour(int64_t t_us) {
+    double secs = (double)wall_at(t_us) - (double)timezone;
+    return fmod(secs / 3600.0, 24.0);
+}
+
+static int local_minute(void) {
+    time_t now = time(NULL);
+    struct tm tm;
+    localtime_r(&now, &tm);
+    return tm.tm_hour * 60 + tm.tm_min;
+}
+
+// Same window rules as the firmware: start == end disables, start > end wraps
+static bool window_open(uint16_t start, uint16_t end, int minute) {
+    if (start == end) return false;
+    return start < end ? minute >= start && minute < end : minute >= start || minute < end;
+}
+
+static bool schedule_open(void) {
+    int m = local_minute();
+    return window_open(s.win[0], s.win[1], m) || window_open(s.win[2], s.win[3], m);
+}
+
+static void trace(const char* kind, int ch, const char* detail) {
+    if (!s_trace) return;
+    time_t now = time(NULL);
+    struct tm tm;
+    localtime_r(&now, &tm);
+    char local[32];
+    strftime(local, sizeof(local), "%Y-%m-%d %H:%M:%S %Z", &tm);
+    fprintf(s_trace, "%.0f,%s,%s,%d,%s,%.0f,%.2f,%.1f,%d%d%d%d\n", (host_now_us() - s_start_us) / 1e6, local, kind,
+            ch, detail ? detail : "", s_model.in.co2_ppm, s_model.in.temp_c, s_model.in.rh, s.on[0], s.on[1],
+            s.on[2], s.on[3]);
+}
+
+static void violation(int ch, const char* what) {
+    s.violations++;
+    time_t now = time(NULL);
+    struct tm tm;
+    localtime_r(&now, &tm);
+    char local[32];
+    strftime(local, sizeof(local), "%Y-%m-%d %H:%M:%S %Z", &tm);
+    fprintf(stderr, "VIOLATION t=%.0f s (%s) relay %d: %s\n", (host_now_us() - s_start_us) / 1e6, local, ch, what);
+    trace("violation", ch, what);
+}
+
+// ---- Hooks into the port ------------------------------------------------------------
+
+static void on_gpio(int gpio, int level, void* ctx) {
+    (void)ctx;
+    int i = gpio - RELAY_GPIO0;
+    if (i < 0 || i >= 4 || (level != 0) == s.on[i]) return;
+    int64_t now = host_now_us();
+    gh_model_advance(&s_model, now, solar_hour(now));
+    s_model.on[i] = level != 0;
+    s.on[i] = level != 0;
+    if (level) {
+        s.on_since_us[i] = now;
+        s.activations[i]++;
+        s.flagged[i] = false;
+        if (s.away) violation(i + 1, "turned on in away mode");
+        else if (s.enforce && !s.synced) violation(i + 1, "turned on before time sync");
+        else if (s.enforce && !schedule_open()) violation(i + 1, "turned on outside the schedule");
+    } else {
+        int64_t d = now - s.on_since_us[i];
+        s.on_total_us[i] += d;
+        if (d > s.on_longest_us[i]) s.on_longest_us[i] = d;
+    }
+    trace("relay", i + 1, level ? "ON" : "OFF");
+}
+
+static host_scd41_sample_t sensor(int64_t t_us, void* ctx) {
+    (void)ctx;
+    gh_model_advance(&s_model, t_us, solar_hour(t_us));
+    host_scd41_sample_t r;
+    gh_model_read(&s_model, &r.co2_ppm, &r.temperature_c, &r.humidity_rh);
+    s.samples++;
+    s.t_min = fmin(s.t_min, s_model.in.temp_c);
+    s.t_max = fmax(s.t_max, s_model.in.temp_c);
+    s.t_sum += s_model.in.temp_c;
+    s.co2_sum += s_model.in.co2_ppm;
+    trace("sample", 0, NULL);
+    return r;
+}
+
+static void on_publish(const host_mqtt_msg_t* m, void* ctx) {
+    (void)ctx;
+    size_t n = strlen(s_base);
+    if (strncmp(m->topic, s_base, n) != 0 || strncmp(m->topic + n, "/scd41/", 7) != 0) return;
+    const char* what = m->topic + n + 7;
+    float v = strtof(m->data, NULL);
+    if (strcmp(what, "co2") == 0) s.co2 = v;
+    else if (strcmp(what, "temperature") == 0) s.temp = v;
+    else if (strcmp(what, "humidity") == 0) s.rh = v, s.fresh = true;
+}
+
+// ---- Commands --------------------------------------------------------------------------
+
+static bool command(const char* suffix, const char* payload) {
+    char topic[128];
+    snprintf(topic, sizeof(topic), "%s/%s", s_base, suffix);
+    if (!host_mqtt_deliver(topic, payload, (int)strlen(payload))) return false;
+    s.commands++;
+    trace("cmd", 0, topic + strlen(s_base) + 1);
+
+    // Track what the device was told, to check it against
+    int ch, end = 0;
+    unsigned v = (unsigned)strtoul(payload, NULL, 10);
+    bool on = strcmp(payload, "ON") == 0;
+    if (strcmp(suffix, "mode/away/set") == 0) {
+        if (on && !s.away) s.away_since_us = host_now_us();
+        s.away = on;
+    } else if (strcmp(suffix, "schedule/enforce/set") == 0) {
+        s.enforce = on;
+    } else if (sscanf(suffix, "relay/%d/max_on/set%n", &ch, &end) == 1 && end && !suffix[end]) {
+        s.max_on_s[ch - 1] = v * 60;
+    } else {
+        static const char* keys[] = { "w1_start", "w1_end", "w2_start", "w2_end" };
+        for (int i = 0; i < 4; ++i) {
+            char t[48];
+            snprintf(t, sizeof(t), "schedule/%s/set", keys[i]);
+            if (strcmp(suffix, t) == 0) s.win[i] = (uint16_t)(v > 1439 ? 1439 : v);
+        }
+    }
+    return true;
+}
+
+static void run_action(const action_t* a) {
+    switch (a->kind) {
+        case ACT_MQTT:
+            if (!command(a->topic, a->payload)) fprintf(stderr, "not delivered: %s\n", a->topic);
+            break;
+        case ACT_BROKER:
+            host_mqtt_set_broker(a->arg);
+            trace("broker", 0, a->arg ? "up" : "down");
+            break;
+        case ACT_AP:
+            host_wifi_set_ap(a->arg);
+            trace("wifi", 0, a->arg ? "up" : "down");
+            break;
+    }
+}
+
+// Hysteresis thermostat/humidistat on the published readings, re-sending a
+// state the device didn't take every retry_s, as an HA automation would
+static void automation(void) {
+    if (!s.fresh) return;
+    s.fresh = false;
+    bool* w = s.want;
+    if (s.temp < s_sc->heat_on_below) w[GH_HEATER] = true;
+    if (s.temp > s_sc->heat_off_above) w[GH_HEATER] = false;
+    if (s.temp > 28 || s.rh > 88) w[GH_FAN] = true;
+    if (s.temp < 25 && s.rh < 80) w[GH_FAN] = false;
+    double sun = s_model.in.sun;
+    if (s.co2 < 700 && sun > 0.2 && !w[GH_FAN]) w[GH_CO2] = true;
+    if (s.co2 > 1000 || sun < 0.1 || w[GH_FAN]) w[GH_CO2] = false;
+    if (s.rh < 55) w[GH_MISTER] = true;
+    if (s.rh > 70) w[GH_MISTER] = false;
+
+    int64_t now = host_now_us();
+    for (int i = 0; i < 4; ++i) {
+        char state_t[96];
+        snprintf(state_t, sizeof(state_t), "%s/relay/%d/state", s_base, i + 1);
+        const char* reported = host_mqtt_retained(state_t);
+        bool is_on = reported && strcmp(reported, "ON") == 0;
+        if (is_on == w[i] || (s.sent_us[i] && now - s.sent_us[i] < (int64_t)s_sc->retry_s * 1000000)) continue;
+        char t[32];
+        snprintf(t, sizeof(t), "relay/%d/set", i + 1);
+        if (command(t, w[i] ? "ON" : "OFF")) s.sent_us[i] = now;
+    }
+}
+
+static void check(void) {
+    int64_t now = host_now_us();
+    bool open = schedule_open();
+    if (open || !s.enforce) s.closed_since_us = 0;
+    else if (!s.closed_since_us) s.closed_since_us = now;
+    const int64_t grace = GRACE_S * 1000000LL;
+
+    for (int i = 0; i < 4; ++i) {
+        if (!s.on[i] || s.flagged[i]) continue;
+        const char* why = NULL;
+        if (s.max_on_s[i] && now - s.on_since_us[i] > (int64_t)s.max_on_s[i] * 1000000 + grace) {
+            why = "on past its max-on time";
+        } else if (s.away && now - s.away_since_us > grace) {
+            why = "still on in away mode";
+        } else if (s.closed_since_us && now - s.closed_since_us > grace) {
+            why = "still on after the schedule closed";
+        }
+        if (why) {
+            s.flagged[i] = true;
+            violation(i + 1, why);
+        }
+    }
+
+    if (s.broker_up != host_mqtt_connected() && now - s.broker_change_us < 60 * 1000000LL) return;
+    const char* avail = host_mqtt_retained(s_avail);
+    if (host_mqtt_connected() && now - s.broker_change_us > grace) {
+        for (int i = 0; i < 4; ++i) {
+            char t[96];
+            snprintf(t, sizeof(t), "%s/relay/%d/state", s_base, i + 1);
+            const char* st = host_mqtt_retained(t);
+            if (!st || strcmp(st, s.on[i] ? "ON" : "OFF") != 0) {
+                if (!s.flagged[i]) violation(i + 1, "retained state differs from the relay");
+                s.flagged[i] = true;
+            }
+        }
+        if (!avail || strcmp(avail, "online") != 0) violation(0, "availability not online while connected");
+    } else if (!host_mqtt_connected() && now - s.broker_change_us > grace && (!avail || strcmp(avail, "offline"))) {
+        violation(0, "availability not offline while disconnected");
+    }
+}
+
+// ---- Main ------------------------------------------------------------------------------
+
+static void usage(void) {
+    fprintf(stderr, "usage: greenhouse_sim <scenario> [--days N] [--seed N] [--trace out.csv]\n\nscenarios:\n");
+    for (size_t i = 0; i < NSCENARIOS; ++i) fprintf(stderr, "  %-11s %s\n", s_scenarios[i].name, s_scenarios[i].about);
+    exit(2);
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) usage();
+    for (size_t i = 0; i < NSCENARIOS; ++i) {
+        if (strcmp(argv[1], s_scenarios[i].name) == 0) s_sc = &s_scenarios[i];
+    }
+    if (!s_sc) usage();
+    int days = s_sc->days;
+    uint32_t seed = 1;
+    for (int i = 2; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "--days") == 0) days = atoi(argv[i + 1]);
+        else if (strcmp(argv[i], "--seed") == 0) seed = (uint32_t)strtoul(argv[i + 1], NULL, 0);
+        else if (strcmp(argv[i], "--trace") == 0) s_trace = fopen(argv[i + 1], "w");
+        else usage();
+    }
+    if (s_trace) fprintf(s_trace, "t_s,local,kind,relay,detail,co2_ppm,temp_c,rh,relays\n");
+
+    s = (sim_t){
+        .away = CONFIG_SAFETY_AWAY_DEFAULT,
+        .enforce = CONFIG_SAFETY_SCHEDULE_ENFORCE_DEFAULT,
+        .win = { CONFIG_SAFETY_W1_START_DEFAULT, CONFIG_SAFETY_W1_END_DEFAULT, CONFIG_SAFETY_W2_START_DEFAULT,
+                 CONFIG_SAFETY_W2_END_DEFAULT },
+        .max_on_s = { CONFIG_SAFETY_RELAY1_MAX_ON_MIN_DEFAULT * 60, CONFIG_SAFETY_RELAY2_MAX_ON_MIN_DEFAULT * 60,
+                      CONFIG_SAFETY_RELAY3_MAX_ON_MIN_DEFAULT * 60, CONFIG_SAFETY_RELAY4_MAX_ON_MIN_DEFAULT * 60 },
+        .broker_up = true,
+        .t_min = 1e9,
+        .t_max = -1e9,
+    };
+    if (s_sc->script) s_sc->script(days);
+
+    host_log_level(1); // errors only, unless $HOST_LOG_LEVEL says otherwise
+    host_init(NULL);
+    host_set_wall_time(s_sc->start);
+    gh_model_init(&s_model, host_now_us(), seed);
+    host_scd41_set_source(sensor, NULL);
+    host_gpio_set_hook(on_gpio, NULL);
+    host_mqtt_set_publish_hook(on_publish, NULL);
+
+    uint8_t mac[6] = { 0x24, 0x0a, 0xc4, 0x12, 0x34, 0x56 };
+    snprintf(s_base, sizeof(s_base), "%s/esp32s3-%02x%02x%02x", CONFIG_MQTT_BASE_TOPIC, mac[3], mac[4], mac[5]);
+    snprintf(s_avail, sizeof(s_avail), "%s/status", s_base);
+
+    host_start_app();
+    for (int i = 0; i < 100 && !host_mqtt_connected(); ++i) host_run_for(100000);
+    if (!host_mqtt_connected()) {
+        fprintf(stderr, "boot did not reach MQTT\n");
+        return 1;
+    }
+    // As if built with CONFIG_TZ_STRING set to the scenario's zone
+    setenv("TZ", s_sc->tz, 1);
+    tzset();
+
+    double wall0 = (double)clock() / CLOCKS_PER_SEC;
+    s_start_us = host_now_us() - (host_now_us() % 1000000); // whole seconds, minute edges line up
+    host_run_for(s_start_us + 1000000 - host_now_us());
+    const int64_t end_us = s_start_us + (int64_t)days * 86400 * 1000000;
+    int next_action = 0;
+    int64_t next_sync = 0;
+
+    while (host_now_us() < end_us) {
+        int64_t t_s = (host_now_us() - s_start_us) / 1000000;
+        if (t_s >= next_sync && host_sntp_reply(time(NULL))) {
+            s.synced = true;
+            next_sync = t_s + SYNC_EVERY;
+        }
+        while (next_action < s_nactions && s_actions[next_action].at_s <= t_s) run_action(&s_actions[next_action++]);
+        if (s.broker_up != host_mqtt_connected()) {
+            s.broker_up = host_mqtt_connected();
+            s.broker_change_us = host_now_us();
+        }
+        automation();
+        host_run_idle();
+        check();
+        host_run_for(STEP_S * 1000000);
+    }
+
+    // Close open on periods for the totals
+    for (int i = 0; i < 4; ++i) {
+        if (!s.on[i]) continue;
+        int64_t d = host_now_us() - s.on_since_us[i];
+        s.on_total_us[i] += d;
+        if (d > s.on_longest_us[i]) s.on_longest_us[i] = d;
+    }
+    double wall = (double)clock() / CLOCKS_PER_SEC - wall0;
+    static const char* names[4] = { "heater", "fan", "co2", "mister" };
+    printf("scenario %s: %d day(s) in %.2f s CPU (%.0fx), %u samples, %u commands\n", s_sc->name, days, wall,
+           days * 86400.0 / (wall > 0 ? wall : 1e-9), s.samples, s.commands);
+    printf("  temperature %.1f..%.1f C (mean %.1f), CO2 mean %.0f ppm\n", s.t_min, s.t_max,
+           s.samples ? s.t_sum / s.samples : 0, s.samples ? s.co2_sum / s.samples : 0);
+    for (int i = 0; i < 4; ++i) {
+        printf("  relay %d %-6s on %6.2f h, %4u activations, longest %6.1f min\n", i + 1, names[i],
+               s.on_total_us[i] / 3.6e9, s.activations[i], s.on_longest_us[i] / 6e7);
+    }
+    printf("  invariants: %s (%u violation%s)\n", s.violations ? "FAIL" : "ok", s.violations,
+           s.violations == 1 ? "" : "s");
+    if (s_trace) fclose(s_trace);
+    return s.violations ? 1 : 0;
+}
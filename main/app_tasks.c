@@ -0,0 +1,20 @@
+#include "app_tasks.h"
+#include "esp_log.h"
+
+static const char* TAG = "tasks";
+
+bool app_task_start(TaskFunction_t fn, const char* name, uint32_t stack_bytes, void* arg, UBaseType_t prio,
+                    BaseType_t core, TaskHandle_t* handle, StackType_t* stack, StaticTask_t* tcb) {
+    TaskHandle_t h = NULL;
+    if (stack && tcb) {
+        h = xTaskCreateStaticPinnedToCore(fn, name, stack_bytes, arg, prio, stack, tcb, core);
+    } else if (xTaskCreatePinnedToCore(fn, name, stack_bytes, arg, prio, &h, core) != pdPASS) {
+        h = NULL;
+    }
+    if (!h) {
+        ESP_LOGE(TAG, "Cannot create %s (%u byte stack)", name, (unsigned)stack_bytes);
+        return false;
+    }
+    if (handle) *handle = h;
+    return true;
+}
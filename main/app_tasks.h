@@ -0,0 +1,86 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "sdkconfig.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Core and priority plan. Core 0 carries networking: Wi-Fi (23), lwIP (18),
+// esp_timer (22) and the MQTT client (5) are pinned there by
+// sdkconfig.defaults, along with the bulk/background application tasks.
+// Core 1 runs only the control task, above everything else on it, and the
+// sensor task below it, so actuation never waits for the network stack and
+// I2C polling never waits behind a burst of MQTT traffic.
+#define APP_CORE_NET   0
+#if portNUM_PROCESSORS > 1
+#define APP_CORE_CTRL  1
+#else
+#define APP_CORE_CTRL  0
+#endif
+
+#define APP_PRIO_CONTROL   10
+#define APP_CORE_CONTROL   APP_CORE_CTRL
+#define APP_PRIO_SCD4X     4
+#define APP_CORE_SCD4X     APP_CORE_CTRL
+#define APP_PRIO_OTA       4   // below MQTT so commands keep flowing during a download
+#define APP_CORE_OTA       APP_CORE_NET
+#define APP_PRIO_MQTT_OUT  4   // ha_mqtt connects and echoes, below the client
+#define APP_CORE_MQTT_OUT  APP_CORE_NET
+#define APP_PRIO_OTA_MQTT  3
+#define APP_CORE_OTA_MQTT  APP_CORE_NET
+#define APP_PRIO_HTTPD     3   // local API, below MQTT
+#define APP_CORE_HTTPD     APP_CORE_NET
+#define APP_PRIO_TIME_BOOT 3
+#define APP_CORE_TIME_BOOT APP_CORE_NET
+#define APP_PRIO_SPOOL     2
+#define APP_CORE_SPOOL     APP_CORE_NET
+#define APP_PRIO_HISTORY   2
+#define APP_CORE_HISTORY   APP_CORE_NET
+#define APP_PRIO_METRICS   1
+#define APP_CORE_METRICS   APP_CORE_NET
+#define APP_PRIO_DLOG      1   // deferred log formatting, only above idle
+#define APP_CORE_DLOG      APP_CORE_NET
+
+// Stack size (bytes) of every application task. tools/mem_budget.py reads
+// these for the build-time memory report, so keep them plain numbers.
+#define APP_STACK_CONTROL    3072
+#define APP_STACK_SCD4X      4096
+#define APP_STACK_TIME_BOOT  3072
+#define APP_STACK_HISTORY    4096
+#define APP_STACK_SPOOL      4096
+#define APP_STACK_METRICS    3072
+#define APP_STACK_OTA        8192
+#define APP_STACK_OTA_MQTT   4096
+#define APP_STACK_DLOG       3072
+#define APP_STACK_MQTT_OUT   4096
+
+// Task storage and creation. With CONFIG_APP_STATIC_ALLOC the stack and TCB
+// are static arrays (placed at link time, counted in the budget report);
+// otherwise they come from the heap at creation. Declare the storage once
+// at file scope, then create with the same id:
+//
+//   APP_TASK_STORAGE(s_foo, APP_STACK_FOO);
+//   APP_TASK_CREATE(s_foo, foo_task, "foo", NULL, 3, tskNO_AFFINITY, &handle);
+#if CONFIG_APP_STATIC_ALLOC
+#define APP_TASK_STORAGE(id, bytes) \
+    static StackType_t id##_stack[(bytes) / sizeof(StackType_t)]; \
+    static StaticTask_t id##_tcb
+#define APP_TASK_CREATE(id, fn, name, arg, prio, core, handle) \
+    app_task_start((fn), (name), sizeof(id##_stack), (arg), (prio), (core), (handle), id##_stack, &id##_tcb)
+#else
+#define APP_TASK_STORAGE(id, bytes) static const uint32_t id##_stack_bytes = (bytes)
+#define APP_TASK_CREATE(id, fn, name, arg, prio, core, handle) \
+    app_task_start((fn), (name), id##_stack_bytes, (arg), (prio), (core), (handle), NULL, NULL)
+#endif
+
+// Use APP_TASK_CREATE. Returns false (and logs) if the task was not created.
+bool app_task_start(TaskFunction_t fn, const char* name, uint32_t stack_bytes, void* arg, UBaseType_t prio,
+                    BaseType_t core, TaskHandle_t* handle, StackType_t* stack, StaticTask_t* tcb);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,61 @@
+#include "boot.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/event_groups.h"
+#include <inttypes.h>
+#include <stdio.h>
+
+static const char* TAG = "boot";
+
+static EventGroupHandle_t s_events = NULL;
+static int64_t s_at_us[BOOT_MS_COUNT] = {0};
+
+static const char* s_names[BOOT_MS_COUNT] = {
+    [BOOT_MS_STORAGE] = "storage",
+    [BOOT_MS_RELAYS] = "relays",
+    [BOOT_MS_SAFETY] = "safety",
+    [BOOT_MS_SENSOR_STARTED] = "sensor",
+    [BOOT_MS_WIFI_STARTED] = "wifi",
+    [BOOT_MS_GOT_IP] = "got_ip",
+    [BOOT_MS_MQTT_CONNECTED] = "mqtt",
+    [BOOT_MS_TIME_VALID] = "time",
+    [BOOT_MS_FIRST_TELEMETRY] = "first_telemetry",
+};
+
+void boot_init(void) {
+    if (!s_events) s_events = xEventGroupCreate();
+}
+
+void boot_mark(boot_milestone_t ms) {
+    if (ms >= BOOT_MS_COUNT || !s_events) return;
+    EventBits_t bit = (EventBits_t)1 << ms;
+    if (xEventGroupGetBits(s_events) & bit) return;
+    s_at_us[ms] = esp_timer_get_time();
+    xEventGroupSetBits(s_events, bit);
+    ESP_LOGI(TAG, "%s at %" PRId64 " ms", s_names[ms], s_at_us[ms] / 1000);
+}
+
+bool boot_reached(boot_milestone_t ms) {
+    if (ms >= BOOT_MS_COUNT || !s_events) return false;
+    return (xEventGroupGetBits(s_events) & ((EventBits_t)1 << ms)) != 0;
+}
+
+int64_t boot_milestone_us(boot_milestone_t ms) {
+    if (ms >= BOOT_MS_COUNT) return 0;
+    return s_at_us[ms];
+}
+
+size_t boot_format_report(char* out, size_t out_sz) {
+    if (!out || !out_sz) return 0;
+    size_t n = (size_t)snprintf(out, out_sz, "{");
+    bool first = true;
+    for (int i = 0; i < BOOT_MS_COUNT && n < out_sz; ++i) {
+        if (!boot_reached((boot_milestone_t)i)) continue;
+        n += (size_t)snprintf(out + n, out_sz - n, "%s\"%s\":%" PRId64,
+                              first ? "" : ",", s_names[i], s_at_us[i] / 1000);
+        first = false;
+    }
+    if (n < out_sz) n += (size_t)snprintf(out + n, out_sz - n, "}");
+    return n < out_sz ? n : out_sz - 1;
+}
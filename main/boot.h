@@ -0,0 +1,40 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "freertos/FreeRTOS.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Boot milestones, kept as event-group bits so any task can check them
+// without locking.
+typedef enum {
+    BOOT_MS_STORAGE = 0,
+    BOOT_MS_RELAYS,
+    BOOT_MS_SAFETY,
+    BOOT_MS_SENSOR_STARTED,   // periodic measurement running
+    BOOT_MS_WIFI_STARTED,
+    BOOT_MS_GOT_IP,
+    BOOT_MS_MQTT_CONNECTED,
+    BOOT_MS_TIME_VALID,
+    BOOT_MS_FIRST_TELEMETRY,  // first reading published
+    BOOT_MS_COUNT
+} boot_milestone_t;
+
+void boot_init(void);
+
+// Record a milestone (first call wins)
+void boot_mark(boot_milestone_t ms);
+bool boot_reached(boot_milestone_t ms);
+
+// Microseconds since boot when the milestone was reached, 0 if not yet
+int64_t boot_milestone_us(boot_milestone_t ms);
+
+// JSON object of milestone -> ms since boot (unreached milestones omitted)
+size_t boot_format_report(char* out, size_t out_sz);
+
+#ifdef __cplusplus
+}
+#endif
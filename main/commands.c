@@ -0,0 +1,252 @@
+#include "commands.h"
+#include "control.h"
+#include "ha_mqtt.h"
+#include "relay.h"
+#include "safety.h"
+#include "scd4x.h"
+
+#include "cJSON.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "sdkconfig.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+// Correlation ids of relay commands in the control queue; it holds at most
+// CONFIG_CONTROL_QUEUE_LEN, so a slot is always free when the send succeeds
+typedef struct {
+    bool used;
+    uint8_t channel;
+    bool on;
+    char id[COMMAND_ID_MAX + 1];
+    int64_t rx_us;
+    int64_t queued_us;
+} ack_slot_t;
+
+static ack_slot_t s_acks[CONFIG_CONTROL_QUEUE_LEN];
+static portMUX_TYPE s_mux = portMUX_INITIALIZER_UNLOCKED;
+
+static const char* const k_results[] = {
+    [COMMAND_APPLIED] = "applied",
+    [COMMAND_BLOCKED_AWAY] = "blocked-by-away",
+    [COMMAND_BLOCKED_SCHEDULE] = "blocked-by-schedule",
+    [COMMAND_INVALID] = "invalid",
+    [COMMAND_BUSY] = "busy",
+};
+
+// Times are microseconds: arrival to queued, waiting in the queue, the
+// safety check and GPIO write, and arrival to now
+static void publish_ack(const char* id, int channel, command_result_t result, int64_t rx_us, int64_t queued_us,
+                        int64_t dequeued_us) {
+    int64_t now = esp_timer_get_time();
+    // The id is echoed as a JSON string; anything needing escapes is replaced
+    char safe[COMMAND_ID_MAX + 1];
+    size_t n = 0;
+    for (; id[n] && n < COMMAND_ID_MAX; ++n) {
+        safe[n] = id[n] == '"' || id[n] == '\\' || (unsigned char)id[n] < 0x20 ? '_' : id[n];
+    }
+    safe[n] = 0;
+    char json[192];
+    int len = snprintf(json, sizeof(json), "{\"id\":\"%s\",\"result\":\"%s\",\"relay\":%d", safe,
+                       k_results[result], channel);
+    if (channel >= 1 && channel <= 4 && len < (int)sizeof(json)) {
+        len += snprintf(json + len, sizeof(json) - len, ",\"state\":\"%s\"", relay_get_channel(channel) ? "ON" : "OFF");
+    }
+    if (dequeued_us && len < (int)sizeof(json)) {
+        len += snprintf(json + len, sizeof(json) - len,
+                        ",\"parse_us\":%" PRId64 ",\"queue_us\":%" PRId64 ",\"apply_us\":%" PRId64,
+                        queued_us - rx_us, dequeued_us - queued_us, now - dequeued_us);
+    }
+    if (len < (int)sizeof(json)) snprintf(json + len, sizeof(json) - len, ",\"total_us\":%" PRId64 "}", now - rx_us);
+    ha_mqtt_publish_ack(json);
+}
+
+bool commands_relay(int channel, bool on, uint16_t trace_id) {
+    if (control_set_relay(channel, on, trace_id, 0)) return true;
+    ha_mqtt_publish_relay_state(channel, relay_get_channel(channel));
+    return false;
+}
+
+bool commands_relay_ack(int channel, bool on, uint16_t trace_id, const char* id, int64_t rx_us) {
+    int slot = -1;
+    taskENTER_CRITICAL(&s_mux);
+    for (int i = 0; i < CONFIG_CONTROL_QUEUE_LEN && slot < 0; ++i) {
+        if (!s_acks[i].used) {
+            slot = i;
+            s_acks[i].used = true;
+        }
+    }
+    taskEXIT_CRITICAL(&s_mux);
+    if (slot < 0) {
+        publish_ack(id, channel, COMMAND_BUSY, rx_us, 0, 0);
+        return false;
+    }
+    ack_slot_t* a = &s_acks[slot];
+    a->channel = (uint8_t)channel;
+    a->on = on;
+    snprintf(a->id, sizeof(a->id), "%s", id);
+    a->rx_us = rx_us;
+    a->queued_us = esp_timer_get_time();
+    if (control_set_relay(channel, on, trace_id, (uint8_t)(slot + 1))) return true;
+
+    taskENTER_CRITICAL(&s_mux);
+    a->used = false;
+    taskEXIT_CRITICAL(&s_mux);
+    publish_ack(id, channel, COMMAND_BUSY, rx_us, 0, 0);
+    ha_mqtt_publish_relay_state(channel, relay_get_channel(channel));
+    return false;
+}
+
+void commands_reject(const char* id, int channel, int64_t rx_us) {
+    publish_ack(id, channel, COMMAND_INVALID, rx_us, 0, 0);
+}
+
+void commands_relay_done(uint8_t ack, command_result_t result, int64_t dequeued_us) {
+    if (ack < 1 || ack > CONFIG_CONTROL_QUEUE_LEN) return;
+    ack_slot_t* a = &s_acks[ack - 1];
+    publish_ack(a->id, a->channel, result, a->rx_us, a->queued_us, dequeued_us);
+    taskENTER_CRITICAL(&s_mux);
+    a->used = false;
+    taskEXIT_CRITICAL(&s_mux);
+}
+
+// Config changes hold safety_settings_lock, so a single-setting command
+// can't slip between the read and the write of a bulk update
+
+void commands_set_away(bool on) {
+    safety_settings_lock();
+    safety_set_away_mode(on);
+    safety_settings_unlock();
+    ha_mqtt_publish_away_state(safety_get_away_mode());
+    control_apply_policy();
+}
+
+void commands_set_schedule_enforce(bool on) {
+    safety_settings_lock();
+    safety_set_schedule_enforce(on);
+    safety_settings_unlock();
+    ha_mqtt_publish_schedule_state(safety_get_schedule_enforce());
+    control_apply_policy();
+}
+
+bool commands_set_window(const char* which, uint32_t minutes) {
+    if (minutes > 1439) minutes = 1439;
+    uint16_t w1s, w1e, w2s, w2e;
+    safety_settings_lock();
+    safety_get_schedule_windows(&w1s, &w1e, &w2s, &w2e);
+    if (strcmp(which, "w1_start") == 0) w1s = (uint16_t)minutes;
+    else if (strcmp(which, "w1_end") == 0) w1e = (uint16_t)minutes;
+    else if (strcmp(which, "w2_start") == 0) w2s = (uint16_t)minutes;
+    else if (strcmp(which, "w2_end") == 0) w2e = (uint16_t)minutes;
+    else {
+        safety_settings_unlock();
+        return false;
+    }
+    safety_set_schedule_windows(w1s, w1e, w2s, w2e);
+    safety_settings_unlock();
+    ha_mqtt_publish_schedule_windows();
+    control_apply_policy();
+    return true;
+}
+
+void commands_set_max_on(int channel, uint32_t minutes) {
+    safety_settings_lock();
+    safety_set_max_on_seconds(channel, minutes * 60u);
+    safety_settings_unlock();
+    ha_mqtt_publish_max_on_minutes(channel, minutes);
+}
+
+static const char* const k_windows[4] = { "w1_start", "w1_end", "w2_start", "w2_end" };
+
+static bool json_minutes(const cJSON* v, uint32_t max, uint32_t* out) {
+    if (!cJSON_IsNumber(v) || v->valuedouble < 0 || v->valuedouble > max) return false;
+    *out = (uint32_t)v->valuedouble;
+    return true;
+}
+
+// Read-only keys are accepted when unchanged, so a snapshot can be sent back
+static bool telemetry_unchanged(const cJSON* t) {
+    const cJSON* it;
+    cJSON_ArrayForEach(it, t) {
+        uint32_t want;
+        if (strcmp(it->string, "sensor_period_s") == 0) want = SCD4X_PERIOD_MS / 1000;
+        else if (strcmp(it->string, "metrics_interval_s") == 0) want = CONFIG_METRICS_INTERVAL_S;
+        else return false;
+        if (!cJSON_IsNumber(it) || it->valuedouble != want) return false;
+    }
+    return cJSON_IsObject(t);
+}
+
+// Builds the new settings from the current ones; the name of the first bad key, or NULL
+static const char* parse_config(const cJSON* root, safety_settings_t* s) {
+    if (!cJSON_IsObject(root)) return "document";
+    uint16_t* win[4] = { &s->w1_start, &s->w1_end, &s->w2_start, &s->w2_end };
+    const cJSON* it;
+    cJSON_ArrayForEach(it, root) {
+        const char* k = it->string;
+        uint32_t v;
+        if (strcmp(k, "away") == 0 || strcmp(k, "schedule_enforce") == 0) {
+            if (!cJSON_IsBool(it)) return k;
+            *(k[0] == 'a' ? &s->away : &s->schedule_enforce) = cJSON_IsTrue(it);
+        } else if (strcmp(k, "max_on_min") == 0) {
+            if (!cJSON_IsArray(it) || cJSON_GetArraySize(it) > 4) return k;
+            for (int i = 0; i < cJSON_GetArraySize(it); ++i) {
+                const cJSON* m = cJSON_GetArrayItem(it, i);
+                if (cJSON_IsNull(m)) continue; // keep
+                if (!json_minutes(m, 24 * 60, &v)) return k;
+                s->max_on_sec[i] = v * 60u;
+            }
+        } else if (strcmp(k, "telemetry") == 0) {
+            if (!telemetry_unchanged(it)) return k;
+        } else {
+            int w = 0;
+            while (w < 4 && strcmp(k, k_windows[w]) != 0) w++;
+            if (w == 4 || !json_minutes(it, 1439, &v)) return k;
+            *win[w] = (uint16_t)v;
+        }
+    }
+    return NULL;
+}
+
+bool commands_apply_config(const char* json, int len, char* err, size_t err_sz) {
+    cJSON* root = cJSON_ParseWithLength(json, (size_t)len);
+    safety_settings_t old, s;
+    safety_settings_lock();
+    safety_get_settings(&old);
+    s = old;
+    const char* bad = root ? parse_config(root, &s) : "document";
+    if (!bad) safety_set_settings(&s);
+    safety_settings_unlock();
+    if (bad && err) snprintf(err, err_sz, "%s", bad);
+    cJSON_Delete(root);
+    if (bad) return false;
+
+    control_apply_policy();
+
+    // Per-setting state topics only where something changed
+    if (s.away != old.away) ha_mqtt_publish_away_state(s.away);
+    if (s.schedule_enforce != old.schedule_enforce) ha_mqtt_publish_schedule_state(s.schedule_enforce);
+    if (s.w1_start != old.w1_start || s.w1_end != old.w1_end || s.w2_start != old.w2_start || s.w2_end != old.w2_end) {
+        ha_mqtt_publish_schedule_windows();
+    }
+    for (int i = 0; i < 4; ++i) {
+        if (s.max_on_sec[i] != old.max_on_sec[i]) ha_mqtt_publish_max_on_minutes(i + 1, s.max_on_sec[i] / 60u);
+    }
+    ha_mqtt_publish_config();
+    return true;
+}
+
+int commands_format_config(char* out, size_t sz) {
+    safety_settings_t s;
+    safety_get_settings(&s);
+    int len = snprintf(out, sz,
+                       "{\"away\":%s,\"schedule_enforce\":%s,\"w1_start\":%u,\"w1_end\":%u,\"w2_start\":%u,"
+                       "\"w2_end\":%u,\"max_on_min\":[%" PRIu32 ",%" PRIu32 ",%" PRIu32 ",%" PRIu32 "],"
+                       "\"telemetry\":{\"sensor_period_s\":%d,\"metrics_interval_s\":%d}}",
+                       s.away ? "true" : "false", s.schedule_enforce ? "true" : "false", s.w1_start, s.w1_end,
+                       s.w2_start, s.w2_end, s.max_on_sec[0] / 60, s.max_on_sec[1] / 60, s.max_on_sec[2] / 60,
+                       s.max_on_sec[3] / 60, SCD4X_PERIOD_MS / 1000, CONFIG_METRICS_INTERVAL_S);
+    return len < (int)sz ? len : -1;
+}
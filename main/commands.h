@@ -0,0 +1,58 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Commands from any transport (MQTT, the local HTTP API). Each one applies
+// the change, announces the new state on every transport and has the
+// control task re-evaluate the safety policy, so a command means the same
+// whichever way it arrives. Relay commands are checked against the safety
+// rules in the control task.
+
+#define COMMAND_ID_MAX 36 // correlation id length, a UUID fits
+
+typedef enum {
+    COMMAND_APPLIED,
+    COMMAND_BLOCKED_AWAY,
+    COMMAND_BLOCKED_SCHEDULE,
+    COMMAND_INVALID,
+    COMMAND_BUSY, // the control queue was full; nothing changed
+} command_result_t;
+
+// Queued to the control task; false (and the unchanged state re-announced)
+// if the queue is full
+bool commands_relay(int channel, bool on, uint16_t trace_id);
+// Same, for a command carrying a correlation id: once the control task has
+// acted on it, the outcome goes out on <base>/ack with the device-side
+// timing, measured from rx_us (when the command arrived)
+bool commands_relay_ack(int channel, bool on, uint16_t trace_id, const char* id, int64_t rx_us);
+// A command with an id that could not be parsed; acknowledged as invalid
+void commands_reject(const char* id, int channel, int64_t rx_us);
+// Control task: the outcome of a command queued with ack slot ack (see
+// control_set_relay), picked up from the queue at dequeued_us
+void commands_relay_done(uint8_t ack, command_result_t result, int64_t dequeued_us);
+void commands_set_away(bool on);
+void commands_set_schedule_enforce(bool on);
+// which is "w1_start", "w1_end", "w2_start" or "w2_end"; minutes are
+// clamped to 0..1439. False for an unknown window name.
+bool commands_set_window(const char* which, uint32_t minutes);
+void commands_set_max_on(int channel, uint32_t minutes);
+
+// Bulk configuration, as one JSON object with any of away, schedule_enforce,
+// w1_start..w2_end (minutes 0..1439) and max_on_min (4 entries, minutes or
+// null to keep). The document is validated as a whole, then applied with a
+// single commit and one policy evaluation, and the resulting snapshot is
+// published on <base>/config. On error nothing changes and err (may be
+// NULL) names the offending key.
+bool commands_apply_config(const char* json, int len, char* err, size_t err_sz);
+// The full snapshot: the keys above plus read-only "telemetry" intervals.
+// Length, or -1 if out is too small.
+int commands_format_config(char* out, size_t sz);
+
+#ifdef __cplusplus
+}
+#endif
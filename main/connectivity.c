@@ -0,0 +1,83 @@
+#include "connectivity.h"
+
+#include "esp_log.h"
+#include "freertos/event_groups.h"
+#include "freertos/semphr.h"
+#include <inttypes.h>
+#include <string.h>
+
+static const char* TAG = "conn";
+
+#define CONN_ALL_BITS (CONN_LINK_UP | CONN_IP | CONN_TIME_VALID | CONN_BROKER_UP)
+#define CONN_MAX_SUBSCRIBERS 8
+
+typedef struct {
+    connectivity_cb_t cb;
+    void* ctx;
+} subscriber_t;
+
+static EventGroupHandle_t s_events = NULL;
+// Serialises transitions and guards the subscriber list. Never held while a
+// subscriber runs: they call into other modules' locks (esp-mqtt's among
+// them), and those modules call back in here with theirs held.
+static SemaphoreHandle_t s_lock = NULL;
+static subscriber_t s_subs[CONN_MAX_SUBSCRIBERS];
+static int s_num_subs = 0;
+
+void connectivity_init(void) {
+    if (s_events) return;
+    s_events = xEventGroupCreate();
+    s_lock = xSemaphoreCreateMutex();
+}
+
+static void update(uint32_t bits, bool set) {
+    bits &= CONN_ALL_BITS;
+    if (!s_events || !bits) return;
+    subscriber_t subs[CONN_MAX_SUBSCRIBERS];
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    uint32_t before = (uint32_t)xEventGroupGetBits(s_events) & CONN_ALL_BITS;
+    if (set) xEventGroupSetBits(s_events, bits);
+    else xEventGroupClearBits(s_events, bits);
+    uint32_t after = set ? (before | bits) : (before & ~bits);
+    uint32_t changed = before ^ after;
+    int n = s_num_subs;
+    memcpy(subs, s_subs, sizeof(subs[0]) * n);
+    xSemaphoreGive(s_lock);
+
+    if (!changed) return;
+    ESP_LOGI(TAG, "state 0x%02" PRIx32 " -> 0x%02" PRIx32, before, after);
+    for (int i = 0; i < n; ++i) subs[i].cb(after, changed, subs[i].ctx);
+}
+
+void connectivity_set(uint32_t bits) { update(bits, true); }
+void connectivity_clear(uint32_t bits) { update(bits, false); }
+
+uint32_t connectivity_get(void) {
+    if (!s_events) return 0;
+    return (uint32_t)xEventGroupGetBits(s_events) & CONN_ALL_BITS;
+}
+
+bool connectivity_is(uint32_t bits) {
+    return (connectivity_get() & bits) == bits;
+}
+
+bool connectivity_wait(uint32_t bits, TickType_t timeout) {
+    if (!s_events) return false;
+    EventBits_t got = xEventGroupWaitBits(s_events, bits, pdFALSE, pdTRUE, timeout);
+    return ((uint32_t)got & bits) == bits;
+}
+
+esp_err_t connectivity_subscribe(connectivity_cb_t cb, void* ctx) {
+    if (!cb) return ESP_ERR_INVALID_ARG;
+    if (!s_lock) return ESP_ERR_INVALID_STATE;
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    esp_err_t err = ESP_ERR_NO_MEM;
+    if (s_num_subs < CONN_MAX_SUBSCRIBERS) {
+        s_subs[s_num_subs].cb = cb;
+        s_subs[s_num_subs].ctx = ctx;
+        s_num_subs++;
+        err = ESP_OK;
+    }
+    xSemaphoreGive(s_lock);
+    return err;
+}
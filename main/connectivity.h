@@ -0,0 +1,38 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "freertos/FreeRTOS.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Connectivity state bits
+#define CONN_LINK_UP    (1u << 0) // associated with the AP
+#define CONN_IP         (1u << 1) // station has an IP address
+#define CONN_TIME_VALID (1u << 2) // wall clock is usable
+#define CONN_BROKER_UP  (1u << 3) // MQTT session established
+
+// Called from the task that changed the state, with no lock held; keep it
+// short and non-blocking. 'changed' holds the bits that flipped, 'state' the
+// bits right after the change. Changes made from different tasks at the same
+// moment may be delivered in either order; use connectivity_get() if only
+// the latest state matters.
+typedef void (*connectivity_cb_t)(uint32_t state, uint32_t changed, void* ctx);
+
+void connectivity_init(void);
+
+void connectivity_set(uint32_t bits);
+void connectivity_clear(uint32_t bits);
+uint32_t connectivity_get(void);
+// True if all of 'bits' are currently set
+bool connectivity_is(uint32_t bits);
+// Block until all of 'bits' are set; returns false on timeout
+bool connectivity_wait(uint32_t bits, TickType_t timeout);
+
+esp_err_t connectivity_subscribe(connectivity_cb_t cb, void* ctx);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,118 @@
+#include "control.h"
+#include "app_tasks.h"
+#include "commands.h"
+#include "ha_mqtt.h"
+#include "metrics.h"
+#include "relay.h"
+#include "safety.h"
+#include "trace.h"
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+#include "sdkconfig.h"
+
+static const char* TAG = "control";
+
+typedef enum {
+    CMD_RELAY,
+    CMD_POLICY,
+} cmd_type_t;
+
+typedef struct {
+    uint8_t type;
+    uint8_t channel;
+    bool on;
+    uint8_t ack;
+    uint16_t trace_id;
+    int64_t queued_us;
+} control_cmd_t;
+
+static QueueHandle_t s_q = NULL;
+static volatile bool s_policy_queued = false;
+APP_TASK_STORAGE(s_task, APP_STACK_CONTROL);
+
+static void do_relay(const control_cmd_t* c) {
+    int64_t dequeued_us = esp_timer_get_time();
+    TRACE(TRACE_SAFETY_BEGIN, c->trace_id);
+    safety_verdict_t v = c->on ? safety_check_turn_on(c->channel) : SAFETY_ALLOW;
+    TRACE(TRACE_SAFETY_END, c->trace_id);
+    if (v != SAFETY_ALLOW) {
+        ESP_LOGW(TAG, "Command blocked: relay %d ON not allowed", c->channel);
+        ha_mqtt_publish_relay_state(c->channel, relay_get_channel(c->channel));
+        if (c->ack) {
+            commands_relay_done(c->ack, v == SAFETY_BLOCK_AWAY ? COMMAND_BLOCKED_AWAY : COMMAND_BLOCKED_SCHEDULE,
+                                dequeued_us);
+        }
+        return;
+    }
+    TRACE(TRACE_RELAY_BEGIN, c->trace_id);
+    relay_set_channel(c->channel, c->on);
+    TRACE(TRACE_RELAY_END, c->trace_id);
+    metrics_control_cmd((uint32_t)(esp_timer_get_time() - c->queued_us));
+    safety_on_relay_state_change(c->channel, c->on);
+    TRACE(TRACE_PUBLISH_BEGIN, c->trace_id);
+    ha_mqtt_publish_relay_state(c->channel, relay_get_channel(c->channel));
+    TRACE(TRACE_PUBLISH_END, c->trace_id);
+    if (c->ack) commands_relay_done(c->ack, COMMAND_APPLIED, dequeued_us);
+}
+
+static void control_task(void* arg) {
+    (void)arg;
+    const TickType_t period = pdMS_TO_TICKS(CONFIG_CONTROL_PERIOD_MS);
+    TickType_t next = xTaskGetTickCount() + period;
+    int64_t last_tick_us = esp_timer_get_time();
+    while (1) {
+        // Periodic enforcement runs as soon as it is due, before the next
+        // command, so a steady stream of commands can't hold it off. The
+        // deviation from the period is the actuation jitter this task would
+        // add to a due max-on cut-off.
+        TickType_t now = xTaskGetTickCount();
+        if ((int32_t)(next - now) <= 0) {
+            int64_t t = esp_timer_get_time();
+            int64_t err = (t - last_tick_us) - (int64_t)CONFIG_CONTROL_PERIOD_MS * 1000;
+            metrics_control_tick((uint32_t)(err < 0 ? -err : err));
+            last_tick_us = t;
+            next += period;
+            if ((int32_t)(next - now) <= 0) next = now + period;   // fell behind: don't burst
+            safety_apply_policy_now();
+            continue;
+        }
+        control_cmd_t c;
+        if (xQueueReceive(s_q, &c, next - now) == pdTRUE) {
+            if (c.type == CMD_RELAY) {
+                do_relay(&c);
+            } else {
+                s_policy_queued = false;
+                safety_apply_policy_now();
+            }
+        }
+    }
+}
+
+bool control_set_relay(int channel, bool on, uint16_t trace_id, uint8_t ack) {
+    if (!s_q || channel < 1 || channel > 4) return false;
+    control_cmd_t c = {
+        .type = CMD_RELAY, .channel = (uint8_t)channel, .on = on, .ack = ack,
+        .trace_id = trace_id, .queued_us = esp_timer_get_time(),
+    };
+    if (xQueueSend(s_q, &c, 0) != pdTRUE) {
+        ESP_LOGW(TAG, "Command queue full, relay %d command dropped", channel);
+        return false;
+    }
+    return true;
+}
+
+void control_apply_policy(void) {
+    if (!s_q || s_policy_queued) return;
+    s_policy_queued = true;
+    control_cmd_t c = { .type = CMD_POLICY, .queued_us = esp_timer_get_time() };
+    if (xQueueSend(s_q, &c, 0) != pdTRUE) s_policy_queued = false; // next tick covers it
+}
+
+void control_init(void) {
+    s_q = xQueueCreate(CONFIG_CONTROL_QUEUE_LEN, sizeof(control_cmd_t));
+    APP_TASK_CREATE(s_task, control_task, "control", NULL, APP_PRIO_CONTROL, APP_CORE_CONTROL, NULL);
+}
@@ -0,0 +1,26 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Control task: the only context that drives relays. It runs pinned to the
+// application core above every other application task, so actuation and
+// safety enforcement don't queue behind Wi-Fi, lwIP or MQTT on core 0.
+// It also re-evaluates the safety policy (max-on, schedule, away) every
+// CONFIG_CONTROL_PERIOD_MS.
+void control_init(void);
+
+// Queue a relay command; the safety check and the state publish happen in
+// the control task. Safe from any task; false if the queue is full. ack is
+// 0, or a commands.c ack slot + 1 to report the outcome to.
+bool control_set_relay(int channel, bool on, uint16_t trace_id, uint8_t ack);
+
+// Ask the control task to apply the safety policy now (coalesced)
+void control_apply_policy(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,225 @@
+#include "delta_patch.h"
+#include "esp_log.h"
+#include "esp_rom_crc.h"
+#include "rom/miniz.h"
+#include <stdlib.h>
+#include <string.h>
+
+static const char* TAG = "delta";
+
+#define DELTA_OP_END    0x00
+#define DELTA_OP_ADD    0x01
+#define DELTA_OP_INSERT 0x02
+#define DELTA_OUT_BUF   4096 // target bytes batched per flash write
+
+typedef enum { ST_HEADER, ST_OP, ST_VARINT, ST_DATA, ST_DONE } delta_state_t;
+
+struct delta_patch {
+    uint8_t hdr[DELTA_HEADER_LEN];
+    size_t hdr_len;
+    uint8_t base_digest[32];
+    size_t base_limit;
+    size_t base_size;
+    size_t target_size;
+
+    tinfl_decompressor inflator;
+    uint8_t* dict;       // circular inflate window, TINFL_LZ_DICT_SIZE
+    size_t dict_ofs;
+    bool inflate_done;
+
+    delta_state_t state;
+    uint8_t op;
+    int field;           // varint being read: 0 = len, 1 = src delta
+    uint64_t varint;
+    int shift;
+    size_t remaining;    // bytes left in the current op
+    size_t src;          // next base offset for ADD
+    size_t src_end;      // end of the previous ADD, base for src deltas
+    size_t produced;
+
+    uint8_t out[DELTA_OUT_BUF];
+    size_t out_len;
+
+    delta_read_base_fn read;
+    delta_write_fn write;
+    void* ctx;
+};
+
+static uint32_t rd32(const uint8_t* b) {
+    return (uint32_t)b[0] | ((uint32_t)b[1] << 8) | ((uint32_t)b[2] << 16) | ((uint32_t)b[3] << 24);
+}
+
+delta_patch_t* delta_patch_create(const uint8_t base_digest[32], size_t base_limit,
+                                  delta_read_base_fn read, delta_write_fn write, void* ctx) {
+    delta_patch_t* p = calloc(1, sizeof(*p));
+    if (!p) return NULL;
+    p->dict = malloc(TINFL_LZ_DICT_SIZE);
+    if (!p->dict) {
+        free(p);
+        return NULL;
+    }
+    memcpy(p->base_digest, base_digest, sizeof(p->base_digest));
+    p->base_limit = base_limit;
+    p->read = read;
+    p->write = write;
+    p->ctx = ctx;
+    tinfl_init(&p->inflator);
+    return p;
+}
+
+void delta_patch_free(delta_patch_t* p) {
+    if (!p) return;
+    free(p->dict);
+    free(p);
+}
+
+size_t delta_patch_target_size(const delta_patch_t* p) {
+    return p ? p->target_size : 0;
+}
+
+static esp_err_t parse_header(delta_patch_t* p) {
+    const uint8_t* h = p->hdr;
+    if (rd32(h) != DELTA_MAGIC) {
+        ESP_LOGE(TAG, "Not a delta patch");
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (rd32(h + 76) != esp_rom_crc32_le(0, h, 76)) {
+        ESP_LOGE(TAG, "Header CRC mismatch");
+        return ESP_ERR_INVALID_CRC;
+    }
+    p->base_size = rd32(h + 4);
+    p->target_size = rd32(h + 40);
+    if (memcmp(h + 8, p->base_digest, 32) != 0 || p->base_size > p->base_limit) {
+        ESP_LOGW(TAG, "Patch was made for a different base image");
+        return ESP_ERR_INVALID_VERSION;
+    }
+    ESP_LOGI(TAG, "Patch %u -> %u bytes", (unsigned)p->base_size, (unsigned)p->target_size);
+    p->state = ST_OP;
+    return ESP_OK;
+}
+
+static esp_err_t flush_out(delta_patch_t* p) {
+    if (!p->out_len) return ESP_OK;
+    esp_err_t err = p->write(p->out, p->out_len, p->ctx);
+    p->out_len = 0;
+    return err;
+}
+
+// Op parser, fed with inflated bytes
+static esp_err_t run_ops(delta_patch_t* p, const uint8_t* buf, size_t n) {
+    while (n) {
+        switch (p->state) {
+            case ST_OP:
+                p->op = *buf++; n--;
+                if (p->op == DELTA_OP_END) {
+                    p->state = ST_DONE;
+                } else if (p->op == DELTA_OP_ADD || p->op == DELTA_OP_INSERT) {
+                    p->field = 0;
+                    p->varint = 0;
+                    p->shift = 0;
+                    p->state = ST_VARINT;
+                } else {
+                    return ESP_ERR_INVALID_RESPONSE;
+                }
+                break;
+
+            case ST_VARINT: {
+                uint8_t b = *buf++; n--;
+                if (p->shift > 56) return ESP_ERR_INVALID_RESPONSE;
+                p->varint |= (uint64_t)(b & 0x7f) << p->shift;
+                p->shift += 7;
+                if (b & 0x80) break;
+                uint64_t v = p->varint;
+                p->varint = 0;
+                p->shift = 0;
+                if (p->field == 0) {
+                    p->remaining = (size_t)v;
+                    if (p->op == DELTA_OP_ADD) {
+                        p->field = 1;
+                        break;
+                    }
+                } else {
+                    int64_t delta = (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+                    int64_t src = (int64_t)p->src_end + delta;
+                    if (src < 0 || (uint64_t)src + p->remaining > p->base_size) return ESP_ERR_INVALID_SIZE;
+                    p->src = (size_t)src;
+                    p->src_end = p->src + p->remaining;
+                }
+                if (p->produced + p->remaining > p->target_size) return ESP_ERR_INVALID_SIZE;
+                p->state = p->remaining ? ST_DATA : ST_OP;
+                break;
+            }
+
+            case ST_DATA: {
+                size_t k = n;
+                if (k > p->remaining) k = p->remaining;
+                if (k > DELTA_OUT_BUF - p->out_len) k = DELTA_OUT_BUF - p->out_len;
+                uint8_t* o = p->out + p->out_len;
+                if (p->op == DELTA_OP_ADD) {
+                    esp_err_t err = p->read(p->src, o, k, p->ctx);
+                    if (err != ESP_OK) return err;
+                    for (size_t i = 0; i < k; ++i) o[i] += buf[i];
+                    p->src += k;
+                } else {
+                    memcpy(o, buf, k);
+                }
+                p->out_len += k;
+                p->produced += k;
+                p->remaining -= k;
+                buf += k; n -= k;
+                if (p->out_len == DELTA_OUT_BUF) {
+                    esp_err_t err = flush_out(p);
+                    if (err != ESP_OK) return err;
+                }
+                if (!p->remaining) p->state = ST_OP;
+                break;
+            }
+
+            case ST_DONE:
+                return ESP_ERR_INVALID_SIZE; // data after END
+            default:
+                return ESP_ERR_INVALID_STATE;
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t delta_patch_feed(delta_patch_t* p, const uint8_t* data, size_t len) {
+    if (p->state == ST_HEADER) {
+        size_t k = DELTA_HEADER_LEN - p->hdr_len;
+        if (k > len) k = len;
+        memcpy(p->hdr + p->hdr_len, data, k);
+        p->hdr_len += k;
+        data += k; len -= k;
+        if (p->hdr_len < DELTA_HEADER_LEN) return ESP_OK;
+        esp_err_t err = parse_header(p);
+        if (err != ESP_OK) return err;
+    }
+
+    while (!p->inflate_done) {
+        size_t in_sz = len;
+        size_t out_sz = TINFL_LZ_DICT_SIZE - p->dict_ofs;
+        tinfl_status st = tinfl_decompress(&p->inflator, data, &in_sz, p->dict, p->dict + p->dict_ofs, &out_sz,
+                                           TINFL_FLAG_PARSE_ZLIB_HEADER | TINFL_FLAG_HAS_MORE_INPUT);
+        data += in_sz; len -= in_sz;
+        if (out_sz) {
+            esp_err_t err = run_ops(p, p->dict + p->dict_ofs, out_sz);
+            if (err != ESP_OK) return err;
+            p->dict_ofs = (p->dict_ofs + out_sz) & (TINFL_LZ_DICT_SIZE - 1);
+        }
+        if (st == TINFL_STATUS_DONE) p->inflate_done = true;
+        else if (st < TINFL_STATUS_DONE) return ESP_ERR_INVALID_RESPONSE;
+        else if (st == TINFL_STATUS_NEEDS_MORE_INPUT && !len) break;
+    }
+    return ESP_OK;
+}
+
+esp_err_t delta_patch_finish(delta_patch_t* p) {
+    esp_err_t err = flush_out(p);
+    if (err != ESP_OK) return err;
+    if (!p->inflate_done || p->state != ST_DONE || p->produced != p->target_size) {
+        ESP_LOGE(TAG, "Patch incomplete (%u of %u bytes)", (unsigned)p->produced, (unsigned)p->target_size);
+        return ESP_ERR_INVALID_SIZE;
+    }
+    return ESP_OK;
+}
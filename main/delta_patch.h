@@ -0,0 +1,47 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Streaming applier for delta firmware patches made by tools/mkdelta.py.
+//
+// Patch layout (little endian):
+//   u32 magic "GHD1", u32 base_size, u8 base_digest[32],
+//   u32 target_size, u8 target_digest[32], u32 crc32 of the preceding 76 bytes
+// followed by a zlib stream of ops:
+//   0x01 ADD    varint len, zigzag varint src delta, len bytes added to base[src..]
+//   0x02 INSERT varint len, len literal bytes
+//   0x00 END
+// Digests are the SHA-256 appended to each app image, which is also what
+// esp_partition_get_sha256() reports for an app partition.
+
+#define DELTA_MAGIC      0x31444847u // "GHD1"
+#define DELTA_HEADER_LEN 80
+
+typedef esp_err_t (*delta_read_base_fn)(size_t offset, void* out, size_t len, void* ctx);
+typedef esp_err_t (*delta_write_fn)(const uint8_t* data, size_t len, void* ctx);
+
+typedef struct delta_patch delta_patch_t;
+
+// base_digest/base_limit describe the image the patch must apply to
+delta_patch_t* delta_patch_create(const uint8_t base_digest[32], size_t base_limit,
+                                  delta_read_base_fn read, delta_write_fn write, void* ctx);
+
+// Feed patch bytes as they arrive. Returns ESP_ERR_INVALID_VERSION as soon as
+// the header shows the patch was made against a different base.
+esp_err_t delta_patch_feed(delta_patch_t* p, const uint8_t* data, size_t len);
+
+// Flush output and check the patch ended cleanly with the expected size
+esp_err_t delta_patch_finish(delta_patch_t* p);
+
+size_t delta_patch_target_size(const delta_patch_t* p); // 0 until the header is in
+void delta_patch_free(delta_patch_t* p);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,266 @@
+#include "dlog.h"
+
+#include "app_tasks.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#if CONFIG_DLOG_ENABLE
+
+static const char* TAG = "dlog";
+
+#define DLOG_RECORDS (1u << CONFIG_DLOG_RECORDS_LOG2)
+#define DLOG_ARG_BYTES 48   // record is 64 bytes with 32-bit pointers
+
+// How an argument was passed, and so how it is packed and re-read
+enum { ARG_NONE, ARG_INT, ARG_LONG, ARG_LLONG, ARG_SIZE, ARG_DBL, ARG_STR, ARG_PTR, ARG_BAD };
+
+typedef struct {
+    const char* tag;
+    const char* fmt;      // format id: the address of the literal
+    uint32_t ts_ms;
+    uint8_t level;
+    uint8_t len;          // bytes used in args
+    uint8_t args[DLOG_ARG_BYTES];
+} dlog_rec_t;
+
+typedef struct {
+    const char* tag;
+    uint32_t last_ms;
+    uint32_t credit;      // thousandths of a message
+    uint32_t dropped;     // over the limit since the last report
+    uint16_t per_s;
+    uint16_t burst;
+} dlog_limit_t;
+
+APP_TASK_STORAGE(s_task, APP_STACK_DLOG);
+
+static portMUX_TYPE s_mux = portMUX_INITIALIZER_UNLOCKED;
+static dlog_rec_t s_ring[DLOG_RECORDS];
+static uint32_t s_head, s_tail;
+static uint32_t s_lost;   // ring full since the last report
+static dlog_limit_t s_limits[CONFIG_DLOG_TAGS];
+
+// One conversion, p just past its '%'. Copies it, '%' included, to spec and
+// returns the position after it.
+static const char* parse_spec(const char* p, char* spec, size_t sz, int* kind) {
+    size_t n = 0;
+    int size = 0;   // 0 int, 1 long, 2 long long, 3 size_t
+    spec[n++] = '%';
+    *kind = ARG_BAD;
+    while (*p) {
+        char c = *p++;
+        if (n + 1 >= sz) break;
+        spec[n++] = c;
+        if (strchr("-+ #0123456789.h", c)) continue;
+        if (c == 'l') { ++size; continue; }
+        if (c == 'j') { size = 2; continue; }
+        if (c == 'z' || c == 't') { size = 3; continue; }
+        if (strchr("diouxXc", c)) *kind = size == 0 ? ARG_INT : size == 1 ? ARG_LONG : size == 2 ? ARG_LLONG : ARG_SIZE;
+        else if (strchr("fFeEgGaA", c)) *kind = ARG_DBL;
+        else if (c == 's') *kind = ARG_STR;
+        else if (c == 'p') *kind = ARG_PTR;
+        else if (c == '%') *kind = ARG_NONE;
+        break;
+    }
+    spec[n] = 0;
+    return p;
+}
+
+// Caller holds s_mux. NULL (unlimited) once the table is full.
+static dlog_limit_t* limit_for(const char* tag) {
+    for (int i = 0; i < CONFIG_DLOG_TAGS; ++i) {
+        dlog_limit_t* l = &s_limits[i];
+        if (!l->tag) {
+            l->tag = tag;
+            l->per_s = CONFIG_DLOG_TAG_RATE;
+            l->burst = CONFIG_DLOG_TAG_BURST;
+            l->credit = l->burst * 1000u;
+            l->last_ms = esp_log_timestamp();
+            return l;
+        }
+        if (l->tag == tag || strcmp(l->tag, tag) == 0) return l;
+    }
+    return NULL;
+}
+
+static bool take_token(const char* tag, uint32_t now) {
+    dlog_limit_t* l = limit_for(tag);
+    if (!l || !l->per_s) return true;
+    uint32_t el = now - l->last_ms;
+    if (el > 10000) el = 10000;
+    l->last_ms = now;
+    l->credit += el * l->per_s;
+    if (l->credit > l->burst * 1000u) l->credit = l->burst * 1000u;
+    if (l->credit < 1000) {
+        l->dropped++;
+        return false;
+    }
+    l->credit -= 1000;
+    return true;
+}
+
+static bool put(dlog_rec_t* r, const void* v, size_t n) {
+    if (r->len + n > DLOG_ARG_BYTES) return false;
+    memcpy(r->args + r->len, v, n);
+    r->len += n;
+    return true;
+}
+
+void dlog_write(esp_log_level_t level, const char* tag, const char* fmt, ...) {
+    dlog_rec_t r;
+    r.tag = tag;
+    r.fmt = fmt;
+    r.ts_ms = esp_log_timestamp();
+    r.level = (uint8_t)level;
+    r.len = 0;
+
+    va_list ap;
+    va_start(ap, fmt);
+    char spec[16];
+    bool room = true;
+    for (const char* p = fmt; room && (p = strchr(p, '%')) != NULL;) {
+        int kind;
+        p = parse_spec(p + 1, spec, sizeof(spec), &kind);
+        switch (kind) {
+            case ARG_NONE: break;
+            case ARG_INT: { int v = va_arg(ap, int); room = put(&r, &v, sizeof(v)); break; }
+            case ARG_LONG: { long v = va_arg(ap, long); room = put(&r, &v, sizeof(v)); break; }
+            case ARG_LLONG: { long long v = va_arg(ap, long long); room = put(&r, &v, sizeof(v)); break; }
+            case ARG_SIZE: { size_t v = va_arg(ap, size_t); room = put(&r, &v, sizeof(v)); break; }
+            case ARG_DBL: { double v = va_arg(ap, double); room = put(&r, &v, sizeof(v)); break; }
+            case ARG_PTR: { void* v = va_arg(ap, void*); room = put(&r, &v, sizeof(v)); break; }
+            case ARG_STR: {
+                const char* s = va_arg(ap, const char*);
+                if (!s) s = "(null)";
+                size_t left = DLOG_ARG_BYTES - r.len;
+                if (left == 0) { room = false; break; }
+                size_t n = strnlen(s, left - 1);
+                memcpy(r.args + r.len, s, n);
+                r.args[r.len + n] = 0;
+                r.len += n + 1;
+                break;
+            }
+            default: room = false; break;   // can't tell what was passed
+        }
+    }
+    va_end(ap);
+
+    portENTER_CRITICAL(&s_mux);
+    if (take_token(tag, r.ts_ms)) {
+        if (s_head - s_tail >= DLOG_RECORDS) s_lost++;
+        else memcpy(&s_ring[s_head++ & (DLOG_RECORDS - 1)], &r, offsetof(dlog_rec_t, args) + r.len);
+    }
+    portEXIT_CRITICAL(&s_mux);
+}
+
+void dlog_set_limit(const char* tag, uint16_t per_s, uint16_t burst) {
+    portENTER_CRITICAL(&s_mux);
+    dlog_limit_t* l = limit_for(tag);
+    if (l) {
+        l->per_s = per_s;
+        l->burst = burst ? burst : 1;
+        l->credit = l->burst * 1000u;
+    }
+    portEXIT_CRITICAL(&s_mux);
+}
+
+// Re-run the format over the packed arguments; "..." where they ran out
+static void render(const dlog_rec_t* r, char* out, size_t sz) {
+    const uint8_t* a = r->args;
+    const uint8_t* end = r->args + r->len;
+    size_t n = 0;
+    char spec[16];
+    for (const char* p = r->fmt; *p && n + 1 < sz;) {
+        if (*p != '%') { out[n++] = *p++; continue; }
+        int kind;
+        p = parse_spec(p + 1, spec, sizeof(spec), &kind);
+        size_t room = sz - n;
+        int w = 0;
+#define EMIT(T) do { T v; if (a + sizeof(v) > end) goto cut; memcpy(&v, a, sizeof(v)); a += sizeof(v); \
+                     w = snprintf(out + n, room, spec, v); } while (0)
+        switch (kind) {
+            case ARG_NONE: out[n++] = '%'; break;
+            case ARG_INT: EMIT(int); break;
+            case ARG_LONG: EMIT(long); break;
+            case ARG_LLONG: EMIT(long long); break;
+            case ARG_SIZE: EMIT(size_t); break;
+            case ARG_DBL: EMIT(double); break;
+            case ARG_PTR: EMIT(void*); break;
+            case ARG_STR:
+                if (a >= end) goto cut;
+                w = snprintf(out + n, room, spec, (const char*)a);
+                a += strlen((const char*)a) + 1;
+                break;
+            default: goto cut;
+        }
+#undef EMIT
+        if (w > 0) n += (size_t)w < room ? (size_t)w : room - 1;
+    }
+    out[n] = 0;
+    return;
+cut:
+    snprintf(out + n, sz - n, "...");
+}
+
+static void report_drops(void) {
+    struct { const char* tag; uint32_t n; } dropped[CONFIG_DLOG_TAGS];
+    int count = 0;
+    portENTER_CRITICAL(&s_mux);
+    uint32_t lost = s_lost;
+    s_lost = 0;
+    for (int i = 0; i < CONFIG_DLOG_TAGS && s_limits[i].tag; ++i) {
+        if (!s_limits[i].dropped) continue;
+        dropped[count].tag = s_limits[i].tag;
+        dropped[count++].n = s_limits[i].dropped;
+        s_limits[i].dropped = 0;
+    }
+    portEXIT_CRITICAL(&s_mux);
+
+    for (int i = 0; i < count; ++i) {
+        ESP_LOGW(dropped[i].tag, "%u messages over the log rate limit", (unsigned)dropped[i].n);
+    }
+    if (lost) ESP_LOGW(TAG, "%u messages lost, ring full", (unsigned)lost);
+}
+
+static void dlog_task(void* arg) {
+    (void)arg;
+    char line[160];
+    while (1) {
+        while (1) {
+            dlog_rec_t r;
+            portENTER_CRITICAL(&s_mux);
+            bool any = s_tail != s_head;
+            if (any) memcpy(&r, &s_ring[s_tail++ & (DLOG_RECORDS - 1)], sizeof(r));
+            portEXIT_CRITICAL(&s_mux);
+            if (!any) break;
+
+            render(&r, line, sizeof(line));
+            uint32_t late = esp_log_timestamp() - r.ts_ms;
+            if (late > 2 * CONFIG_DLOG_FLUSH_MS) {
+                ESP_LOG_LEVEL((esp_log_level_t)r.level, r.tag, "%s (%u ms ago)", line, (unsigned)late);
+            } else {
+                ESP_LOG_LEVEL((esp_log_level_t)r.level, r.tag, "%s", line);
+            }
+        }
+        report_drops();
+        vTaskDelay(pdMS_TO_TICKS(CONFIG_DLOG_FLUSH_MS));
+    }
+}
+
+void dlog_init(void) {
+    APP_TASK_CREATE(s_task, dlog_task, "dlog", NULL, APP_PRIO_DLOG, APP_CORE_DLOG, NULL);
+}
+
+#else
+
+void dlog_init(void) {}
+
+void dlog_set_limit(const char* tag, uint16_t per_s, uint16_t burst) {
+    (void)tag; (void)per_s; (void)burst;
+}
+
+#endif
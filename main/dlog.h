@@ -0,0 +1,46 @@
+#pragma once
+#include <stdint.h>
+#include "esp_log.h"
+#include "sdkconfig.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Deferred log for hot paths. DLOGx(tag, fmt, ...) stores the format
+// pointer, the tag and the packed arguments in a fixed ring instead of
+// formatting on the caller; a low-priority task renders them through
+// ESP_LOG_LEVEL every CONFIG_DLOG_FLUSH_MS, so the console timestamp is the
+// print time and a line that waited longer than two periods says how long
+// ago it was logged. Each tag has a token bucket
+// (CONFIG_DLOG_TAG_RATE per second, bursts of CONFIG_DLOG_TAG_BURST);
+// messages over the limit or into a full ring are counted and reported
+// instead of printed.
+//
+// fmt must be a string literal and tag a static string: only their
+// addresses are kept. %s arguments are copied into the record, so
+// temporaries are fine, but long strings are cut to fit. Supports the
+// integer, floating point, %c, %s and %p conversions without '*'.
+// Anything that must reach the console before a crash belongs in ESP_LOGx.
+#if CONFIG_DLOG_ENABLE
+void dlog_write(esp_log_level_t level, const char* tag, const char* fmt, ...) __attribute__((format(printf, 3, 4)));
+#define DLOG_AT(level, tag, fmt, ...) do { \
+        if (LOG_LOCAL_LEVEL >= (level)) dlog_write((level), (tag), fmt, ##__VA_ARGS__); \
+    } while (0)
+#define DLOGW(tag, fmt, ...) DLOG_AT(ESP_LOG_WARN, tag, fmt, ##__VA_ARGS__)
+#define DLOGI(tag, fmt, ...) DLOG_AT(ESP_LOG_INFO, tag, fmt, ##__VA_ARGS__)
+#define DLOGD(tag, fmt, ...) DLOG_AT(ESP_LOG_DEBUG, tag, fmt, ##__VA_ARGS__)
+#else
+#define DLOGW(tag, fmt, ...) ESP_LOGW(tag, fmt, ##__VA_ARGS__)
+#define DLOGI(tag, fmt, ...) ESP_LOGI(tag, fmt, ##__VA_ARGS__)
+#define DLOGD(tag, fmt, ...) ESP_LOGD(tag, fmt, ##__VA_ARGS__)
+#endif
+
+// Start the formatting task; records written before this are kept
+void dlog_init(void);
+// Override the limit of one tag (per_s 0 = unlimited)
+void dlog_set_limit(const char* tag, uint16_t per_s, uint16_t burst);
+
+#ifdef __cplusplus
+}
+#endif
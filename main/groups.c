@@ -0,0 +1,288 @@
+#include "groups.h"
+#include "commands.h"
+#include "connectivity.h"
+#include "storage.h"
+
+#include "cJSON.h"
+#include "esp_log.h"
+#include "esp_random.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "sdkconfig.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/time.h>
+
+static const char* TAG = "groups";
+
+typedef struct {
+    char name[GROUPS_NAME_MAX + 1]; // "" = unused slot
+    uint32_t map;                  // byte i: mask of local relays for group relay i+1
+} group_t;
+
+// A relay command waiting out its jitter or target time
+typedef struct {
+    esp_timer_handle_t timer;
+    bool used;
+    bool on;
+    uint8_t mask;
+    char id[COMMAND_ID_MAX + 1];
+    int64_t rx_us;
+} pending_t;
+
+static group_t s_groups[CONFIG_GROUPS_MAX]; // MQTT task only, after init
+static pending_t s_pending[CONFIG_GROUPS_PENDING];
+static portMUX_TYPE s_mux = portMUX_INITIALIZER_UNLOCKED;
+
+static void run_relay(uint8_t mask, bool on, const char* id, int64_t rx_us) {
+    for (int ch = 1; ch <= 4; ++ch) {
+        if (!(mask & (1u << (ch - 1)))) continue;
+        if (id[0]) commands_relay_ack(ch, on, 0, id, rx_us);
+        else commands_relay(ch, on, 0);
+    }
+}
+
+static void pending_fire(void* arg) {
+    pending_t* p = arg;
+    run_relay(p->mask, p->on, p->id, p->rx_us);
+    taskENTER_CRITICAL(&s_mux);
+    p->used = false;
+    taskEXIT_CRITICAL(&s_mux);
+}
+
+static bool valid_name(const char* s) {
+    size_t n = strlen(s);
+    if (n == 0 || n > GROUPS_NAME_MAX) return false;
+    for (size_t i = 0; i < n; ++i) {
+        char c = s[i];
+        if (!((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '-' || c == '_')) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void key(char* out, size_t sz, const char* prefix, int slot) {
+    snprintf(out, sz, "%s%d", prefix, slot);
+}
+
+void groups_init(void) {
+    for (int i = 0; i < CONFIG_GROUPS_MAX; ++i) {
+        char k[16];
+        key(k, sizeof(k), "grp", i);
+        storage_get_str(k, s_groups[i].name, sizeof(s_groups[i].name), "");
+        key(k, sizeof(k), "gmap", i);
+        storage_get_u32(k, &s_groups[i].map, 0);
+        if (s_groups[i].name[0] && !valid_name(s_groups[i].name)) s_groups[i].name[0] = 0;
+        if (s_groups[i].name[0]) ESP_LOGI(TAG, "Member of group %s (map %08" PRIx32 ")", s_groups[i].name, s_groups[i].map);
+    }
+    for (int i = 0; i < CONFIG_GROUPS_PENDING; ++i) {
+        const esp_timer_create_args_t args = { .callback = pending_fire, .arg = &s_pending[i], .name = "group_cmd" };
+        esp_timer_create(&args, &s_pending[i].timer);
+    }
+}
+
+// One map entry: a local relay, 0, or a list of local relays
+static bool parse_mask(const cJSON* v, uint8_t* out) {
+    *out = 0;
+    if (cJSON_IsNumber(v)) {
+        if (v->valuedouble < 0 || v->valuedouble > 4) return false;
+        if (v->valueint) *out = (uint8_t)(1u << (v->valueint - 1));
+        return true;
+    }
+    if (!cJSON_IsArray(v)) return false;
+    const cJSON* it;
+    cJSON_ArrayForEach(it, v) {
+        if (!cJSON_IsNumber(it) || it->valuedouble < 1 || it->valuedouble > 4) return false;
+        *out |= (uint8_t)(1u << (it->valueint - 1));
+    }
+    return true;
+}
+
+bool groups_set(const char* json, int len) {
+    cJSON* root = cJSON_ParseWithLength(json, (size_t)len);
+    group_t next[CONFIG_GROUPS_MAX];
+    memset(next, 0, sizeof(next));
+    bool ok = cJSON_IsObject(root) && cJSON_GetArraySize(root) <= CONFIG_GROUPS_MAX;
+    int n = 0;
+    const cJSON* g;
+    cJSON_ArrayForEach(g, ok ? root : NULL) {
+        if (!valid_name(g->string) || !cJSON_IsArray(g) || cJSON_GetArraySize(g) > 4) {
+            ok = false;
+            break;
+        }
+        snprintf(next[n].name, sizeof(next[n].name), "%s", g->string);
+        for (int i = 0; ok && i < cJSON_GetArraySize(g); ++i) {
+            uint8_t mask;
+            ok = parse_mask(cJSON_GetArrayItem(g, i), &mask);
+            next[n].map |= (uint32_t)mask << (8 * i);
+        }
+        n++;
+    }
+    cJSON_Delete(root);
+    if (!ok) {
+        ESP_LOGW(TAG, "Invalid group membership, unchanged");
+        return false;
+    }
+
+    memcpy(s_groups, next, sizeof(s_groups));
+    for (int i = 0; i < CONFIG_GROUPS_MAX; ++i) {
+        char k[16];
+        key(k, sizeof(k), "grp", i);
+        storage_set_str(k, s_groups[i].name);
+        key(k, sizeof(k), "gmap", i);
+        storage_set_u32(k, s_groups[i].map);
+    }
+    ESP_LOGI(TAG, "Member of %d group(s)", n);
+    return true;
+}
+
+int groups_format(char* out, size_t sz) {
+    int len = snprintf(out, sz, "{");
+    bool first = true;
+    for (int g = 0; g < CONFIG_GROUPS_MAX && len < (int)sz; ++g) {
+        if (!s_groups[g].name[0]) continue;
+        len += snprintf(out + len, sz - len, "%s\"%s\":[", first ? "" : ",", s_groups[g].name);
+        first = false;
+        for (int i = 0; i < 4 && len < (int)sz; ++i) {
+            uint8_t mask = (uint8_t)(s_groups[g].map >> (8 * i));
+            len += snprintf(out + len, sz - len, "%s[", i ? "," : "");
+            for (int ch = 1; ch <= 4 && len < (int)sz; ++ch) {
+                if (mask & (1u << (ch - 1))) {
+                    len += snprintf(out + len, sz - len, "%s%d", (mask & ((1u << (ch - 1)) - 1)) ? "," : "", ch);
+                }
+            }
+            if (len < (int)sz) len += snprintf(out + len, sz - len, "]");
+        }
+        if (len < (int)sz) len += snprintf(out + len, sz - len, "]");
+    }
+    if (len < (int)sz) len += snprintf(out + len, sz - len, "}");
+    return len < (int)sz ? len : -1;
+}
+
+bool groups_name(int slot, char* out, size_t sz) {
+    if (slot < 0 || slot >= CONFIG_GROUPS_MAX || !s_groups[slot].name[0]) return false;
+    snprintf(out, sz, "%s", s_groups[slot].name);
+    return true;
+}
+
+void groups_name_filter(const char* name, char* out, size_t sz) {
+    snprintf(out, sz, "%s/group/%s/#", CONFIG_MQTT_BASE_TOPIC, name);
+}
+
+bool groups_filter(int slot, char* out, size_t sz) {
+    if (slot < 0 || slot >= CONFIG_GROUPS_MAX || !s_groups[slot].name[0]) return false;
+    groups_name_filter(s_groups[slot].name, out, sz);
+    return true;
+}
+
+// Delay before running a group relay command; -1 if "at" is out of range
+static int64_t delay_us(const cJSON* at) {
+    if (cJSON_IsNumber(at) && connectivity_is(CONN_TIME_VALID)) {
+        struct timeval tv;
+        gettimeofday(&tv, NULL);
+        // Range-check in seconds before scaling; also rejects NaN
+        double d = at->valuedouble - ((double)tv.tv_sec + tv.tv_usec / 1e6);
+        if (!(d <= CONFIG_GROUPS_MAX_DELAY_S)) return -1;
+        return d > 0 ? (int64_t)(d * 1e6) : 0; // late: run now
+    }
+    if (at) ESP_LOGW(TAG, "No valid clock for a timed group command; jittering instead");
+    return CONFIG_GROUPS_JITTER_MS ? (int64_t)(esp_random() % (CONFIG_GROUPS_JITTER_MS + 1)) * 1000 : 0;
+}
+
+static void on_group_relay(uint8_t mask, const char* data, int dlen) {
+    int64_t rx_us = esp_timer_get_time();
+    char id[COMMAND_ID_MAX + 1] = "";
+    bool on = false, valid;
+    int64_t delay;
+    if (dlen > 0 && data[0] == '{') {
+        cJSON* root = cJSON_ParseWithLength(data, (size_t)dlen);
+        const cJSON* jid = cJSON_GetObjectItemCaseSensitive(root, "id");
+        const cJSON* state = cJSON_GetObjectItemCaseSensitive(root, "state");
+        if (cJSON_IsString(jid)) snprintf(id, sizeof(id), "%s", jid->valuestring);
+        else if (cJSON_IsNumber(jid)) snprintf(id, sizeof(id), "%.15g", jid->valuedouble);
+        valid = cJSON_IsString(state) && (strcasecmp(state->valuestring, "ON") == 0 ||
+                                          strcasecmp(state->valuestring, "OFF") == 0);
+        on = valid && strcasecmp(state->valuestring, "ON") == 0;
+        delay = delay_us(cJSON_GetObjectItemCaseSensitive(root, "at"));
+        cJSON_Delete(root);
+        if (delay < 0) valid = false;
+    } else {
+        valid = (dlen == 2 && strncasecmp(data, "ON", 2) == 0) || (dlen == 3 && strncasecmp(data, "OFF", 3) == 0);
+        on = dlen == 2;
+        delay = delay_us(NULL);
+    }
+    if (!valid) {
+        ESP_LOGW(TAG, "Invalid group relay command");
+        for (int ch = 1; id[0] && ch <= 4; ++ch) {
+            if (mask & (1u << (ch - 1))) commands_reject(id, ch, rx_us);
+        }
+        return;
+    }
+    if (!delay) {
+        run_relay(mask, on, id, rx_us);
+        return;
+    }
+
+    pending_t* p = NULL;
+    taskENTER_CRITICAL(&s_mux);
+    for (int i = 0; i < CONFIG_GROUPS_PENDING && !p; ++i) {
+        if (!s_pending[i].used) {
+            p = &s_pending[i];
+            p->used = true;
+        }
+    }
+    taskEXIT_CRITICAL(&s_mux);
+    if (!p || !p->timer) {
+        // Nowhere to park it: acting late would be worse than acting now
+        if (p) p->used = false;
+        run_relay(mask, on, id, rx_us);
+        return;
+    }
+    p->mask = mask;
+    p->on = on;
+    snprintf(p->id, sizeof(p->id), "%s", id);
+    p->rx_us = rx_us;
+    esp_timer_start_once(p->timer, (uint64_t)delay);
+}
+
+bool groups_handle(const char* topic, int tlen, const char* data, int dlen, bool retained) {
+    static const char k_mid[] = "/group/";
+    size_t blen = strlen(CONFIG_MQTT_BASE_TOPIC);
+    if (tlen <= (int)(blen + sizeof(k_mid) - 1) || strncmp(topic, CONFIG_MQTT_BASE_TOPIC, blen) != 0 ||
+        strncmp(topic + blen, k_mid, sizeof(k_mid) - 1) != 0) {
+        return false;
+    }
+    const char* name = topic + blen + sizeof(k_mid) - 1;
+    const char* end = topic + tlen;
+    const char* slash = memchr(name, '/', (size_t)(end - name));
+    if (!slash) return false;
+    size_t nlen = (size_t)(slash - name);
+    const group_t* g = NULL;
+    for (int i = 0; i < CONFIG_GROUPS_MAX && !g; ++i) {
+        if (s_groups[i].name[0] && strlen(s_groups[i].name) == nlen && strncmp(s_groups[i].name, name, nlen) == 0) {
+            g = &s_groups[i];
+        }
+    }
+    if (!g) return false;
+    if (retained) {
+        // A stale group command must not replay on every reconnect
+        ESP_LOGW(TAG, "Ignoring retained message on group %s", g->name);
+        return true;
+    }
+
+    const char* rest = slash + 1;
+    int rlen = (int)(end - rest);
+    if (rlen == 11 && strncmp(rest, "relay/", 6) == 0 && rest[6] >= '1' && rest[6] <= '4' &&
+        strncmp(rest + 7, "/set", 4) == 0) {
+        uint8_t mask = (uint8_t)(g->map >> (8 * (rest[6] - '1')));
+        if (mask) on_group_relay(mask, data, dlen);
+    } else if (rlen == 13 && strncmp(rest, "mode/away/set", 13) == 0) {
+        if (dlen == 2 && strncasecmp(data, "ON", 2) == 0) commands_set_away(true);
+        else if (dlen == 3 && strncasecmp(data, "OFF", 3) == 0) commands_set_away(false);
+    }
+    return true;
+}
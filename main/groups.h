@@ -0,0 +1,45 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include "sdkconfig.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Group membership, so one publish drives many controllers. Besides its own
+// topics the device obeys <CONFIG_MQTT_BASE_TOPIC>/group/<name>/... for
+// every group it belongs to:
+//   .../relay/<n>/set    ON/OFF, or {"state":"OFF","at":<epoch s>,"id":"..."}
+//   .../mode/away/set    ON/OFF
+// Group relay n drives the local relays given by this device's channel map
+// for the group. A relay command runs after a random delay of up to
+// CONFIG_GROUPS_JITTER_MS, so members don't all answer the broker at once,
+// or at "at" (Unix seconds, fractions allowed) for simultaneous switching
+// once the clock is valid. With "id" every local relay is acknowledged on
+// <base>/ack as for direct commands. Retained group messages are ignored.
+//
+// Membership and maps are persisted via storage.c and set as a whole from
+// <base>/groups/set, in the form {"<name>":[<map of relay 1>, ... 4]}, where
+// each map is a local relay 1..4, 0 for none, or a list of local relays.
+#define GROUPS_NAME_MAX 31
+// Longest groups_format() output, NUL included: every slot used, with a
+// full-length name and all four relays in each of the four maps
+#define GROUPS_FORMAT_MAX (CONFIG_GROUPS_MAX * (GROUPS_NAME_MAX + 45) + 3)
+
+void groups_init(void);
+// Replace the membership; false (nothing changed) if the document is invalid
+bool groups_set(const char* json, int len);
+// Current membership in the <base>/groups/set form; length, or -1 if too small
+int groups_format(char* out, size_t sz);
+// Name of membership slot 0..CONFIG_GROUPS_MAX-1; false if unused
+bool groups_name(int slot, char* out, size_t sz);
+// Subscription filter for a group name, or for a slot (false if unused)
+void groups_name_filter(const char* name, char* out, size_t sz);
+bool groups_filter(int slot, char* out, size_t sz);
+// A message on a group topic; false if the topic isn't one of ours
+bool groups_handle(const char* topic, int tlen, const char* data, int dlen, bool retained);
+
+#ifdef __cplusplus
+}
+#endif
@@ -2,10 +2,30 @@
 #include "relay.h"
 #include "safety.h"
 #include "ota.h"
+#include "ota_mqtt.h"
+#include "boot.h"
+#include "connectivity.h"
+#include "time_sync.h"
+#include "history.h"
+#include "spool.h"
+#include "metrics.h"
+#include "trace.h"
+#include "control.h"
+#include "commands.h"
+#include "groups.h"
+#include "local_api.h"
+#include "dlog.h"
+#include "relay_stats.h"
+#include "app_tasks.h"
 
 #include "esp_log.h"
 #include "mqtt_client.h"
 #include "esp_system.h"
+#include "cJSON.h"
+#include "esp_random.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
 #include "sdkconfig.h"
 #include <stdio.h>
 #include <string.h>
@@ -23,24 +43,69 @@ static char s_device_name[64] = {0};
 static char s_base_topic[128] = {0};         // e.g., greenhouse/<id>
 static char s_availability_topic[160] = {0}; // base/status
 static char s_ha_prefix[64] = {0};           // e.g., homeassistant
+static bool s_started = false;
+static esp_timer_handle_t s_reconnect_timer = NULL;
+static uint32_t s_reconnect_attempt = 0;
+// Work posted to the mqtt_out task, see post_work()
+#define WORK_CONNECT     (1u << 0)
+#define WORK_RELAY(ch)   (1u << (ch))        // channels 1..4
+#define WORK_MAX_ON(ch)  (1u << (4 + (ch)))
+#define WORK_AWAY        (1u << 9)
+#define WORK_SCHEDULE    (1u << 10)
+#define WORK_WINDOWS     (1u << 11)
+#define WORK_CONFIG      (1u << 12)
+#define WORK_ACK         (1u << 13)
+#define WORK_RELAY_STATS (1u << 14)
+// Command acks waiting for mqtt_out; room for a full control queue plus the
+// busy/invalid replies sent straight from the command handlers
+#define ACK_JSON_MAX    192
+#define ACK_QUEUE_LEN   (2 * CONFIG_CONTROL_QUEUE_LEN)
+static QueueHandle_t s_ack_q = NULL;
+static bool s_stats_discovery_sent = false;   // relay usage discovery, see publish_discovery()
+// Last values posted, sent by the worker
+static bool s_relay_echo[4];
+static uint32_t s_max_on_echo[4];
+static bool s_away_echo, s_schedule_echo;
+static TaskHandle_t s_worker = NULL;
+static uint32_t s_work = 0;
+APP_TASK_STORAGE(s_worker_task, APP_STACK_MQTT_OUT);
+static uint16_t s_trace_id = 0; // current MQTT_EVENT_DATA, see trace.h
+static int64_t s_rx_us = 0;     // when it arrived, for command acks
 
 static void publish_discovery(void);
 static void publish_availability(bool online);
 static void publish_initial_states(void);
+static void run_work(uint32_t work);
 
-static void publish(const char* topic, const char* payload, int qos, bool retain) {
-    if (!s_client) return;
+static int publish(const char* topic, const char* payload, int qos, bool retain) {
+    if (!s_client) return -1;
+    int64_t t0 = esp_timer_get_time();
     int msg_id = esp_mqtt_client_publish(s_client, topic, payload, 0, qos, retain);
+    metrics_mqtt_publish(msg_id, qos, t0);
     if (msg_id < 0) {
         ESP_LOGW(TAG, "Publish failed to %s", topic);
     }
+    return msg_id;
+}
+
+// Hand the message to the MQTT task's outbox instead of writing the socket
+// here. Still takes the esp-mqtt lock, so not for the control task.
+static int enqueue(const char* topic, const char* payload, int qos, bool retain) {
+    if (!s_client) return -1;
+    int64_t t0 = esp_timer_get_time();
+    int msg_id = esp_mqtt_client_enqueue(s_client, topic, payload, 0, qos, retain, true);
+    metrics_mqtt_publish(msg_id, qos, t0);
+    if (msg_id < 0) {
+        ESP_LOGW(TAG, "Enqueue failed to %s", topic);
+    }
+    return msg_id;
 }
 
 static void subscribe(const char* topic, int qos) {
     if (!s_client) return;
     int msg_id = esp_mqtt_client_subscribe(s_client, topic, qos);
     if (msg_id >= 0) {
-        ESP_LOGI(TAG, "Subscribed: %s", topic);
+        DLOGI(TAG, "Subscribed: %s", topic);
     } else {
         ESP_LOGW(TAG, "Subscribe failed: %s", topic);
     }
@@ -69,78 +134,392 @@ static bool parse_u32(const char* payload, int len, uint32_t* out) {
     return true;
 }
 
+// {"id":"<correlation id>","state":"ON"|"OFF"} (or "on":true/false); the
+// outcome is acknowledged on <base>/ack. Without an id it's a plain command.
+static void on_command_relay_json(int channel, const char* payload, int len) {
+    cJSON* root = cJSON_ParseWithLength(payload, (size_t)len);
+    const cJSON* id = cJSON_GetObjectItemCaseSensitive(root, "id");
+    const cJSON* state = cJSON_GetObjectItemCaseSensitive(root, "state");
+    const cJSON* on = cJSON_GetObjectItemCaseSensitive(root, "on");
+    char idbuf[COMMAND_ID_MAX + 1] = "";
+    if (cJSON_IsString(id)) snprintf(idbuf, sizeof(idbuf), "%s", id->valuestring);
+    else if (cJSON_IsNumber(id)) snprintf(idbuf, sizeof(idbuf), "%.15g", id->valuedouble);
+
+    bool req_on = false, valid = false;
+    if (cJSON_IsString(state)) {
+        valid = parse_bool(state->valuestring, (int)strlen(state->valuestring), &req_on);
+    } else if (cJSON_IsBool(on)) {
+        valid = true;
+        req_on = cJSON_IsTrue(on);
+    }
+    cJSON_Delete(root);
+
+    if (!idbuf[0]) {
+        if (valid) commands_relay(channel, req_on, s_trace_id);
+        else ESP_LOGW(TAG, "Relay %d: unrecognised command", channel);
+    } else if (!valid) {
+        commands_reject(idbuf, channel, s_rx_us);
+    } else {
+        commands_relay_ack(channel, req_on, s_trace_id, idbuf, s_rx_us);
+    }
+}
+
 static void on_command_relay(int channel, const char* payload, int len) {
+    if (len > 0 && payload[0] == '{') {
+        on_command_relay_json(channel, payload, len);
+        return;
+    }
     bool req_on = false;
-    if (!parse_bool(payload, len, &req_on)) return;
+    if (!parse_bool(payload, len, &req_on)) {
+        ESP_LOGW(TAG, "Relay %d: unrecognised command", channel);
+        return;
+    }
+
+    // Safety check, actuation and the state echo run in the control task
+    commands_relay(channel, req_on, s_trace_id);
+}
 
-    if (req_on && !safety_can_turn_on(channel)) {
-        ESP_LOGW(TAG, "Command blocked: relay %d ON not allowed", channel);
-        ha_mqtt_publish_relay_state(channel, relay_get_channel(channel));
+static void on_command_trace_dump(void) {
+    size_t len = 0;
+    void* dump = trace_dump(&len);
+    if (!dump) {
+        ESP_LOGW(TAG, "Trace dump unavailable");
         return;
     }
+    char topic[192];
+    snprintf(topic, sizeof(topic), "%s/trace", s_base_topic);
+    if (esp_mqtt_client_publish(s_client, topic, dump, (int)len, 0, false) < 0) {
+        ESP_LOGW(TAG, "Trace publish failed (%u bytes)", (unsigned)len);
+    }
+    free(dump);
+}
+
+static void publish_groups(void) {
+    char topic[192], payload[GROUPS_FORMAT_MAX];
+    snprintf(topic, sizeof(topic), "%s/groups", s_base_topic);
+    if (groups_format(payload, sizeof(payload)) >= 0) publish(topic, payload, 1, true);
+    else ESP_LOGW(TAG, "Group membership too long to publish");
+}
+
+// Swap the group subscriptions along with the membership
+static void on_command_groups(const char* payload, int len) {
+    char filter[192], name[GROUPS_NAME_MAX + 1];
+    char old[CONFIG_GROUPS_MAX][GROUPS_NAME_MAX + 1];
+    for (int g = 0; g < CONFIG_GROUPS_MAX; ++g) {
+        if (!groups_name(g, old[g], sizeof(old[g]))) old[g][0] = 0;
+    }
+    if (groups_set(payload, len) && s_client) {
+        for (int g = 0; g < CONFIG_GROUPS_MAX; ++g) {
+            if (!old[g][0]) continue;
+            bool kept = false;
+            for (int n = 0; n < CONFIG_GROUPS_MAX && !kept; ++n) {
+                kept = groups_name(n, name, sizeof(name)) && strcmp(name, old[g]) == 0;
+            }
+            if (!kept) {
+                groups_name_filter(old[g], filter, sizeof(filter));
+                esp_mqtt_client_unsubscribe(s_client, filter);
+            }
+        }
+        for (int g = 0; g < CONFIG_GROUPS_MAX; ++g) {
+            if (groups_filter(g, filter, sizeof(filter))) subscribe(filter, 1);
+        }
+    }
+    publish_groups();
+}
 
-    relay_set_channel(channel, req_on);
-    safety_on_relay_state_change(channel, req_on);
-    ha_mqtt_publish_relay_state(channel, relay_get_channel(channel));
+// A rejected document leaves the config alone and says why on <base>/config/error
+static void on_command_config(const char* payload, int len) {
+    char bad[32];
+    if (commands_apply_config(payload, len, bad, sizeof(bad))) return;
+    ESP_LOGW(TAG, "Config document rejected: %s", bad);
+    char topic[192], msg[64];
+    snprintf(topic, sizeof(topic), "%s/config/error", s_base_topic);
+    snprintf(msg, sizeof(msg), "{\"error\":\"invalid %s\"}", bad);
+    publish(topic, msg, 1, false);
 }
 
 static void on_command_away(const char* payload, int len) {
     bool on=false; if (!parse_bool(payload, len, &on)) return;
-    safety_set_away_mode(on);
-    ha_mqtt_publish_away_state(safety_get_away_mode());
-    safety_apply_policy_now();
+    commands_set_away(on);
 }
 
 static void on_command_schedule_enforce(const char* payload, int len) {
     bool on=false; if (!parse_bool(payload, len, &on)) return;
-    safety_set_schedule_enforce(on);
-    ha_mqtt_publish_schedule_state(safety_get_schedule_enforce());
-    safety_apply_policy_now();
+    commands_set_schedule_enforce(on);
 }
 
 static void on_command_max_on(int channel, const char* payload, int len) {
-    // minutes -> seconds
     uint32_t minutes=0; if (!parse_u32(payload, len, &minutes)) return;
-    uint32_t sec = minutes * 60u;
-    safety_set_max_on_seconds(channel, sec);
-    ha_mqtt_publish_max_on_minutes(channel, minutes);
+    commands_set_max_on(channel, minutes);
 }
 
 static void on_command_window(const char* which, const char* payload, int len) {
     // minutes 0..1439
     uint32_t v=0; if (!parse_u32(payload, len, &v)) return;
-    if (v > 1439) v = 1439;
-    uint16_t w1s, w1e, w2s, w2e;
-    safety_get_schedule_windows(&w1s, &w1e, &w2s, &w2e);
-    if (strcmp(which, "w1_start") == 0) w1s = (uint16_t)v;
-    else if (strcmp(which, "w1_end") == 0) w1e = (uint16_t)v;
-    else if (strcmp(which, "w2_start") == 0) w2s = (uint16_t)v;
-    else if (strcmp(which, "w2_end") == 0) w2e = (uint16_t)v;
-    else return;
-
-    safety_set_schedule_windows(w1s, w1e, w2s, w2e);
-    ha_mqtt_publish_schedule_windows();
-    safety_apply_policy_now();
+    commands_set_window(which, v);
 }
 
 static void on_command_ota_url(const char* payload, int len) {
     char url[256];
-    int n = len < (int)sizeof(url)-1 ? len : (int)sizeof(url)-1;
-    memcpy(url, payload, n); url[n] = 0;
+    // A cut-down URL would point somewhere else; refuse it instead
+    if (len >= (int)sizeof(url)) {
+        ESP_LOGW(TAG, "OTA URL too long (%d bytes)", len);
+        return;
+    }
+    memcpy(url, payload, len); url[len] = 0;
     ota_set_url(url);
     ha_mqtt_publish_ota_url();
 }
 
+static void on_command_ota_delta_url(const char* payload, int len) {
+    char url[256];
+    if (len >= (int)sizeof(url)) {
+        ESP_LOGW(TAG, "OTA delta URL too long (%d bytes)", len);
+        return;
+    }
+    memcpy(url, payload, len); url[len] = 0;
+    ota_set_delta_url(url);
+    ha_mqtt_publish_ota_url();
+}
+
 static void on_command_ota_start(void) {
     char url[256]; ota_get_url(url, sizeof(url));
     ESP_LOGW(TAG, "OTA trigger -> %s", url);
-    ota_trigger(url);
+    if (ota_trigger(NULL) != ESP_OK) ha_mqtt_publish_ota_progress("busy", 0, 0, 0, 0);
+}
+
+// Start the client on first use, afterwards ask it to reconnect
+static void client_connect(void) {
+    if (!s_client) return;
+    if (!s_started) {
+        s_started = esp_mqtt_client_start(s_client) == ESP_OK;
+    } else {
+        esp_mqtt_client_reconnect(s_client);
+    }
+}
+
+// Starting or reconnecting the client takes the esp-mqtt lock, which the
+// client task holds for a whole connect attempt. The event loop and the
+// esp_timer task must not wait that out, so they hand the work to mqtt_out.
+static void post_work(uint32_t bits) {
+    __atomic_fetch_or(&s_work, bits, __ATOMIC_RELEASE);
+    if (s_worker) xTaskNotifyGive(s_worker);
+}
+
+static void worker_task(void* arg) {
+    (void)arg;
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        run_work(__atomic_exchange_n(&s_work, 0, __ATOMIC_ACQUIRE));
+    }
+}
+
+static void reconnect_timer_cb(void* arg) {
+    (void)arg;
+    post_work(WORK_CONNECT);
+}
+
+// Broker unreachable while the link is up: retry with jittered exponential
+// backoff. With no IP we wait for the IP-up transition instead.
+static void schedule_reconnect(void) {
+    if (!s_reconnect_timer || !connectivity_is(CONN_IP)) return;
+    uint32_t d = CONFIG_MQTT_RECONNECT_MIN_MS;
+    for (uint32_t i = 0; i < s_reconnect_attempt && d < CONFIG_MQTT_RECONNECT_MAX_MS; ++i) d *= 2;
+    if (d > CONFIG_MQTT_RECONNECT_MAX_MS) d = CONFIG_MQTT_RECONNECT_MAX_MS;
+    d = d / 2 + esp_random() % (d / 2 + 1);
+    s_reconnect_attempt++;
+    esp_timer_stop(s_reconnect_timer);
+    esp_timer_start_once(s_reconnect_timer, (uint64_t)d * 1000);
+}
+
+static void on_connectivity(uint32_t state, uint32_t changed, void* ctx) {
+    if (!(changed & CONN_IP)) return;
+    if (state & CONN_IP) {
+        // Link is back: connect now rather than waiting out a backoff
+        esp_timer_stop(s_reconnect_timer);
+        s_reconnect_attempt = 0;
+        post_work(WORK_CONNECT);
+    } else {
+        esp_timer_stop(s_reconnect_timer);
+    }
+}
+
+// One complete message, by topic
+static void route(const char* topic, int tlen, const char* data, int dlen, bool retain) {
+    // Firmware chunks are the bulk of traffic during a transfer; match them first
+    {
+        char tpat[192];
+        snprintf(tpat, sizeof(tpat), "%s/ota/chunk", s_base_topic);
+        if (((int)strlen(tpat) == tlen && strncmp(topic, tpat, tlen) == 0) ||
+            ((int)strlen(CONFIG_OTA_MQTT_GROUP_TOPIC) == tlen && strncmp(topic, CONFIG_OTA_MQTT_GROUP_TOPIC, tlen) == 0)) {
+            ota_mqtt_handle_chunk(data, dlen);
+            return;
+        }
+    }
+    // Relay commands
+    for (int ch = 1; ch <= 4; ++ch) {
+        char tpat[192];
+        snprintf(tpat, sizeof(tpat), "%s/relay/%d/set", s_base_topic, ch);
+        if ((int)strlen(tpat) == tlen && strncmp(topic, tpat, tlen) == 0) {
+            TRACE(TRACE_RELAY_MATCHED, s_trace_id);
+            on_command_relay(ch, data, dlen);
+            return;
+        }
+        snprintf(tpat, sizeof(tpat), "%s/relay/%d/max_on/set", s_base_topic, ch);
+        if ((int)strlen(tpat) == tlen && strncmp(topic, tpat, tlen) == 0) {
+            on_command_max_on(ch, data, dlen);
+            return;
+        }
+    }
+    if (groups_handle(topic, tlen, data, dlen, retain)) return;
+    // Away
+    {
+        char tpat[192];
+        snprintf(tpat, sizeof(tpat), "%s/mode/away/set", s_base_topic);
+        if ((int)strlen(tpat) == tlen && strncmp(topic, tpat, tlen) == 0) {
+            on_command_away(data, dlen);
+            return;
+        }
+    }
+    // Schedule enforce
+    {
+        char tpat[192];
+        snprintf(tpat, sizeof(tpat), "%s/schedule/enforce/set", s_base_topic);
+        if ((int)strlen(tpat) == tlen && strncmp(topic, tpat, tlen) == 0) {
+            on_command_schedule_enforce(data, dlen);
+            return;
+        }
+    }
+    // Window numbers
+    const char* keys[] = {"w1_start","w1_end","w2_start","w2_end"};
+    for (size_t i=0;i<4;i++) {
+        char tpat[192];
+        snprintf(tpat, sizeof(tpat), "%s/schedule/%s/set", s_base_topic, keys[i]);
+        if ((int)strlen(tpat) == tlen && strncmp(topic, tpat, tlen) == 0) {
+            on_command_window(keys[i], data, dlen);
+            return;
+        }
+    }
+    // Trace dump
+    {
+        char tpat[192];
+        snprintf(tpat, sizeof(tpat), "%s/trace/dump", s_base_topic);
+        if ((int)strlen(tpat) == tlen && strncmp(topic, tpat, tlen) == 0) {
+            on_command_trace_dump();
+            return;
+        }
+    }
+    // Bulk config
+    {
+        char tpat[192];
+        snprintf(tpat, sizeof(tpat), "%s/config/set", s_base_topic);
+        if ((int)strlen(tpat) == tlen && strncmp(topic, tpat, tlen) == 0) {
+            on_command_config(data, dlen);
+            return;
+        }
+    }
+    // Group membership
+    {
+        char tpat[192];
+        snprintf(tpat, sizeof(tpat), "%s/groups/set", s_base_topic);
+        if ((int)strlen(tpat) == tlen && strncmp(topic, tpat, tlen) == 0) {
+            on_command_groups(data, dlen);
+            return;
+        }
+    }
+    // History query
+    {
+        char tpat[192];
+        snprintf(tpat, sizeof(tpat), "%s/history/query", s_base_topic);
+        if ((int)strlen(tpat) == tlen && strncmp(topic, tpat, tlen) == 0) {
+            history_request_query(data, dlen);
+            return;
+        }
+    }
+    // OTA URL and trigger
+    {
+        char tpat[192];
+        snprintf(tpat, sizeof(tpat), "%s/ota/url/set", s_base_topic);
+        if ((int)strlen(tpat) == tlen && strncmp(topic, tpat, tlen) == 0) {
+            on_command_ota_url(data, dlen);
+            return;
+        }
+    }
+    {
+        char tpat[192];
+        snprintf(tpat, sizeof(tpat), "%s/ota/delta_url/set", s_base_topic);
+        if ((int)strlen(tpat) == tlen && strncmp(topic, tpat, tlen) == 0) {
+            on_command_ota_delta_url(data, dlen);
+            return;
+        }
+    }
+    {
+        char tpat[192];
+        snprintf(tpat, sizeof(tpat), "%s/ota/update", s_base_topic);
+        if ((int)strlen(tpat) == tlen && strncmp(topic, tpat, tlen) == 0) {
+            on_command_ota_start();
+            return;
+        }
+    }
+}
+
+// Messages larger than the client's receive buffer arrive as consecutive
+// MQTT_EVENT_DATA fragments, only the first carrying the topic. They are
+// copied into a fixed buffer and routed once complete; anything larger
+// than the buffer is dropped as it streams past. Either way a fragment
+// costs at most one copy, so the small commands queued behind a big
+// message wait for nothing but the network.
+static struct {
+    bool active;
+    bool drop;
+    bool retain;
+    int tlen;
+    int total;
+    int got;
+    char topic[192];
+} s_frag;
+static char s_frag_buf[CONFIG_MQTT_REASSEMBLY_MAX];
+
+static void on_data(esp_mqtt_event_handle_t event) {
+    if (event->current_data_offset == 0) {
+        if (event->topic_len <= 0) return;
+        if (event->data_len >= event->total_data_len) {
+            // The common case: whole in one event, routed in place
+            route(event->topic, event->topic_len, event->data, event->data_len, event->retain);
+            return;
+        }
+        if (s_frag.active) ESP_LOGW(TAG, "Fragmented message on %.*s cut short", s_frag.tlen, s_frag.topic);
+        s_frag.active = true;
+        s_frag.retain = event->retain;
+        s_frag.total = event->total_data_len;
+        s_frag.got = 0;
+        s_frag.drop = event->total_data_len > (int)sizeof(s_frag_buf) || event->topic_len > (int)sizeof(s_frag.topic);
+        s_frag.tlen = event->topic_len < (int)sizeof(s_frag.topic) ? event->topic_len : (int)sizeof(s_frag.topic);
+        memcpy(s_frag.topic, event->topic, s_frag.tlen);
+        if (s_frag.drop) {
+            ESP_LOGW(TAG, "Dropping %d-byte message on %.*s (limit %d)", s_frag.total, s_frag.tlen, s_frag.topic,
+                     (int)sizeof(s_frag_buf));
+        }
+    } else if (!s_frag.active || event->current_data_offset != s_frag.got) {
+        return; // continuation of a message we never saw start
+    }
+
+    if (!s_frag.drop && s_frag.got + event->data_len <= s_frag.total) {
+        memcpy(s_frag_buf + s_frag.got, event->data, event->data_len);
+    }
+    s_frag.got += event->data_len;
+    if (s_frag.got < s_frag.total) return;
+    s_frag.active = false;
+    if (!s_frag.drop && s_frag.got == s_frag.total) route(s_frag.topic, s_frag.tlen, s_frag_buf, s_frag.total, s_frag.retain);
 }
 
 static esp_err_t mqtt_event_handler_cb(esp_mqtt_event_handle_t event) {
     switch (event->event_id) {
         case MQTT_EVENT_CONNECTED: {
             ESP_LOGI(TAG, "MQTT connected");
+            s_reconnect_attempt = 0;
+            boot_mark(BOOT_MS_MQTT_CONNECTED);
+            connectivity_set(CONN_BROKER_UP);
             publish_availability(true);
             publish_discovery();
             publish_initial_states();
@@ -157,81 +536,33 @@ static esp_err_t mqtt_event_handler_cb(esp_mqtt_event_handle_t event) {
             const char* keys[] = {"w1_start","w1_end","w2_start","w2_end"};
             for (int i=0;i<4;i++) { snprintf(topic, sizeof(topic), "%s/schedule/%s/set", s_base_topic, keys[i]); subscribe(topic, 1);}            
 snprintf(topic, sizeof(topic), "%s/ota/url/set", s_base_topic); subscribe(topic, 1);
+            snprintf(topic, sizeof(topic), "%s/ota/delta_url/set", s_base_topic); subscribe(topic, 1);
             snprintf(topic, sizeof(topic), "%s/ota/update", s_base_topic); subscribe(topic, 1);
+            snprintf(topic, sizeof(topic), "%s/ota/chunk", s_base_topic); subscribe(topic, 0);
+            subscribe(CONFIG_OTA_MQTT_GROUP_TOPIC, 0);
+            snprintf(topic, sizeof(topic), "%s/history/query", s_base_topic); subscribe(topic, 0);
+            snprintf(topic, sizeof(topic), "%s/trace/dump", s_base_topic); subscribe(topic, 0);
+            snprintf(topic, sizeof(topic), "%s/groups/set", s_base_topic); subscribe(topic, 1);
+            snprintf(topic, sizeof(topic), "%s/config/set", s_base_topic); subscribe(topic, 1);
+            for (int g = 0; g < CONFIG_GROUPS_MAX; ++g) {
+                if (groups_filter(g, topic, sizeof(topic))) subscribe(topic, 1);
+            }
             break; }
         case MQTT_EVENT_DISCONNECTED:
             ESP_LOGW(TAG, "MQTT disconnected");
+            connectivity_clear(CONN_BROKER_UP);
+            s_frag.active = false; // a partial message won't be continued
+            schedule_reconnect();
             // LWT will show offline; enforce safety now
-            safety_apply_policy_now();
+            control_apply_policy();
             break;
-        case MQTT_EVENT_DATA: {
-            const char* topic = event->topic;
-            int tlen = event->topic_len;
-            const char* data = event->data;
-            int dlen = event->data_len;
-
-            if (tlen <= 0) break;
-            // Relay commands
-            for (int ch = 1; ch <= 4; ++ch) {
-                char tpat[192];
-                snprintf(tpat, sizeof(tpat), "%s/relay/%d/set", s_base_topic, ch);
-                if ((int)strlen(tpat) == tlen && strncmp(topic, tpat, tlen) == 0) {
-                    on_command_relay(ch, data, dlen);
-                    return ESP_OK;
-                }
-                snprintf(tpat, sizeof(tpat), "%s/relay/%d/max_on/set", s_base_topic, ch);
-                if ((int)strlen(tpat) == tlen && strncmp(topic, tpat, tlen) == 0) {
-                    on_command_max_on(ch, data, dlen);
-                    return ESP_OK;
-                }
-            }
-            // Away
-            {
-                char tpat[192];
-                snprintf(tpat, sizeof(tpat), "%s/mode/away/set", s_base_topic);
-                if ((int)strlen(tpat) == tlen && strncmp(topic, tpat, tlen) == 0) {
-                    on_command_away(data, dlen);
-                    return ESP_OK;
-                }
-            }
-            // Schedule enforce
-            {
-                char tpat[192];
-                snprintf(tpat, sizeof(tpat), "%s/schedule/enforce/set", s_base_topic);
-                if ((int)strlen(tpat) == tlen && strncmp(topic, tpat, tlen) == 0) {
-                    on_command_schedule_enforce(data, dlen);
-                    return ESP_OK;
-                }
-            }
-            // Window numbers
-            const char* keys[] = {"w1_start","w1_end","w2_start","w2_end"};
-            for (size_t i=0;i<4;i++) {
-                char tpat[192];
-                snprintf(tpat, sizeof(tpat), "%s/schedule/%s/set", s_base_topic, keys[i]);
-                if ((int)strlen(tpat) == tlen && strncmp(topic, tpat, tlen) == 0) {
-                    on_command_window(keys[i], data, dlen);
-                    return ESP_OK;
-                }
-            }
-            // OTA URL and trigger
-            {
-                char tpat[192];
-                snprintf(tpat, sizeof(tpat), "%s/ota/url/set", s_base_topic);
-                if ((int)strlen(tpat) == tlen && strncmp(topic, tpat, tlen) == 0) {
-                    on_command_ota_url(data, dlen);
-                    return ESP_OK;
-                }
-            }
-            {
-                char tpat[192];
-                snprintf(tpat, sizeof(tpat), "%s/ota/update", s_base_topic);
-                if ((int)strlen(tpat) == tlen && strncmp(topic, tpat, tlen) == 0) {
-                    on_command_ota_start();
-                    return ESP_OK;
-                }
-            }
+        case MQTT_EVENT_PUBLISHED:
+            metrics_mqtt_published(event->msg_id);
+            spool_on_published(event->msg_id);
+            break;
+        case MQTT_EVENT_DATA:
+            on_data(event);
             break;
-        }
         default:
             break;
     }
@@ -240,6 +571,10 @@ snprintf(topic, sizeof(topic), "%s/ota/url/set", s_base_topic); subscribe(topic,
 
 static void mqtt_event_handler(void* handler_args, esp_event_base_t base, int32_t event_id, void* event_data) {
     esp_mqtt_event_handle_t event = (esp_mqtt_event_handle_t)event_data;
+    if (event_id == MQTT_EVENT_DATA) {
+        s_rx_us = esp_timer_get_time();
+        TRACE(TRACE_MQTT_RX, ++s_trace_id);
+    }
     mqtt_event_handler_cb(event);
 }
 
@@ -258,10 +593,25 @@ void ha_mqtt_start(const char* device_name, const char* device_id) {
         .session.last_will.msg = "offline",
         .session.last_will.retain = true,
         .session.last_will.qos = 1,
+        // Reconnects are driven by connectivity transitions, see on_connectivity()
+        .network.disable_auto_reconnect = true,
+        // Receive buffer holds a whole firmware chunk; transmit keeps the default
+        .buffer.size = CONFIG_OTA_MQTT_CHUNK_MAX + OTA_CHUNK_HDR_LEN + 256,
+        .buffer.out_size = 1024,
+        .outbox.limit = CONFIG_MQTT_OUTBOX_LIMIT,
     };
     s_client = esp_mqtt_client_init(&cfg);
     esp_mqtt_client_register_event(s_client, ESP_EVENT_ANY_ID, mqtt_event_handler, NULL);
-    esp_mqtt_client_start(s_client);
+
+    const esp_timer_create_args_t targs = {
+        .callback = reconnect_timer_cb,
+        .name = "mqtt_reconnect",
+    };
+    esp_timer_create(&targs, &s_reconnect_timer);
+    s_ack_q = xQueueCreate(ACK_QUEUE_LEN, ACK_JSON_MAX);
+    APP_TASK_CREATE(s_worker_task, worker_task, "mqtt_out", NULL, APP_PRIO_MQTT_OUT, APP_CORE_MQTT_OUT, &s_worker);
+    connectivity_subscribe(on_connectivity, NULL);
+    post_work(WORK_CONNECT);
 }
 
 static void add_device_block(char* out, size_t out_sz) {
@@ -286,18 +636,18 @@ static void publish_discovery(void) {
 
         char payload[768];
         snprintf(payload, sizeof(payload),
-            "{\"
-              name\":\"%s Relay %d\",\
-              unique_id\":\"%s_relay%d\",\
-              command_topic\":\"%s\",\
-              state_topic\":\"%s\",\
-              availability_topic\":\"%s\",\
-              payload_available\":\"online\",\
-              payload_not_available\":\"offline\",\
-              payload_on\":\"ON\",\
-              payload_off\":\"OFF\",\
-              %s\
-            }",
+            "{"
+            "\"name\":\"%s Relay %d\","
+            "\"unique_id\":\"%s_relay%d\","
+            "\"command_topic\":\"%s\","
+            "\"state_topic\":\"%s\","
+            "\"availability_topic\":\"%s\","
+            "\"payload_available\":\"online\","
+            "\"payload_not_available\":\"offline\","
+            "\"payload_on\":\"ON\","
+            "\"payload_off\":\"OFF\","
+            "%s"
+            "}",
             s_device_name, ch, s_device_id, ch, cmd_t, stat_t, s_availability_topic, dev);
         publish(topic, payload, 1, true);
     }
@@ -311,18 +661,18 @@ static void publish_discovery(void) {
         char payload[768], devb[256];
         add_device_block(devb, sizeof(devb));
         snprintf(payload, sizeof(payload),
-            "{\"
-              name\":\"%s CO2\",\
-              unique_id\":\"%s_co2\",\
-              state_topic\":\"%s\",\
-              availability_topic\":\"%s\",\
-              payload_available\":\"online\",\
-              payload_not_available\":\"offline\",\
-              unit_of_measurement\":\"ppm\",\
-              device_class\":\"carbon_dioxide\",\
-              state_class\":\"measurement\",\
-              %s\
-            }",
+            "{"
+            "\"name\":\"%s CO2\","
+            "\"unique_id\":\"%s_co2\","
+            "\"state_topic\":\"%s\","
+            "\"availability_topic\":\"%s\","
+            "\"payload_available\":\"online\","
+            "\"payload_not_available\":\"offline\","
+            "\"unit_of_measurement\":\"ppm\","
+            "\"device_class\":\"carbon_dioxide\","
+            "\"state_class\":\"measurement\","
+            "%s"
+            "}",
             s_device_name, s_device_id, state_t, s_availability_topic, devb);
         publish(topic, payload, 1, true);
     }
@@ -335,18 +685,18 @@ static void publish_discovery(void) {
         char payload[768], devb[256];
         add_device_block(devb, sizeof(devb));
         snprintf(payload, sizeof(payload),
-            "{\"
-              name\":\"%s Temperature\",\
-              unique_id\":\"%s_temperature\",\
-              state_topic\":\"%s\",\
-              availability_topic\":\"%s\",\
-              payload_available\":\"online\",\
-              payload_not_available\":\"offline\",\
-              unit_of_measurement\":\"°C\",\
-              device_class\":\"temperature\",\
-              state_class\":\"measurement\",\
-              %s\
-            }",
+            "{"
+            "\"name\":\"%s Temperature\","
+            "\"unique_id\":\"%s_temperature\","
+            "\"state_topic\":\"%s\","
+            "\"availability_topic\":\"%s\","
+            "\"payload_available\":\"online\","
+            "\"payload_not_available\":\"offline\","
+            "\"unit_of_measurement\":\"°C\","
+            "\"device_class\":\"temperature\","
+            "\"state_class\":\"measurement\","
+            "%s"
+            "}",
             s_device_name, s_device_id, state_t, s_availability_topic, devb);
         publish(topic, payload, 1, true);
     }
@@ -359,18 +709,18 @@ static void publish_discovery(void) {
         char payload[768], devb[256];
         add_device_block(devb, sizeof(devb));
         snprintf(payload, sizeof(payload),
-            "{\"
-              name\":\"%s Humidity\",\
-              unique_id\":\"%s_humidity\",\
-              state_topic\":\"%s\",\
-              availability_topic\":\"%s\",\
-              payload_available\":\"online\",\
-              payload_not_available\":\"offline\",\
-              unit_of_measurement\":\"%%\",\
-              device_class\":\"humidity\",\
-              state_class\":\"measurement\",\
-              %s\
-            }",
+            "{"
+            "\"name\":\"%s Humidity\","
+            "\"unique_id\":\"%s_humidity\","
+            "\"state_topic\":\"%s\","
+            "\"availability_topic\":\"%s\","
+            "\"payload_available\":\"online\","
+            "\"payload_not_available\":\"offline\","
+            "\"unit_of_measurement\":\"%%\","
+            "\"device_class\":\"humidity\","
+            "\"state_class\":\"measurement\","
+            "%s"
+            "}",
             s_device_name, s_device_id, state_t, s_availability_topic, devb);
         publish(topic, payload, 1, true);
     }
@@ -385,18 +735,18 @@ static void publish_discovery(void) {
         char payload[768], devb[256];
         add_device_block(devb, sizeof(devb));
         snprintf(payload, sizeof(payload),
-            "{\"
-              name\":\"%s Away\",\
-              unique_id\":\"%s_away\",\
-              command_topic\":\"%s\",\
-              state_topic\":\"%s\",\
-              availability_topic\":\"%s\",\
-              payload_available\":\"online\",\
-              payload_not_available\":\"offline\",\
-              payload_on\":\"ON\",\
-              payload_off\":\"OFF\",\
-              %s\
-            }",
+            "{"
+            "\"name\":\"%s Away\","
+            "\"unique_id\":\"%s_away\","
+            "\"command_topic\":\"%s\","
+            "\"state_topic\":\"%s\","
+            "\"availability_topic\":\"%s\","
+            "\"payload_available\":\"online\","
+            "\"payload_not_available\":\"offline\","
+            "\"payload_on\":\"ON\","
+            "\"payload_off\":\"OFF\","
+            "%s"
+            "}",
             s_device_name, s_device_id, cmd_t, stat_t, s_availability_topic, devb);
         publish(topic, payload, 1, true);
     }
@@ -411,18 +761,18 @@ static void publish_discovery(void) {
         char payload[768], devb[256];
         add_device_block(devb, sizeof(devb));
         snprintf(payload, sizeof(payload),
-            "{\"
-              name\":\"%s Schedule Enforce\",\
-              unique_id\":\"%s_sched_enf\",\
-              command_topic\":\"%s\",\
-              state_topic\":\"%s\",\
-              availability_topic\":\"%s\",\
-              payload_available\":\"online\",\
-              payload_not_available\":\"offline\",\
-              payload_on\":\"ON\",\
-              payload_off\":\"OFF\",\
-              %s\
-            }",
+            "{"
+            "\"name\":\"%s Schedule Enforce\","
+            "\"unique_id\":\"%s_sched_enf\","
+            "\"command_topic\":\"%s\","
+            "\"state_topic\":\"%s\","
+            "\"availability_topic\":\"%s\","
+            "\"payload_available\":\"online\","
+            "\"payload_not_available\":\"offline\","
+            "\"payload_on\":\"ON\","
+            "\"payload_off\":\"OFF\","
+            "%s"
+            "}",
             s_device_name, s_device_id, cmd_t, stat_t, s_availability_topic, devb);
         publish(topic, payload, 1, true);
     }
@@ -437,16 +787,16 @@ static void publish_discovery(void) {
         char payload[768], devb[256];
         add_device_block(devb, sizeof(devb));
         snprintf(payload, sizeof(payload),
-            "{\"
-              name\":\"%s Relay %d Max ON (min)\",\
-              unique_id\":\"%s_relay%d_maxon\",\
-              command_topic\":\"%s\",\
-              state_topic\":\"%s\",\
-              availability_topic\":\"%s\",\
-              min\":0,\"max\":1440,\"step\":1,
-              mode\":\"box\",\
-              %s\
-            }",
+            "{"
+            "\"name\":\"%s Relay %d Max ON (min)\","
+            "\"unique_id\":\"%s_relay%d_maxon\","
+            "\"command_topic\":\"%s\","
+            "\"state_topic\":\"%s\","
+            "\"availability_topic\":\"%s\","
+            "\"min\":0,\"max\":1440,\"step\":1,"
+            "\"mode\":\"box\","
+            "%s"
+            "}",
             s_device_name, ch, s_device_id, ch, cmd_t, stat_t, s_availability_topic, devb);
         publish(topic, payload, 1, true);
     }
@@ -463,16 +813,16 @@ static void publish_discovery(void) {
         char payload[768], devb[256];
         add_device_block(devb, sizeof(devb));
         snprintf(payload, sizeof(payload),
-            "{\"
-              name\":\"%s %s (min)\",\
-              unique_id\":\"%s_%s\",\
-              command_topic\":\"%s\",\
-              state_topic\":\"%s\",\
-              availability_topic\":\"%s\",\
-              min\":0,\"max\":1439,\"step\":1,
-              mode\":\"box\",\
-              %s\
-            }",
+            "{"
+            "\"name\":\"%s %s (min)\","
+            "\"unique_id\":\"%s_%s\","
+            "\"command_topic\":\"%s\","
+            "\"state_topic\":\"%s\","
+            "\"availability_topic\":\"%s\","
+            "\"min\":0,\"max\":1439,\"step\":1,"
+            "\"mode\":\"box\","
+            "%s"
+            "}",
             s_device_name, names[i], s_device_id, keys[i], cmd_t, stat_t, s_availability_topic, devb);
         publish(topic, payload, 1, true);
     }
@@ -487,14 +837,36 @@ static void publish_discovery(void) {
         char payload[768], devb[256];
         add_device_block(devb, sizeof(devb));
         snprintf(payload, sizeof(payload),
-            "{\"
-              name\":\"%s OTA URL\",\
-              unique_id\":\"%s_ota_url\",\
-              command_topic\":\"%s\",\
-              state_topic\":\"%s\",\
-              availability_topic\":\"%s\",\
-              %s\
-            }",
+            "{"
+            "\"name\":\"%s OTA URL\","
+            "\"unique_id\":\"%s_ota_url\","
+            "\"command_topic\":\"%s\","
+            "\"state_topic\":\"%s\","
+            "\"availability_topic\":\"%s\","
+            "%s"
+            "}",
+            s_device_name, s_device_id, cmd_t, stat_t, s_availability_topic, devb);
+        publish(topic, payload, 1, true);
+    }
+
+    // OTA delta patch URL (text)
+    {
+        char topic[256];
+        snprintf(topic, sizeof(topic), "%s/text/%s/ota_delta_url/config", s_ha_prefix, s_device_id);
+        char cmd_t[160], stat_t[160];
+        snprintf(cmd_t, sizeof(cmd_t), "%s/ota/delta_url/set", s_base_topic);
+        snprintf(stat_t, sizeof(stat_t), "%s/ota/delta_url", s_base_topic);
+        char payload[768], devb[256];
+        add_device_block(devb, sizeof(devb));
+        snprintf(payload, sizeof(payload),
+            "{"
+            "\"name\":\"%s OTA Delta URL\","
+            "\"unique_id\":\"%s_ota_delta_url\","
+            "\"command_topic\":\"%s\","
+            "\"state_topic\":\"%s\","
+            "\"availability_topic\":\"%s\","
+            "%s"
+            "}",
             s_device_name, s_device_id, cmd_t, stat_t, s_availability_topic, devb);
         publish(topic, payload, 1, true);
     }
@@ -508,14 +880,397 @@ static void publish_discovery(void) {
         char payload[768], devb[256];
         add_device_block(devb, sizeof(devb));
         snprintf(payload, sizeof(payload),
-            "{\"
-              name\":\"%s OTA Update\",\
-              unique_id\":\"%s_ota_update\",\
-              command_topic\":\"%s\",\
-              availability_topic\":\"%s\",\
-              %s\
-            }",
+            "{"
+            "\"name\":\"%s OTA Update\","
+            "\"unique_id\":\"%s_ota_update\","
+            "\"command_topic\":\"%s\","
+            "\"availability_topic\":\"%s\","
+            "%s"
+            "}",
             s_device_name, s_device_id, cmd_t, s_availability_topic, devb);
         publish(topic, payload, 1, true);
     }
-}
\ No newline at end of file
+
+    // OTA progress (sensor, percent; bytes/throughput as attributes)
+    {
+        char topic[256];
+        snprintf(topic, sizeof(topic), "%s/sensor/%s/ota_progress/config", s_ha_prefix, s_device_id);
+        char state_t[160];
+        snprintf(state_t, sizeof(state_t), "%s/ota/progress", s_base_topic);
+        char payload[768], devb[256];
+        add_device_block(devb, sizeof(devb));
+        snprintf(payload, sizeof(payload),
+            "{"
+            "\"name\":\"%s OTA Progress\","
+            "\"unique_id\":\"%s_ota_progress\","
+            "\"state_topic\":\"%s\","
+            "\"value_template\":\"{{ value_json.percent }}\","
+            "\"json_attributes_topic\":\"%s\","
+            "\"availability_topic\":\"%s\","
+            "\"unit_of_measurement\":\"%%\","
+            "\"entity_category\":\"diagnostic\","
+            "%s"
+            "}",
+            s_device_name, s_device_id, state_t, state_t, s_availability_topic, devb);
+        publish(topic, payload, 1, true);
+    }
+
+    // Offline spool fill (sensor, percent; counters as attributes)
+    {
+        char topic[256];
+        snprintf(topic, sizeof(topic), "%s/sensor/%s/spool_fill/config", s_ha_prefix, s_device_id);
+        char state_t[160];
+        snprintf(state_t, sizeof(state_t), "%s/spool", s_base_topic);
+        char payload[768], devb[256];
+        add_device_block(devb, sizeof(devb));
+        snprintf(payload, sizeof(payload),
+            "{"
+            "\"name\":\"%s Spool Fill\","
+            "\"unique_id\":\"%s_spool_fill\","
+            "\"state_topic\":\"%s\","
+            "\"value_template\":\"{{ value_json.fill_pct }}\","
+            "\"json_attributes_topic\":\"%s\","
+            "\"availability_topic\":\"%s\","
+            "\"unit_of_measurement\":\"%%\","
+            "\"entity_category\":\"diagnostic\","
+            "%s"
+            "}",
+            s_device_name, s_device_id, state_t, state_t, s_availability_topic, devb);
+        publish(topic, payload, 1, true);
+    }
+
+    // Runtime metrics (diagnostic sensors off one message; the full record as attributes)
+    {
+        static const struct {
+            const char* key;
+            const char* name;
+            const char* tmpl;
+            const char* unit;
+            const char* extra;
+        } sensors[] = {
+            { "heap_free", "Free Heap", "{{ value_json.heap }}", "B", "" },
+            { "heap_min", "Min Free Heap", "{{ value_json.heap_min }}", "B", "" },
+            { "cpu0", "CPU0 Load", "{{ value_json.cpu[0] }}", "%", "" },
+            { "cpu1", "CPU1 Load", "{{ value_json.cpu[1] }}", "%", "" },
+            { "rssi", "WiFi RSSI", "{{ value_json.rssi }}", "dBm", "\"device_class\":\"signal_strength\"," },
+            { "mqtt_p95", "MQTT Publish p95", "{{ (value_json.pub.p95_us / 1000) | round(1) }}", "ms", "" },
+        };
+        char state_t[160];
+        snprintf(state_t, sizeof(state_t), "%s/metrics", s_base_topic);
+        char devb[256];
+        add_device_block(devb, sizeof(devb));
+        for (size_t i = 0; i < sizeof(sensors) / sizeof(sensors[0]); ++i) {
+            char topic[256], payload[768];
+            snprintf(topic, sizeof(topic), "%s/sensor/%s/%s/config", s_ha_prefix, s_device_id, sensors[i].key);
+            snprintf(payload, sizeof(payload),
+                "{"
+                "\"name\":\"%s %s\","
+                "\"unique_id\":\"%s_%s\","
+                "\"state_topic\":\"%s\","
+                "\"value_template\":\"%s\","
+                "%s%s%s"
+                "\"availability_topic\":\"%s\","
+                "\"unit_of_measurement\":\"%s\","
+                "\"state_class\":\"measurement\","
+                "%s"
+                "\"entity_category\":\"diagnostic\","
+                "%s"
+                "}",
+                s_device_name, sensors[i].name, s_device_id, sensors[i].key, state_t, sensors[i].tmpl,
+                i == 0 ? "\"json_attributes_topic\":\"" : "", i == 0 ? state_t : "", i == 0 ? "\"," : "",
+                s_availability_topic, sensors[i].unit, sensors[i].extra, devb);
+            publish(topic, payload, 1, true);
+        }
+    }
+
+    // Relay usage (per relay: on-time and switch count as HA totals, duty
+    // cycles). Sixteen fixed, retained configs: sent once per boot, and again
+    // on the next connect only if one of them could not be handed over.
+    if (!s_stats_discovery_sent) {
+        static const struct {
+            const char* key;
+            const char* name;
+            const char* field;
+            const char* extra;
+        } sensors[] = {
+            { "on_time", "On Time", "on_s",
+              "\"unit_of_measurement\":\"s\",\"device_class\":\"duration\",\"state_class\":\"total_increasing\"," },
+            { "switches", "Switch Count", "switches", "\"state_class\":\"total_increasing\"," },
+            { "duty_1h", "Duty 1h", "duty_1h", "\"unit_of_measurement\":\"%\",\"state_class\":\"measurement\"," },
+            { "duty_24h", "Duty 24h", "duty_24h", "\"unit_of_measurement\":\"%\",\"state_class\":\"measurement\"," },
+        };
+        char state_t[160];
+        snprintf(state_t, sizeof(state_t), "%s/relay_stats", s_base_topic);
+        char devb[256];
+        add_device_block(devb, sizeof(devb));
+        bool sent = true;
+        for (int ch = 1; ch <= 4; ++ch) {
+            for (size_t i = 0; i < sizeof(sensors) / sizeof(sensors[0]); ++i) {
+                char topic[256], payload[768];
+                snprintf(topic, sizeof(topic), "%s/sensor/%s/relay%d_%s/config", s_ha_prefix, s_device_id, ch, sensors[i].key);
+                snprintf(payload, sizeof(payload),
+                    "{"
+                    "\"name\":\"%s Relay %d %s\","
+                    "\"unique_id\":\"%s_relay%d_%s\","
+                    "\"state_topic\":\"%s\","
+                    "\"value_template\":\"{{ value_json.relays[%d].%s }}\","
+                    "\"availability_topic\":\"%s\","
+                    "%s"
+                    "\"entity_category\":\"diagnostic\","
+                    "%s"
+                    "}",
+                    s_device_name, ch, sensors[i].name, s_device_id, ch, sensors[i].key, state_t,
+                    ch - 1, sensors[i].field, s_availability_topic, sensors[i].extra, devb);
+                if (publish(topic, payload, 1, true) < 0) sent = false;
+            }
+        }
+        s_stats_discovery_sent = sent;
+    }
+}
+static void publish_availability(bool online) {
+    publish(s_availability_topic, online ? "online" : "offline", 1, true);
+}
+
+static void publish_initial_states(void) {
+    for (int ch = 1; ch <= 4; ++ch) {
+        ha_mqtt_publish_relay_state(ch, relay_get_channel(ch));
+        ha_mqtt_publish_max_on_minutes(ch, safety_get_max_on_seconds(ch) / 60u);
+    }
+    ha_mqtt_publish_away_state(safety_get_away_mode());
+    ha_mqtt_publish_schedule_state(safety_get_schedule_enforce());
+    ha_mqtt_publish_schedule_windows();
+    ha_mqtt_publish_config();
+    publish_groups();
+    ha_mqtt_publish_ota_url();
+    ha_mqtt_publish_time_status();
+    ha_mqtt_publish_spool_stats();
+    ha_mqtt_publish_relay_stats();
+    if (boot_reached(BOOT_MS_FIRST_TELEMETRY)) ha_mqtt_publish_boot_report();
+}
+
+static void send_relay_state(int channel, bool on) {
+    char topic[192];
+    snprintf(topic, sizeof(topic), "%s/relay/%d/state", s_base_topic, channel);
+    enqueue(topic, on ? "ON" : "OFF", 1, true);
+}
+
+// The control task echoes every command, so the send is left to mqtt_out;
+// repeated changes of a channel before it runs go out as the latest state
+void ha_mqtt_publish_relay_state(int channel, bool on) {
+    if (channel < 1 || channel > 4) return;
+    __atomic_store_n(&s_relay_echo[channel - 1], on, __ATOMIC_RELAXED);
+    post_work(WORK_RELAY(channel));
+    local_api_notify_state();
+}
+
+static void send_max_on_minutes(int channel, uint32_t minutes) {
+    char topic[192], payload[16];
+    snprintf(topic, sizeof(topic), "%s/relay/%d/max_on", s_base_topic, channel);
+    snprintf(payload, sizeof(payload), "%" PRIu32, minutes);
+    publish(topic, payload, 1, true);
+}
+
+// Settings changed over the local API are echoed from the httpd task, which
+// must not wait out a broker connect either; these post to mqtt_out as well
+void ha_mqtt_publish_max_on_minutes(int channel, uint32_t minutes) {
+    if (channel < 1 || channel > 4) return;
+    __atomic_store_n(&s_max_on_echo[channel - 1], minutes, __ATOMIC_RELAXED);
+    post_work(WORK_MAX_ON(channel));
+    local_api_notify_state();
+}
+
+static void send_schedule_state(bool enforce) {
+    char topic[192];
+    snprintf(topic, sizeof(topic), "%s/schedule/enforce", s_base_topic);
+    publish(topic, enforce ? "ON" : "OFF", 1, true);
+}
+
+void ha_mqtt_publish_schedule_state(bool enforce) {
+    __atomic_store_n(&s_schedule_echo, enforce, __ATOMIC_RELAXED);
+    post_work(WORK_SCHEDULE);
+    local_api_notify_state();
+}
+
+static void send_away_state(bool away) {
+    char topic[192];
+    snprintf(topic, sizeof(topic), "%s/mode/away", s_base_topic);
+    publish(topic, away ? "ON" : "OFF", 1, true);
+}
+
+void ha_mqtt_publish_away_state(bool away) {
+    __atomic_store_n(&s_away_echo, away, __ATOMIC_RELAXED);
+    post_work(WORK_AWAY);
+    local_api_notify_state();
+}
+
+static void send_schedule_windows(void) {
+    uint16_t w[4];
+    safety_get_schedule_windows(&w[0], &w[1], &w[2], &w[3]);
+    const char* keys[] = {"w1_start","w1_end","w2_start","w2_end"};
+    for (int i=0;i<4;i++) {
+        char topic[192], payload[8];
+        snprintf(topic, sizeof(topic), "%s/schedule/%s", s_base_topic, keys[i]);
+        snprintf(payload, sizeof(payload), "%u", w[i]);
+        publish(topic, payload, 1, true);
+    }
+}
+
+void ha_mqtt_publish_schedule_windows(void) {
+    post_work(WORK_WINDOWS);
+    local_api_notify_state();
+}
+
+static void send_config(void) {
+    char topic[192], payload[320];
+    snprintf(topic, sizeof(topic), "%s/config", s_base_topic);
+    if (commands_format_config(payload, sizeof(payload)) >= 0) publish(topic, payload, 1, true);
+}
+
+static void send_relay_stats(void) {
+    char topic[192], payload[384];
+    snprintf(topic, sizeof(topic), "%s/relay_stats", s_base_topic);
+    if (relay_stats_format(payload, sizeof(payload)) >= 0) enqueue(topic, payload, 1, true);
+}
+
+static void run_work(uint32_t work) {
+    if ((work & WORK_CONNECT) && connectivity_is(CONN_IP)) client_connect();
+    for (int ch = 1; ch <= 4; ++ch) {
+        if (work & WORK_RELAY(ch)) send_relay_state(ch, __atomic_load_n(&s_relay_echo[ch - 1], __ATOMIC_RELAXED));
+        if (work & WORK_MAX_ON(ch)) send_max_on_minutes(ch, __atomic_load_n(&s_max_on_echo[ch - 1], __ATOMIC_RELAXED));
+    }
+    if (work & WORK_AWAY) send_away_state(__atomic_load_n(&s_away_echo, __ATOMIC_RELAXED));
+    if (work & WORK_SCHEDULE) send_schedule_state(__atomic_load_n(&s_schedule_echo, __ATOMIC_RELAXED));
+    if (work & WORK_WINDOWS) send_schedule_windows();
+    if (work & WORK_CONFIG) send_config();
+    if (work & WORK_RELAY_STATS) send_relay_stats();
+    if (work & WORK_ACK) {
+        char topic[192], json[ACK_JSON_MAX];
+        snprintf(topic, sizeof(topic), "%s/ack", s_base_topic);
+        while (xQueueReceive(s_ack_q, json, 0) == pdTRUE) enqueue(topic, json, 1, false);
+    }
+}
+
+void ha_mqtt_publish_scd4x(float co2_ppm, float temperature_c, float humidity_rh) {
+    if (!connectivity_is(CONN_BROKER_UP)) return;
+    char topic[192], payload[16];
+    snprintf(topic, sizeof(topic), "%s/scd41/co2", s_base_topic);
+    snprintf(payload, sizeof(payload), "%.0f", co2_ppm);
+    publish(topic, payload, 0, false);
+    snprintf(topic, sizeof(topic), "%s/scd41/temperature", s_base_topic);
+    snprintf(payload, sizeof(payload), "%.2f", temperature_c);
+    publish(topic, payload, 0, false);
+    snprintf(topic, sizeof(topic), "%s/scd41/humidity", s_base_topic);
+    snprintf(payload, sizeof(payload), "%.1f", humidity_rh);
+    publish(topic, payload, 0, false);
+
+    if (!boot_reached(BOOT_MS_FIRST_TELEMETRY)) {
+        boot_mark(BOOT_MS_FIRST_TELEMETRY);
+        ha_mqtt_publish_boot_report();
+    }
+}
+
+void ha_mqtt_publish_ota_url(void) {
+    char topic[192], url[256];
+    snprintf(topic, sizeof(topic), "%s/ota/url", s_base_topic);
+    ota_get_url(url, sizeof(url));
+    publish(topic, url, 1, true);
+    snprintf(topic, sizeof(topic), "%s/ota/delta_url", s_base_topic);
+    ota_get_delta_url(url, sizeof(url));
+    publish(topic, url, 1, true);
+}
+
+void ha_mqtt_publish_ota_progress(const char* state, size_t written, size_t total, uint32_t kbps, uint32_t resumes) {
+    if (!connectivity_is(CONN_BROKER_UP)) return;
+    char topic[192], payload[192];
+    snprintf(topic, sizeof(topic), "%s/ota/progress", s_base_topic);
+    unsigned pct = total ? (unsigned)((uint64_t)written * 100 / total) : 0;
+    snprintf(payload, sizeof(payload),
+        "{\"state\":\"%s\",\"bytes\":%u,\"total\":%u,\"percent\":%u,\"kbps\":%" PRIu32 ",\"resumes\":%" PRIu32 "}",
+        state, (unsigned)written, (unsigned)total, pct, kbps, resumes);
+    // Not retained: a stale "downloading" must not survive a reboot
+    publish(topic, payload, 0, false);
+}
+
+void ha_mqtt_publish_ota_ack(uint32_t session, uint32_t next, uint32_t written, const char* state) {
+    char topic[192], payload[160];
+    snprintf(topic, sizeof(topic), "%s/ota/ack", s_base_topic);
+    snprintf(payload, sizeof(payload),
+        "{\"session\":%" PRIu32 ",\"next\":%" PRIu32 ",\"written\":%" PRIu32 ",\"window\":%d,\"state\":\"%s\"}",
+        session, next, written, CONFIG_OTA_MQTT_WINDOW, state);
+    publish(topic, payload, 0, false);
+}
+
+void ha_mqtt_publish_history(const char* json) {
+    char topic[192];
+    snprintf(topic, sizeof(topic), "%s/history/result", s_base_topic);
+    publish(topic, json, 0, false);
+}
+
+int ha_mqtt_publish_backlog(const char* json) {
+    char topic[192];
+    snprintf(topic, sizeof(topic), "%s/scd41/backlog", s_base_topic);
+    // QoS 1 so the spool only retires records the broker has taken
+    return publish(topic, json, 1, false);
+}
+
+void ha_mqtt_publish_spool_stats(void) {
+    if (!connectivity_is(CONN_BROKER_UP)) return;
+    spool_stats_t st;
+    spool_get_stats(&st);
+    char topic[192], payload[256];
+    snprintf(topic, sizeof(topic), "%s/spool", s_base_topic);
+    snprintf(payload, sizeof(payload),
+        "{\"capacity\":%" PRIu32 ",\"used\":%" PRIu32 ",\"fill_pct\":%" PRIu32 ",\"pending\":%" PRIu32
+        ",\"dropped\":%" PRIu32 ",\"replayed\":%" PRIu32 ",\"replay_rate\":%" PRIu32 ",\"erases\":%" PRIu32 "}",
+        st.capacity, st.used, st.capacity ? (uint32_t)((uint64_t)st.used * 100 / st.capacity) : 0,
+        st.pending, st.dropped, st.replayed, st.replay_rate, st.erases);
+    publish(topic, payload, 1, true);
+}
+
+void ha_mqtt_publish_metrics(const char* json) {
+    char topic[192];
+    snprintf(topic, sizeof(topic), "%s/metrics", s_base_topic);
+    publish(topic, json, 0, false);
+}
+
+// From the relay_stats esp_timer tick; the worker formats and sends it
+void ha_mqtt_publish_relay_stats(void) {
+    if (connectivity_is(CONN_BROKER_UP)) post_work(WORK_RELAY_STATS);
+}
+
+void ha_mqtt_publish_config(void) {
+    post_work(WORK_CONFIG);
+    local_api_notify_state();
+}
+
+// Acks mostly come from the control task (commands_relay_done), so they are
+// queued for mqtt_out rather than enqueued here
+void ha_mqtt_publish_ack(const char* json) {
+    if (!s_ack_q) return;
+    char buf[ACK_JSON_MAX];
+    snprintf(buf, sizeof(buf), "%s", json);
+    if (xQueueSend(s_ack_q, buf, 0) != pdTRUE) {
+        DLOGW(TAG, "Ack queue full, ack dropped");
+        return;
+    }
+    post_work(WORK_ACK);
+}
+
+void ha_mqtt_publish_boot_report(void) {
+    char topic[192], payload[384];
+    snprintf(topic, sizeof(topic), "%s/boot", s_base_topic);
+    boot_format_report(payload, sizeof(payload));
+    publish(topic, payload, 1, true);
+}
+
+void ha_mqtt_publish_time_status(void) {
+    time_sync_status_t st;
+    time_sync_get_status(&st);
+    char topic[192], payload[192];
+    snprintf(topic, sizeof(topic), "%s/time", s_base_topic);
+    snprintf(payload, sizeof(payload),
+        "{\"quality\":\"%s\",\"last_sync\":%" PRId64 ",\"offset_ms\":%" PRId32 ",\"event\":\"%s\",\"steps\":%" PRIu32 ",\"slews\":%" PRIu32 "}",
+        time_sync_quality_name(st.quality), st.last_sync, st.last_offset_ms,
+        st.last_was_step ? "step" : "slew", st.steps, st.slews);
+    publish(topic, payload, 1, true);
+}
@@ -1,5 +1,6 @@
 #pragma once
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 #ifdef __cplusplus
@@ -8,7 +9,9 @@ extern "C" {
 
 void ha_mqtt_start(const char* device_name, const char* device_id);
 
-// Publishers for state reflections
+// Publishers for state reflections. Relay and setting echoes (down to
+// ha_mqtt_publish_schedule_windows, and ha_mqtt_publish_config) are sent from
+// the mqtt_out task, so any task may call them without blocking.
 void ha_mqtt_publish_relay_state(int channel, bool on);
 void ha_mqtt_publish_max_on_minutes(int channel, uint32_t minutes);
 void ha_mqtt_publish_schedule_state(bool enforce);
@@ -16,6 +19,21 @@ void ha_mqtt_publish_away_state(bool away);
 void ha_mqtt_publish_schedule_windows(void);
 void ha_mqtt_publish_scd4x(float co2_ppm, float temperature_c, float humidity_rh);
 void ha_mqtt_publish_ota_url(void);
+void ha_mqtt_publish_ota_progress(const char* state, size_t written, size_t total, uint32_t kbps, uint32_t resumes);
+void ha_mqtt_publish_ota_ack(uint32_t session, uint32_t next, uint32_t written, const char* state);
+void ha_mqtt_publish_history(const char* json);
+// Returns the MQTT msg_id (QoS 1) or -1
+int ha_mqtt_publish_backlog(const char* json);
+void ha_mqtt_publish_spool_stats(void);
+void ha_mqtt_publish_metrics(const char* json);
+// relay_stats_format() on <base>/relay_stats, retained; sent from mqtt_out
+void ha_mqtt_publish_relay_stats(void);
+// Full config snapshot (commands_format_config) on <base>/config, retained
+void ha_mqtt_publish_config(void);
+// Command acknowledgement on <base>/ack (QoS 1); queued for mqtt_out, non-blocking
+void ha_mqtt_publish_ack(const char* json);
+void ha_mqtt_publish_boot_report(void);
+void ha_mqtt_publish_time_status(void);
 
 #ifdef __cplusplus
 }
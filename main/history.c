@@ -0,0 +1,208 @@
+#include "history.h"
+#include "tsdb.h"
+#include "relay.h"
+#include "ha_mqtt.h"
+#include "time_sync.h"
+#include "app_tasks.h"
+
+#include "cJSON.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "sdkconfig.h"
+#include <ctype.h>
+#include <inttypes.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+static const char* TAG = "history";
+
+#define HISTORY_RELAYS 4
+
+typedef struct {
+    char id[24];
+    uint32_t from;
+    uint32_t to;
+    uint32_t step; // 0 = raw points
+} history_query_t;
+
+typedef struct {
+    uint32_t ts;
+    tsdb_rollup_t r;
+} history_row_t;
+
+static uint8_t s_blocks[CONFIG_HISTORY_BLOCKS * TSDB_BLOCK_SIZE];
+static tsdb_block_meta_t s_meta[CONFIG_HISTORY_BLOCKS];
+static tsdb_t s_db;
+static SemaphoreHandle_t s_lock = NULL;
+static QueueHandle_t s_query_q = NULL;
+APP_TASK_STORAGE(s_task, APP_STACK_HISTORY);
+
+// Page scratch, only touched by the history task
+static union {
+    history_row_t rows[CONFIG_HISTORY_PAGE_ROWS];
+    tsdb_point_t points[CONFIG_HISTORY_PAGE_ROWS]; // step 0
+} s_page;
+static char s_json[CONFIG_HISTORY_PAGE_ROWS * 96 + 256];
+
+void history_record(float co2_ppm, float temperature_c, float humidity_rh) {
+    // An NVS lower bound after power loss would file points under the wrong time
+    if (!time_sync_is_valid() || !s_lock) return;
+    time_t now = time(NULL);
+    tsdb_point_t p = { .ts = (uint32_t)now };
+    p.v[TSDB_CO2] = (int32_t)lroundf(co2_ppm);
+    p.v[TSDB_TEMP] = (int32_t)lroundf(temperature_c * 10.0f);
+    p.v[TSDB_RH] = (int32_t)lroundf(humidity_rh * 10.0f);
+    for (int ch = 1; ch <= HISTORY_RELAYS; ++ch) {
+        if (relay_get_channel(ch)) p.v[TSDB_RELAYS] |= 1 << (ch - 1);
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    tsdb_append(&s_db, &p);
+    xSemaphoreGive(s_lock);
+}
+
+typedef struct {
+    const history_query_t* q;
+    int n;
+    bool full;
+    uint32_t resume_ts;
+} page_ctx_t;
+
+static bool collect(const tsdb_point_t* p, void* arg) {
+    page_ctx_t* c = arg;
+    if (!c->q->step) {
+        if (c->n == CONFIG_HISTORY_PAGE_ROWS) {
+            c->full = true;
+            c->resume_ts = p->ts;
+            return false;
+        }
+        s_page.points[c->n++] = *p;
+        return true;
+    }
+    uint32_t b = c->q->from + (p->ts - c->q->from) / c->q->step * c->q->step;
+    if (c->n == 0 || s_page.rows[c->n - 1].ts != b) {
+        if (c->n == CONFIG_HISTORY_PAGE_ROWS) {
+            c->full = true;
+            c->resume_ts = b;
+            return false;
+        }
+        s_page.rows[c->n].ts = b;
+        tsdb_rollup_reset(&s_page.rows[c->n].r);
+        c->n++;
+    }
+    tsdb_rollup_add(&s_page.rows[c->n - 1].r, p);
+    return true;
+}
+
+static int format_page(const history_query_t* q, int page, const page_ctx_t* c) {
+    int len = snprintf(s_json, sizeof(s_json), "{\"id\":\"%s\",\"page\":%d,\"last\":%s,\"step\":%" PRIu32 ",",
+                       q->id, page, c->full ? "false" : "true", q->step);
+    if (page == 0) {
+        tsdb_stats_t st;
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        tsdb_get_stats(&s_db, &st);
+        xSemaphoreGive(s_lock);
+        len += snprintf(s_json + len, sizeof(s_json) - len,
+                        "\"stored\":%" PRIu32 ",\"bytes\":%" PRIu32 ",\"oldest\":%" PRIu32 ",",
+                        st.points, st.bytes, st.first_ts);
+    }
+    len += snprintf(s_json + len, sizeof(s_json) - len, "\"cols\":%s,\"rows\":[",
+                    q->step ? "[\"ts\",\"n\",\"co2_min\",\"co2_max\",\"co2_avg\",\"t_min\",\"t_max\",\"t_avg\","
+                              "\"rh_min\",\"rh_max\",\"rh_avg\",\"r1_pct\",\"r2_pct\",\"r3_pct\",\"r4_pct\"]"
+                            : "[\"ts\",\"co2\",\"t\",\"rh\",\"relays\"]");
+    for (int i = 0; i < c->n && len < (int)sizeof(s_json); ++i) {
+        const char* sep = i ? "," : "";
+        if (!q->step) {
+            const tsdb_point_t* p = &s_page.points[i];
+            len += snprintf(s_json + len, sizeof(s_json) - len, "%s[%" PRIu32 ",%" PRId32 ",%.1f,%.1f,%" PRId32 "]",
+                            sep, p->ts, p->v[TSDB_CO2], p->v[TSDB_TEMP] / 10.0, p->v[TSDB_RH] / 10.0,
+                            p->v[TSDB_RELAYS]);
+            continue;
+        }
+        const tsdb_rollup_t* r = &s_page.rows[i].r;
+        len += snprintf(s_json + len, sizeof(s_json) - len,
+                        "%s[%" PRIu32 ",%" PRIu32 ",%" PRId32 ",%" PRId32 ",%.0f,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f",
+                        sep, s_page.rows[i].ts, r->n,
+                        r->min[TSDB_CO2], r->max[TSDB_CO2], (double)r->sum[TSDB_CO2] / r->n,
+                        r->min[TSDB_TEMP] / 10.0, r->max[TSDB_TEMP] / 10.0, (double)r->sum[TSDB_TEMP] / r->n / 10.0,
+                        r->min[TSDB_RH] / 10.0, r->max[TSDB_RH] / 10.0, (double)r->sum[TSDB_RH] / r->n / 10.0);
+        for (int ch = 0; ch < HISTORY_RELAYS && len < (int)sizeof(s_json); ++ch) {
+            len += snprintf(s_json + len, sizeof(s_json) - len, ",%" PRIu32, r->relay_on[ch] * 100 / r->n);
+        }
+        if (len < (int)sizeof(s_json)) len += snprintf(s_json + len, sizeof(s_json) - len, "]");
+    }
+    if (len < (int)sizeof(s_json)) len += snprintf(s_json + len, sizeof(s_json) - len, "]}");
+    return len < (int)sizeof(s_json) ? len : -1;
+}
+
+static void run_query(history_query_t* q) {
+    uint32_t from = q->from;
+    for (int page = 0;; ++page) {
+        page_ctx_t c = { .q = q };
+        // Decode one page under the lock, publish without it
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        tsdb_query(&s_db, from, q->to, collect, &c);
+        xSemaphoreGive(s_lock);
+        if (format_page(q, page, &c) < 0) {
+            ESP_LOGE(TAG, "Page %d does not fit the JSON buffer", page);
+            return;
+        }
+        ha_mqtt_publish_history(s_json);
+        if (!c.full) return;
+        from = c.resume_ts;
+    }
+}
+
+static void history_task(void* arg) {
+    (void)arg;
+    history_query_t q;
+    while (1) {
+        if (xQueueReceive(s_query_q, &q, portMAX_DELAY) == pdTRUE) run_query(&q);
+    }
+}
+
+// Clamped before the cast: out-of-range doubles don't convert
+static uint32_t json_u32(const cJSON* root, const char* key, uint32_t def) {
+    const cJSON* it = cJSON_GetObjectItemCaseSensitive(root, key);
+    if (!cJSON_IsNumber(it) || !(it->valuedouble >= 0)) return def;
+    return it->valuedouble >= (double)UINT32_MAX ? UINT32_MAX : (uint32_t)it->valuedouble;
+}
+
+void history_request_query(const char* payload, int len) {
+    if (!s_query_q) return;
+    cJSON* root = cJSON_ParseWithLength(payload, (size_t)len);
+    if (!root) {
+        ESP_LOGW(TAG, "Bad query");
+        return;
+    }
+    uint32_t now = (uint32_t)time(NULL);
+    history_query_t q = { 0 };
+    const cJSON* id = cJSON_GetObjectItemCaseSensitive(root, "id");
+    if (cJSON_IsString(id)) {
+        // Echoed back unescaped, so keep it to a safe charset
+        size_t n = 0;
+        for (const char* c = id->valuestring; *c && n < sizeof(q.id) - 1; ++c) {
+            if (isalnum((unsigned char)*c) || *c == '-' || *c == '_' || *c == '.') q.id[n++] = *c;
+        }
+    }
+    q.to = json_u32(root, "to", now);
+    uint32_t hours = json_u32(root, "hours", 1);
+    q.from = json_u32(root, "from", q.to > (uint64_t)hours * 3600 ? q.to - hours * 3600 : 0);
+    q.step = json_u32(root, "step", 300);
+    cJSON_Delete(root);
+    if (q.step && q.step < 5) q.step = 5;
+    if (q.from > q.to) return;
+    if (xQueueSend(s_query_q, &q, 0) != pdTRUE) ESP_LOGW(TAG, "Query dropped, busy");
+}
+
+void history_init(void) {
+    tsdb_init(&s_db, s_blocks, s_meta, CONFIG_HISTORY_BLOCKS);
+    s_lock = xSemaphoreCreateMutex();
+    s_query_q = xQueueCreate(2, sizeof(history_query_t));
+    // Low priority: queries are bulk work, sensor and control tasks come first
+    APP_TASK_CREATE(s_task, history_task, "history", NULL, APP_PRIO_HISTORY, APP_CORE_HISTORY, NULL);
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Telemetry history kept in RAM (see tsdb.h). Queried over MQTT:
+//   <base>/history/query  {"id":"x","from":<epoch>,"to":<epoch>,"step":<s>}
+//                         or {"hours":N,...}; step 0 returns raw points
+//   <base>/history/result paged JSON rows, "last":true on the final page
+void history_init(void);
+
+// Called for each sensor reading; relay states are sampled alongside
+void history_record(float co2_ppm, float temperature_c, float humidity_rh);
+
+// Called from the MQTT handler; the query runs in the history task
+void history_request_query(const char* payload, int len);
+
+#ifdef __cplusplus
+}
+#endif
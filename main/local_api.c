@@ -0,0 +1,347 @@
+#include "local_api.h"
+#include "app_tasks.h"
+#include "commands.h"
+#include "connectivity.h"
+#include "metrics.h"
+#include "relay.h"
+#include "safety.h"
+
+#include "cJSON.h"
+#include "esp_http_server.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "sdkconfig.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+
+static const char* TAG = "local_api";
+
+#if CONFIG_LOCAL_API_ENABLE
+
+#define DIRTY_STATE   (1u << 0)
+#define DIRTY_SENSORS (1u << 1)
+#define PUSH_DELAY_US 20000   // also coalesces the burst of publishes on reconnect
+
+static httpd_handle_t s_server;
+static portMUX_TYPE s_mux = portMUX_INITIALIZER_UNLOCKED;
+static uint32_t s_dirty;
+static bool s_push_queued;
+static esp_timer_handle_t s_push_timer;
+static bool s_have_sensors;
+static float s_co2, s_temp, s_rh;
+
+// Server task only: handlers, the close callback and queued work all run there
+static int s_ws_fds[CONFIG_LOCAL_API_WS_CLIENTS];
+static volatile int s_ws_count;
+static char s_out[640];
+static char s_body[CONFIG_LOCAL_API_BODY_MAX + 1];
+
+static int format_state(char* out, size_t sz) {
+    uint16_t w[4];
+    safety_get_schedule_windows(&w[0], &w[1], &w[2], &w[3]);
+    int len = snprintf(out, sz, "{\"type\":\"state\",\"relays\":[");
+    for (int ch = 1; ch <= 4 && len < (int)sz; ++ch) {
+        len += snprintf(out + len, sz - len, "%s{\"on\":%s,\"max_on_min\":%" PRIu32 "}", ch > 1 ? "," : "",
+                        relay_get_channel(ch) ? "true" : "false", safety_get_max_on_seconds(ch) / 60);
+    }
+    if (len < (int)sz) {
+        len += snprintf(out + len, sz - len,
+                        "],\"away\":%s,\"schedule_enforce\":%s,\"w1_start\":%u,\"w1_end\":%u,\"w2_start\":%u,"
+                        "\"w2_end\":%u,\"broker_up\":%s,\"time_valid\":%s,\"up\":%" PRId64,
+                        safety_get_away_mode() ? "true" : "false", safety_get_schedule_enforce() ? "true" : "false",
+                        w[0], w[1], w[2], w[3], connectivity_is(CONN_BROKER_UP) ? "true" : "false",
+                        connectivity_is(CONN_TIME_VALID) ? "true" : "false", esp_timer_get_time() / 1000000);
+    }
+    float co2, t, rh;
+    bool have;
+    taskENTER_CRITICAL(&s_mux);
+    have = s_have_sensors;
+    co2 = s_co2;
+    t = s_temp;
+    rh = s_rh;
+    taskEXIT_CRITICAL(&s_mux);
+    if (have && len < (int)sz) {
+        len += snprintf(out + len, sz - len, ",\"co2\":%.0f,\"temperature\":%.2f,\"humidity\":%.1f", co2, t, rh);
+    }
+    if (len < (int)sz) len += snprintf(out + len, sz - len, "}");
+    return len < (int)sz ? len : -1;
+}
+
+// ---- WebSocket push --------------------------------------------------------
+
+static void ws_forget(int fd) {
+    for (int i = 0; i < CONFIG_LOCAL_API_WS_CLIENTS; ++i) {
+        if (s_ws_fds[i] == fd) {
+            s_ws_fds[i] = -1;
+            s_ws_count--;
+        }
+    }
+}
+
+static void ws_broadcast(const char* json, int len) {
+    httpd_ws_frame_t f = { .final = true, .type = HTTPD_WS_TYPE_TEXT, .payload = (uint8_t*)json, .len = (size_t)len };
+    for (int i = 0; i < CONFIG_LOCAL_API_WS_CLIENTS; ++i) {
+        int fd = s_ws_fds[i];
+        if (fd < 0) continue;
+        if (httpd_ws_get_fd_info(s_server, fd) != HTTPD_WS_CLIENT_WEBSOCKET ||
+            httpd_ws_send_frame_async(s_server, fd, &f) != ESP_OK) {
+            // A client that can't keep up is dropped rather than buffered for
+            ws_forget(fd);
+            httpd_sess_trigger_close(s_server, fd);
+        }
+    }
+}
+
+static void push_work(void* arg) {
+    (void)arg;
+    uint32_t dirty;
+    float co2, t, rh;
+    taskENTER_CRITICAL(&s_mux);
+    dirty = s_dirty;
+    s_dirty = 0;
+    s_push_queued = false;
+    co2 = s_co2;
+    t = s_temp;
+    rh = s_rh;
+    taskEXIT_CRITICAL(&s_mux);
+    if (!s_ws_count) return;
+
+    int len;
+    if (dirty & DIRTY_STATE) {
+        len = format_state(s_out, sizeof(s_out));
+    } else {
+        len = snprintf(s_out, sizeof(s_out),
+                       "{\"type\":\"sensors\",\"co2\":%.0f,\"temperature\":%.2f,\"humidity\":%.1f}", co2, t, rh);
+    }
+    if (len > 0 && len < (int)sizeof(s_out)) ws_broadcast(s_out, len);
+}
+
+static void push_unqueue(void) {
+    taskENTER_CRITICAL(&s_mux);
+    s_push_queued = false; // the next change retries
+    taskEXIT_CRITICAL(&s_mux);
+}
+
+// esp_timer task (core 0): hand the push to the server task
+static void push_timer_cb(void* arg) {
+    (void)arg;
+    if (httpd_queue_work(s_server, push_work, NULL) != ESP_OK) push_unqueue();
+}
+
+// Called from the control task among others, so it only arms a timer: the
+// control-socket write behind httpd_queue_work happens on core 0
+static void mark_dirty(uint32_t bits) {
+    if (!s_server || !s_ws_count) return;
+    bool queue;
+    taskENTER_CRITICAL(&s_mux);
+    s_dirty |= bits;
+    queue = !s_push_queued;
+    s_push_queued = true;
+    taskEXIT_CRITICAL(&s_mux);
+    if (queue && esp_timer_start_once(s_push_timer, PUSH_DELAY_US) != ESP_OK) push_unqueue();
+}
+
+void local_api_notify_state(void) {
+    mark_dirty(DIRTY_STATE);
+}
+
+void local_api_notify_sensors(float co2_ppm, float temperature_c, float humidity_rh) {
+    taskENTER_CRITICAL(&s_mux);
+    s_have_sensors = true;
+    s_co2 = co2_ppm;
+    s_temp = temperature_c;
+    s_rh = humidity_rh;
+    taskEXIT_CRITICAL(&s_mux);
+    mark_dirty(DIRTY_SENSORS);
+}
+
+// ---- Requests --------------------------------------------------------------
+
+// Looks at every byte of the longer of the two whatever matches, so the reply
+// time doesn't reveal how much of a guess was right
+static bool token_equal(const char* given) {
+    const char* want = CONFIG_LOCAL_API_TOKEN;
+    size_t gl = strlen(given), wl = sizeof(CONFIG_LOCAL_API_TOKEN) - 1;
+    size_t n = gl > wl ? gl : wl;
+    unsigned diff = gl != wl;
+    for (size_t i = 0; i < n; ++i) {
+        diff |= (unsigned char)(i < gl ? given[i] : 0) ^ (unsigned char)(i < wl ? want[i] : 0);
+    }
+    return diff == 0;
+}
+
+static bool authorized(httpd_req_t* req, bool allow_query) {
+    if (!CONFIG_LOCAL_API_TOKEN[0]) return true;
+    char v[96];
+    if (httpd_req_get_hdr_value_str(req, "Authorization", v, sizeof(v)) == ESP_OK) {
+        return strncmp(v, "Bearer ", 7) == 0 && token_equal(v + 7);
+    }
+    // Browsers can't set headers on a WebSocket handshake
+    char q[128];
+    return allow_query && httpd_req_get_url_query_str(req, q, sizeof(q)) == ESP_OK &&
+           httpd_query_key_value(q, "token", v, sizeof(v)) == ESP_OK && token_equal(v);
+}
+
+static esp_err_t reply(httpd_req_t* req, const char* status, const char* json) {
+    httpd_resp_set_status(req, status);
+    httpd_resp_set_type(req, "application/json");
+    return httpd_resp_send(req, json, HTTPD_RESP_USE_STRLEN);
+}
+
+// Whole body into s_body; NULL (with the reply sent) if too large or cut short
+static const char* read_body(httpd_req_t* req) {
+    if (req->content_len > CONFIG_LOCAL_API_BODY_MAX) {
+        reply(req, "413 Payload Too Large", "{\"error\":\"body too large\"}");
+        return NULL;
+    }
+    size_t got = 0;
+    while (got < req->content_len) {
+        int n = httpd_req_recv(req, s_body + got, req->content_len - got);
+        if (n <= 0) {
+            reply(req, "408 Request Timeout", "{\"error\":\"body incomplete\"}");
+            return NULL;
+        }
+        got += (size_t)n;
+    }
+    s_body[got] = 0;
+    return s_body;
+}
+
+static esp_err_t get_state(httpd_req_t* req) {
+    if (format_state(s_out, sizeof(s_out)) < 0) return reply(req, "500 Internal Server Error", "{}");
+    return reply(req, "200 OK", s_out);
+}
+
+static esp_err_t post_relay(httpd_req_t* req) {
+    const char* p = strrchr(req->uri, '/');
+    int ch = p && p[1] >= '1' && p[1] <= '4' && (p[2] == 0 || p[2] == '?') ? p[1] - '0' : 0;
+    if (!ch) return reply(req, "404 Not Found", "{\"error\":\"relay 1..4\"}");
+    const char* body = read_body(req);
+    if (!body) return ESP_OK;
+    while (*body == ' ' || *body == '\n' || *body == '\r' || *body == '\t') body++;
+
+    int on = -1;
+    if (*body == '{') {
+        cJSON* j = cJSON_Parse(body);
+        cJSON* v = j ? cJSON_GetObjectItemCaseSensitive(j, "on") : NULL;
+        if (cJSON_IsBool(v)) on = cJSON_IsTrue(v);
+        cJSON_Delete(j);
+    } else if (strncasecmp(body, "ON", 2) == 0 || strncasecmp(body, "true", 4) == 0 || *body == '1') {
+        on = 1;
+    } else if (strncasecmp(body, "OFF", 3) == 0 || strncasecmp(body, "false", 5) == 0 || *body == '0') {
+        on = 0;
+    }
+    if (on < 0) return reply(req, "400 Bad Request", "{\"error\":\"expected ON or OFF\"}");
+    if (!commands_relay(ch, on, 0)) return reply(req, "503 Service Unavailable", "{\"error\":\"queue full\"}");
+    return reply(req, "202 Accepted", "{\"queued\":true}");
+}
+
+// Validated as a whole before anything is applied
+static esp_err_t post_config(httpd_req_t* req) {
+    const char* body = read_body(req);
+    if (!body) return ESP_OK;
+    char bad[32];
+    if (!commands_apply_config(body, (int)strlen(body), bad, sizeof(bad))) {
+        snprintf(s_out, sizeof(s_out), "{\"error\":\"invalid %s\"}", bad);
+        return reply(req, "400 Bad Request", s_out);
+    }
+    return get_state(req);
+}
+
+// Authorization and latency accounting around every REST handler
+static esp_err_t timed(httpd_req_t* req) {
+    int64_t t0 = esp_timer_get_time();
+    esp_err_t err;
+    if (!authorized(req, false)) {
+        err = reply(req, "401 Unauthorized", "{\"error\":\"token\"}");
+    } else {
+        err = ((esp_err_t(*)(httpd_req_t*))req->user_ctx)(req);
+    }
+    metrics_http((uint32_t)(esp_timer_get_time() - t0));
+    return err;
+}
+
+static esp_err_t ws_handler(httpd_req_t* req) {
+    int fd = httpd_req_to_sockfd(req);
+    if (req->method == HTTP_GET) {
+        // Handshake done; keep the client if there is room
+        int slot = -1;
+        for (int i = 0; i < CONFIG_LOCAL_API_WS_CLIENTS && slot < 0; ++i) {
+            if (s_ws_fds[i] < 0) slot = i;
+        }
+        if (!authorized(req, true) || slot < 0) {
+            ESP_LOGW(TAG, "WebSocket refused (%s)", slot < 0 ? "too many clients" : "token");
+            return ESP_FAIL;
+        }
+        s_ws_fds[slot] = fd;
+        s_ws_count++;
+        mark_dirty(DIRTY_STATE);
+        return ESP_OK;
+    }
+    // Clients only listen; read and drop whatever they send
+    httpd_ws_frame_t f = { 0 };
+    if (httpd_ws_recv_frame(req, &f, 0) != ESP_OK) return ESP_FAIL;
+    if (f.len > CONFIG_LOCAL_API_BODY_MAX) return ESP_FAIL;
+    f.payload = (uint8_t*)s_body;
+    return httpd_ws_recv_frame(req, &f, f.len);
+}
+
+static void on_close(httpd_handle_t hd, int fd) {
+    (void)hd;
+    ws_forget(fd);
+    close(fd);
+}
+
+void local_api_start(void) {
+    for (int i = 0; i < CONFIG_LOCAL_API_WS_CLIENTS; ++i) s_ws_fds[i] = -1;
+    const esp_timer_create_args_t targs = { .callback = push_timer_cb, .name = "api_push" };
+    if (esp_timer_create(&targs, &s_push_timer) != ESP_OK) {
+        ESP_LOGE(TAG, "Push timer not created");
+        return;
+    }
+
+    httpd_config_t cfg = HTTPD_DEFAULT_CONFIG();
+    cfg.server_port = CONFIG_LOCAL_API_PORT;
+    cfg.max_open_sockets = CONFIG_LOCAL_API_MAX_SOCKETS;
+    cfg.stack_size = CONFIG_LOCAL_API_STACK_SIZE;
+    cfg.task_priority = APP_PRIO_HTTPD;
+    cfg.core_id = APP_CORE_HTTPD;
+    cfg.lru_purge_enable = true; // a new client evicts the idlest rather than being refused
+    cfg.max_uri_handlers = 4;
+    cfg.close_fn = on_close;
+    cfg.uri_match_fn = httpd_uri_match_wildcard;
+    if (httpd_start(&s_server, &cfg) != ESP_OK) {
+        ESP_LOGE(TAG, "HTTP server failed to start");
+        s_server = NULL;
+        return;
+    }
+
+    const httpd_uri_t uris[] = {
+        { .uri = "/api/state", .method = HTTP_GET, .handler = timed, .user_ctx = (void*)get_state },
+        { .uri = "/api/relay/*", .method = HTTP_POST, .handler = timed, .user_ctx = (void*)post_relay },
+        { .uri = "/api/config", .method = HTTP_POST, .handler = timed, .user_ctx = (void*)post_config },
+        { .uri = "/api/ws", .method = HTTP_GET, .handler = ws_handler, .is_websocket = true },
+    };
+    for (size_t i = 0; i < sizeof(uris) / sizeof(uris[0]); ++i) httpd_register_uri_handler(s_server, &uris[i]);
+    ESP_LOGI(TAG, "Local API on port %d", CONFIG_LOCAL_API_PORT);
+}
+
+#else
+
+void local_api_start(void) {
+    ESP_LOGI(TAG, "Local API disabled");
+}
+
+void local_api_notify_state(void) {
+}
+
+void local_api_notify_sensors(float co2_ppm, float temperature_c, float humidity_rh) {
+    (void)co2_ppm;
+    (void)temperature_c;
+    (void)humidity_rh;
+}
+
+#endif
@@ -0,0 +1,27 @@
+#pragma once
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// LAN control API on esp_http_server, for when the broker is unreachable:
+//   GET  /api/state       relays, safety config, sensors, connectivity
+//   POST /api/relay/<n>   body ON/OFF (or {"on":true}); 202 once queued
+//   POST /api/config      the <base>/config/set document, all-or-nothing
+//                         (commands_apply_config)
+//   GET  /api/ws          WebSocket: the state on connect and on every
+//                         change, sensor readings as they arrive
+// Commands go through commands.h like MQTT ones. With CONFIG_LOCAL_API_TOKEN
+// set, requests need "Authorization: Bearer <token>" (WebSockets may pass
+// ?token=<token> instead). Per-request latency goes to the metrics module.
+void local_api_start(void);
+
+// Relay or config state changed: WebSocket clients get the new state. Cheap
+// and non-blocking; pushes are coalesced and sent from the server task.
+void local_api_notify_state(void);
+void local_api_notify_sensors(float co2_ppm, float temperature_c, float humidity_rh);
+
+#ifdef __cplusplus
+}
+#endif
@@ -12,23 +12,44 @@
 #include "safety.h"
 #include "ha_mqtt.h"
 #include "ota.h"
+#include "ota_mqtt.h"
+#include "boot.h"
+#include "connectivity.h"
+#include "history.h"
+#include "spool.h"
+#include "metrics.h"
+#include "app_tasks.h"
+#include "control.h"
+#include "local_api.h"
+#include "groups.h"
+#include "dlog.h"
+#include "relay_stats.h"
+
+#include <time.h>
 
 static const char* TAG = "app";
 
+APP_TASK_STORAGE(s_scd4x_task, APP_STACK_SCD4X);
+APP_TASK_STORAGE(s_time_boot_task, APP_STACK_TIME_BOOT);
+
 static void scd4x_task(void* arg) {
     (void)arg;
     const i2c_port_t port = (i2c_port_t)CONFIG_I2C_PORT;
 
-    // Initialize I2C and sensor
+    // Initialize I2C and sensor. A warm reboot can leave it measuring, and
+    // reinit is only accepted in idle mode, so stop first.
     ESP_ERROR_CHECK(scd4x_i2c_init(port, CONFIG_I2C_SDA_GPIO, CONFIG_I2C_SCL_GPIO, CONFIG_I2C_CLK_HZ));
-    scd4x_reinit(port);
-    vTaskDelay(pdMS_TO_TICKS(50));
     scd4x_stop_periodic_measurement(port);
-    vTaskDelay(pdMS_TO_TICKS(500));
+    scd4x_reinit(port);
     scd4x_start_periodic_measurement(port);
+    boot_mark(BOOT_MS_SENSOR_STARTED);
 
-    // First measurement available after ~5s
-    vTaskDelay(pdMS_TO_TICKS(5500));
+    // First measurement available after ~5s; poll so we read it as soon as it lands
+    for (int i = 0; i < 70; ++i) {
+        bool ready = false;
+        if (scd4x_get_data_ready(port, &ready) == ESP_OK && ready) break;
+        vTaskDelay(pdMS_TO_TICKS(100));
+    }
 
     while (1) {
         scd4x_measurement_t m = {0};
@@ -36,17 +57,28 @@ static void scd4x_task(void* arg) {
         if (err == ESP_OK) {
             // Filter out zeros that sometimes appear if data not ready
             if (m.co2_ppm > 0.0f) {
-                ha_mqtt_publish_scd4x(m.co2_ppm, m.temperature_c, m.humidity_rh);
-                ESP_LOGI(TAG, "SCD41: CO2=%.0f ppm T=%.2f C RH=%.1f%%", m.co2_ppm, m.temperature_c, m.humidity_rh);
+                if (connectivity_is(CONN_BROKER_UP)) {
+                    ha_mqtt_publish_scd4x(m.co2_ppm, m.temperature_c, m.humidity_rh);
+                } else if (time_sync_is_valid()) {
+                    // Broker down: keep it for replay, but only with a trustworthy
+                    // timestamp (not the NVS lower bound left by a power loss)
+                    spool_append_scd4x((uint32_t)time(NULL), m.co2_ppm, m.temperature_c, m.humidity_rh);
+                }
+                history_record(m.co2_ppm, m.temperature_c, m.humidity_rh);
+                local_api_notify_sensors(m.co2_ppm, m.temperature_c, m.humidity_rh);
+                DLOGI(TAG, "SCD41: CO2=%.0f ppm T=%.2f C RH=%.1f%%", m.co2_ppm, m.temperature_c, m.humidity_rh);
             }
         } else {
             ESP_LOGW(TAG, "scd4x_read_measurement failed: %s", esp_err_to_name(err));
             // Attempt a reinit if repeated failures
         }
-        vTaskDelay(pdMS_TO_TICKS(5000));
+        vTaskDelay(pdMS_TO_TICKS(SCD4X_PERIOD_MS));
     }
 }
 
+static char s_device_id[32];
+static char s_device_name[64];
+
 static void make_device_identity(char* dev_id, size_t id_sz, char* dev_name, size_t name_sz) {
     uint8_t mac[6] = {0};
     esp_efuse_mac_get_default(mac);
@@ -54,34 +86,65 @@ static void make_device_identity(char* dev_id, size_t id_sz, char* dev_name, siz
     snprintf(dev_name, name_sz, "%s", CONFIG_DEVICE_NAME);
 }
 
+// Schedule enforcement starts once the wall clock is usable (restored or synced)
+static void time_boot_task(void* arg) {
+    (void)arg;
+    connectivity_wait(CONN_TIME_VALID, portMAX_DELAY);
+    boot_mark(BOOT_MS_TIME_VALID);
+    control_apply_policy();
+    vTaskDelete(NULL);
+}
+
 void app_main(void) {
+    boot_init();
+    connectivity_init();
+    dlog_init();
+
     // Storage first (NVS)
     storage_init();
+    boot_mark(BOOT_MS_STORAGE);
 
     // Hardware
     ESP_ERROR_CHECK(relay_init());
+    relay_stats_init();
+    boot_mark(BOOT_MS_RELAYS);
+
+    // Wall clock from RTC/NVS before safety evaluates any schedule; SNTP runs in the background
+    time_sync_init();
 
     // Safety + timers + persisted config
     safety_init();
+    boot_mark(BOOT_MS_SAFETY);
+    groups_init();
 
-    // Networking
-    wifi_init_and_start();
-    time_sync_init();
+    // Relay actuation and periodic safety enforcement (core 1)
+    control_init();
+
+    // Telemetry history (RAM only)
+    history_init();
+
+    // Offline readings survive reboots in the spool partition
+    spool_init();
+
+    // Health metrics; the hooks are live before this, the task only samples
+    metrics_init();
+
+    // Sensor warm-up is the longest step and needs no network; start it first
+    APP_TASK_CREATE(s_scd4x_task, scd4x_task, "scd4x_task", NULL, APP_PRIO_SCD4X, APP_CORE_SCD4X, NULL);
 
     // OTA
     ota_init();
+    ota_mqtt_init();
 
-    // MQTT + HA discovery
-    char device_id[32];
-    char device_name[64];
-    make_device_identity(device_id, sizeof(device_id), device_name, sizeof(device_name));
-    ha_mqtt_start(device_name, device_id);
-
-    // Sensor task
-    xTaskCreatePinnedToCore(scd4x_task, "scd4x_task", 4096, NULL, 5, NULL, tskNO_AFFINITY);
+    // Networking. MQTT + HA discovery connect on IP-up, schedule on time-valid.
+    make_device_identity(s_device_id, sizeof(s_device_id), s_device_name, sizeof(s_device_name));
+    ha_mqtt_start(s_device_name, s_device_id);
+    APP_TASK_CREATE(s_time_boot_task, time_boot_task, "time_boot", NULL, APP_PRIO_TIME_BOOT, APP_CORE_TIME_BOOT, NULL);
+    wifi_init_and_start();
+    local_api_start(); // LAN control, independent of the broker
 
     // Idle: nothing else to do here; tasks and callbacks do the work
     while (1) {
         vTaskDelay(pdMS_TO_TICKS(10000));
     }
-}
\ No newline at end of file
+}
@@ -0,0 +1,231 @@
+#include "metrics.h"
+#include "connectivity.h"
+#include "ha_mqtt.h"
+#include "storage.h"
+#include "wifi.h"
+#include "app_tasks.h"
+
+#include "esp_log.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "esp_wifi.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "sdkconfig.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+static const char* TAG = "metrics";
+
+// Latency bucket upper bounds (us); the last bucket is open-ended
+static const uint32_t k_bounds_us[] = { 500, 1000, 2000, 5000, 10000, 20000, 50000, 100000, 500000 };
+#define NBUCKETS (sizeof(k_bounds_us) / sizeof(k_bounds_us[0]) + 1)
+
+typedef struct {
+    uint32_t n;
+    uint32_t max_us;
+    uint32_t bucket[NBUCKETS];
+} hist_t;
+
+// QoS 1 publishes waiting for PUBLISHED; the oldest slot is reused when full
+#define ACK_SLOTS 8
+typedef struct {
+    int msg_id;
+    int64_t t0_us;
+} ack_slot_t;
+
+static portMUX_TYPE s_mux = portMUX_INITIALIZER_UNLOCKED;
+static hist_t s_pub;  // time the caller blocked in esp_mqtt_client_publish
+static hist_t s_ack;  // publish -> broker PUBACK
+static ack_slot_t s_ack_slots[ACK_SLOTS];
+static uint32_t s_ack_next;
+static uint32_t s_i2c_n, s_i2c_sum_us, s_i2c_max_us;
+static hist_t s_tick; // control period jitter
+static hist_t s_cmd;  // relay command queue -> GPIO
+static hist_t s_http; // local API request handling
+
+// Sampling state, only touched by the metrics task
+static TaskStatus_t s_tasks[CONFIG_METRICS_MAX_TASKS];
+static uint32_t s_idle_prev[portNUM_PROCESSORS];
+static uint32_t s_total_prev;
+static char s_json[1792];
+APP_TASK_STORAGE(s_task, APP_STACK_METRICS);
+
+static void hist_add(hist_t* h, uint32_t us) {
+    size_t b = 0;
+    while (b < NBUCKETS - 1 && us > k_bounds_us[b]) b++;
+    h->bucket[b]++;
+    h->n++;
+    if (us > h->max_us) h->max_us = us;
+}
+
+// Upper bound of the bucket holding the pct-th percentile (max for the open bucket)
+static uint32_t hist_pct(const hist_t* h, uint32_t pct) {
+    if (!h->n) return 0;
+    uint32_t want = (h->n * pct + 99) / 100, seen = 0;
+    for (size_t b = 0; b < NBUCKETS - 1; ++b) {
+        seen += h->bucket[b];
+        if (seen >= want) return k_bounds_us[b] < h->max_us ? k_bounds_us[b] : h->max_us;
+    }
+    return h->max_us;
+}
+
+void metrics_mqtt_publish(int msg_id, int qos, int64_t t0_us) {
+    int64_t now = esp_timer_get_time();
+    taskENTER_CRITICAL(&s_mux);
+    hist_add(&s_pub, (uint32_t)(now - t0_us));
+    if (qos > 0 && msg_id > 0) {
+        s_ack_slots[s_ack_next % ACK_SLOTS] = (ack_slot_t){ msg_id, t0_us };
+        s_ack_next++;
+    }
+    taskEXIT_CRITICAL(&s_mux);
+}
+
+void metrics_mqtt_published(int msg_id) {
+    int64_t now = esp_timer_get_time();
+    taskENTER_CRITICAL(&s_mux);
+    for (int i = 0; i < ACK_SLOTS; ++i) {
+        if (s_ack_slots[i].msg_id == msg_id) {
+            hist_add(&s_ack, (uint32_t)(now - s_ack_slots[i].t0_us));
+            s_ack_slots[i].msg_id = 0;
+            break;
+        }
+    }
+    taskEXIT_CRITICAL(&s_mux);
+}
+
+void metrics_i2c(uint32_t us) {
+    taskENTER_CRITICAL(&s_mux);
+    s_i2c_n++;
+    s_i2c_sum_us += us;
+    if (us > s_i2c_max_us) s_i2c_max_us = us;
+    taskEXIT_CRITICAL(&s_mux);
+}
+
+void metrics_control_tick(uint32_t jitter_us) {
+    taskENTER_CRITICAL(&s_mux);
+    hist_add(&s_tick, jitter_us);
+    taskEXIT_CRITICAL(&s_mux);
+}
+
+void metrics_control_cmd(uint32_t us) {
+    taskENTER_CRITICAL(&s_mux);
+    hist_add(&s_cmd, us);
+    taskEXIT_CRITICAL(&s_mux);
+}
+
+void metrics_http(uint32_t us) {
+    taskENTER_CRITICAL(&s_mux);
+    hist_add(&s_http, us);
+    taskEXIT_CRITICAL(&s_mux);
+}
+
+static int fmt_hist(char* out, size_t sz, const char* name, const hist_t* h) {
+    int len = snprintf(out, sz, ",\"%s\":{\"n\":%" PRIu32 ",\"p50_us\":%" PRIu32 ",\"p95_us\":%" PRIu32
+                       ",\"max_us\":%" PRIu32 ",\"hist\":[",
+                       name, h->n, hist_pct(h, 50), hist_pct(h, 95), h->max_us);
+    for (size_t b = 0; b < NBUCKETS && len < (int)sz; ++b) {
+        len += snprintf(out + len, sz - len, "%s%" PRIu32, b ? "," : "", h->bucket[b]);
+    }
+    if (len < (int)sz) len += snprintf(out + len, sz - len, "]}");
+    return len;
+}
+
+// Builds s_json; returns its length or -1 if it did not fit
+static int collect(int64_t cost_prev_us) {
+    // Snapshot and reset the interval counters
+    hist_t pub, ack, tick, cmd, http;
+    uint32_t i2c_n, i2c_sum, i2c_max;
+    taskENTER_CRITICAL(&s_mux);
+    pub = s_pub;
+    ack = s_ack;
+    tick = s_tick;
+    cmd = s_cmd;
+    http = s_http;
+    i2c_n = s_i2c_n;
+    i2c_sum = s_i2c_sum_us;
+    i2c_max = s_i2c_max_us;
+    memset(&s_pub, 0, sizeof(s_pub));
+    memset(&s_ack, 0, sizeof(s_ack));
+    memset(&s_tick, 0, sizeof(s_tick));
+    memset(&s_cmd, 0, sizeof(s_cmd));
+    memset(&s_http, 0, sizeof(s_http));
+    s_i2c_n = s_i2c_sum_us = s_i2c_max_us = 0;
+    taskEXIT_CRITICAL(&s_mux);
+
+    // Bounded: a fixed array, and the scheduler is only suspended while it is filled
+    uint32_t total = 0;
+    UBaseType_t ntasks = uxTaskGetSystemState(s_tasks, CONFIG_METRICS_MAX_TASKS, &total);
+
+    int cpu[portNUM_PROCESSORS];
+    for (int c = 0; c < portNUM_PROCESSORS; ++c) {
+        cpu[c] = -1;
+        TaskHandle_t idle = xTaskGetIdleTaskHandleForCore(c);
+        for (UBaseType_t i = 0; i < ntasks; ++i) {
+            if (s_tasks[i].xHandle != idle) continue;
+            uint32_t dt = total - s_total_prev, di = s_tasks[i].ulRunTimeCounter - s_idle_prev[c];
+            if (s_total_prev && dt) cpu[c] = 100 - (int)((uint64_t)(di < dt ? di : dt) * 100 / dt);
+            s_idle_prev[c] = s_tasks[i].ulRunTimeCounter;
+            break;
+        }
+    }
+    s_total_prev = total;
+
+    int rssi = 0;
+    wifi_ap_record_t ap;
+    if (connectivity_is(CONN_LINK_UP) && esp_wifi_sta_get_ap_info(&ap) == ESP_OK) rssi = ap.rssi;
+
+    storage_stats_t st;
+    storage_get_stats(&st);
+
+    const size_t sz = sizeof(s_json);
+    int len = snprintf(s_json, sz,
+                       "{\"up\":%" PRId64 ",\"heap\":%" PRIu32 ",\"heap_min\":%" PRIu32 ",\"rssi\":%d,"
+                       "\"wifi_connect_ms\":%" PRIu32 ",\"nvs_commits\":%" PRIu32 ",\"cost_us\":%" PRId64 ",\"cpu\":[",
+                       esp_timer_get_time() / 1000000, esp_get_free_heap_size(), esp_get_minimum_free_heap_size(),
+                       rssi, wifi_get_last_connect_ms(), st.commits, cost_prev_us);
+    for (int c = 0; c < portNUM_PROCESSORS && len < (int)sz; ++c) {
+        len += snprintf(s_json + len, sz - len, "%s%d", c ? "," : "", cpu[c]);
+    }
+    if (len < (int)sz) {
+        len += snprintf(s_json + len, sz - len, "],\"i2c\":{\"n\":%" PRIu32 ",\"avg_us\":%" PRIu32 ",\"max_us\":%" PRIu32 "}",
+                        i2c_n, i2c_n ? i2c_sum / i2c_n : 0, i2c_max);
+    }
+    if (len < (int)sz) len += fmt_hist(s_json + len, sz - len, "pub", &pub);
+    if (len < (int)sz) len += fmt_hist(s_json + len, sz - len, "ack", &ack);
+    if (len < (int)sz) len += fmt_hist(s_json + len, sz - len, "ctl_tick", &tick);
+    if (len < (int)sz) len += fmt_hist(s_json + len, sz - len, "ctl_cmd", &cmd);
+    if (len < (int)sz) len += fmt_hist(s_json + len, sz - len, "http", &http);
+    // Free stack in bytes per task; 0 tasks means the table was too small
+    if (len < (int)sz) len += snprintf(s_json + len, sz - len, ",\"stack\":{");
+    for (UBaseType_t i = 0; i < ntasks && len < (int)sz; ++i) {
+        len += snprintf(s_json + len, sz - len, "%s\"%s\":%u", i ? "," : "", s_tasks[i].pcTaskName,
+                        (unsigned)s_tasks[i].usStackHighWaterMark);
+    }
+    if (len < (int)sz) len += snprintf(s_json + len, sz - len, "}}");
+    return len < (int)sz ? len : -1;
+}
+
+static void metrics_task(void* arg) {
+    (void)arg;
+    int64_t cost_us = 0;
+    TickType_t last = xTaskGetTickCount();
+    while (1) {
+        vTaskDelayUntil(&last, pdMS_TO_TICKS(CONFIG_METRICS_INTERVAL_S * 1000));
+        // The reported cost is the previous round's, so it includes formatting
+        int64_t t0 = esp_timer_get_time();
+        int len = collect(cost_us);
+        cost_us = esp_timer_get_time() - t0;
+        if (len < 0) {
+            ESP_LOGW(TAG, "Metrics do not fit the buffer");
+            continue;
+        }
+        if (connectivity_is(CONN_BROKER_UP)) ha_mqtt_publish_metrics(s_json);
+    }
+}
+
+void metrics_init(void) {
+    // Lowest application priority: a late sample is fine, a late relay is not
+    APP_TASK_CREATE(s_task, metrics_task, "metrics", NULL, APP_PRIO_METRICS, APP_CORE_METRICS, NULL);
+}
@@ -0,0 +1,30 @@
+#pragma once
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Runtime health metrics. A low-priority task samples heap, per-task stack
+// high-water marks, per-core CPU load, NVS commits, RSSI and the last Wi-Fi
+// time-to-IP every CONFIG_METRICS_INTERVAL_S and publishes them, together
+// with the latency figures collected by the hooks below, as one JSON message
+// on <base>/metrics. Hooks are O(1) and safe to call from any task.
+void metrics_init(void);
+
+// esp_mqtt_client_publish() returned msg_id after blocking since t0_us
+void metrics_mqtt_publish(int msg_id, int qos, int64_t t0_us);
+// MQTT_EVENT_PUBLISHED for msg_id (QoS 1 round trip)
+void metrics_mqtt_published(int msg_id);
+// One I2C transaction took us
+void metrics_i2c(uint32_t us);
+// Control task: deviation of a periodic tick from its period, and the time
+// from queueing a relay command to the GPIO write
+void metrics_control_tick(uint32_t jitter_us);
+void metrics_control_cmd(uint32_t us);
+// Local API: one HTTP request, from handler entry to the response sent
+void metrics_http(uint32_t us);
+
+#ifdef __cplusplus
+}
+#endif
@@ -1,78 +1,436 @@
 #include "ota.h"
-#include "esp_https_ota.h"
+#include "delta_patch.h"
 #include "esp_http_client.h"
+#include "esp_ota_ops.h"
+#include "esp_app_format.h"
+#include "esp_system.h"
+#include "esp_timer.h"
 #include "esp_log.h"
+#include "esp_partition.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "storage.h"
+#include "connectivity.h"
+#include "ha_mqtt.h"
+#include "app_tasks.h"
 #include "sdkconfig.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 static const char* TAG = "ota";
+// Configured URLs; set from the MQTT task, read under s_url_mux
 static char s_url[256] = {0};
+static char s_delta_url[256] = {0};
+static portMUX_TYPE s_url_mux = portMUX_INITIALIZER_UNLOCKED;
+// Claimed with an atomic exchange by whoever starts an update
+static bool s_running = false;
+static delta_patch_t* s_patch = NULL;
+
+// The OTA task is created once at init and waits for a trigger, so an
+// update never depends on finding an 8 KB stack in a fragmented heap
+static TaskHandle_t s_task = NULL;
+// Copied by ota_trigger before it notifies the task, and owned by the task
+// until s_running is released; "" delta = full image only
+static char s_task_url[256];
+static char s_task_delta_url[256];
+APP_TASK_STORAGE(s_ota_task, APP_STACK_OTA);
+static void ota_task(void* arg);
+#if CONFIG_APP_STATIC_ALLOC
+static uint8_t s_rx_buf[CONFIG_OTA_RX_BUF_SIZE];
+#endif
+
+// Image writer: streams into the next OTA partition, validates the app
+// header as soon as it arrives and the whole image before switching boot.
+#define OTA_HEADER_LEN (sizeof(esp_image_header_t) + sizeof(esp_image_segment_header_t) + sizeof(esp_app_desc_t))
+
+typedef struct {
+    const esp_partition_t* part;
+    esp_ota_handle_t handle;
+    size_t written;     // image bytes written to flash
+    size_t rx;          // bytes downloaded (image or patch)
+    size_t rx_total;    // 0 if unknown
+    uint8_t header[OTA_HEADER_LEN];
+    bool header_checked;
+    int64_t start_us;
+    int64_t last_report_us;
+    uint32_t resumes;
+} ota_writer_t;
+
+static ota_writer_t s_w;
+
+static uint32_t writer_kbps(void) {
+    int64_t dt = esp_timer_get_time() - s_w.start_us;
+    return dt > 0 ? (uint32_t)((int64_t)s_w.rx * 8000 / dt) : 0;
+}
+
+static void report(const char* state) {
+    ha_mqtt_publish_ota_progress(state, s_w.rx, s_w.rx_total, writer_kbps(), s_w.resumes);
+}
+
+static void report_throttled(void) {
+    int64_t now = esp_timer_get_time();
+    if (now - s_w.last_report_us >= (int64_t)CONFIG_OTA_PROGRESS_INTERVAL_MS * 1000) {
+        s_w.last_report_us = now;
+        report("downloading");
+    }
+}
+
+static esp_err_t writer_begin(void) {
+    memset(&s_w, 0, sizeof(s_w));
+    s_w.part = esp_ota_get_next_update_partition(NULL);
+    if (!s_w.part) return ESP_ERR_NOT_FOUND;
+    // Sequential writes erase sector by sector instead of the whole slot up front
+    esp_err_t err = esp_ota_begin(s_w.part, OTA_WITH_SEQUENTIAL_WRITES, &s_w.handle);
+    if (err != ESP_OK) return err;
+    s_w.start_us = esp_timer_get_time();
+    ESP_LOGI(TAG, "Writing to partition %s at 0x%" PRIx32, s_w.part->label, s_w.part->address);
+    return ESP_OK;
+}
+
+// Reject images built for another project before downloading the rest
+static esp_err_t check_header(void) {
+    const esp_app_desc_t* desc = (const esp_app_desc_t*)(s_w.header + sizeof(esp_image_header_t) + sizeof(esp_image_segment_header_t));
+    const esp_image_header_t* img = (const esp_image_header_t*)s_w.header;
+    if (img->magic != ESP_IMAGE_HEADER_MAGIC || desc->magic_word != ESP_APP_DESC_MAGIC_WORD) {
+        ESP_LOGE(TAG, "Not an app image");
+        return ESP_ERR_OTA_VALIDATE_FAILED;
+    }
+    const esp_app_desc_t* running = esp_app_get_description();
+    if (strncmp(desc->project_name, running->project_name, sizeof(desc->project_name)) != 0) {
+        ESP_LOGE(TAG, "Image is for project '%.32s'", desc->project_name);
+        return ESP_ERR_OTA_VALIDATE_FAILED;
+    }
+    ESP_LOGI(TAG, "Incoming version %.32s (running %.32s)", desc->version, running->version);
+    return ESP_OK;
+}
+
+static esp_err_t writer_write(const uint8_t* data, size_t len) {
+    if (!s_w.header_checked) {
+        size_t n = OTA_HEADER_LEN - s_w.written;
+        if (n > len) n = len;
+        memcpy(s_w.header + s_w.written, data, n);
+        if (s_w.written + n == OTA_HEADER_LEN) {
+            esp_err_t err = check_header();
+            if (err != ESP_OK) return err;
+            s_w.header_checked = true;
+        }
+    }
+    esp_err_t err = esp_ota_write(s_w.handle, data, len);
+    if (err != ESP_OK) return err;
+    s_w.written += len;
+    return ESP_OK;
+}
+
+// esp_ota_end checks segment layout, the appended SHA-256 and (if enabled)
+// the secure boot signature; only a valid image becomes the boot partition.
+static esp_err_t writer_finish(void) {
+    report("verifying");
+    esp_err_t err = esp_ota_end(s_w.handle);
+    s_w.handle = 0;
+    if (err != ESP_OK) return err;
+    return esp_ota_set_boot_partition(s_w.part);
+}
+
+static void writer_abort(void) {
+    if (s_w.handle) esp_ota_abort(s_w.handle);
+    s_w.handle = 0;
+}
 
 void ota_init(void) {
     // Load saved URL or default from Kconfig
     storage_get_str("ota_url", s_url, sizeof(s_url), CONFIG_OTA_DEFAULT_URL);
+    storage_get_str("ota_delta_url", s_delta_url, sizeof(s_delta_url), "");
+    APP_TASK_CREATE(s_ota_task, ota_task, "ota_task", NULL, APP_PRIO_OTA, APP_CORE_OTA, &s_task);
+}
+
+static void url_copy(char* dst, size_t dst_sz, const char* src) {
+    taskENTER_CRITICAL(&s_url_mux);
+    size_t n = strnlen(src, dst_sz - 1);
+    memcpy(dst, src, n);
+    dst[n] = 0;
+    taskEXIT_CRITICAL(&s_url_mux);
 }
 
 void ota_set_url(const char* url) {
-    if (!url) url = "";
-    strncpy(s_url, url, sizeof(s_url)-1);
-    s_url[sizeof(s_url)-1] = 0;
-    storage_set_str("ota_url", s_url);
+    url_copy(s_url, sizeof(s_url), url ? url : "");
+    storage_set_str("ota_url", url ? url : "");
 }
 
 void ota_get_url(char* out, size_t out_sz) {
     if (!out || !out_sz) return;
-    strncpy(out, s_url, out_sz - 1);
-    out[out_sz - 1] = 0;
+    url_copy(out, out_sz, s_url);
 }
 
-static void ota_task(void* arg) {
-    const char* url = (const char*)arg;
-    char local[256];
-    if (url && url[0]) {
-        strncpy(local, url, sizeof(local)-1);
-        local[sizeof(local)-1] = 0;
-    } else {
-        strncpy(local, s_url, sizeof(local)-1);
-        local[sizeof(local)-1] = 0;
-    }
+void ota_set_delta_url(const char* url) {
+    url_copy(s_delta_url, sizeof(s_delta_url), url ? url : "");
+    storage_set_str("ota_delta_url", url ? url : "");
+}
 
-    if (!local[0]) {
-        ESP_LOGE(TAG, "No OTA URL configured");
-        vTaskDelete(NULL);
-        return;
-    }
+void ota_get_delta_url(char* out, size_t out_sz) {
+    if (!out || !out_sz) return;
+    url_copy(out, out_sz, s_delta_url);
+}
 
-    ESP_LOGI(TAG, "Starting OTA from %s", local);
+// Download sinks: full image straight to flash, or patch through the applier
+typedef esp_err_t (*ota_sink_t)(const uint8_t* data, size_t len);
 
+static esp_err_t image_sink(const uint8_t* data, size_t len) {
+    return writer_write(data, len);
+}
+
+static esp_err_t read_base(size_t offset, void* out, size_t len, void* ctx) {
+    return esp_partition_read((const esp_partition_t*)ctx, offset, out, len);
+}
+
+static esp_err_t write_target(const uint8_t* data, size_t len, void* ctx) {
+    return writer_write(data, len);
+}
+
+static esp_err_t patch_sink(const uint8_t* data, size_t len) {
+    return delta_patch_feed(s_patch, data, len);
+}
+
+// One HTTP request from the current download offset. Returns ESP_OK when the
+// download is complete, ESP_ERR_OTA_VALIDATE_FAILED / ESP_ERR_INVALID_STATE
+// when the sink rejected the data; any other error leaves s_w intact for a resume.
+static esp_err_t download_from_offset(const char* url, uint8_t* buf, ota_sink_t sink) {
     esp_http_client_config_t http_cfg = {
-        .url = local,
-        .timeout_ms = 15000,
+        .url = url,
+        .timeout_ms = CONFIG_OTA_HTTP_TIMEOUT_MS,
+        .buffer_size = CONFIG_OTA_RX_BUF_SIZE,
 #if CONFIG_OTA_USE_SERVER_CERT
         .cert_pem = (const char*)CONFIG_OTA_SERVER_CERT_PEM,
 #else
         .cert_pem = NULL,
 #endif
     };
-    esp_https_ota_config_t ota_cfg = {
-        .http_config = &http_cfg,
-    };
+    esp_http_client_handle_t client = esp_http_client_init(&http_cfg);
+    if (!client) return ESP_ERR_NO_MEM;
+
+    if (s_w.rx > 0) {
+        char range[32];
+        snprintf(range, sizeof(range), "bytes=%u-", (unsigned)s_w.rx);
+        esp_http_client_set_header(client, "Range", range);
+    }
+
+    esp_err_t err = esp_http_client_open(client, 0);
+    if (err != ESP_OK) goto out;
+    int64_t len = esp_http_client_fetch_headers(client);
+    int status = esp_http_client_get_status_code(client);
 
-    esp_err_t ret = esp_https_ota(&ota_cfg);
-    if (ret == ESP_OK) {
-        ESP_LOGI(TAG, "OTA successful, rebooting...");
+    size_t skip = 0;
+    if (status == 206) {
+        if (len > 0) s_w.rx_total = s_w.rx + (size_t)len;
+    } else if (status == 200) {
+        // Server ignored Range: discard what we already have
+        skip = s_w.rx;
+        if (len > 0) s_w.rx_total = (size_t)len;
+    } else {
+        ESP_LOGE(TAG, "HTTP status %d", status);
+        err = ESP_ERR_INVALID_RESPONSE;
+        goto out;
+    }
+    if (s_w.rx_total > s_w.part->size) {
+        ESP_LOGE(TAG, "Download (%u bytes) larger than partition", (unsigned)s_w.rx_total);
+        err = ESP_ERR_INVALID_SIZE;
+        goto out;
+    }
+
+    while (1) {
+        int n = esp_http_client_read(client, (char*)buf, CONFIG_OTA_RX_BUF_SIZE);
+        if (n < 0) {
+            err = ESP_FAIL;
+            break;
+        }
+        if (n == 0) {
+            bool complete = esp_http_client_is_complete_data_received(client) &&
+                            (!s_w.rx_total || s_w.rx == s_w.rx_total);
+            err = complete ? ESP_OK : ESP_ERR_INVALID_SIZE;
+            break;
+        }
+        const uint8_t* p = buf;
+        if (skip) {
+            size_t k = skip < (size_t)n ? skip : (size_t)n;
+            skip -= k; p += k; n -= (int)k;
+            if (!n) continue;
+        }
+        err = sink(p, (size_t)n);
+        if (err != ESP_OK) {
+            // Bad image, wrong patch base or flash error: no point resuming
+            ESP_LOGE(TAG, "Data rejected at %u bytes: %s", (unsigned)s_w.rx, esp_err_to_name(err));
+            esp_http_client_close(client);
+            esp_http_client_cleanup(client);
+            return err == ESP_ERR_OTA_VALIDATE_FAILED ? err : ESP_ERR_INVALID_STATE;
+        }
+        s_w.rx += (size_t)n;
+        report_throttled();
+    }
+out:
+    esp_http_client_close(client);
+    esp_http_client_cleanup(client);
+    return err;
+}
+
+// Download into a freshly begun OTA partition, resuming after interruptions
+static esp_err_t download(const char* url, uint8_t* buf, ota_sink_t sink) {
+    esp_err_t err = writer_begin();
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "OTA begin failed: %s", esp_err_to_name(err));
+        return err;
+    }
+    ESP_LOGI(TAG, "Downloading %s", url);
+    while (1) {
+        err = download_from_offset(url, buf, sink);
+        if (err == ESP_OK || err == ESP_ERR_OTA_VALIDATE_FAILED || err == ESP_ERR_INVALID_STATE) break;
+        if (s_w.resumes >= CONFIG_OTA_MAX_RESUMES) break;
+        s_w.resumes++;
+        ESP_LOGW(TAG, "Download interrupted at %u bytes (%s), resume %" PRIu32 "/%d",
+                 (unsigned)s_w.rx, esp_err_to_name(err), s_w.resumes, CONFIG_OTA_MAX_RESUMES);
+        report("resuming");
+        connectivity_wait(CONN_IP, pdMS_TO_TICKS(60000));
+        vTaskDelay(pdMS_TO_TICKS(1000u << (s_w.resumes < 5 ? s_w.resumes : 5)));
+    }
+    return err;
+}
+
+// Patch the running image into the OTA partition. Fails fast (after the
+// 80-byte header) when the patch was made against another build.
+static esp_err_t download_delta(const char* url, uint8_t* buf) {
+    const esp_partition_t* running = esp_ota_get_running_partition();
+    uint8_t digest[32];
+    esp_err_t err = esp_partition_get_sha256(running, digest);
+    if (err != ESP_OK) return err;
+    s_patch = delta_patch_create(digest, running->size, read_base, write_target, (void*)running);
+    if (!s_patch) return ESP_ERR_NO_MEM;
+    err = download(url, buf, patch_sink);
+    if (err == ESP_OK) err = delta_patch_finish(s_patch);
+    if (err == ESP_OK) {
+        ESP_LOGI(TAG, "Delta applied: %u byte patch -> %u byte image",
+                 (unsigned)s_w.rx, (unsigned)s_w.written);
+    }
+    delta_patch_free(s_patch);
+    s_patch = NULL;
+    return err;
+}
+
+static void run_update(const char* url, const char* delta_url) {
+    bool try_delta = delta_url[0] != 0;
+    uint8_t* buf = NULL;
+    esp_err_t err = ESP_FAIL;
+
+    if (!url[0] && !try_delta) {
+        ESP_LOGE(TAG, "No OTA URL configured");
+        goto done;
+    }
+
+    // Don't burn the HTTP timeout against a dead link; wait for it to come back
+    if (!connectivity_wait(CONN_IP, pdMS_TO_TICKS(60000))) {
+        ESP_LOGE(TAG, "No network, OTA abandoned");
+        goto done;
+    }
+
+#if CONFIG_APP_STATIC_ALLOC
+    buf = s_rx_buf;
+#else
+    buf = malloc(CONFIG_OTA_RX_BUF_SIZE);
+#endif
+    if (!buf) {
+        ESP_LOGE(TAG, "No memory for receive buffer");
+        goto done;
+    }
+
+    if (try_delta) {
+        err = download_delta(delta_url, buf);
+        if (err != ESP_OK) {
+            writer_abort();
+            ESP_LOGW(TAG, "Delta update failed (%s)%s", esp_err_to_name(err),
+                     url[0] ? ", falling back to full image" : "");
+        }
+    }
+    if (err != ESP_OK && url[0]) err = download(url, buf, image_sink);
+
+    if (err == ESP_OK) err = writer_finish();
+    if (err == ESP_OK) {
+        ESP_LOGI(TAG, "OTA successful (%u bytes, %" PRIu32 " kbit/s, %" PRIu32 " resumes), rebooting...",
+                 (unsigned)s_w.written, writer_kbps(), s_w.resumes);
+        report("rebooting");
         vTaskDelay(pdMS_TO_TICKS(1000));
         esp_restart();
-    } else {
-        ESP_LOGE(TAG, "OTA failed: %s", esp_err_to_name(ret));
     }
-    vTaskDelete(NULL);
+    ESP_LOGE(TAG, "OTA failed: %s", esp_err_to_name(err));
+    writer_abort();
+    report("failed");
+
+done:
+#if !CONFIG_APP_STATIC_ALLOC
+    free(buf);
+#endif
+    __atomic_store_n(&s_running, false, __ATOMIC_RELEASE);
+}
+
+static void ota_task(void* arg) {
+    (void)arg;
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        run_update(s_task_url, s_task_delta_url);
+    }
 }
 
 esp_err_t ota_trigger(const char* url_or_null) {
-    BaseType_t ok = xTaskCreate(ota_task, "ota_task", 8192, (void*)url_or_null, 5, NULL);
-    return ok == pdPASS ? ESP_OK : ESP_FAIL;
-}
\ No newline at end of file
+    if (!s_task) return ESP_ERR_INVALID_STATE;
+    if (__atomic_exchange_n(&s_running, true, __ATOMIC_ACQ_REL)) {
+        ESP_LOGW(TAG, "OTA already in progress");
+        return ESP_ERR_INVALID_STATE;
+    }
+    // The configured URL may try the delta URL first; an explicit URL is
+    // always a full image. The task owns these copies until it clears s_running.
+    if (url_or_null && url_or_null[0]) {
+        url_copy(s_task_url, sizeof(s_task_url), url_or_null);
+        s_task_delta_url[0] = 0;
+    } else {
+        url_copy(s_task_url, sizeof(s_task_url), s_url);
+        url_copy(s_task_delta_url, sizeof(s_task_delta_url), s_delta_url);
+    }
+    xTaskNotifyGive(s_task);
+    return ESP_OK;
+}
+
+esp_err_t ota_stream_begin(size_t total) {
+    if (__atomic_exchange_n(&s_running, true, __ATOMIC_ACQ_REL)) return ESP_ERR_INVALID_STATE;
+    esp_err_t err = writer_begin();
+    if (err == ESP_OK && total > s_w.part->size) err = ESP_ERR_INVALID_SIZE;
+    if (err != ESP_OK) {
+        writer_abort();
+        __atomic_store_n(&s_running, false, __ATOMIC_RELEASE);
+        return err;
+    }
+    s_w.rx_total = total;
+    return ESP_OK;
+}
+
+esp_err_t ota_stream_write(const void* data, size_t len) {
+    esp_err_t err = writer_write((const uint8_t*)data, len);
+    if (err != ESP_OK) return err;
+    s_w.rx += len;
+    report_throttled();
+    return ESP_OK;
+}
+
+esp_err_t ota_stream_finish(void) {
+    esp_err_t err = writer_finish();
+    if (err != ESP_OK) {
+        ota_stream_abort();
+        return err;
+    }
+    ESP_LOGI(TAG, "OTA stream complete (%u bytes, %" PRIu32 " kbit/s)", (unsigned)s_w.written, writer_kbps());
+    report("rebooting");
+    return ESP_OK;
+}
+
+void ota_stream_abort(void) {
+    writer_abort();
+    report("failed");
+    __atomic_store_n(&s_running, false, __ATOMIC_RELEASE);
+}
@@ -9,8 +9,23 @@ extern "C" {
 void ota_init(void);
 void ota_set_url(const char* url);
 void ota_get_url(char* out, size_t out_sz);
+// Optional delta patch URL (tools/mkdelta.py output). When set, an update
+// started without an explicit URL tries the patch first and falls back to
+// the full image URL if the patch doesn't apply to the running build.
+void ota_set_delta_url(const char* url);
+void ota_get_delta_url(char* out, size_t out_sz);
 esp_err_t ota_trigger(const char* url_or_null); // starts OTA task
 
+// Push-style writer for transports that deliver the image themselves.
+// begin claims the updater (ESP_ERR_INVALID_STATE while another update runs);
+// finish validates the image and selects it for the next boot, the caller
+// restarts. Writes must not be issued from latency-sensitive tasks: flash
+// erases take tens of milliseconds.
+esp_err_t ota_stream_begin(size_t total);
+esp_err_t ota_stream_write(const void* data, size_t len);
+esp_err_t ota_stream_finish(void);
+void ota_stream_abort(void);
+
 #ifdef __cplusplus
 }
 #endif
\ No newline at end of file
@@ -0,0 +1,212 @@
+#include "ota_mqtt.h"
+#include "ota.h"
+#include "ha_mqtt.h"
+#include "app_tasks.h"
+
+#include "esp_log.h"
+#include "esp_rom_crc.h"
+#include "esp_system.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "sdkconfig.h"
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char* TAG = "ota_mqtt";
+
+typedef struct __attribute__((packed)) {
+    uint32_t magic;
+    uint32_t session;
+    uint32_t seq;
+    uint32_t total;
+    uint32_t offset;
+    uint16_t len;
+    uint16_t flags;
+    uint32_t crc;
+} ota_chunk_hdr_t;
+
+_Static_assert(sizeof(ota_chunk_hdr_t) == OTA_CHUNK_HDR_LEN, "chunk header layout");
+
+typedef struct {
+    uint8_t* buf;
+    uint16_t len;
+} chunk_t;
+
+// Chunk buffers cycle between the free queue (MQTT task takes one per
+// accepted chunk) and the work queue (writer task returns it after the
+// flash write). The pool size is the flow-control window.
+static SemaphoreHandle_t s_lock = NULL;
+static QueueHandle_t s_free_q = NULL;
+static QueueHandle_t s_work_q = NULL;
+static uint8_t* s_pool = NULL;
+#if CONFIG_APP_STATIC_ALLOC
+static uint8_t s_pool_mem[CONFIG_OTA_MQTT_WINDOW * CONFIG_OTA_MQTT_CHUNK_MAX];
+#endif
+
+// Writer task: created once, woken per session
+static TaskHandle_t s_task = NULL;
+APP_TASK_STORAGE(s_writer_task, APP_STACK_OTA_MQTT);
+
+static bool s_active = false;
+static uint32_t s_session = 0;
+static uint32_t s_total = 0;
+static uint32_t s_next_seq = 0;     // next chunk accepted from the MQTT side
+static uint32_t s_next_offset = 0;
+static uint32_t s_nacked_seq = UINT32_MAX;
+static volatile uint32_t s_written_seq = 0; // chunks written to flash
+
+static void send_ack(const char* state) {
+    ha_mqtt_publish_ota_ack(s_session, s_next_seq, s_written_seq, state);
+}
+
+static void end_session(void) {
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    s_active = false;
+    xQueueReset(s_work_q);
+    xQueueReset(s_free_q);
+#if !CONFIG_APP_STATIC_ALLOC
+    free(s_pool);
+#endif
+    s_pool = NULL;
+    xSemaphoreGive(s_lock);
+}
+
+static void run_session(void) {
+    esp_err_t err = ESP_OK;
+    uint32_t written = 0;
+    uint32_t ack_every = CONFIG_OTA_MQTT_WINDOW > 1 ? CONFIG_OTA_MQTT_WINDOW / 2 : 1;
+
+    while (written < s_total) {
+        chunk_t c;
+        if (xQueueReceive(s_work_q, &c, pdMS_TO_TICKS(CONFIG_OTA_MQTT_TIMEOUT_S * 1000)) != pdTRUE) {
+            ESP_LOGE(TAG, "No chunk for %d s, giving up at %" PRIu32 " bytes", CONFIG_OTA_MQTT_TIMEOUT_S, written);
+            err = ESP_ERR_TIMEOUT;
+            break;
+        }
+        err = ota_stream_write(c.buf, c.len);
+        xQueueSend(s_free_q, &c.buf, 0);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Write failed at %" PRIu32 " bytes: %s", written, esp_err_to_name(err));
+            break;
+        }
+        written += c.len;
+        s_written_seq++;
+        // First ack tells the sender our window
+        if (s_written_seq == 1 || s_written_seq % ack_every == 0 || written == s_total) send_ack("receiving");
+    }
+
+    if (err == ESP_OK) err = ota_stream_finish();
+    else ota_stream_abort();
+    send_ack(err == ESP_OK ? "done" : "error");
+    end_session();
+
+    if (err == ESP_OK) {
+        ESP_LOGI(TAG, "Image received, rebooting...");
+        vTaskDelay(pdMS_TO_TICKS(1000));
+        esp_restart();
+    }
+}
+
+static void ota_mqtt_task(void* arg) {
+    (void)arg;
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        run_session();
+    }
+}
+
+// Called with s_lock held
+static bool start_session(const ota_chunk_hdr_t* h) {
+    esp_err_t err = ota_stream_begin(h->total);
+    if (err != ESP_OK) {
+        ESP_LOGW(TAG, "Cannot start session %08" PRIx32 ": %s", h->session, esp_err_to_name(err));
+        return false;
+    }
+#if CONFIG_APP_STATIC_ALLOC
+    s_pool = s_pool_mem;
+#else
+    s_pool = malloc((size_t)CONFIG_OTA_MQTT_WINDOW * CONFIG_OTA_MQTT_CHUNK_MAX);
+#endif
+    if (!s_pool) {
+        ota_stream_abort();
+        return false;
+    }
+    for (int i = 0; i < CONFIG_OTA_MQTT_WINDOW; ++i) {
+        uint8_t* b = s_pool + (size_t)i * CONFIG_OTA_MQTT_CHUNK_MAX;
+        xQueueSend(s_free_q, &b, 0);
+    }
+    s_session = h->session;
+    s_total = h->total;
+    s_next_seq = 0;
+    s_next_offset = 0;
+    s_nacked_seq = UINT32_MAX;
+    s_written_seq = 0;
+    s_active = true;
+    xTaskNotifyGive(s_task);
+    ESP_LOGI(TAG, "Session %08" PRIx32 ": %" PRIu32 " bytes", s_session, s_total);
+    return true;
+}
+
+void ota_mqtt_handle_chunk(const char* data, int len) {
+    ota_chunk_hdr_t h;
+    if (!s_task || len < (int)sizeof(h)) return;
+    memcpy(&h, data, sizeof(h));
+    const uint8_t* payload = (const uint8_t*)data + sizeof(h);
+    int plen = len - (int)sizeof(h);
+    if (h.magic != OTA_CHUNK_MAGIC || h.len != plen || plen == 0 || plen > CONFIG_OTA_MQTT_CHUNK_MAX) return;
+    // A corrupt chunk is just dropped; the gap makes the sender resend it
+    if (esp_rom_crc32_le(0, payload, plen) != h.crc) return;
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    if (!s_active || h.session != s_session) {
+        if (h.seq != 0) goto out; // joined mid-transfer: wait for the sender to restart
+        if (s_active) {
+            ha_mqtt_publish_ota_ack(h.session, 0, 0, "busy");
+            goto out;
+        }
+        if (!start_session(&h)) {
+            ha_mqtt_publish_ota_ack(h.session, 0, 0, "busy");
+            goto out;
+        }
+    }
+
+    if (h.seq < s_next_seq) {
+        // Duplicate (a slower group member asked for a resend): ack sparingly
+        if (h.seq % CONFIG_OTA_MQTT_WINDOW == 0) send_ack("receiving");
+        goto out;
+    }
+    if (h.seq > s_next_seq || h.offset != s_next_offset) {
+        // Gap: tell the sender where to go back to, once per position
+        if (s_nacked_seq != s_next_seq) {
+            s_nacked_seq = s_next_seq;
+            send_ack("resend");
+        }
+        goto out;
+    }
+    // Every chunk restates the image size; one that disagrees or would run
+    // past the end is dropped before anything is written
+    if (h.total != s_total || (uint32_t)plen > s_total - s_next_offset) {
+        ESP_LOGW(TAG, "Chunk %" PRIu32 " outside the %" PRIu32 "-byte image, dropped", h.seq, s_total);
+        goto out;
+    }
+    uint8_t* buf;
+    if (xQueueReceive(s_free_q, &buf, 0) != pdTRUE) goto out; // sender overran the window
+    memcpy(buf, payload, plen);
+    chunk_t c = { .buf = buf, .len = (uint16_t)plen };
+    xQueueSend(s_work_q, &c, 0);
+    s_next_seq++;
+    s_next_offset += plen;
+out:
+    xSemaphoreGive(s_lock);
+}
+
+void ota_mqtt_init(void) {
+    s_lock = xSemaphoreCreateMutex();
+    s_free_q = xQueueCreate(CONFIG_OTA_MQTT_WINDOW, sizeof(uint8_t*));
+    s_work_q = xQueueCreate(CONFIG_OTA_MQTT_WINDOW, sizeof(chunk_t));
+    // Below the MQTT task so chunk intake and commands preempt flash writes
+    APP_TASK_CREATE(s_writer_task, ota_mqtt_task, "ota_mqtt", NULL, APP_PRIO_OTA_MQTT, APP_CORE_OTA_MQTT, &s_task);
+}
@@ -0,0 +1,29 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Firmware delivery over MQTT. The image is published in sequenced chunks
+// (tools/mqtt_ota_send.py) to <base>/ota/chunk or the shared group topic
+// CONFIG_OTA_MQTT_GROUP_TOPIC; each chunk is a little-endian header
+//   u32 magic "GHC1", u32 session, u32 seq, u32 total, u32 offset,
+//   u16 len, u16 flags, u32 crc32(data)
+// followed by len bytes. Progress is acked on <base>/ota/ack; the sender
+// keeps at most CONFIG_OTA_MQTT_WINDOW unacked chunks in flight.
+
+#define OTA_CHUNK_MAGIC   0x31434847u // "GHC1"
+#define OTA_CHUNK_HDR_LEN 28
+
+void ota_mqtt_init(void);
+
+// Called from the MQTT event handler. Only validates and queues; flash
+// writes happen in a lower-priority task so commands stay responsive.
+void ota_mqtt_handle_chunk(const char* data, int len);
+
+#ifdef __cplusplus
+}
+#endif
@@ -1,4 +1,5 @@
 #include "relay.h"
+#include "relay_stats.h"
 #include "esp_log.h"
 
 static const char* TAG = "relay";
@@ -43,6 +44,7 @@ esp_err_t relay_set_channel(int channel, bool on) {
     gpio_num_t gpio = relay_gpios[channel - 1];
     esp_err_t err = gpio_set_level(gpio, on ? RELAY_ACTIVE_LEVEL : !RELAY_ACTIVE_LEVEL);
     if (err == ESP_OK) {
+        if (relay_states[channel - 1] != on) relay_stats_note(channel, on);
         relay_states[channel - 1] = on;
     }
     return err;
@@ -52,6 +54,7 @@ esp_err_t relay_set_all(bool on) {
     for (int i = 0; i < 4; ++i) {
         esp_err_t err = gpio_set_level(relay_gpios[i], on ? RELAY_ACTIVE_LEVEL : !RELAY_ACTIVE_LEVEL);
         if (err != ESP_OK) return err;
+        if (relay_states[i] != on) relay_stats_note(i + 1, on);
         relay_states[i] = on;
     }
     return ESP_OK;
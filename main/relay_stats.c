@@ -0,0 +1,187 @@
+#include "relay_stats.h"
+#include "storage.h"
+#include "ha_mqtt.h"
+#include "esp_timer.h"
+#include "esp_system.h"
+#include "esp_log.h"
+#include "esp_rom_crc.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "sdkconfig.h"
+#include <inttypes.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+static const char* TAG = "relay_stats";
+
+// Totals persisted as one CRC-protected blob; bump the version on layout changes
+#define STATS_KEY     "relay_stats"
+#define STATS_VERSION 1
+
+#define MIN_MS  60000ull
+#define HOUR_MS 3600000ull
+
+typedef struct {
+    uint16_t version;
+    uint16_t size;
+    uint32_t reserved;
+    uint64_t on_ms[4];
+    uint32_t switches[4];
+    uint32_t crc;                // CRC32 of all preceding bytes
+} stats_blob_t;
+
+typedef struct {
+    uint64_t on_ms;              // since first boot
+    uint32_t switches;           // OFF->ON transitions since first boot
+    bool on;
+    uint16_t min_ms[60];         // on-time per minute of the last hour
+    uint32_t hour_ms[24];        // on-time per hour of the last day
+} chan_stats_t;
+
+static chan_stats_t s_ch[4];
+static uint64_t s_last_ms;       // time accounted up to, ms since boot
+static portMUX_TYPE s_mux = portMUX_INITIALIZER_UNLOCKED;
+static stats_blob_t s_saved;     // last checkpoint, to skip unchanged writes
+static esp_timer_handle_t s_timer;
+static uint32_t s_ticks;
+
+static uint64_t now_ms(void) {
+    return (uint64_t)esp_timer_get_time() / 1000;
+}
+
+// Credit on-time up to now, a minute at a time so each slice lands in its
+// buckets and the buckets being entered start from zero. Caller holds s_mux;
+// the tick runs every publish period, so this is one or two slices.
+static void advance(uint64_t now) {
+    while (s_last_ms < now) {
+        uint64_t next = (s_last_ms / MIN_MS + 1) * MIN_MS;
+        uint64_t end = now < next ? now : next;
+        uint32_t d = (uint32_t)(end - s_last_ms);
+        int m = (int)(s_last_ms / MIN_MS % 60), h = (int)(s_last_ms / HOUR_MS % 24);
+        for (int i = 0; i < 4; ++i) {
+            chan_stats_t* c = &s_ch[i];
+            if (!c->on) continue;
+            c->on_ms += d;
+            c->min_ms[m] += (uint16_t)d;
+            c->hour_ms[h] += d;
+        }
+        s_last_ms = end;
+        if (end == next) {
+            m = (int)(end / MIN_MS % 60);
+            bool new_hour = end % HOUR_MS == 0;
+            h = (int)(end / HOUR_MS % 24);
+            for (int i = 0; i < 4; ++i) {
+                s_ch[i].min_ms[m] = 0;
+                if (new_hour) s_ch[i].hour_ms[h] = 0;
+            }
+        }
+    }
+}
+
+void relay_stats_note(int channel, bool on) {
+    if (channel < 1 || channel > 4) return;
+    chan_stats_t* c = &s_ch[channel - 1];
+    uint64_t now = now_ms();
+    taskENTER_CRITICAL(&s_mux);
+    advance(now);
+    if (on && !c->on) c->switches++;
+    c->on = on;
+    taskEXIT_CRITICAL(&s_mux);
+}
+
+// Share of the window that the buckets cover, as a percentage. The window is
+// the current partial bucket plus the n-1 full ones before it, or the uptime
+// if that is shorter.
+static float duty_pct(uint64_t sum_ms, uint64_t now, uint64_t bucket_ms, int n) {
+    uint64_t window = now % bucket_ms + (uint64_t)(n - 1) * bucket_ms;
+    if (window > now) window = now;
+    return window ? (float)sum_ms * 100.0f / (float)window : 0.0f;
+}
+
+int relay_stats_format(char* out, size_t sz) {
+    uint64_t on_ms[4], h1[4] = {0}, h24[4] = {0};
+    uint32_t switches[4];
+    uint64_t now = now_ms();
+    taskENTER_CRITICAL(&s_mux);
+    advance(now);
+    for (int i = 0; i < 4; ++i) {
+        on_ms[i] = s_ch[i].on_ms;
+        switches[i] = s_ch[i].switches;
+        for (int k = 0; k < 60; ++k) h1[i] += s_ch[i].min_ms[k];
+        for (int k = 0; k < 24; ++k) h24[i] += s_ch[i].hour_ms[k];
+    }
+    taskEXIT_CRITICAL(&s_mux);
+
+    int n = snprintf(out, sz, "{\"relays\":[");
+    for (int i = 0; i < 4 && n >= 0 && (size_t)n < sz; ++i) {
+        n += snprintf(out + n, sz - n, "%s{\"on_s\":%" PRIu64 ",\"switches\":%" PRIu32 ",\"duty_1h\":%.1f,\"duty_24h\":%.1f}",
+                      i ? "," : "", on_ms[i] / 1000, switches[i],
+                      duty_pct(h1[i], now, MIN_MS, 60), duty_pct(h24[i], now, HOUR_MS, 24));
+    }
+    if (n < 0 || (size_t)n >= sz) return -1;
+    n += snprintf(out + n, sz - n, "]}");
+    return (size_t)n < sz ? n : -1;
+}
+
+static uint32_t blob_crc(const stats_blob_t* b) {
+    return esp_rom_crc32_le(0, (const uint8_t*)b, offsetof(stats_blob_t, crc));
+}
+
+static void checkpoint(void) {
+    stats_blob_t b;
+    memset(&b, 0, sizeof(b));
+    uint64_t now = now_ms();
+    taskENTER_CRITICAL(&s_mux);
+    advance(now);
+    for (int i = 0; i < 4; ++i) {
+        b.on_ms[i] = s_ch[i].on_ms;
+        b.switches[i] = s_ch[i].switches;
+    }
+    taskEXIT_CRITICAL(&s_mux);
+    if (memcmp(b.on_ms, s_saved.on_ms, sizeof(b.on_ms)) == 0 &&
+        memcmp(b.switches, s_saved.switches, sizeof(b.switches)) == 0) {
+        return;
+    }
+    b.version = STATS_VERSION;
+    b.size = sizeof(b);
+    b.crc = blob_crc(&b);
+    if (storage_set_blob(STATS_KEY, &b, sizeof(b)) == ESP_OK) s_saved = b;
+}
+
+static void shutdown_checkpoint(void) {
+    checkpoint();
+}
+
+static void tick(void* arg) {
+    (void)arg;
+    ha_mqtt_publish_relay_stats();
+    if (++s_ticks * CONFIG_RELAY_STATS_PUBLISH_S >= CONFIG_RELAY_STATS_CHECKPOINT_MIN * 60u) {
+        s_ticks = 0;
+        checkpoint();
+    }
+}
+
+void relay_stats_init(void) {
+    stats_blob_t b;
+    size_t len = sizeof(b);
+    if (storage_get_blob(STATS_KEY, &b, &len) == ESP_OK) {
+        if (len != sizeof(b) || b.version != STATS_VERSION || b.size != sizeof(b) || b.crc != blob_crc(&b)) {
+            ESP_LOGW(TAG, "Checkpoint version %u/size %u invalid, counting from zero", b.version, (unsigned)len);
+        } else {
+            for (int i = 0; i < 4; ++i) {
+                s_ch[i].on_ms = b.on_ms[i];
+                s_ch[i].switches = b.switches[i];
+            }
+            s_saved = b;
+        }
+    }
+    s_last_ms = now_ms();
+
+    const esp_timer_create_args_t targs = { .callback = tick, .name = "relay_stats" };
+    if (esp_timer_create(&targs, &s_timer) == ESP_OK) {
+        esp_timer_start_periodic(s_timer, (uint64_t)CONFIG_RELAY_STATS_PUBLISH_S * 1000000ull);
+    }
+    // Runs before storage's own flush handler (they are called in reverse)
+    esp_register_shutdown_handler(shutdown_checkpoint);
+}
@@ -0,0 +1,24 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Per-relay usage for pump wear and energy estimates: cumulative on-time and
+// OFF->ON switch count since first boot, plus the duty cycle over the last
+// hour and the last 24 hours. Totals are checkpointed to NVS every
+// CONFIG_RELAY_STATS_CHECKPOINT_MIN (and before a restart), so at most that
+// much on-time is lost to a power cut; duty windows live in RAM and restart
+// empty. Published on <base>/relay_stats every CONFIG_RELAY_STATS_PUBLISH_S:
+//   {"relays":[{"on_s":N,"switches":N,"duty_1h":P,"duty_24h":P}, ... 4]}
+void relay_stats_init(void);
+// relay.c reports every actual change of a channel's output
+void relay_stats_note(int channel, bool on);
+// Current figures in the form above; length, or -1 if out is too small
+int relay_stats_format(char* out, size_t sz);
+
+#ifdef __cplusplus
+}
+#endif
@@ -2,18 +2,52 @@
 #include "storage.h"
 #include "relay.h"
 #include "ha_mqtt.h"
+#include "time_sync.h"
 #include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
 #include "esp_log.h"
+#include "esp_rom_crc.h"
 #include "time.h"
 #include "sdkconfig.h"
 #include <inttypes.h>
+#include <stddef.h>
 
 static const char* TAG = "safety";
 
-static bool s_away = false;
-static bool s_sched_enf = false;
-static uint16_t s_w1s = 0, s_w1e = 0, s_w2s = 0, s_w2e = 0; // minutes since midnight
-static uint32_t s_max_on_sec[4] = {0,0,0,0};
+// All persisted safety/control settings, stored as one CRC-protected blob so
+// boot needs a single NVS lookup. Bump SAFETY_CFG_VERSION on layout changes.
+#define SAFETY_CFG_KEY     "safety_cfg"
+#define SAFETY_CFG_VERSION 1
+
+// Kconfig leaves disabled bools undefined
+#ifndef CONFIG_SAFETY_AWAY_DEFAULT
+#define CONFIG_SAFETY_AWAY_DEFAULT 0
+#endif
+#ifndef CONFIG_SAFETY_SCHEDULE_ENFORCE_DEFAULT
+#define CONFIG_SAFETY_SCHEDULE_ENFORCE_DEFAULT 0
+#endif
+
+typedef struct {
+    uint16_t version;
+    uint16_t size;
+    uint8_t away;
+    uint8_t sched_enf;
+    uint16_t w1s, w1e, w2s, w2e; // minutes since midnight
+    uint16_t reserved;
+    uint32_t max_on_sec[4];
+    uint32_t crc;                // CRC32 of all preceding bytes
+} safety_cfg_t;
+
+static safety_cfg_t s_cfg = {0};
+// Writers hold it while changing s_cfg; the policy works on a copy taken
+// under it, so a multi-field update is never seen half applied
+static portMUX_TYPE s_cfg_mux = portMUX_INITIALIZER_UNLOCKED;
+// Snapshot-and-write of the blob, so saves reach storage in the order the
+// snapshots were taken
+static SemaphoreHandle_t s_save_lock = NULL;
+static SemaphoreHandle_t s_settings_lock = NULL;
 
 // Track ON start times (microseconds)
 static int64_t s_on_start_us[4] = {0,0,0,0};
@@ -33,22 +67,83 @@ static bool within_window(uint16_t start, uint16_t end, int minute) {
     }
 }
 
-void safety_init(void) {
-    // Load persisted values or defaults from Kconfig
+// Without a trustworthy wall clock the windows can't be evaluated; fail safe
+static bool in_schedule(const safety_cfg_t* cfg) {
+    if (time_sync_get_quality() == TIME_QUALITY_UNSYNCED) return false;
+    int mod = minute_of_day();
+    return within_window(cfg->w1s, cfg->w1e, mod) || within_window(cfg->w2s, cfg->w2e, mod);
+}
+
+static safety_cfg_t cfg_snapshot(void) {
+    taskENTER_CRITICAL(&s_cfg_mux);
+    safety_cfg_t cfg = s_cfg;
+    taskEXIT_CRITICAL(&s_cfg_mux);
+    return cfg;
+}
+
+static uint32_t cfg_crc(const safety_cfg_t* cfg) {
+    return esp_rom_crc32_le(0, (const uint8_t*)cfg, offsetof(safety_cfg_t, crc));
+}
+
+static void save_config(void) {
+    xSemaphoreTake(s_save_lock, portMAX_DELAY);
+    safety_cfg_t cfg = cfg_snapshot();
+    cfg.version = SAFETY_CFG_VERSION;
+    cfg.size = sizeof(cfg);
+    cfg.crc = cfg_crc(&cfg);
+    storage_set_blob(SAFETY_CFG_KEY, &cfg, sizeof(cfg));
+    xSemaphoreGive(s_save_lock);
+}
+
+static bool load_config_blob(void) {
+    safety_cfg_t cfg;
+    size_t len = sizeof(cfg);
+    if (storage_get_blob(SAFETY_CFG_KEY, &cfg, &len) != ESP_OK) return false;
+    if (len != sizeof(cfg) || cfg.version != SAFETY_CFG_VERSION || cfg.size != sizeof(cfg)) {
+        ESP_LOGW(TAG, "Config blob version %u/size %u not supported", cfg.version, (unsigned)len);
+        return false;
+    }
+    if (cfg.crc != cfg_crc(&cfg)) {
+        ESP_LOGE(TAG, "Config blob CRC mismatch");
+        return false;
+    }
+    s_cfg = cfg;
+    return true;
+}
+
+// Pre-blob firmware stored one key per setting; missing keys fall back to Kconfig.
+// The old keys are left in place so a rollback still finds its settings.
+static void load_config_legacy(void) {
     bool b;
-    storage_get_bool("away", &b, CONFIG_SAFETY_AWAY_DEFAULT); s_away = b;
-    storage_get_bool("sched_enf", &b, CONFIG_SAFETY_SCHEDULE_ENFORCE_DEFAULT); s_sched_enf = b;
+    storage_get_bool("away", &b, CONFIG_SAFETY_AWAY_DEFAULT); s_cfg.away = b;
+    storage_get_bool("sched_enf", &b, CONFIG_SAFETY_SCHEDULE_ENFORCE_DEFAULT); s_cfg.sched_enf = b;
 
     uint32_t v;
-    storage_get_u32("w1s", &v, CONFIG_SAFETY_W1_START_DEFAULT); s_w1s = (uint16_t)v;
-    storage_get_u32("w1e", &v, CONFIG_SAFETY_W1_END_DEFAULT); s_w1e = (uint16_t)v;
-    storage_get_u32("w2s", &v, CONFIG_SAFETY_W2_START_DEFAULT); s_w2s = (uint16_t)v;
-    storage_get_u32("w2e", &v, CONFIG_SAFETY_W2_END_DEFAULT); s_w2e = (uint16_t)v;
+    storage_get_u32("w1s", &v, CONFIG_SAFETY_W1_START_DEFAULT); s_cfg.w1s = (uint16_t)v;
+    storage_get_u32("w1e", &v, CONFIG_SAFETY_W1_END_DEFAULT); s_cfg.w1e = (uint16_t)v;
+    storage_get_u32("w2s", &v, CONFIG_SAFETY_W2_START_DEFAULT); s_cfg.w2s = (uint16_t)v;
+    storage_get_u32("w2e", &v, CONFIG_SAFETY_W2_END_DEFAULT); s_cfg.w2e = (uint16_t)v;
+
+    storage_get_u32("max1", &v, CONFIG_SAFETY_RELAY1_MAX_ON_MIN_DEFAULT * 60U); s_cfg.max_on_sec[0] = v;
+    storage_get_u32("max2", &v, CONFIG_SAFETY_RELAY2_MAX_ON_MIN_DEFAULT * 60U); s_cfg.max_on_sec[1] = v;
+    storage_get_u32("max3", &v, CONFIG_SAFETY_RELAY3_MAX_ON_MIN_DEFAULT * 60U); s_cfg.max_on_sec[2] = v;
+    storage_get_u32("max4", &v, CONFIG_SAFETY_RELAY4_MAX_ON_MIN_DEFAULT * 60U); s_cfg.max_on_sec[3] = v;
+}
 
-    storage_get_u32("max1", &v, CONFIG_SAFETY_RELAY1_MAX_ON_MIN_DEFAULT * 60U); s_max_on_sec[0] = v;
-    storage_get_u32("max2", &v, CONFIG_SAFETY_RELAY2_MAX_ON_MIN_DEFAULT * 60U); s_max_on_sec[1] = v;
-    storage_get_u32("max3", &v, CONFIG_SAFETY_RELAY3_MAX_ON_MIN_DEFAULT * 60U); s_max_on_sec[2] = v;
-    storage_get_u32("max4", &v, CONFIG_SAFETY_RELAY4_MAX_ON_MIN_DEFAULT * 60U); s_max_on_sec[3] = v;
+void safety_init(void) {
+    s_save_lock = xSemaphoreCreateMutex();
+    s_settings_lock = xSemaphoreCreateMutex();
+
+    // Load persisted blob; migrate from per-key storage (or Kconfig defaults) if absent
+    int64_t t0 = esp_timer_get_time();
+    if (load_config_blob()) {
+        ESP_LOGI(TAG, "Config loaded from blob in %" PRId64 " us", esp_timer_get_time() - t0);
+    } else {
+        load_config_legacy();
+        save_config();
+        storage_flush();
+        ESP_LOGI(TAG, "Config migrated from per-key storage in %" PRId64 " us", esp_timer_get_time() - t0);
+    }
 
     // Initialize start times if relays are already on (unlikely at boot)
     for (int i=0;i<4;i++) {
@@ -56,33 +151,41 @@ void safety_init(void) {
     }
 }
 
+safety_verdict_t safety_check_turn_on(int channel) {
+    safety_cfg_t cfg = cfg_snapshot();
+    if (cfg.away) return SAFETY_BLOCK_AWAY;
+    if (!cfg.sched_enf) return SAFETY_ALLOW;
+
+    if (time_sync_get_quality() == TIME_QUALITY_UNSYNCED) {
+        ESP_LOGW(TAG, "Time not synced, schedule blocks relay %d", channel);
+        return SAFETY_BLOCK_SCHEDULE;
+    }
+    return in_schedule(&cfg) ? SAFETY_ALLOW : SAFETY_BLOCK_SCHEDULE;
+}
+
 bool safety_can_turn_on(int channel) {
     if (channel < 1 || channel > 4) return false;
-    if (s_away) return false;
-    if (!s_sched_enf) return true;
-
-    int mod = minute_of_day();
-    bool ok = within_window(s_w1s, s_w1e, mod) || within_window(s_w2s, s_w2e, mod);
-    return ok;
+    return safety_check_turn_on(channel) == SAFETY_ALLOW;
 }
 
 void safety_on_relay_state_change(int channel, bool on) {
     if (channel < 1 || channel > 4) return;
     int idx = channel - 1;
     if (on) {
-        s_on_start_us[idx] = esp_timer_get_time();
+        // A repeated ON doesn't restart the max-on period
+        if (s_on_start_us[idx] == 0) s_on_start_us[idx] = esp_timer_get_time();
     } else {
         s_on_start_us[idx] = 0;
     }
 }
 
-static void enforce_max_on(void) {
+static void enforce_max_on(const safety_cfg_t* cfg) {
     int64_t now = esp_timer_get_time();
     for (int i=0;i<4;i++) {
-        if (relay_get_channel(i+1) && s_max_on_sec[i] > 0 && s_on_start_us[i] > 0) {
+        if (relay_get_channel(i+1) && cfg->max_on_sec[i] > 0 && s_on_start_us[i] > 0) {
             int64_t elapsed_sec = (now - s_on_start_us[i]) / 1000000LL;
-            if (elapsed_sec >= (int64_t)s_max_on_sec[i]) {
-                ESP_LOGW(TAG, "Relay %d exceeded max-on (%" PRId64 "s >= %us), turning OFF", i+1, elapsed_sec, s_max_on_sec[i]);
+            if (elapsed_sec >= (int64_t)cfg->max_on_sec[i]) {
+                ESP_LOGW(TAG, "Relay %d exceeded max-on (%" PRId64 "s >= %us), turning OFF", i+1, elapsed_sec, cfg->max_on_sec[i]);
                 relay_set_channel(i+1, false);
                 s_on_start_us[i] = 0;
                 ha_mqtt_publish_relay_state(i+1, false);
@@ -93,13 +196,13 @@ static void enforce_max_on(void) {
 
 void safety_apply_policy_now(void) {
     // Enforce away/schedule immediately
-    if (s_away || s_sched_enf) {
-        int mod = minute_of_day();
+    safety_cfg_t cfg = cfg_snapshot();
+    if (cfg.away || cfg.sched_enf) {
+        bool ok = in_schedule(&cfg);
         for (int ch=1; ch<=4; ++ch) {
             bool should_off = false;
-            if (s_away) should_off = true;
-            if (!should_off && s_sched_enf) {
-                bool ok = within_window(s_w1s, s_w1e, mod) || within_window(s_w2s, s_w2e, mod);
+            if (cfg.away) should_off = true;
+            if (!should_off && cfg.sched_enf) {
                 should_off = !ok;
             }
             if (should_off && relay_get_channel(ch)) {
@@ -109,42 +212,77 @@ void safety_apply_policy_now(void) {
             }
         }
     }
-    enforce_max_on();
+    enforce_max_on(&cfg);
 }
 
-bool safety_get_away_mode(void) { return s_away; }
+bool safety_get_away_mode(void) { return s_cfg.away; }
 void safety_set_away_mode(bool on) {
-    s_away = on;
-    storage_set_bool("away", on);
+    taskENTER_CRITICAL(&s_cfg_mux);
+    s_cfg.away = on;
+    taskEXIT_CRITICAL(&s_cfg_mux);
+    save_config();
+    storage_flush(); // safety-critical: don't wait for the quiet period
 }
 
-bool safety_get_schedule_enforce(void) { return s_sched_enf; }
+bool safety_get_schedule_enforce(void) { return s_cfg.sched_enf; }
 void safety_set_schedule_enforce(bool on) {
-    s_sched_enf = on;
-    storage_set_bool("sched_enf", on);
+    taskENTER_CRITICAL(&s_cfg_mux);
+    s_cfg.sched_enf = on;
+    taskEXIT_CRITICAL(&s_cfg_mux);
+    save_config();
+    storage_flush();
 }
 
 void safety_get_schedule_windows(uint16_t* w1_start, uint16_t* w1_end, uint16_t* w2_start, uint16_t* w2_end) {
-    if (w1_start) *w1_start = s_w1s;
-    if (w1_end) *w1_end = s_w1e;
-    if (w2_start) *w2_start = s_w2s;
-    if (w2_end) *w2_end = s_w2e;
+    if (w1_start) *w1_start = s_cfg.w1s;
+    if (w1_end) *w1_end = s_cfg.w1e;
+    if (w2_start) *w2_start = s_cfg.w2s;
+    if (w2_end) *w2_end = s_cfg.w2e;
 }
-safety_set_schedule_windows(uint16_t w1_start, uint16_t w1_end, uint16_t w2_start, uint16_t w2_end) {
-    s_w1s = w1_start; s_w1e = w1_end; s_w2s = w2_start; s_w2e = w2_end;
-    storage_set_u32("w1s", s_w1s);
-    storage_set_u32("w1e", s_w1e);
-    storage_set_u32("w2s", s_w2s);
-    storage_set_u32("w2e", s_w2e);
+void safety_set_schedule_windows(uint16_t w1_start, uint16_t w1_end, uint16_t w2_start, uint16_t w2_end) {
+    taskENTER_CRITICAL(&s_cfg_mux);
+    s_cfg.w1s = w1_start; s_cfg.w1e = w1_end; s_cfg.w2s = w2_start; s_cfg.w2e = w2_end;
+    taskEXIT_CRITICAL(&s_cfg_mux);
+    save_config();
 }
 
 void safety_set_max_on_seconds(int channel, uint32_t seconds) {
     if (channel < 1 || channel > 4) return;
-    s_max_on_sec[channel-1] = seconds;
-    const char* keys[] = {"max1","max2","max3","max4"};
-    storage_set_u32(keys[channel-1], seconds);
+    taskENTER_CRITICAL(&s_cfg_mux);
+    s_cfg.max_on_sec[channel-1] = seconds;
+    taskEXIT_CRITICAL(&s_cfg_mux);
+    save_config();
 }
 uint32_t safety_get_max_on_seconds(int channel) {
     if (channel < 1 || channel > 4) return 0;
-    return s_max_on_sec[channel-1];
-}
\ No newline at end of file
+    return s_cfg.max_on_sec[channel-1];
+}
+
+void safety_get_settings(safety_settings_t* out) {
+    safety_cfg_t cfg = cfg_snapshot();
+    out->away = cfg.away;
+    out->schedule_enforce = cfg.sched_enf;
+    out->w1_start = cfg.w1s; out->w1_end = cfg.w1e;
+    out->w2_start = cfg.w2s; out->w2_end = cfg.w2e;
+    for (int i = 0; i < 4; ++i) out->max_on_sec[i] = cfg.max_on_sec[i];
+}
+
+void safety_set_settings(const safety_settings_t* in) {
+    taskENTER_CRITICAL(&s_cfg_mux);
+    s_cfg.away = in->away;
+    s_cfg.sched_enf = in->schedule_enforce;
+    s_cfg.w1s = in->w1_start; s_cfg.w1e = in->w1_end;
+    s_cfg.w2s = in->w2_start; s_cfg.w2e = in->w2_end;
+    for (int i = 0; i < 4; ++i) s_cfg.max_on_sec[i] = in->max_on_sec[i];
+    taskEXIT_CRITICAL(&s_cfg_mux);
+    save_config();
+    storage_flush();
+}
+
+void safety_settings_lock(void) {
+    xSemaphoreTake(s_settings_lock, portMAX_DELAY);
+}
+
+void safety_settings_unlock(void) {
+    xSemaphoreGive(s_settings_lock);
+}
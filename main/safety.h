@@ -6,8 +6,16 @@
 extern "C" {
 #endif
 
+typedef enum {
+    SAFETY_ALLOW,
+    SAFETY_BLOCK_AWAY,
+    SAFETY_BLOCK_SCHEDULE, // outside the windows, or no usable time yet
+} safety_verdict_t;
+
 void safety_init(void);
 bool safety_can_turn_on(int channel);
+// Same check, with the reason when the answer is no
+safety_verdict_t safety_check_turn_on(int channel);
 void safety_on_relay_state_change(int channel, bool on);
 void safety_apply_policy_now(void);
 
@@ -24,6 +32,23 @@ void safety_set_schedule_windows(uint16_t w1_start, uint16_t w1_end, uint16_t w2
 void safety_set_max_on_seconds(int channel, uint32_t seconds);
 uint32_t safety_get_max_on_seconds(int channel);
 
+// Every persisted setting at once. The setter replaces them all together
+// with one blob write and one commit; the policy never sees a mix of old
+// and new values. Re-evaluating the policy is left to the caller.
+typedef struct {
+    bool away;
+    bool schedule_enforce;
+    uint16_t w1_start, w1_end, w2_start, w2_end; // minutes since midnight
+    uint32_t max_on_sec[4];
+} safety_settings_t;
+
+void safety_get_settings(safety_settings_t* out);
+void safety_set_settings(const safety_settings_t* in);
+// Held around a get-modify-set of the settings so changes arriving from
+// different tasks (MQTT, local API) don't overwrite each other
+void safety_settings_lock(void);
+void safety_settings_unlock(void);
+
 #ifdef __cplusplus
 }
 #endif
\ No newline at end of file
@@ -1,7 +1,9 @@
 #include "scd4x.h"
+#include "metrics.h"
 #include "esp_log.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "esp_timer.h"
 #include <string.h>
 
 static const char* TAG = "scd4x";
@@ -17,9 +19,16 @@ static uint8_t sensirion_crc8(const uint8_t* data, uint16_t count) {
     return crc;
 }
 
+static esp_err_t timed_write(i2c_port_t port, const uint8_t* buf, size_t len) {
+    int64_t t0 = esp_timer_get_time();
+    esp_err_t err = i2c_master_write_to_device(port, SCD4X_I2C_ADDR, buf, len, pdMS_TO_TICKS(100));
+    metrics_i2c((uint32_t)(esp_timer_get_time() - t0));
+    return err;
+}
+
 static esp_err_t scd4x_write_cmd(i2c_port_t port, uint16_t cmd) {
     uint8_t buf[2] = { (uint8_t)((cmd >> 8) & 0xFF), (uint8_t)(cmd & 0xFF) };
-    return i2c_master_write_to_device(port, SCD4X_I2C_ADDR, buf, sizeof(buf), pdMS_TO_TICKS(100));
+    return timed_write(port, buf, sizeof(buf));
 }
 
 static esp_err_t scd4x_write_cmd_with_args(i2c_port_t port, uint16_t cmd, const uint16_t* args, size_t num_args) {
@@ -34,7 +43,7 @@ static esp_err_t scd4x_write_cmd_with_args(i2c_port_t port, uint16_t cmd, const
         buf[2 + i*3 + 1] = lsb;
         buf[2 + i*3 + 2] = crc;
     }
-    return i2c_master_write_to_device(port, SCD4X_I2C_ADDR, buf, sizeof(buf), pdMS_TO_TICKS(100));
+    return timed_write(port, buf, sizeof(buf));
 }
 
 static esp_err_t scd4x_read_words(i2c_port_t port, uint16_t cmd, uint16_t* words, size_t num_words) {
@@ -46,7 +55,9 @@ static esp_err_t scd4x_read_words(i2c_port_t port, uint16_t cmd, uint16_t* words
     uint8_t buf[18];
     if (to_read > sizeof(buf)) return ESP_ERR_INVALID_SIZE;
 
+    int64_t t0 = esp_timer_get_time();
     err = i2c_master_read_from_device(port, SCD4X_I2C_ADDR, buf, to_read, pdMS_TO_TICKS(100));
+    metrics_i2c((uint32_t)(esp_timer_get_time() - t0));
     if (err != ESP_OK) return err;
 
     for (size_t i = 0; i < num_words; ++i) {
@@ -68,6 +79,7 @@ static esp_err_t scd4x_read_words(i2c_port_t port, uint16_t cmd, uint16_t* words
 #define SCD4X_CMD_READ_MEASUREMENT             0xEC05
 #define SCD4X_CMD_REINIT                       0x3646
 #define SCD4X_CMD_READ_SERIAL_NUMBER           0x3682
+#define SCD4X_CMD_GET_DATA_READY_STATUS        0xE4B8
 
 esp_err_t scd4x_i2c_init(i2c_port_t port, int sda_gpio, int scl_gpio, uint32_t clk_speed_hz) {
     i2c_config_t conf = {
@@ -124,6 +136,16 @@ esp_err_t scd4x_read_measurement(i2c_port_t port, scd4x_measurement_t* out) {
     return ESP_OK;
 }
 
+esp_err_t scd4x_get_data_ready(i2c_port_t port, bool* ready) {
+    if (!ready) return ESP_ERR_INVALID_ARG;
+    uint16_t status = 0;
+    esp_err_t err = scd4x_read_words(port, SCD4X_CMD_GET_DATA_READY_STATUS, &status, 1);
+    if (err != ESP_OK) return err;
+    // Least significant 11 bits are 0 when no data is ready
+    *ready = (status & 0x07FF) != 0;
+    return ESP_OK;
+}
+
 esp_err_t scd4x_read_serial_number(i2c_port_t port, uint16_t sn_words[3]) {
     if (!sn_words) return ESP_ERR_INVALID_ARG;
     return scd4x_read_words(port, SCD4X_CMD_READ_SERIAL_NUMBER, sn_words, 3);
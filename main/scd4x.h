@@ -22,7 +22,8 @@ esp_err_t scd4x_i2c_init(i2c_port_t port, int sda_gpio, int scl_gpio, uint32_t c
 // Soft-reset/reinit sensor
 esp_err_t scd4x_reinit(i2c_port_t port);
 
-// Start periodic measurement (typical mode)
+// Start periodic measurement (typical mode: a new reading every SCD4X_PERIOD_MS)
+#define SCD4X_PERIOD_MS 5000
 esp_err_t scd4x_start_periodic_measurement(i2c_port_t port);
 
 // Stop periodic measurement
@@ -31,6 +32,9 @@ esp_err_t scd4x_stop_periodic_measurement(i2c_port_t port);
 // Read the latest measurement (CO2 ppm, temp C, RH %). Should be called ~5s or more after start and then every 5s.
 esp_err_t scd4x_read_measurement(i2c_port_t port, scd4x_measurement_t* out);
 
+// Data-ready status: *ready is true once a new measurement can be read
+esp_err_t scd4x_get_data_ready(i2c_port_t port, bool* ready);
+
 // Optional: read serial number (3 words)
 esp_err_t scd4x_read_serial_number(i2c_port_t port, uint16_t sn_words[3]);
 
@@ -0,0 +1,375 @@
+#include "spool.h"
+#include "connectivity.h"
+#include "ha_mqtt.h"
+#include "app_tasks.h"
+
+#include "esp_log.h"
+#include "esp_partition.h"
+#include "esp_rom_crc.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "sdkconfig.h"
+#include <inttypes.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const char* TAG = "spool";
+
+#define SPOOL_PART_SUBTYPE 0x40
+#define SPOOL_SECTOR       4096
+#define SPOOL_MAGIC        0x4c4f4f53 // "SPOL"
+
+// Flash bits only go 1 -> 0 without an erase, so a record's state can be
+// advanced in place: erased -> valid -> sent.
+#define REC_ERASED 0xFF
+#define REC_VALID  0xFE
+#define REC_SENT   0xFC
+
+#define REC_TYPE_SCD4X 1
+
+// Sectors are numbered by seq; recovery takes the highest as the head and
+// walks back through consecutive seqs to find the oldest.
+typedef struct {
+    uint32_t magic;
+    uint32_t seq;
+    uint32_t crc;
+    uint32_t reserved;
+} sector_hdr_t;
+
+// Header and payload are programmed together; a torn write fails the CRC
+typedef struct {
+    uint8_t state;
+    uint8_t type;
+    uint8_t len;
+    uint8_t reserved;
+    uint32_t ts;
+    uint32_t crc; // over type, len, ts and payload
+} rec_hdr_t;
+
+typedef struct {
+    float co2;
+    float t;
+    float rh;
+} rec_scd4x_t;
+
+#define REC_MAX_PAYLOAD 32
+#define REC_SIZE(len) (sizeof(rec_hdr_t) + (((len) + 3u) & ~3u))
+
+typedef struct {
+    uint32_t sect;
+    uint32_t off;
+} pos_t;
+
+static const esp_partition_t* s_part = NULL;
+static uint32_t s_nsect = 0;
+static SemaphoreHandle_t s_lock = NULL;
+static TaskHandle_t s_task = NULL;
+APP_TASK_STORAGE(s_spool_task, APP_STACK_SPOOL);
+
+static pos_t s_head;        // next write position
+static uint32_t s_head_seq;
+static pos_t s_tail;        // first record that may still be pending
+static spool_stats_t s_stats;
+static volatile int s_wait_msg_id = -1;
+
+static uint32_t addr(pos_t p) {
+    return p.sect * SPOOL_SECTOR + p.off;
+}
+
+static uint32_t rec_crc(const rec_hdr_t* h, const void* payload) {
+    uint32_t crc = esp_rom_crc32_le(0, &h->type, 2);
+    crc = esp_rom_crc32_le(crc, (const uint8_t*)&h->ts, sizeof(h->ts));
+    return esp_rom_crc32_le(crc, payload, h->len);
+}
+
+static uint32_t hdr_crc(const sector_hdr_t* h) {
+    return esp_rom_crc32_le(0, (const uint8_t*)h, offsetof(sector_hdr_t, crc));
+}
+
+static esp_err_t start_sector(uint32_t sect, uint32_t seq) {
+    esp_err_t err = esp_partition_erase_range(s_part, sect * SPOOL_SECTOR, SPOOL_SECTOR);
+    if (err != ESP_OK) return err;
+    s_stats.erases++;
+    sector_hdr_t h = { .magic = SPOOL_MAGIC, .seq = seq };
+    h.crc = hdr_crc(&h);
+    err = esp_partition_write(s_part, sect * SPOOL_SECTOR, &h, sizeof(h));
+    if (err != ESP_OK) return err;
+    s_head = (pos_t){ sect, sizeof(sector_hdr_t) };
+    s_head_seq = seq;
+    return ESP_OK;
+}
+
+// Read the record at p. Returns false at the end of the written data or at a
+// torn record (either way nothing more in this sector).
+static bool read_rec(pos_t p, rec_hdr_t* h, uint8_t* payload) {
+    if (p.off + sizeof(rec_hdr_t) > SPOOL_SECTOR) return false;
+    if (esp_partition_read(s_part, addr(p), h, sizeof(*h)) != ESP_OK) return false;
+    if (h->state == REC_ERASED) return false;
+    if (h->len > REC_MAX_PAYLOAD || p.off + REC_SIZE(h->len) > SPOOL_SECTOR) return false;
+    if (esp_partition_read(s_part, addr(p) + sizeof(*h), payload, h->len) != ESP_OK) return false;
+    return rec_crc(h, payload) == h->crc;
+}
+
+static uint32_t next_sect(uint32_t s) {
+    return (s + 1) % s_nsect;
+}
+
+// Count pending records in a sector; optionally report the first one
+static uint32_t scan_sector(uint32_t sect, uint32_t* end_off, bool* first_found, pos_t* first) {
+    rec_hdr_t h;
+    uint8_t payload[REC_MAX_PAYLOAD];
+    pos_t p = { sect, sizeof(sector_hdr_t) };
+    uint32_t pending = 0;
+    while (read_rec(p, &h, payload)) {
+        if (h.state == REC_VALID) {
+            pending++;
+            if (first_found && !*first_found) {
+                *first_found = true;
+                *first = p;
+            }
+        }
+        p.off += REC_SIZE(h.len);
+    }
+    if (end_off) *end_off = p.off;
+    return pending;
+}
+
+static esp_err_t recover(void) {
+    uint32_t* seq = calloc(s_nsect, sizeof(uint32_t));
+    if (!seq) return ESP_ERR_NO_MEM;
+    int head = -1;
+    for (uint32_t i = 0; i < s_nsect; ++i) {
+        sector_hdr_t h;
+        if (esp_partition_read(s_part, i * SPOOL_SECTOR, &h, sizeof(h)) != ESP_OK) continue;
+        if (h.magic != SPOOL_MAGIC || h.crc != hdr_crc(&h) || h.seq == 0) continue;
+        seq[i] = h.seq;
+        if (head < 0 || h.seq > seq[head]) head = (int)i;
+    }
+    if (head < 0) {
+        free(seq);
+        ESP_LOGI(TAG, "Formatting %" PRIu32 " sectors", s_nsect);
+        esp_err_t err = start_sector(0, 1);
+        s_tail = s_head;
+        return err;
+    }
+
+    uint32_t oldest = (uint32_t)head;
+    for (uint32_t k = 1; k < s_nsect; ++k) {
+        uint32_t j = (uint32_t)(head + (int)s_nsect - (int)k) % s_nsect;
+        if (seq[j] != seq[head] - k) break;
+        oldest = j;
+    }
+    s_head_seq = seq[head];
+    free(seq);
+
+    bool found = false;
+    s_stats.pending = 0;
+    for (uint32_t s = oldest;; s = next_sect(s)) {
+        uint32_t end = 0;
+        s_stats.pending += scan_sector(s, &end, &found, &s_tail);
+        if (s == (uint32_t)head) {
+            s_head = (pos_t){ s, end };
+            break;
+        }
+    }
+    // A write torn before its first byte leaves a dirty tail that a new
+    // record can't be programmed over; continue in a fresh sector
+    uint8_t probe[sizeof(rec_hdr_t)];
+    if (s_head.off + sizeof(probe) <= SPOOL_SECTOR &&
+        esp_partition_read(s_part, addr(s_head), probe, sizeof(probe)) == ESP_OK) {
+        for (size_t i = 0; i < sizeof(probe); ++i) {
+            if (probe[i] != 0xFF) {
+                s_head.off = SPOOL_SECTOR;
+                break;
+            }
+        }
+    }
+    if (!found) s_tail = s_head;
+    ESP_LOGI(TAG, "Recovered: %" PRIu32 " pending, head %" PRIu32 ":%" PRIu32,
+             s_stats.pending, s_head.sect, s_head.off);
+    return ESP_OK;
+}
+
+// Move the head to the next sector, dropping the oldest data if it lives there
+static esp_err_t rotate(void) {
+    uint32_t next = next_sect(s_head.sect);
+    if (s_tail.sect == next && s_stats.pending) {
+        uint32_t lost = scan_sector(next, NULL, NULL, NULL);
+        s_stats.pending -= lost;
+        s_stats.dropped += lost;
+        s_tail = (pos_t){ next_sect(next), sizeof(sector_hdr_t) };
+        ESP_LOGW(TAG, "Spool full, dropped %" PRIu32 " oldest records", lost);
+    }
+    return start_sector(next, s_head_seq + 1);
+}
+
+esp_err_t spool_append_scd4x(uint32_t ts, float co2_ppm, float temperature_c, float humidity_rh) {
+    if (!s_part) return ESP_ERR_INVALID_STATE;
+    struct {
+        rec_hdr_t h;
+        rec_scd4x_t r;
+    } rec = {
+        .h = { .state = REC_VALID, .type = REC_TYPE_SCD4X, .len = sizeof(rec_scd4x_t), .reserved = 0xFF, .ts = ts },
+        .r = { co2_ppm, temperature_c, humidity_rh },
+    };
+    _Static_assert(sizeof(rec) == REC_SIZE(sizeof(rec_scd4x_t)), "record padding");
+    rec.h.crc = rec_crc(&rec.h, &rec.r);
+
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    esp_err_t err = ESP_OK;
+    if (s_head.off + sizeof(rec) > SPOOL_SECTOR) err = rotate();
+    if (err == ESP_OK) err = esp_partition_write(s_part, addr(s_head), &rec, sizeof(rec));
+    if (err == ESP_OK) {
+        if (!s_stats.pending) s_tail = s_head;
+        s_head.off += sizeof(rec);
+        s_stats.pending++;
+    }
+    xSemaphoreGive(s_lock);
+    if (err != ESP_OK) ESP_LOGE(TAG, "Append failed: %s", esp_err_to_name(err));
+    else if (s_task) xTaskNotifyGive(s_task);
+    return err;
+}
+
+void spool_on_published(int msg_id) {
+    if (msg_id >= 0 && msg_id == s_wait_msg_id && s_task) xTaskNotifyGive(s_task);
+}
+
+static uint32_t used_bytes(void) {
+    if (!s_stats.pending) return 0;
+    uint32_t sectors = (s_head.sect + s_nsect - s_tail.sect) % s_nsect;
+    return sectors * SPOOL_SECTOR + s_head.off - s_tail.off;
+}
+
+void spool_get_stats(spool_stats_t* out) {
+    if (!out) return;
+    if (!s_lock) {
+        memset(out, 0, sizeof(*out));
+        return;
+    }
+    xSemaphoreTake(s_lock, portMAX_DELAY);
+    s_stats.capacity = s_nsect * SPOOL_SECTOR;
+    s_stats.used = used_bytes();
+    *out = s_stats;
+    xSemaphoreGive(s_lock);
+}
+
+// Collect up to CONFIG_SPOOL_REPLAY_BATCH pending records starting at the
+// tail, formatted as one JSON message. *end is where the tail moves once the
+// batch is confirmed.
+static int read_batch(pos_t* at, uint32_t* n_out, pos_t* end, char* json, size_t json_sz) {
+    rec_hdr_t h;
+    uint8_t payload[REC_MAX_PAYLOAD];
+    pos_t p = s_tail;
+    uint32_t n = 0;
+    int len = snprintf(json, json_sz, "{\"records\":[");
+    while (n < CONFIG_SPOOL_REPLAY_BATCH) {
+        if (p.sect == s_head.sect && p.off >= s_head.off) break;
+        if (!read_rec(p, &h, payload)) {
+            if (p.sect == s_head.sect) break;
+            p = (pos_t){ next_sect(p.sect), sizeof(sector_hdr_t) };
+            continue;
+        }
+        if (h.state == REC_VALID && h.type == REC_TYPE_SCD4X) {
+            rec_scd4x_t r;
+            memcpy(&r, payload, sizeof(r));
+            int w = snprintf(json + len, json_sz - len, "%s{\"ts\":%" PRIu32 ",\"co2\":%.0f,\"t\":%.2f,\"rh\":%.1f}",
+                             n ? "," : "", h.ts, r.co2, r.t, r.rh);
+            if (len + w + 3 >= (int)json_sz) break;
+            len += w;
+            at[n++] = p;
+        }
+        p.off += REC_SIZE(h.len);
+    }
+    len += snprintf(json + len, json_sz - len, "]}");
+    *n_out = n;
+    *end = p;
+    return len;
+}
+
+static void spool_task(void* arg) {
+    (void)arg;
+    static pos_t at[CONFIG_SPOOL_REPLAY_BATCH];
+    static char json[CONFIG_SPOOL_REPLAY_BATCH * 72 + 32];
+    int64_t last_batch_us = 0;
+    bool replaying = false;
+
+    while (1) {
+        connectivity_wait(CONN_BROKER_UP, portMAX_DELAY);
+        if (!s_stats.pending) {
+            if (replaying) {
+                replaying = false;
+                ESP_LOGI(TAG, "Replay complete (%" PRIu32 " records)", s_stats.replayed);
+                ha_mqtt_publish_spool_stats();
+            }
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(5000));
+            continue;
+        }
+        replaying = true;
+
+        uint32_t n = 0;
+        pos_t end;
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        read_batch(at, &n, &end, json, sizeof(json));
+        uint32_t dropped = s_stats.dropped;
+        xSemaphoreGive(s_lock);
+
+        if (n) {
+            // Only mark records sent once the broker has acknowledged them
+            ulTaskNotifyTake(pdTRUE, 0);
+            s_wait_msg_id = ha_mqtt_publish_backlog(json);
+            bool acked = s_wait_msg_id >= 0 &&
+                         ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(CONFIG_SPOOL_PUBLISH_TIMEOUT_MS)) > 0;
+            s_wait_msg_id = -1;
+            if (!acked) {
+                vTaskDelay(pdMS_TO_TICKS(CONFIG_SPOOL_REPLAY_INTERVAL_MS));
+                continue;
+            }
+        }
+
+        xSemaphoreTake(s_lock, portMAX_DELAY);
+        if (s_stats.dropped != dropped) {
+            // Overflow erased the sector under this batch; re-read from the new tail
+            xSemaphoreGive(s_lock);
+            continue;
+        }
+        static const uint8_t sent = REC_SENT;
+        for (uint32_t i = 0; i < n; ++i) esp_partition_write(s_part, addr(at[i]), &sent, 1);
+        s_stats.pending -= n < s_stats.pending ? n : s_stats.pending;
+        s_stats.replayed += n;
+        s_tail = s_stats.pending ? end : s_head;
+        int64_t now = esp_timer_get_time();
+        if (last_batch_us) s_stats.replay_rate = (uint32_t)((int64_t)n * 1000000 / (now - last_batch_us + 1));
+        last_batch_us = now;
+        xSemaphoreGive(s_lock);
+        ha_mqtt_publish_spool_stats();
+
+        // Rate limit so live telemetry and commands keep the link
+        vTaskDelay(pdMS_TO_TICKS(CONFIG_SPOOL_REPLAY_INTERVAL_MS));
+    }
+}
+
+esp_err_t spool_init(void) {
+    s_part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, SPOOL_PART_SUBTYPE, "spool");
+    if (!s_part) {
+        ESP_LOGW(TAG, "No spool partition, readings taken offline will be dropped");
+        return ESP_ERR_NOT_FOUND;
+    }
+    s_nsect = s_part->size / SPOOL_SECTOR;
+    if (s_nsect < 3) {
+        s_part = NULL;
+        return ESP_ERR_INVALID_SIZE;
+    }
+    s_lock = xSemaphoreCreateMutex();
+    esp_err_t err = recover();
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Recovery failed: %s", esp_err_to_name(err));
+        s_part = NULL;
+        return err;
+    }
+    APP_TASK_CREATE(s_spool_task, spool_task, "spool", NULL, APP_PRIO_SPOOL, APP_CORE_SPOOL, &s_task);
+    return ESP_OK;
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_err.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Store-and-forward spool for readings taken while the broker is down.
+// Records are appended to the "spool" data partition as a circular log of
+// 4 KB sectors; when it is full the oldest sector is dropped. After the
+// broker comes back a low-priority task replays them in batches to
+// <base>/scd41/backlog with their original timestamps.
+
+esp_err_t spool_init(void);
+
+esp_err_t spool_append_scd4x(uint32_t ts, float co2_ppm, float temperature_c, float humidity_rh);
+
+// MQTT_EVENT_PUBLISHED hook: confirms a replayed batch reached the broker
+void spool_on_published(int msg_id);
+
+typedef struct {
+    uint32_t capacity;     // bytes
+    uint32_t used;         // bytes from the oldest pending record to the write position
+    uint32_t pending;      // records not yet replayed
+    uint32_t dropped;      // records lost to overflow
+    uint32_t replayed;
+    uint32_t replay_rate;  // records/s over the last batch
+    uint32_t erases;       // sector erases since boot
+} spool_stats_t;
+
+void spool_get_stats(spool_stats_t* out);
+
+#ifdef __cplusplus
+}
+#endif
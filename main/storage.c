@@ -2,11 +2,130 @@
 #include "nvs_flash.h"
 #include "nvs.h"
 #include "esp_log.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "sdkconfig.h"
 #include <string.h>
+#include <stdlib.h>
 
 static const char* TAG = "storage";
 static nvs_handle_t s_nvs = 0;
 
+// RAM write-back cache. Entries stay resident after a flush so repeated reads
+// and unchanged writes never touch flash.
+typedef enum {
+    ENTRY_FREE = 0,
+    ENTRY_U32,
+    ENTRY_STR,
+    ENTRY_BLOB,
+} entry_type_t;
+
+typedef struct {
+    char key[NVS_KEY_NAME_MAX_SIZE];
+    entry_type_t type;
+    bool dirty;
+    uint32_t u32;
+    char* str;   // heap copy for ENTRY_STR / ENTRY_BLOB
+    size_t len;  // ENTRY_BLOB length
+} cache_entry_t;
+
+static cache_entry_t s_cache[CONFIG_STORAGE_CACHE_ENTRIES];
+static SemaphoreHandle_t s_lock = NULL;
+static esp_timer_handle_t s_flush_timer = NULL;
+static int64_t s_dirty_since_us = 0; // 0 = nothing pending
+static storage_stats_t s_stats = {0};
+
+static void lock(void) { xSemaphoreTake(s_lock, portMAX_DELAY); }
+static void unlock(void) { xSemaphoreGive(s_lock); }
+
+static cache_entry_t* find_entry(const char* key) {
+    for (int i = 0; i < CONFIG_STORAGE_CACHE_ENTRIES; ++i) {
+        if (s_cache[i].type != ENTRY_FREE && strcmp(s_cache[i].key, key) == 0) return &s_cache[i];
+    }
+    return NULL;
+}
+
+static void release_entry(cache_entry_t* e) {
+    free(e->str);
+    memset(e, 0, sizeof(*e));
+}
+
+// Caller holds the lock
+static esp_err_t flush_locked(void) {
+    bool wrote = false;
+    esp_err_t first_err = ESP_OK;
+    for (int i = 0; i < CONFIG_STORAGE_CACHE_ENTRIES; ++i) {
+        cache_entry_t* e = &s_cache[i];
+        if (e->type == ENTRY_FREE || !e->dirty) continue;
+        esp_err_t err;
+        if (e->type == ENTRY_U32) err = nvs_set_u32(s_nvs, e->key, e->u32);
+        else if (e->type == ENTRY_BLOB) err = nvs_set_blob(s_nvs, e->key, e->str, e->len);
+        else err = nvs_set_str(s_nvs, e->key, e->str ? e->str : "");
+        s_stats.flash_writes++;
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "nvs_set %s failed: %s", e->key, esp_err_to_name(err));
+            if (first_err == ESP_OK) first_err = err;
+            continue; // stays dirty, retried on next flush
+        }
+        e->dirty = false;
+        wrote = true;
+    }
+    if (wrote) {
+        esp_err_t err = nvs_commit(s_nvs);
+        s_stats.commits++;
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "nvs_commit failed: %s", esp_err_to_name(err));
+            if (first_err == ESP_OK) first_err = err;
+        }
+    }
+    if (first_err == ESP_OK) s_dirty_since_us = 0;
+    return first_err;
+}
+
+// Caller holds the lock. Evicts a clean entry, flushing first if every slot is dirty.
+static cache_entry_t* alloc_entry(const char* key) {
+    cache_entry_t* victim = NULL;
+    for (int i = 0; i < CONFIG_STORAGE_CACHE_ENTRIES; ++i) {
+        if (s_cache[i].type == ENTRY_FREE) { victim = &s_cache[i]; break; }
+        if (!victim && !s_cache[i].dirty) victim = &s_cache[i];
+    }
+    if (!victim) {
+        flush_locked();
+        for (int i = 0; i < CONFIG_STORAGE_CACHE_ENTRIES && !victim; ++i) {
+            if (!s_cache[i].dirty) victim = &s_cache[i];
+        }
+        if (!victim) return NULL;
+    }
+    release_entry(victim);
+    strncpy(victim->key, key, sizeof(victim->key) - 1);
+    return victim;
+}
+
+static void flush_timer_cb(void* arg) {
+    (void)arg;
+    lock();
+    flush_locked();
+    unlock();
+}
+
+// Caller holds the lock. Restarts the quiet-period timer, but never pushes the
+// commit past CONFIG_STORAGE_COMMIT_MAX_DELAY_MS after the first dirty write.
+static void schedule_flush_locked(void) {
+    int64_t now = esp_timer_get_time();
+    if (s_dirty_since_us == 0) s_dirty_since_us = now;
+    int64_t delay_us = (int64_t)CONFIG_STORAGE_COMMIT_DELAY_MS * 1000;
+    int64_t left_us = s_dirty_since_us + (int64_t)CONFIG_STORAGE_COMMIT_MAX_DELAY_MS * 1000 - now;
+    if (left_us < delay_us) delay_us = left_us > 0 ? left_us : 0;
+    esp_timer_stop(s_flush_timer);
+    esp_timer_start_once(s_flush_timer, (uint64_t)delay_us);
+}
+
+static void shutdown_flush(void) {
+    storage_flush();
+}
+
 esp_err_t storage_init(void) {
     esp_err_t err = nvs_flash_init();
     if (err == ESP_ERR_NVS_NO_FREE_PAGES || err == ESP_ERR_NVS_NEW_VERSION_FOUND) {
@@ -17,22 +136,66 @@ esp_err_t storage_init(void) {
     err = nvs_open("cfg", NVS_READWRITE, &s_nvs);
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "nvs_open failed: %s", esp_err_to_name(err));
+        return err;
     }
-    return err;
+
+    s_lock = xSemaphoreCreateMutex();
+    const esp_timer_create_args_t targs = {
+        .callback = flush_timer_cb,
+        .name = "storage_flush",
+    };
+    err = esp_timer_create(&targs, &s_flush_timer);
+    if (err != ESP_OK) return err;
+    // Pending writes reach flash before esp_restart() (OTA, etc.)
+    esp_register_shutdown_handler(shutdown_flush);
+    return ESP_OK;
 }
 
 esp_err_t storage_set_u32(const char* key, uint32_t v) {
-    esp_err_t err = nvs_set_u32(s_nvs, key, v);
-    if (err == ESP_OK) err = nvs_commit(s_nvs);
-    return err;
+    lock();
+    cache_entry_t* e = find_entry(key);
+    if (e && e->type == ENTRY_U32 && e->u32 == v) {
+        s_stats.writes_skipped++;
+        unlock();
+        return ESP_OK;
+    }
+    if (e && e->type != ENTRY_U32) {
+        release_entry(e);
+        e = NULL;
+    }
+    if (!e) e = alloc_entry(key);
+    if (!e) {
+        unlock();
+        return ESP_ERR_NO_MEM;
+    }
+    e->type = ENTRY_U32;
+    e->u32 = v;
+    e->dirty = true;
+    s_stats.writes++;
+    schedule_flush_locked();
+    unlock();
+    return ESP_OK;
 }
 
 esp_err_t storage_get_u32(const char* key, uint32_t* out, uint32_t default_v) {
+    lock();
+    cache_entry_t* e = find_entry(key);
+    if (e && e->type == ENTRY_U32) {
+        *out = e->u32;
+        s_stats.cache_hits++;
+        unlock();
+        return ESP_OK;
+    }
     uint32_t v = 0;
     esp_err_t err = nvs_get_u32(s_nvs, key, &v);
     if (err == ESP_OK) {
-        *out = v; return ESP_OK;
+        *out = v;
+        e = alloc_entry(key);
+        if (e) { e->type = ENTRY_U32; e->u32 = v; }
+        unlock();
+        return ESP_OK;
     }
+    unlock();
     *out = default_v;
     return ESP_OK;
 }
@@ -49,18 +212,65 @@ esp_err_t storage_get_bool(const char* key, bool* out, bool default_v) {
 }
 
 esp_err_t storage_set_str(const char* key, const char* v) {
-    esp_err_t err = nvs_set_str(s_nvs, key, v ? v : "");
-    if (err == ESP_OK) err = nvs_commit(s_nvs);
-    return err;
+    if (!v) v = "";
+    lock();
+    cache_entry_t* e = find_entry(key);
+    if (e && e->type == ENTRY_STR && e->str && strcmp(e->str, v) == 0) {
+        s_stats.writes_skipped++;
+        unlock();
+        return ESP_OK;
+    }
+    char* copy = strdup(v);
+    if (!copy) {
+        unlock();
+        return ESP_ERR_NO_MEM;
+    }
+    if (e && e->type != ENTRY_STR) {
+        release_entry(e);
+        e = NULL;
+    }
+    if (!e) e = alloc_entry(key);
+    if (!e) {
+        free(copy);
+        unlock();
+        return ESP_ERR_NO_MEM;
+    }
+    free(e->str);
+    e->type = ENTRY_STR;
+    e->str = copy;
+    e->dirty = true;
+    s_stats.writes++;
+    schedule_flush_locked();
+    unlock();
+    return ESP_OK;
 }
 
 esp_err_t storage_get_str(const char* key, char* out, size_t out_sz, const char* default_v) {
-    size_t required = 0;
-    esp_err_t err = nvs_get_str(s_nvs, key, NULL, &required);
-    if (err == ESP_OK && required > 0 && required <= out_sz) {
-        err = nvs_get_str(s_nvs, key, out, &required);
-        return err;
+    lock();
+    cache_entry_t* e = find_entry(key);
+    if (e && e->type == ENTRY_STR && e->str) {
+        s_stats.cache_hits++;
+        if (strlen(e->str) < out_sz) {
+            strcpy(out, e->str);
+            unlock();
+            return ESP_OK;
+        }
+    } else {
+        size_t required = 0;
+        esp_err_t err = nvs_get_str(s_nvs, key, NULL, &required);
+        if (err == ESP_OK && required > 0 && required <= out_sz) {
+            err = nvs_get_str(s_nvs, key, out, &required);
+            if (err == ESP_OK) {
+                char* copy = strdup(out);
+                e = copy ? alloc_entry(key) : NULL;
+                if (e) { e->type = ENTRY_STR; e->str = copy; }
+                else free(copy);
+            }
+            unlock();
+            return err;
+        }
     }
+    unlock();
     // default
     if (default_v) {
         strncpy(out, default_v, out_sz - 1);
@@ -69,4 +279,89 @@ esp_err_t storage_get_str(const char* key, char* out, size_t out_sz, const char*
         out[0] = 0;
     }
     return ESP_OK;
-}
\ No newline at end of file
+}
+
+esp_err_t storage_set_blob(const char* key, const void* data, size_t len) {
+    if (!data || !len) return ESP_ERR_INVALID_ARG;
+    lock();
+    cache_entry_t* e = find_entry(key);
+    if (e && e->type == ENTRY_BLOB && e->len == len && memcmp(e->str, data, len) == 0) {
+        s_stats.writes_skipped++;
+        unlock();
+        return ESP_OK;
+    }
+    char* copy = malloc(len);
+    if (!copy) {
+        unlock();
+        return ESP_ERR_NO_MEM;
+    }
+    memcpy(copy, data, len);
+    if (e && e->type != ENTRY_BLOB) {
+        release_entry(e);
+        e = NULL;
+    }
+    if (!e) e = alloc_entry(key);
+    if (!e) {
+        free(copy);
+        unlock();
+        return ESP_ERR_NO_MEM;
+    }
+    free(e->str);
+    e->type = ENTRY_BLOB;
+    e->str = copy;
+    e->len = len;
+    e->dirty = true;
+    s_stats.writes++;
+    schedule_flush_locked();
+    unlock();
+    return ESP_OK;
+}
+
+esp_err_t storage_get_blob(const char* key, void* out, size_t* inout_len) {
+    if (!out || !inout_len) return ESP_ERR_INVALID_ARG;
+    lock();
+    cache_entry_t* e = find_entry(key);
+    if (e && e->type == ENTRY_BLOB) {
+        s_stats.cache_hits++;
+        esp_err_t err = ESP_ERR_NVS_INVALID_LENGTH;
+        if (e->len <= *inout_len) {
+            memcpy(out, e->str, e->len);
+            err = ESP_OK;
+        }
+        *inout_len = e->len;
+        unlock();
+        return err;
+    }
+    // Single lookup: the caller's buffer size is the expected blob size
+    esp_err_t err = nvs_get_blob(s_nvs, key, out, inout_len);
+    if (err == ESP_OK) {
+        char* copy = malloc(*inout_len);
+        e = copy ? alloc_entry(key) : NULL;
+        if (e) {
+            memcpy(copy, out, *inout_len);
+            e->type = ENTRY_BLOB;
+            e->str = copy;
+            e->len = *inout_len;
+        } else {
+            free(copy);
+        }
+    }
+    unlock();
+    return err;
+}
+
+esp_err_t storage_flush(void) {
+    if (!s_lock) return ESP_ERR_INVALID_STATE;
+    lock();
+    esp_timer_stop(s_flush_timer);
+    esp_err_t err = flush_locked();
+    unlock();
+    return err;
+}
+
+void storage_get_stats(storage_stats_t* out) {
+    if (!out) return;
+    lock();
+    *out = s_stats;
+    unlock();
+}
@@ -10,13 +10,33 @@ extern "C" {
 esp_err_t storage_init(void);
 
 // Generic helpers
+// Setters update a RAM write-back cache; dirty keys are committed to NVS
+// together once writes have been quiet for CONFIG_STORAGE_COMMIT_DELAY_MS.
 esp_err_t storage_set_u32(const char* key, uint32_t v);
 esp_err_t storage_get_u32(const char* key, uint32_t* out, uint32_t default_v);
 esp_err_t storage_set_bool(const char* key, bool v);
 esp_err_t storage_get_bool(const char* key, bool* out, bool default_v);
 esp_err_t storage_set_str(const char* key, const char* v);
 esp_err_t storage_get_str(const char* key, char* out, size_t out_sz, const char* default_v);
+// Blob helpers. get returns ESP_ERR_NVS_NOT_FOUND when the key is absent and
+// ESP_ERR_NVS_INVALID_LENGTH when *inout_len is too small; *inout_len is set
+// to the stored size in both the OK and too-small cases.
+esp_err_t storage_set_blob(const char* key, const void* data, size_t len);
+esp_err_t storage_get_blob(const char* key, void* out, size_t* inout_len);
+
+// Write all dirty keys and commit now (use after safety-critical changes)
+esp_err_t storage_flush(void);
+
+typedef struct {
+    uint32_t writes;        // storage_set_* calls that changed a value
+    uint32_t writes_skipped;// storage_set_* calls with an unchanged value
+    uint32_t flash_writes;  // nvs_set_* calls issued
+    uint32_t commits;       // nvs_commit calls issued
+    uint32_t cache_hits;    // reads served from RAM
+} storage_stats_t;
+
+void storage_get_stats(storage_stats_t* out);
 
 #ifdef __cplusplus
 }
-#endif
\ No newline at end of file
+#endif
@@ -1,38 +1,212 @@
 #include "time_sync.h"
+#include "connectivity.h"
+#include "storage.h"
+#include "ha_mqtt.h"
 
+#include "esp_attr.h"
 #include "esp_log.h"
+#include "esp_rom_crc.h"
 #include "esp_sntp.h"
+#include "esp_timer.h"
 #include "sdkconfig.h"
-#include "freertos/FreeRTOS.h"
-#include "freertos/task.h"
-#include <time.h>
+#include <inttypes.h>
+#include <stddef.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/time.h>
+#include <time.h>
 
 static const char* TAG = "time_sync";
 
+#define TIME_RTC_MAGIC   0x54494d45 // "TIME"
+#define TIME_NVS_KEY     "time_last"
+// RTC checkpoints per NVS write; at least every checkpoint when the NVS
+// interval is shorter than the RTC one
+#define TIME_NVS_EVERY   (CONFIG_TIME_NVS_SAVE_MIN * 60 / CONFIG_TIME_CHECKPOINT_S > 0 ? \
+                          CONFIG_TIME_NVS_SAVE_MIN * 60 / CONFIG_TIME_CHECKPOINT_S : 1)
+
+// Survives software resets (not power loss). Refreshed every checkpoint so a
+// warm reboot can restore the clock to within a few seconds.
+typedef struct {
+    uint32_t magic;
+    uint32_t synced;  // clock was SNTP-synced when last saved
+    int64_t epoch;    // wall time at last checkpoint (seconds)
+    uint32_t crc;
+} rtc_time_t;
+
+static RTC_NOINIT_ATTR rtc_time_t s_rtc;
+
+static time_sync_status_t s_status = { 0 };
+static esp_timer_handle_t s_checkpoint_timer = NULL;
+static esp_timer_handle_t s_report_timer = NULL;
+static uint32_t s_checkpoints = 0;
+
+static uint32_t rtc_crc(const rtc_time_t* r) {
+    return esp_rom_crc32_le(0, (const uint8_t*)r, offsetof(rtc_time_t, crc));
+}
+
+static void rtc_save(time_t now) {
+    s_rtc.magic = TIME_RTC_MAGIC;
+    s_rtc.synced = s_status.quality != TIME_QUALITY_UNSYNCED;
+    s_rtc.epoch = now;
+    s_rtc.crc = rtc_crc(&s_rtc);
+}
+
+static void log_time(const char* what) {
+    time_t now = 0;
+    time(&now);
+    struct tm tm_info;
+    localtime_r(&now, &tm_info);
+    char buf[64];
+    strftime(buf, sizeof(buf), "%F %T %Z", &tm_info);
+    ESP_LOGI(TAG, "%s: %s (%s)", what, buf, time_sync_quality_name(s_status.quality));
+}
+
+static void set_clock(int64_t epoch) {
+    struct timeval tv = { .tv_sec = (time_t)epoch, .tv_usec = 0 };
+    settimeofday(&tv, NULL);
+}
+
+// Restore what we can before SNTP answers
+static void restore_clock(void) {
+    time_t now = 0;
+    time(&now);
+    bool rtc_ok = s_rtc.magic == TIME_RTC_MAGIC && s_rtc.crc == rtc_crc(&s_rtc);
+
+    if (now > TIME_VALID_EPOCH) {
+        // The RTC timer kept system time across the reset
+        s_status.quality = (rtc_ok && s_rtc.synced) ? TIME_QUALITY_ESTIMATED : TIME_QUALITY_UNSYNCED;
+    } else if (rtc_ok && s_rtc.epoch > TIME_VALID_EPOCH) {
+        set_clock(s_rtc.epoch);
+        s_status.quality = s_rtc.synced ? TIME_QUALITY_ESTIMATED : TIME_QUALITY_UNSYNCED;
+    } else {
+        // Power loss: NVS only gives a lower bound (how long were we off?).
+        // Use it so timestamps aren't 1970, but don't trust it for schedules.
+        uint32_t last = 0;
+        storage_get_u32(TIME_NVS_KEY, &last, 0);
+        if (last > TIME_VALID_EPOCH) set_clock(last);
+        s_status.quality = TIME_QUALITY_UNSYNCED;
+    }
+    if (s_status.quality != TIME_QUALITY_UNSYNCED) {
+        log_time("Clock restored");
+        connectivity_set(CONN_TIME_VALID);
+    }
+}
+
+static void checkpoint_timer_cb(void* arg) {
+    (void)arg;
+    time_t now = 0;
+    time(&now);
+    if (now <= TIME_VALID_EPOCH) return;
+    rtc_save(now);
+    // NVS copy is only a power-loss lower bound; keep flash writes rare
+    if (s_status.quality != TIME_QUALITY_UNSYNCED &&
+        (s_checkpoints++ % TIME_NVS_EVERY) == 0) {
+        storage_set_u32(TIME_NVS_KEY, (uint32_t)now);
+    }
+}
+
+// Publishing from the SNTP callback would run on the lwIP thread; defer it
+static void report_timer_cb(void* arg) {
+    (void)arg;
+    ha_mqtt_publish_time_status();
+}
+
+static void on_time_synced(struct timeval* tv);
+
+// Replaces the weak IDF implementation so we can tell steps from slews.
+// Small offsets are slewed with adjtime() so schedules never see time jump.
+// The weak version is what calls the notification callback, so this one has
+// to finish the job itself.
+void sntp_sync_time(struct timeval* tv) {
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    int64_t offset_us = ((int64_t)tv->tv_sec - now.tv_sec) * 1000000LL + (tv->tv_usec - now.tv_usec);
+    bool step = s_status.quality == TIME_QUALITY_UNSYNCED ||
+                llabs(offset_us) > (int64_t)CONFIG_TIME_SLEW_MAX_MS * 1000;
+    if (step) {
+        settimeofday(tv, NULL);
+        s_status.steps++;
+    } else {
+        struct timeval delta = {
+            .tv_sec = (time_t)(offset_us / 1000000LL),
+            .tv_usec = (suseconds_t)(offset_us % 1000000LL),
+        };
+        adjtime(&delta, NULL);
+        s_status.slews++;
+    }
+    s_status.last_offset_ms = (int32_t)(offset_us / 1000);
+    s_status.last_was_step = step;
+    sntp_set_sync_status(SNTP_SYNC_STATUS_COMPLETED);
+    on_time_synced(tv);
+}
+
+static void on_time_synced(struct timeval* tv) {
+    bool first = s_status.quality != TIME_QUALITY_SYNCED;
+    s_status.quality = TIME_QUALITY_SYNCED;
+    s_status.last_sync = tv->tv_sec;
+    rtc_save(tv->tv_sec);
+    ESP_LOGI(TAG, "SNTP %s by %" PRId32 " ms", s_status.last_was_step ? "step" : "slew",
+             s_status.last_offset_ms);
+    if (first) log_time("Time synced");
+    connectivity_set(CONN_TIME_VALID);
+    esp_timer_start_once(s_report_timer, 0);
+}
+
+// Only poll NTP while there is a route to the server; restart right away when
+// the link comes back instead of waiting out lwIP's retry interval.
+static void on_connectivity(uint32_t state, uint32_t changed, void* ctx) {
+    if (!(changed & CONN_IP)) return;
+    if (state & CONN_IP) {
+        if (sntp_enabled()) sntp_restart();
+        else sntp_init();
+    } else if (sntp_enabled()) {
+        sntp_stop();
+    }
+}
+
 void time_sync_init(void) {
     // Timezone
     setenv("TZ", CONFIG_TZ_STRING, 1);
     tzset();
 
+    restore_clock();
+
+    const esp_timer_create_args_t cargs = {
+        .callback = checkpoint_timer_cb,
+        .name = "time_ckpt",
+    };
+    esp_timer_create(&cargs, &s_checkpoint_timer);
+    esp_timer_start_periodic(s_checkpoint_timer, (uint64_t)CONFIG_TIME_CHECKPOINT_S * 1000000ULL);
+    const esp_timer_create_args_t rargs = {
+        .callback = report_timer_cb,
+        .name = "time_report",
+    };
+    esp_timer_create(&rargs, &s_report_timer);
+
     // SNTP
     sntp_setoperatingmode(SNTP_OPMODE_POLL);
     sntp_setservername(0, CONFIG_SNTP_SERVER);
-    sntp_init();
-
-    // Wait for time to be set roughly
-    for (int i = 0; i < 20; ++i) {
-        time_t now = 0;
-        time(&now);
-        if (now > 1609459200) { // 2021-01-01
-            struct tm tm_info;
-            localtime_r(&now, &tm_info);
-            char buf[64];
-            strftime(buf, sizeof(buf), "%F %T %Z", &tm_info);
-            ESP_LOGI(TAG, "Time synced: %s", buf);
-            return;
-        }
-        vTaskDelay(pdMS_TO_TICKS(500));
+    connectivity_subscribe(on_connectivity, NULL);
+    if (connectivity_is(CONN_IP) && !sntp_enabled()) sntp_init();
+}
+
+bool time_sync_is_valid(void) {
+    return s_status.quality != TIME_QUALITY_UNSYNCED;
+}
+
+time_quality_t time_sync_get_quality(void) {
+    return s_status.quality;
+}
+
+void time_sync_get_status(time_sync_status_t* out) {
+    if (out) *out = s_status;
+}
+
+const char* time_sync_quality_name(time_quality_t q) {
+    switch (q) {
+        case TIME_QUALITY_SYNCED: return "synced";
+        case TIME_QUALITY_ESTIMATED: return "estimated";
+        default: return "unsynced";
     }
-    ESP_LOGW(TAG, "SNTP time not synced yet");
-}
\ No newline at end of file
+}
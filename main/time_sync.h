@@ -1,10 +1,39 @@
 #pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+// Earliest plausible wall time (2021-01-01); anything before it is the
+// power-on default, not a clock that was ever set
+#define TIME_VALID_EPOCH 1609459200
+
+typedef enum {
+    TIME_QUALITY_UNSYNCED = 0, // wall clock unknown (or only a lower bound)
+    TIME_QUALITY_ESTIMATED,    // carried across a warm reboot, not yet re-synced
+    TIME_QUALITY_SYNCED,       // set by SNTP this boot
+} time_quality_t;
+
+typedef struct {
+    time_quality_t quality;
+    int64_t last_sync;      // epoch seconds of last SNTP sync, 0 if none this boot
+    int32_t last_offset_ms; // correction applied at the last sync
+    bool last_was_step;     // last correction stepped the clock (else slewed)
+    uint32_t steps;
+    uint32_t slews;
+} time_sync_status_t;
+
+// Non-blocking: restores the clock from RTC memory/NVS and starts SNTP in
+// the background. CONN_TIME_VALID is set once the clock is usable.
 void time_sync_init(void);
+// True once the wall clock is usable (estimated or synced)
+bool time_sync_is_valid(void);
+time_quality_t time_sync_get_quality(void);
+void time_sync_get_status(time_sync_status_t* out);
+const char* time_sync_quality_name(time_quality_t q);
 
 #ifdef __cplusplus
 }
-#endif
\ No newline at end of file
+#endif
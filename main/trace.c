@@ -0,0 +1,55 @@
+#include "trace.h"
+
+#include "esp_cpu.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if CONFIG_TRACE_ENABLE
+
+#define TRACE_RECORDS (1u << CONFIG_TRACE_RECORDS_LOG2)
+
+static trace_rec_t s_ring[TRACE_RECORDS];
+static uint32_t s_next;          // total records claimed
+static volatile bool s_paused;
+
+void trace_record(uint8_t event, uint16_t arg) {
+    if (s_paused) return;
+    uint32_t i = __atomic_fetch_add(&s_next, 1, __ATOMIC_RELAXED);
+    trace_rec_t* r = &s_ring[i & (TRACE_RECORDS - 1)];
+    r->ts_us = (uint32_t)esp_timer_get_time();
+    r->event = event;
+    r->core = (uint8_t)esp_cpu_get_core_id();
+    r->arg = arg;
+}
+
+void* trace_dump(size_t* out_len) {
+    s_paused = true;
+    // Let writers that claimed a slot before the pause finish filling it
+    vTaskDelay(1);
+    uint32_t total = __atomic_load_n(&s_next, __ATOMIC_ACQUIRE);
+    uint32_t count = total < TRACE_RECORDS ? total : TRACE_RECORDS;
+    size_t len = sizeof(trace_dump_hdr_t) + count * sizeof(trace_rec_t);
+    uint8_t* out = malloc(len);
+    if (out) {
+        trace_dump_hdr_t h = { TRACE_DUMP_MAGIC, count, total, (uint32_t)esp_timer_get_time() };
+        memcpy(out, &h, sizeof(h));
+        trace_rec_t* dst = (trace_rec_t*)(out + sizeof(h));
+        uint32_t first = total - count;
+        for (uint32_t k = 0; k < count; ++k) dst[k] = s_ring[(first + k) & (TRACE_RECORDS - 1)];
+        *out_len = len;
+    }
+    s_paused = false;
+    return out;
+}
+
+#else
+
+void* trace_dump(size_t* out_len) {
+    (void)out_len;
+    return NULL;
+}
+
+#endif
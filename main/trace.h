@@ -0,0 +1,55 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include "sdkconfig.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Binary event trace for the command-to-actuation path. Records are 8 bytes
+// (timestamp in us, event id, core, arg) in a fixed power-of-two ring; a
+// writer claims a slot with one atomic add, so any task can record without
+// a lock. Dumped on request to <base>/trace and decoded by
+// tools/trace_decode.py.
+typedef enum {
+    TRACE_MQTT_RX = 1,     // MQTT_EVENT_DATA reached mqtt_event_handler
+    TRACE_RELAY_MATCHED,   // topic matched a relay command
+    TRACE_SAFETY_BEGIN,    // safety_can_turn_on (control task)
+    TRACE_SAFETY_END,
+    TRACE_RELAY_BEGIN,     // relay_set_channel
+    TRACE_RELAY_END,
+    TRACE_PUBLISH_BEGIN,   // relay state publish
+    TRACE_PUBLISH_END,
+} trace_event_t;
+
+typedef struct {
+    uint32_t ts_us;
+    uint8_t event;
+    uint8_t core;
+    uint16_t arg;  // command id; groups the records of one message
+} trace_rec_t;
+
+// Dump layout: header, then 'count' records oldest first
+#define TRACE_DUMP_MAGIC 0x31544847 // "GHT1"
+typedef struct {
+    uint32_t magic;
+    uint32_t count;
+    uint32_t total;   // records written since boot
+    uint32_t now_us;
+} trace_dump_hdr_t;
+
+#if CONFIG_TRACE_ENABLE
+void trace_record(uint8_t event, uint16_t arg);
+#define TRACE(event, arg) trace_record((event), (arg))
+#else
+#define TRACE(event, arg) ((void)0)
+#endif
+
+// Snapshot the ring into a malloc'd dump (header + records); caller frees.
+// Recording is paused while it copies.
+void* trace_dump(size_t* out_len);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,209 @@
+#include "tsdb.h"
+#include <string.h>
+
+#define BLOCK_BITS (TSDB_BLOCK_SIZE * 8)
+#define MAX_POINT_BITS (32 + 32 * TSDB_FIELDS) // raw first point
+
+typedef struct {
+    uint8_t* buf;
+    uint32_t pos; // bit position
+} bitw_t;
+
+typedef struct {
+    const uint8_t* buf;
+    uint32_t pos;
+} bitr_t;
+
+static void put_bits(bitw_t* w, uint32_t v, int n) {
+    while (n > 0) {
+        int room = 8 - (int)(w->pos & 7);
+        int k = n < room ? n : room;
+        uint8_t bits = (uint8_t)((v >> (n - k)) & ((1u << k) - 1));
+        uint8_t* b = &w->buf[w->pos >> 3];
+        if ((w->pos & 7) == 0) *b = 0;
+        *b |= (uint8_t)(bits << (room - k));
+        w->pos += (uint32_t)k;
+        n -= k;
+    }
+}
+
+static uint32_t get_bits(bitr_t* r, int n) {
+    uint32_t v = 0;
+    while (n > 0) {
+        int avail = 8 - (int)(r->pos & 7);
+        int k = n < avail ? n : avail;
+        uint8_t b = r->buf[r->pos >> 3];
+        v = (v << k) | ((uint32_t)(b >> (avail - k)) & ((1u << k) - 1));
+        r->pos += (uint32_t)k;
+        n -= k;
+    }
+    return v;
+}
+
+static uint32_t zigzag(int32_t v) {
+    return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);
+}
+
+static int32_t unzigzag(uint32_t v) {
+    return (int32_t)(v >> 1) ^ -(int32_t)(v & 1);
+}
+
+static void put_dod(bitw_t* w, int32_t dod) {
+    uint32_t z = zigzag(dod);
+    if (z == 0) put_bits(w, 0x0, 1);
+    else if (z < (1u << 7)) { put_bits(w, 0x2, 2); put_bits(w, z, 7); }
+    else if (z < (1u << 9)) { put_bits(w, 0x6, 3); put_bits(w, z, 9); }
+    else if (z < (1u << 12)) { put_bits(w, 0xE, 4); put_bits(w, z, 12); }
+    else { put_bits(w, 0xF, 4); put_bits(w, z, 32); }
+}
+
+static int32_t get_dod(bitr_t* r) {
+    if (!get_bits(r, 1)) return 0;
+    if (!get_bits(r, 1)) return unzigzag(get_bits(r, 7));
+    if (!get_bits(r, 1)) return unzigzag(get_bits(r, 9));
+    if (!get_bits(r, 1)) return unzigzag(get_bits(r, 12));
+    return unzigzag(get_bits(r, 32));
+}
+
+static void put_delta(bitw_t* w, int32_t d) {
+    uint32_t z = zigzag(d);
+    if (z == 0) put_bits(w, 0x0, 1);
+    else if (z < (1u << 6)) { put_bits(w, 0x2, 2); put_bits(w, z, 6); }
+    else if (z < (1u << 12)) { put_bits(w, 0x6, 3); put_bits(w, z, 12); }
+    else { put_bits(w, 0x7, 3); put_bits(w, z, 32); }
+}
+
+static int32_t get_delta(bitr_t* r) {
+    if (!get_bits(r, 1)) return 0;
+    if (!get_bits(r, 1)) return unzigzag(get_bits(r, 6));
+    if (!get_bits(r, 1)) return unzigzag(get_bits(r, 12));
+    return unzigzag(get_bits(r, 32));
+}
+
+// Encode p after prev (or raw when first); returns bits written
+static uint32_t encode_point(bitw_t* w, const tsdb_point_t* p, const tsdb_point_t* prev,
+                             int32_t prev_delta, bool first) {
+    uint32_t start = w->pos;
+    if (first) {
+        put_bits(w, p->ts, 32);
+        for (int f = 0; f < TSDB_FIELDS; ++f) put_bits(w, (uint32_t)p->v[f], 32);
+        return w->pos - start;
+    }
+    put_dod(w, (int32_t)(p->ts - prev->ts) - prev_delta);
+    for (int f = 0; f < TSDB_VALUES; ++f) put_delta(w, p->v[f] - prev->v[f]);
+    uint32_t x = (uint32_t)(p->v[TSDB_RELAYS] ^ prev->v[TSDB_RELAYS]) & ((1u << TSDB_RELAY_BITS) - 1);
+    if (!x) put_bits(w, 0, 1);
+    else { put_bits(w, 1, 1); put_bits(w, x, TSDB_RELAY_BITS); }
+    return w->pos - start;
+}
+
+void tsdb_init(tsdb_t* db, uint8_t* blocks, tsdb_block_meta_t* meta, uint16_t nblocks) {
+    memset(db, 0, sizeof(*db));
+    db->blocks = blocks;
+    db->meta = meta;
+    db->nblocks = nblocks;
+    memset(meta, 0, sizeof(*meta) * nblocks);
+}
+
+void tsdb_append(tsdb_t* db, const tsdb_point_t* p) {
+    if (!db->nblocks) return;
+    tsdb_block_meta_t* m = &db->meta[db->head];
+    bool first = db->used == 0 || m->count == 0;
+
+    if (!first) {
+        // Encode into scratch to see whether it still fits this block
+        uint8_t scratch[(MAX_POINT_BITS + 7) / 8 + 1];
+        bitw_t sw = { .buf = scratch, .pos = 0 };
+        uint32_t n = encode_point(&sw, p, &db->prev, db->prev_delta, false);
+        if (m->bits + n <= BLOCK_BITS) {
+            bitw_t w = { .buf = db->blocks + (size_t)db->head * TSDB_BLOCK_SIZE, .pos = m->bits };
+            bitr_t r = { .buf = scratch, .pos = 0 };
+            for (uint32_t left = n; left; ) {
+                int k = left > 24 ? 24 : (int)left;
+                put_bits(&w, get_bits(&r, k), k);
+                left -= (uint32_t)k;
+            }
+            m->bits = (uint16_t)w.pos;
+            m->count++;
+            m->last_ts = p->ts;
+            db->prev_delta = (int32_t)(p->ts - db->prev.ts);
+            db->prev = *p;
+            return;
+        }
+        // Block full: move on, dropping the oldest block if the ring is full
+        db->head = (uint16_t)((db->head + 1) % db->nblocks);
+        m = &db->meta[db->head];
+        memset(m, 0, sizeof(*m));
+    }
+
+    bitw_t w = { .buf = db->blocks + (size_t)db->head * TSDB_BLOCK_SIZE, .pos = 0 };
+    m->bits = (uint16_t)encode_point(&w, p, NULL, 0, true);
+    m->count = 1;
+    m->first_ts = m->last_ts = p->ts;
+    if (db->used < db->nblocks) db->used++;
+    db->prev = *p;
+    db->prev_delta = 0;
+}
+
+static bool visit_block(const tsdb_t* db, uint16_t b, uint32_t from, uint32_t to, tsdb_visit_fn fn, void* ctx) {
+    const tsdb_block_meta_t* m = &db->meta[b];
+    bitr_t r = { .buf = db->blocks + (size_t)b * TSDB_BLOCK_SIZE, .pos = 0 };
+    tsdb_point_t p;
+    int32_t delta = 0;
+    for (uint16_t i = 0; i < m->count; ++i) {
+        if (i == 0) {
+            p.ts = get_bits(&r, 32);
+            for (int f = 0; f < TSDB_FIELDS; ++f) p.v[f] = (int32_t)get_bits(&r, 32);
+        } else {
+            delta += get_dod(&r);
+            p.ts += (uint32_t)delta;
+            for (int f = 0; f < TSDB_VALUES; ++f) p.v[f] += get_delta(&r);
+            if (get_bits(&r, 1)) p.v[TSDB_RELAYS] ^= (int32_t)get_bits(&r, TSDB_RELAY_BITS);
+        }
+        if (p.ts >= from && p.ts <= to && !fn(&p, ctx)) return false;
+    }
+    return true;
+}
+
+void tsdb_query(const tsdb_t* db, uint32_t from, uint32_t to, tsdb_visit_fn fn, void* ctx) {
+    if (!db->used) return;
+    uint16_t oldest = db->used < db->nblocks ? 0 : (uint16_t)((db->head + 1) % db->nblocks);
+    for (uint16_t i = 0; i < db->used; ++i) {
+        uint16_t b = (uint16_t)((oldest + i) % db->nblocks);
+        const tsdb_block_meta_t* m = &db->meta[b];
+        // Blocks are time-ordered unless the clock stepped back; check both ends
+        uint32_t lo = m->first_ts < m->last_ts ? m->first_ts : m->last_ts;
+        uint32_t hi = m->first_ts < m->last_ts ? m->last_ts : m->first_ts;
+        if (hi < from || lo > to) continue;
+        if (!visit_block(db, b, from, to, fn, ctx)) return;
+    }
+}
+
+void tsdb_get_stats(const tsdb_t* db, tsdb_stats_t* out) {
+    memset(out, 0, sizeof(*out));
+    if (!db->used) return;
+    uint16_t oldest = db->used < db->nblocks ? 0 : (uint16_t)((db->head + 1) % db->nblocks);
+    for (uint16_t i = 0; i < db->used; ++i) {
+        const tsdb_block_meta_t* m = &db->meta[(oldest + i) % db->nblocks];
+        out->points += m->count;
+        out->bytes += (m->bits + 7u) / 8u;
+    }
+    out->first_ts = db->meta[oldest].first_ts;
+    out->last_ts = db->meta[db->head].last_ts;
+}
+
+void tsdb_rollup_reset(tsdb_rollup_t* r) {
+    memset(r, 0, sizeof(*r));
+}
+
+void tsdb_rollup_add(tsdb_rollup_t* r, const tsdb_point_t* p) {
+    for (int f = 0; f < TSDB_VALUES; ++f) {
+        if (!r->n || p->v[f] < r->min[f]) r->min[f] = p->v[f];
+        if (!r->n || p->v[f] > r->max[f]) r->max[f] = p->v[f];
+        r->sum[f] += p->v[f];
+    }
+    for (int b = 0; b < TSDB_RELAY_BITS; ++b) {
+        if (p->v[TSDB_RELAYS] & (1 << b)) r->relay_on[b]++;
+    }
+    r->n++;
+}
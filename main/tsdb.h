@@ -0,0 +1,85 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Compressed in-RAM time series (no ESP-IDF dependencies, also built on the
+// host by host/). Points are bit-packed into a ring of fixed-size blocks; the
+// oldest block is dropped when the ring is full.
+//
+// Per point, relative to the previous one in the same block:
+//   timestamp  delta-of-delta: '0' | '10'+7 | '110'+9 | '1110'+12 | '1111'+32 bits
+//   values     zigzag delta:   '0' | '10'+6 | '110'+12 | '111'+32 bits
+//   relays     XOR mask:       '0' | '1'+8 bits
+// The first point of each block is stored raw so blocks decode on their own.
+
+#define TSDB_BLOCK_SIZE 1024
+
+enum {
+    TSDB_CO2 = 0,   // ppm
+    TSDB_TEMP,      // 0.1 C
+    TSDB_RH,        // 0.1 %
+    TSDB_RELAYS,    // bit n = relay n+1 on
+    TSDB_FIELDS
+};
+// Fields before TSDB_RELAYS are values (delta coded, rolled up as min/max/sum)
+#define TSDB_VALUES TSDB_RELAYS
+#define TSDB_RELAY_BITS 8
+
+typedef struct {
+    uint32_t ts;             // epoch seconds
+    int32_t v[TSDB_FIELDS];
+} tsdb_point_t;
+
+typedef struct {
+    uint32_t first_ts;
+    uint32_t last_ts;
+    uint16_t count;
+    uint16_t bits;
+} tsdb_block_meta_t;
+
+typedef struct {
+    uint8_t* blocks;         // nblocks * TSDB_BLOCK_SIZE
+    tsdb_block_meta_t* meta; // nblocks
+    uint16_t nblocks;
+    uint16_t head;           // block being appended to
+    uint16_t used;           // blocks holding data
+    tsdb_point_t prev;       // encoder state
+    int32_t prev_delta;
+} tsdb_t;
+
+void tsdb_init(tsdb_t* db, uint8_t* blocks, tsdb_block_meta_t* meta, uint16_t nblocks);
+void tsdb_append(tsdb_t* db, const tsdb_point_t* p);
+
+// Visit stored points with from <= ts <= to, oldest first; return false to stop
+typedef bool (*tsdb_visit_fn)(const tsdb_point_t* p, void* ctx);
+void tsdb_query(const tsdb_t* db, uint32_t from, uint32_t to, tsdb_visit_fn fn, void* ctx);
+
+typedef struct {
+    uint32_t points;
+    uint32_t bytes;          // encoded size of stored points
+    uint32_t first_ts;
+    uint32_t last_ts;
+} tsdb_stats_t;
+
+void tsdb_get_stats(const tsdb_t* db, tsdb_stats_t* out);
+
+// min/max/avg over a set of points; relays are reported as per-channel on counts
+typedef struct {
+    uint32_t n;
+    int32_t min[TSDB_VALUES];
+    int32_t max[TSDB_VALUES];
+    int64_t sum[TSDB_VALUES];
+    uint32_t relay_on[TSDB_RELAY_BITS];
+} tsdb_rollup_t;
+
+void tsdb_rollup_reset(tsdb_rollup_t* r);
+void tsdb_rollup_add(tsdb_rollup_t* r, const tsdb_point_t* p);
+
+#ifdef __cplusplus
+}
+#endif
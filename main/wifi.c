@@ -1,32 +1,165 @@
 #include "wifi.h"
+#include "boot.h"
+#include "storage.h"
+#include "connectivity.h"
 
 #include "esp_event.h"
 #include "esp_log.h"
 #include "esp_netif.h"
+#include "esp_random.h"
+#include "esp_timer.h"
 #include "esp_wifi.h"
 #include "nvs_flash.h"
 #include "sdkconfig.h"
+#include <inttypes.h>
 #include <string.h>
 
 static const char* TAG = "wifi";
-static bool s_connected = false;
+
+// Last good association, persisted so the next boot can skip the full scan
+#define WIFI_CACHE_KEY     "wifi_ap"
+#define WIFI_CACHE_VERSION 1
+
+typedef struct {
+    uint8_t version;
+    uint8_t channel;
+    uint8_t bssid[6];
+    uint32_t ip, netmask, gw, dns; // network byte order, as in esp_ip4_addr_t
+} wifi_cache_t;
+
+static esp_netif_t* s_netif = NULL;
+static wifi_config_t s_wifi_config = { 0 };
+static wifi_cache_t s_cache = { 0 };
+static bool s_fast_connect = false;  // config currently pinned to cached BSSID/channel
+static bool s_static_ip = false;     // cached IP applied, DHCP client stopped
+static uint8_t s_cur_bssid[6] = { 0 };
+static uint8_t s_cur_channel = 0;
+
+static esp_timer_handle_t s_retry_timer = NULL;
+static uint32_t s_attempt = 0;            // consecutive failures since last got-IP
+static int64_t s_connect_start_us = 0;    // start of the current (re)connect cycle
+static uint32_t s_last_connect_ms = 0;
+
+static bool load_cache(void) {
+    size_t len = sizeof(s_cache);
+    if (storage_get_blob(WIFI_CACHE_KEY, &s_cache, &len) != ESP_OK) return false;
+    return len == sizeof(s_cache) && s_cache.version == WIFI_CACHE_VERSION && s_cache.channel != 0;
+}
+
+static void apply_static_ip(void) {
+#if CONFIG_WIFI_STATIC_IP_FROM_CACHE
+    if (!s_cache.ip) return;
+    esp_netif_ip_info_t info = {
+        .ip.addr = s_cache.ip,
+        .netmask.addr = s_cache.netmask,
+        .gw.addr = s_cache.gw,
+    };
+    if (esp_netif_dhcpc_stop(s_netif) != ESP_OK) return;
+    if (esp_netif_set_ip_info(s_netif, &info) != ESP_OK) {
+        esp_netif_dhcpc_start(s_netif);
+        return;
+    }
+    if (s_cache.dns) {
+        esp_netif_dns_info_t dns = { 0 };
+        dns.ip.u_addr.ip4.addr = s_cache.dns;
+        dns.ip.type = ESP_IPADDR_TYPE_V4;
+        esp_netif_set_dns_info(s_netif, ESP_NETIF_DNS_MAIN, &dns);
+    }
+    s_static_ip = true;
+    ESP_LOGI(TAG, "Using cached IP " IPSTR, IP2STR(&info.ip));
+#endif
+}
+
+// Fall back to a full scan and DHCP; the cached AP or address is no longer good
+static void drop_fast_connect(void) {
+    if (s_static_ip) {
+        esp_netif_dhcpc_start(s_netif);
+        s_static_ip = false;
+    }
+    if (!s_fast_connect) return;
+    s_fast_connect = false;
+    s_wifi_config.sta.bssid_set = false;
+    s_wifi_config.sta.channel = 0;
+    esp_wifi_set_config(WIFI_IF_STA, &s_wifi_config);
+    ESP_LOGW(TAG, "Cached AP not usable, falling back to full scan");
+}
+
+static void save_cache(const ip_event_got_ip_t* ev) {
+    wifi_cache_t c = s_cache;
+    c.version = WIFI_CACHE_VERSION;
+    c.channel = s_cur_channel;
+    memcpy(c.bssid, s_cur_bssid, sizeof(c.bssid));
+    c.ip = ev->ip_info.ip.addr;
+    c.netmask = ev->ip_info.netmask.addr;
+    c.gw = ev->ip_info.gw.addr;
+    esp_netif_dns_info_t dns = { 0 };
+    if (esp_netif_get_dns_info(s_netif, ESP_NETIF_DNS_MAIN, &dns) == ESP_OK) {
+        c.dns = dns.ip.u_addr.ip4.addr;
+    }
+    s_cache = c;
+    storage_set_blob(WIFI_CACHE_KEY, &s_cache, sizeof(s_cache)); // no-op when unchanged
+}
+
+static void retry_timer_cb(void* arg) {
+    (void)arg;
+    esp_wifi_connect();
+}
+
+// Exponential backoff with equal jitter, so a fleet that lost the AP together
+// doesn't reassociate in lockstep
+static uint32_t backoff_ms(uint32_t attempt) {
+    uint32_t d = CONFIG_WIFI_BACKOFF_MIN_MS;
+    for (uint32_t i = 1; i < attempt && d < CONFIG_WIFI_BACKOFF_MAX_MS; ++i) d *= 2;
+    if (d > CONFIG_WIFI_BACKOFF_MAX_MS) d = CONFIG_WIFI_BACKOFF_MAX_MS;
+    return d / 2 + esp_random() % (d / 2 + 1);
+}
 
 static void wifi_event_handler(void* arg, esp_event_base_t event_base, int32_t event_id, void* event_data) {
     if (event_base == WIFI_EVENT) {
         switch (event_id) {
             case WIFI_EVENT_STA_START:
+                boot_mark(BOOT_MS_WIFI_STARTED);
+                s_connect_start_us = esp_timer_get_time();
                 esp_wifi_connect();
                 break;
-            case WIFI_EVENT_STA_DISCONNECTED:
-                s_connected = false;
-                ESP_LOGW(TAG, "Disconnected, retrying...");
-                esp_wifi_connect();
+            case WIFI_EVENT_STA_CONNECTED: {
+                const wifi_event_sta_connected_t* ev = (const wifi_event_sta_connected_t*)event_data;
+                memcpy(s_cur_bssid, ev->bssid, sizeof(s_cur_bssid));
+                s_cur_channel = ev->channel;
+                connectivity_set(CONN_LINK_UP);
                 break;
+            }
+            case WIFI_EVENT_STA_DISCONNECTED: {
+                const wifi_event_sta_disconnected_t* ev = (const wifi_event_sta_disconnected_t*)event_data;
+                if (connectivity_is(CONN_IP)) s_connect_start_us = esp_timer_get_time();
+                connectivity_clear(CONN_LINK_UP | CONN_IP);
+                s_attempt++;
+                // The cached AP may be gone or moved channel: give it two retries, then rescan
+                if (ev->reason == WIFI_REASON_NO_AP_FOUND || s_attempt > 2) {
+                    drop_fast_connect();
+                }
+                uint32_t delay = backoff_ms(s_attempt);
+                ESP_LOGW(TAG, "Disconnected (reason %u), retry %" PRIu32 " in %" PRIu32 " ms",
+                         ev->reason, s_attempt, delay);
+                esp_timer_stop(s_retry_timer);
+                esp_timer_start_once(s_retry_timer, (uint64_t)delay * 1000);
+                break;
+            }
             default: break;
         }
     } else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP) {
-        s_connected = true;
-        ESP_LOGI(TAG, "Got IP");
+        const ip_event_got_ip_t* ev = (const ip_event_got_ip_t*)event_data;
+        s_last_connect_ms = (uint32_t)((esp_timer_get_time() - s_connect_start_us) / 1000);
+        ESP_LOGI(TAG, "Got IP " IPSTR " in %" PRIu32 " ms (%s, %" PRIu32 " retries)",
+                 IP2STR(&ev->ip_info.ip), s_last_connect_ms,
+                 s_fast_connect ? "fast" : "scan", s_attempt);
+        s_attempt = 0;
+        save_cache(ev);
+        boot_mark(BOOT_MS_GOT_IP);
+        connectivity_set(CONN_IP);
+    } else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_LOST_IP) {
+        ESP_LOGW(TAG, "Lost IP");
+        connectivity_clear(CONN_IP);
     }
 }
 
@@ -40,23 +173,45 @@ void wifi_init_and_start(void) {
 
     ESP_ERROR_CHECK(esp_netif_init());
     ESP_ERROR_CHECK(esp_event_loop_create_default());
-    esp_netif_create_default_wifi_sta();
+    s_netif = esp_netif_create_default_wifi_sta();
+
+    const esp_timer_create_args_t targs = {
+        .callback = retry_timer_cb,
+        .name = "wifi_retry",
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&targs, &s_retry_timer));
 
     wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
     ESP_ERROR_CHECK(esp_wifi_init(&cfg));
+    // We persist the association ourselves; keep the driver from writing its config to NVS
+    esp_wifi_set_storage(WIFI_STORAGE_RAM);
     ESP_ERROR_CHECK(esp_event_handler_register(WIFI_EVENT, ESP_EVENT_ANY_ID, &wifi_event_handler, NULL));
     ESP_ERROR_CHECK(esp_event_handler_register(IP_EVENT, IP_EVENT_STA_GOT_IP, &wifi_event_handler, NULL));
+    ESP_ERROR_CHECK(esp_event_handler_register(IP_EVENT, IP_EVENT_STA_LOST_IP, &wifi_event_handler, NULL));
 
-    wifi_config_t wifi_config = { 0 };
-    strncpy((char*)wifi_config.sta.ssid, CONFIG_WIFI_SSID, sizeof(wifi_config.sta.ssid)-1);
-    strncpy((char*)wifi_config.sta.password, CONFIG_WIFI_PASSWORD, sizeof(wifi_config.sta.password)-1);
-    wifi_config.sta.threshold.authmode = WIFI_AUTH_WPA2_PSK;
+    strncpy((char*)s_wifi_config.sta.ssid, CONFIG_WIFI_SSID, sizeof(s_wifi_config.sta.ssid)-1);
+    strncpy((char*)s_wifi_config.sta.password, CONFIG_WIFI_PASSWORD, sizeof(s_wifi_config.sta.password)-1);
+    s_wifi_config.sta.threshold.authmode = WIFI_AUTH_WPA2_PSK;
+
+    if (load_cache()) {
+        // Probe only the cached channel for the cached BSSID instead of a full scan
+        s_wifi_config.sta.bssid_set = true;
+        memcpy(s_wifi_config.sta.bssid, s_cache.bssid, sizeof(s_cache.bssid));
+        s_wifi_config.sta.channel = s_cache.channel;
+        s_fast_connect = true;
+        apply_static_ip();
+        ESP_LOGI(TAG, "Fast connect to cached AP on channel %u", s_cache.channel);
+    }
 
     ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
-    ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &wifi_config));
+    ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &s_wifi_config));
     ESP_ERROR_CHECK(esp_wifi_start());
 }
 
 bool wifi_is_connected(void) {
-    return s_connected;
-}
\ No newline at end of file
+    return connectivity_is(CONN_IP);
+}
+
+uint32_t wifi_get_last_connect_ms(void) {
+    return s_last_connect_ms;
+}
@@ -1,5 +1,6 @@
 #pragma once
 #include <stdbool.h>
+#include <stdint.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -7,6 +8,8 @@ extern "C" {
 
 void wifi_init_and_start(void);
 bool wifi_is_connected(void);
+// Time from start of the last (re)connect cycle to got-IP
+uint32_t wifi_get_last_connect_ms(void);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,213 @@
+#!/usr/bin/env python3
+"""Measure actuation jitter with and without an MQTT flood.
+
+    mosquitto -p 1883 &            # local broker the device is pointed at
+    tools/jitter_bench.py --device greenhouse/esp32s3-a1b2c3 \\
+        --rate 500 --size 1024 --phase 120 [--channel 4]
+
+Runs a quiet baseline phase, then a flood phase in which --publishers
+clients publish --rate msg/s of --size byte junk to <device>/ota/chunk.
+The device subscribes to that topic and matches it first, so every flood
+message crosses Wi-Fi, lwIP and the MQTT task and is then dropped at the
+chunk magic check, without side effects.
+
+The device-side numbers come from the control task histograms in
+<device>/metrics (enable a short CONFIG_METRICS_INTERVAL_S and make each
+phase span a few intervals):
+  ctl_tick  deviation of the periodic safety tick from its period
+  ctl_cmd   relay command queued -> GPIO written
+With --channel the tool also toggles that relay every --gap seconds and
+times publish -> state echo from the client side. It really switches the
+relay; pick a channel with nothing dangerous attached.
+
+Needs paho-mqtt.
+"""
+import argparse
+import json
+import math
+import os
+import threading
+import time
+
+import paho.mqtt.client as mqtt
+
+# Must match k_bounds_us in main/metrics.c; the last bucket is open-ended
+BOUNDS_US = [500, 1000, 2000, 5000, 10000, 20000, 50000, 100000, 500000]
+HISTS = ["ctl_tick", "ctl_cmd", "pub"]
+
+
+class Phase:
+    def __init__(self, name):
+        self.name = name
+        self.hist = {h: {"n": 0, "max": 0, "b": [0] * (len(BOUNDS_US) + 1)} for h in HISTS}
+        self.cpu = []
+        self.rtt = []
+        self.sent = 0
+        self.samples = 0
+
+    def add_metrics(self, m):
+        self.samples += 1
+        for h in HISTS:
+            src = m.get(h)
+            if not src:
+                continue
+            dst = self.hist[h]
+            dst["n"] += src["n"]
+            dst["max"] = max(dst["max"], src["max_us"])
+            dst["b"] = [a + b for a, b in zip(dst["b"], src["hist"])]
+        if m.get("cpu"):
+            self.cpu.append(m["cpu"])
+
+
+def hist_pct(h, p):
+    if not h["n"]:
+        return 0
+    want, seen = math.ceil(h["n"] * p / 100.0), 0
+    for i, bound in enumerate(BOUNDS_US):
+        seen += h["b"][i]
+        if seen >= want:
+            return min(bound, h["max"])
+    return h["max"]
+
+
+def pct(values, p):
+    s = sorted(values)
+    return s[max(0, min(len(s) - 1, math.ceil(p / 100.0 * len(s)) - 1))]
+
+
+def flood(args, stop, counter, idx):
+    c = mqtt.Client(client_id="jitter-flood-%d-%d" % (os.getpid(), idx))
+    if args.username:
+        c.username_pw_set(args.username, args.password)
+    c.connect(args.host, args.port)
+    c.loop_start()
+    topic = args.device + "/ota/chunk"
+    payload = bytes(args.size)  # zero magic: dropped by the device
+    interval = args.publishers / float(args.rate)
+    nxt = time.monotonic()
+    while not stop.is_set():
+        c.publish(topic, payload, qos=0)
+        counter[idx] += 1
+        nxt += interval
+        delay = nxt - time.monotonic()
+        if delay > 0:
+            time.sleep(delay)
+    c.loop_stop()
+    c.disconnect()
+
+
+def run_phase(args, mon, phase, flooding):
+    mon.phase = phase
+    stop = threading.Event()
+    counter = [0] * args.publishers
+    threads = []
+    if flooding:
+        for i in range(args.publishers):
+            t = threading.Thread(target=flood, args=(args, stop, counter, i), daemon=True)
+            t.start()
+            threads.append(t)
+    t_end = time.monotonic() + args.phase
+    want = "ON"
+    while time.monotonic() < t_end:
+        if args.channel:
+            rtt = mon.command(want)
+            if rtt is not None:
+                phase.rtt.append(rtt)
+            want = "OFF" if want == "ON" else "ON"
+        time.sleep(args.gap)
+    stop.set()
+    for t in threads:
+        t.join()
+    phase.sent = sum(counter)
+    if args.channel:
+        mon.command("OFF")
+    # Let the metrics interval covering the end of the phase arrive
+    time.sleep(args.settle)
+
+
+class Monitor:
+    def __init__(self, args):
+        self.args = args
+        self.phase = None
+        self.cond = threading.Condition()
+        self.echo = None
+        self.c = mqtt.Client(client_id="jitter-mon-%d" % os.getpid())
+        if args.username:
+            self.c.username_pw_set(args.username, args.password)
+        self.c.on_message = self.on_message
+        self.c.connect(args.host, args.port)
+        self.c.subscribe(args.device + "/metrics", 0)
+        if args.channel:
+            self.state_t = "%s/relay/%d/state" % (args.device, args.channel)
+            self.c.subscribe(self.state_t, 1)
+        self.c.loop_start()
+
+    def on_message(self, _c, _u, msg):
+        if msg.topic.endswith("/metrics"):
+            if self.phase:
+                try:
+                    self.phase.add_metrics(json.loads(msg.payload))
+                except ValueError:
+                    pass
+            return
+        with self.cond:
+            self.echo = (time.monotonic(), msg.payload.decode(errors="replace"))
+            self.cond.notify_all()
+
+    def command(self, want):
+        with self.cond:
+            self.echo = None
+            t0 = time.monotonic()
+            self.c.publish("%s/relay/%d/set" % (self.args.device, self.args.channel), want, qos=1)
+            if not self.cond.wait_for(lambda: self.echo and self.echo[1] == want, timeout=5.0):
+                return None
+            return int((self.echo[0] - t0) * 1e6)
+
+
+def report(phases, args):
+    print("%-10s %-9s %6s %9s %9s %9s %9s" % ("phase", "metric", "n", "p50_us", "p99_us", "max_us", ""))
+    for ph in phases:
+        extra = ""
+        if ph.sent:
+            extra = "flood %d msgs (%.0f/s)" % (ph.sent, ph.sent / float(args.phase))
+        for h in HISTS:
+            d = ph.hist[h]
+            print("%-10s %-9s %6d %9d %9d %9d  %s" % (ph.name, h, d["n"], hist_pct(d, 50), hist_pct(d, 99), d["max"], extra))
+            extra = ""
+        if ph.rtt:
+            print("%-10s %-9s %6d %9d %9d %9d" % (ph.name, "rtt", len(ph.rtt), pct(ph.rtt, 50), pct(ph.rtt, 99), max(ph.rtt)))
+        if ph.cpu:
+            loads = ["%d" % (sum(c[i] for c in ph.cpu) / len(ph.cpu)) for i in range(len(ph.cpu[0]))]
+            print("%-10s %-9s avg load per core %%: %s" % (ph.name, "cpu", "/".join(loads)))
+        if not ph.samples:
+            print("%-10s no metrics received; lengthen --phase or shorten CONFIG_METRICS_INTERVAL_S" % ph.name)
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    ap.add_argument("--host", default="localhost")
+    ap.add_argument("--port", type=int, default=1883)
+    ap.add_argument("--username")
+    ap.add_argument("--password")
+    ap.add_argument("--device", required=True, help="device base topic")
+    ap.add_argument("--rate", type=int, default=200, help="flood messages per second (total)")
+    ap.add_argument("--size", type=int, default=512, help="flood payload bytes")
+    ap.add_argument("--publishers", type=int, default=4)
+    ap.add_argument("--phase", type=float, default=120.0, help="seconds per phase")
+    ap.add_argument("--settle", type=float, default=15.0, help="seconds to wait for trailing metrics")
+    ap.add_argument("--channel", type=int, default=0, help="relay to toggle for client-side RTT (0 = off)")
+    ap.add_argument("--gap", type=float, default=1.0, help="seconds between relay toggles")
+    args = ap.parse_args()
+    if args.channel and not 1 <= args.channel <= 4:
+        ap.error("--channel must be 1..4")
+
+    mon = Monitor(args)
+    phases = [Phase("baseline"), Phase("flood")]
+    run_phase(args, mon, phases[0], False)
+    run_phase(args, mon, phases[1], True)
+    mon.phase = None
+    report(phases, args)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,159 @@
+#!/usr/bin/env python3
+"""Build-time memory budget report.
+
+    tools/mem_budget.py --map build/relay_scd41.map --tasks main/app_tasks.h \\
+        [--sdkconfig build/config/sdkconfig.json]
+
+Reports static RAM (.data + .bss, DRAM and IRAM-resident data) per source
+file of the application and per other component, task stacks from
+app_tasks.h, and the fixed runtime allocations the config implies (MQTT
+buffers, heap-created stacks). Runs after every link (see CMakeLists.txt);
+exits non-zero when CONFIG_APP_RAM_BUDGET_KB is set and exceeded.
+"""
+import argparse
+import json
+import re
+import sys
+from collections import defaultdict
+
+# Input sections that occupy RAM at runtime
+RAM_SECTION = re.compile(r"^\.(s?bss|s?data|dram\d?\.(bss|data)|noinit|rodata_in_dram)\b")
+# Output sections whose contents live in RAM
+RAM_OUTPUT = re.compile(r"^\.(dram\d?\.\w+|s?bss|s?data|noinit|flash\.rodata_in_dram)$")
+OBJ = re.compile(r"(?:lib([\w\-]+)\.a)?\(?([\w\-.]+?)(?:\.c|\.cpp|\.S)?\.o(?:bj)?\)?$")
+
+
+def owner(path):
+    """('main', 'history') for the app, ('mqtt', None) for other components."""
+    m = OBJ.search(path)
+    if not m:
+        return ("other", None)
+    lib, obj = m.group(1), m.group(2)
+    if lib == "main":
+        return ("main", obj)
+    return (lib or "other", None)
+
+
+def parse_map(path):
+    sizes = defaultdict(int)
+    in_map = False
+    out_sect = None
+    pending = None
+
+    def record(name, size_hex, obj):
+        if (name == "COMMON" or RAM_SECTION.match(name)) and int(size_hex, 16):
+            sizes[owner(obj)] += int(size_hex, 16)
+
+    with open(path, errors="replace") as f:
+        for line in f:
+            if not in_map:
+                in_map = line.startswith("Linker script and memory map")
+                continue
+            parts = line.split()
+            if not parts:
+                continue
+            if not line[0].isspace():
+                # Output section; a long name puts its address on the next line
+                out_sect = parts[0]
+                pending = None
+                continue
+            if not out_sect or not RAM_OUTPUT.match(out_sect):
+                continue
+            if parts[0].startswith(".") or parts[0] == "COMMON":
+                # Input section: ".bss.x 0xADDR 0xSIZE obj", or the name alone
+                # when it is too long and the numbers follow on the next line
+                pending = None
+                if len(parts) == 1:
+                    pending = parts[0]
+                elif len(parts) >= 4 and parts[1].startswith("0x") and parts[2].startswith("0x"):
+                    record(parts[0], parts[2], parts[3])
+                continue
+            if pending and len(parts) >= 3 and parts[0].startswith("0x") and parts[1].startswith("0x"):
+                record(pending, parts[1], parts[2])
+            pending = None
+    return sizes
+
+
+def parse_stacks(path):
+    stacks = {}
+    for m in re.finditer(r"#define\s+APP_STACK_(\w+)\s+(\d+)", open(path).read()):
+        stacks[m.group(1).lower()] = int(m.group(2))
+    return stacks
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    ap.add_argument("--map", required=True)
+    ap.add_argument("--tasks", required=True)
+    ap.add_argument("--sdkconfig", help="build/config/sdkconfig.json")
+    ap.add_argument("--top", type=int, default=12, help="other components listed individually")
+    args = ap.parse_args()
+
+    cfg = json.load(open(args.sdkconfig)) if args.sdkconfig else {}
+    static_alloc = bool(cfg.get("APP_STATIC_ALLOC"))
+    budget_kb = int(cfg.get("APP_RAM_BUDGET_KB", 0) or 0)
+
+    sizes = parse_map(args.map)
+    stacks = parse_stacks(args.tasks)
+
+    app = sorted(((k[1], v) for k, v in sizes.items() if k[0] == "main"), key=lambda kv: -kv[1])
+    comps = defaultdict(int)
+    for k, v in sizes.items():
+        if k[0] != "main":
+            comps[k[0]] += v
+    comps = sorted(comps.items(), key=lambda kv: -kv[1])
+
+    app_total = sum(v for _, v in app)
+    print("Static RAM, application (.data + .bss):")
+    for name, v in app:
+        print("  %-16s %8d" % (name, v))
+    print("  %-16s %8d" % ("total", app_total))
+
+    print("Static RAM, other components:")
+    for name, v in comps[:args.top]:
+        print("  %-16s %8d" % (name, v))
+    rest = sum(v for _, v in comps[args.top:])
+    if rest:
+        print("  %-16s %8d" % ("(others)", rest))
+    print("  %-16s %8d" % ("total", sum(v for _, v in comps)))
+
+    stack_total = sum(stacks.values())
+    print("Task stacks (%s):" % ("static, included above" if static_alloc else "heap at task creation"))
+    for name, v in sorted(stacks.items(), key=lambda kv: -kv[1]):
+        print("  %-16s %8d" % (name, v))
+    print("  %-16s %8d" % ("total", stack_total))
+
+    if cfg:
+        chunk = int(cfg.get("OTA_MQTT_CHUNK_MAX", 0))
+        window = int(cfg.get("OTA_MQTT_WINDOW", 0))
+        runtime = [
+            ("mqtt rx buffer", chunk + 28 + 256),
+            ("mqtt tx buffer", 1024),
+            ("mqtt outbox max", int(cfg.get("MQTT_OUTBOX_LIMIT", 0))),
+            ("mqtt task stack", int(cfg.get("MQTT_TASK_STACK_SIZE", 6144))),
+        ]
+        if cfg.get("LOCAL_API_ENABLE"):
+            runtime.append(("httpd task stack", int(cfg.get("LOCAL_API_STACK_SIZE", 4096))))
+        if not static_alloc:
+            runtime += [
+                ("ota rx buffer", int(cfg.get("OTA_RX_BUF_SIZE", 0))),
+                ("ota chunk pool", chunk * window),
+            ]
+        print("Fixed heap allocations implied by the config:")
+        for name, v in runtime:
+            print("  %-16s %8d" % (name, v))
+        print("  %-16s %8d" % ("total", sum(v for _, v in runtime)))
+
+    # Stacks are inside app static RAM when static, otherwise added on top
+    app_budget_use = app_total + (0 if static_alloc else stack_total)
+    print("Application RAM (static + task stacks): %d bytes" % app_budget_use)
+    if budget_kb:
+        limit = budget_kb * 1024
+        print("Budget: %d bytes, %s by %d" % (limit, "over" if app_budget_use > limit else "under",
+                                              abs(limit - app_budget_use)))
+        if app_budget_use > limit:
+            sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
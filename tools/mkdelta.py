@@ -0,0 +1,184 @@
+#!/usr/bin/env python3
+"""Make a delta firmware patch between two app images.
+
+    tools/mkdelta.py old.bin new.bin out.patch [--verify]
+
+The patch is applied on the device by main/delta_patch.c while streaming,
+reading matching regions from the running partition. Format (see
+delta_patch.h): an 80-byte header identifying base and target by the
+SHA-256 digest appended to each image, then a zlib stream of ADD/INSERT ops.
+
+Matching is bsdiff-like: regions of the new image that mostly match the old
+one (code moved by a few bytes still differs in embedded addresses) are
+stored as byte differences, which are mostly zero and compress well.
+"""
+import argparse
+import struct
+import sys
+import zlib
+
+MAGIC = 0x31444847  # "GHD1"
+OP_END, OP_ADD, OP_INSERT = 0, 1, 2
+BLOCK = 12       # hash key length
+STRIDE = 4       # base positions indexed (any match >= BLOCK+STRIDE is found)
+MIN_MATCH = 24   # shorter matches are cheaper as literals
+SLACK = 32       # stop extending after this many bytes without improvement
+
+
+def image_digest(img, name):
+    if len(img) < 24 + 32 or img[0] != 0xE9:
+        sys.exit("%s: not an ESP app image" % name)
+    if img[23] != 1:
+        sys.exit("%s: image has no appended SHA-256 (hash_appended=0)" % name)
+    return img[-32:]
+
+
+def varint(v):
+    out = bytearray()
+    while True:
+        b = v & 0x7F
+        v >>= 7
+        if v:
+            out.append(b | 0x80)
+        else:
+            out.append(b)
+            return bytes(out)
+
+
+def zigzag(v):
+    return (v << 1) if v >= 0 else ((-v << 1) - 1)
+
+
+def extend(base, tgt, s, t):
+    """Length of the approximate match at base[s:], tgt[t:] (>50% equal bytes)."""
+    lim = min(len(base) - s, len(tgt) - t)
+    best_len = best_score = score = 0
+    i = 0
+    while i < lim:
+        score += 1 if base[s + i] == tgt[t + i] else -1
+        i += 1
+        if score > best_score:
+            best_score, best_len = score, i
+        elif i - best_len > SLACK:
+            break
+    return best_len
+
+
+def diff(base, target):
+    index = {}
+    for i in range(0, len(base) - BLOCK + 1, STRIDE):
+        index.setdefault(base[i:i + BLOCK], i)
+
+    ops = bytearray()
+    src_end = 0
+    last_off = None   # base - target offset of the previous match
+    lit_start = pos = 0
+    n = len(target)
+
+    def emit_literal(end):
+        if end > lit_start:
+            ops.append(OP_INSERT)
+            ops.extend(varint(end - lit_start))
+            ops.extend(target[lit_start:end])
+
+    while pos < n:
+        cands = []
+        if last_off is not None and 0 <= pos + last_off < len(base):
+            cands.append(pos + last_off)
+        for d in range(STRIDE):
+            # the indexed block may start up to STRIDE-1 bytes into the match
+            s = index.get(target[pos + d:pos + d + BLOCK])
+            if s is not None and s - d >= 0:
+                cands.append(s - d)
+        best_s, best_len = None, 0
+        for s in cands:
+            if base[s:s + 8] != target[pos:pos + 8]:
+                continue
+            m = extend(base, target, s, pos)
+            if m > best_len:
+                best_s, best_len = s, m
+        if best_len < MIN_MATCH:
+            pos += 1
+            continue
+        # Pull exact matches backwards into the pending literal run
+        while pos > lit_start and best_s > 0 and base[best_s - 1] == target[pos - 1]:
+            pos -= 1
+            best_s -= 1
+            best_len += 1
+        emit_literal(pos)
+        ops.append(OP_ADD)
+        ops.extend(varint(best_len))
+        ops.extend(varint(zigzag(best_s - src_end)))
+        ops.extend(bytes((target[pos + i] - base[best_s + i]) & 0xFF for i in range(best_len)))
+        src_end = best_s + best_len
+        last_off = best_s - pos
+        pos += best_len
+        lit_start = pos
+    emit_literal(n)
+    ops.append(OP_END)
+    return bytes(ops)
+
+
+def make_patch(base, target):
+    hdr = struct.pack("<II32sI32s", MAGIC, len(base), image_digest(base, "base"),
+                      len(target), image_digest(target, "target"))
+    hdr += struct.pack("<I", zlib.crc32(hdr))
+    return hdr + zlib.compress(diff(base, target), 9)
+
+
+def read_varint(buf, i):
+    v = shift = 0
+    while True:
+        b = buf[i]
+        i += 1
+        v |= (b & 0x7F) << shift
+        shift += 7
+        if not b & 0x80:
+            return v, i
+
+
+def apply_patch(base, patch):
+    """Reference applier, mirrors delta_patch.c"""
+    magic, base_size, _, target_size, _, crc = struct.unpack_from("<II32sI32sI", patch)
+    assert magic == MAGIC and crc == zlib.crc32(patch[:76])
+    ops = zlib.decompress(patch[80:])
+    out = bytearray()
+    i = src_end = 0
+    while True:
+        op = ops[i]
+        i += 1
+        if op == OP_END:
+            break
+        n, i = read_varint(ops, i)
+        if op == OP_ADD:
+            z, i = read_varint(ops, i)
+            src = src_end + ((z >> 1) ^ -(z & 1))
+            assert 0 <= src and src + n <= base_size
+            out.extend((base[src + k] + ops[i + k]) & 0xFF for k in range(n))
+            src_end = src + n
+        else:
+            out.extend(ops[i:i + n])
+        i += n
+    assert len(out) == target_size
+    return bytes(out)
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    ap.add_argument("base")
+    ap.add_argument("target")
+    ap.add_argument("out")
+    ap.add_argument("--verify", action="store_true", help="apply the patch and compare")
+    args = ap.parse_args()
+    base = open(args.base, "rb").read()
+    target = open(args.target, "rb").read()
+    patch = make_patch(base, target)
+    if args.verify and apply_patch(base, patch) != target:
+        sys.exit("verify failed")
+    with open(args.out, "wb") as f:
+        f.write(patch)
+    print("%s: %d bytes (%.1f%% of %d)" % (args.out, len(patch), 100.0 * len(patch) / len(target), len(target)))
+
+
+if __name__ == "__main__":
+    main()
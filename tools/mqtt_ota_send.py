@@ -0,0 +1,133 @@
+#!/usr/bin/env python3
+"""Send a firmware image to one device or a group over MQTT.
+
+    tools/mqtt_ota_send.py build/greenhouse.bin --host broker.local \\
+        --device greenhouse/gh-a1b2c3 --device greenhouse/gh-d4e5f6 \\
+        [--group-topic greenhouse/ota/chunk]
+
+Chunks (see main/ota_mqtt.h) go to <device>/ota/chunk, or once to the group
+topic for all listed devices. The sender keeps at most `window` chunks
+beyond the slowest device's acknowledged position and goes back to the
+lowest requested sequence number when a device reports a gap or acks stall.
+Needs paho-mqtt.
+"""
+import argparse
+import json
+import random
+import struct
+import sys
+import threading
+import time
+import zlib
+
+import paho.mqtt.client as mqtt
+
+MAGIC = 0x31434847  # "GHC1"
+
+
+def chunk_msg(session, seq, total, offset, data):
+    return struct.pack("<IIIIIHHI", MAGIC, session, seq, total, offset, len(data), 0, zlib.crc32(data)) + data
+
+
+class Device:
+    def __init__(self, base):
+        self.base = base
+        self.next = 0
+        self.written = 0
+        self.window = None
+        self.state = "waiting"
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    ap.add_argument("image")
+    ap.add_argument("--host", default="localhost")
+    ap.add_argument("--port", type=int, default=1883)
+    ap.add_argument("--username")
+    ap.add_argument("--password")
+    ap.add_argument("--device", action="append", required=True, help="device base topic (repeatable)")
+    ap.add_argument("--group-topic", help="publish chunks once to this shared topic")
+    ap.add_argument("--chunk", type=int, default=2048, help="must not exceed CONFIG_OTA_MQTT_CHUNK_MAX")
+    ap.add_argument("--qos", type=int, default=0)
+    ap.add_argument("--stall", type=float, default=3.0, help="resend from the lowest gap after this many idle seconds")
+    args = ap.parse_args()
+
+    image = open(args.image, "rb").read()
+    chunks = [image[i:i + args.chunk] for i in range(0, len(image), args.chunk)]
+    session = random.getrandbits(32)
+    devices = {d: Device(d) for d in args.device}
+    lock = threading.Condition()
+    last_progress = [time.monotonic()]
+    rewind = [None]
+
+    def on_message(client, userdata, msg):
+        base = msg.topic[: -len("/ota/ack")]
+        dev = devices.get(base)
+        try:
+            ack = json.loads(msg.payload)
+        except ValueError:
+            return
+        if not dev or ack.get("session") != session:
+            return
+        with lock:
+            if ack["written"] > dev.written:
+                last_progress[0] = time.monotonic()
+            dev.next, dev.written, dev.window, dev.state = ack["next"], ack["written"], ack["window"], ack["state"]
+            if dev.state == "resend":
+                rewind[0] = dev.next if rewind[0] is None else min(rewind[0], dev.next)
+            lock.notify()
+
+    client = mqtt.Client()
+    if args.username:
+        client.username_pw_set(args.username, args.password)
+    client.on_message = on_message
+    client.connect(args.host, args.port)
+    for d in devices:
+        client.subscribe(d + "/ota/ack", 0)
+    client.loop_start()
+
+    def send(seq):
+        msg = chunk_msg(session, seq, len(image), seq * args.chunk, chunks[seq])
+        if args.group_topic:
+            client.publish(args.group_topic, msg, args.qos)
+        else:
+            for d in devices.values():
+                if d.state not in ("done", "error", "busy"):
+                    client.publish(d.base + "/ota/chunk", msg, args.qos)
+
+    t0 = time.monotonic()
+    cursor = sent = 0
+    with lock:
+        while True:
+            active = [d for d in devices.values() if d.state not in ("done", "error", "busy")]
+            if not active:
+                break
+            if rewind[0] is not None:
+                cursor = min(cursor, rewind[0])
+                rewind[0] = None
+            if time.monotonic() - last_progress[0] > args.stall:
+                cursor = min(d.next for d in active)
+                last_progress[0] = time.monotonic()
+            window = min(d.window or 1 for d in active)  # one chunk until the window is known
+            limit = min(min(d.written for d in active) + window, len(chunks))
+            while cursor < limit:
+                send(cursor)
+                cursor += 1
+                sent += 1
+            lock.wait(0.2)
+            done = min(d.written for d in active) if active else len(chunks)
+            print("\r%5.1f%%  %d/%d chunks  %d sent" % (100.0 * done / len(chunks), done, len(chunks), sent),
+                  end="", file=sys.stderr)
+
+    dt = time.monotonic() - t0
+    print(file=sys.stderr)
+    for d in devices.values():
+        print("%-32s %s" % (d.base, d.state))
+    print("%d bytes in %.1f s (%.1f kbit/s), %d chunks sent for %d (%.0f%% resent)" % (
+        len(image), dt, len(image) * 8 / 1000 / dt, sent, len(chunks), 100.0 * (sent - len(chunks)) / len(chunks)))
+    client.loop_stop()
+    sys.exit(0 if all(d.state == "done" for d in devices.values()) else 1)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,85 @@
+#!/usr/bin/env python3
+"""Local firmware server for exercising OTA download, resume and progress.
+
+Serves one image with HTTP Range support. Optional throttling and fault
+injection make the device's resume path testable without a flaky network:
+
+    tools/ota_server.py build/greenhouse.bin --port 8070 --kbps 200 --drop-at 300000
+
+then set the device OTA URL to http://<host>:8070/fw.bin and press update.
+"""
+import argparse
+import http.server
+import os
+import re
+import time
+
+
+def make_handler(args):
+    drops_left = [args.drops]
+
+    class Handler(http.server.BaseHTTPRequestHandler):
+        protocol_version = "HTTP/1.1"
+
+        def do_GET(self):
+            size = os.path.getsize(args.image)
+            start = 0
+            m = re.match(r"bytes=(\d+)-$", self.headers.get("Range", ""))
+            if m and not args.no_range:
+                start = int(m.group(1))
+                if start >= size:
+                    self.send_response(416)
+                    self.send_header("Content-Range", "bytes */%d" % size)
+                    self.send_header("Content-Length", "0")
+                    self.end_headers()
+                    return
+                self.send_response(206)
+                self.send_header("Content-Range", "bytes %d-%d/%d" % (start, size - 1, size))
+            else:
+                self.send_response(200)
+            self.send_header("Content-Type", "application/octet-stream")
+            self.send_header("Content-Length", str(size - start))
+            self.end_headers()
+
+            sent = start
+            t0 = time.monotonic()
+            with open(args.image, "rb") as f:
+                f.seek(start)
+                while True:
+                    chunk = f.read(args.chunk)
+                    if not chunk:
+                        break
+                    if args.drop_at and drops_left[0] > 0 and sent < args.drop_at <= sent + len(chunk):
+                        drops_left[0] -= 1
+                        self.wfile.write(chunk[: args.drop_at - sent])
+                        self.log_message("dropping connection at %d", args.drop_at)
+                        self.close_connection = True
+                        return
+                    self.wfile.write(chunk)
+                    sent += len(chunk)
+                    if args.kbps:
+                        ahead = (sent - start) * 8 / (args.kbps * 1000) - (time.monotonic() - t0)
+                        if ahead > 0:
+                            time.sleep(ahead)
+            self.log_message("sent %d bytes from offset %d in %.1f s", sent - start, start, time.monotonic() - t0)
+
+    return Handler
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    ap.add_argument("image")
+    ap.add_argument("--port", type=int, default=8070)
+    ap.add_argument("--kbps", type=int, default=0, help="throttle to this many kbit/s (0 = unlimited)")
+    ap.add_argument("--chunk", type=int, default=1024)
+    ap.add_argument("--drop-at", type=int, default=0, help="close the connection after this byte offset")
+    ap.add_argument("--drops", type=int, default=1, help="how many times to drop")
+    ap.add_argument("--no-range", action="store_true", help="ignore Range headers (always 200)")
+    args = ap.parse_args()
+    srv = http.server.ThreadingHTTPServer(("", args.port), make_handler(args))
+    print("serving %s on :%d" % (args.image, args.port))
+    srv.serve_forever()
+
+
+if __name__ == "__main__":
+    main()
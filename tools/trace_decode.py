@@ -0,0 +1,195 @@
+#!/usr/bin/env python3
+"""Decode a command-path trace dump into per-stage latency percentiles.
+
+    mosquitto_sub -h broker -t greenhouse/<id>/trace -C 1 -N > trace.bin &
+    mosquitto_pub -h broker -t greenhouse/<id>/trace/dump -m 1
+    tools/trace_decode.py trace.bin
+
+or fetch it directly (needs paho-mqtt):
+
+    tools/trace_decode.py --host broker --device greenhouse/<id> \\
+        [--probe 50 --channel 4]
+
+--probe toggles the given relay N times first and times each command from
+publish to the state echo, so the part spent outside the device (client,
+broker, network) can be separated from the on-device stages. It really
+switches the relay; pick a channel with nothing dangerous attached.
+
+Records are defined in main/trace.h.
+"""
+import argparse
+import math
+import struct
+import sys
+import time
+
+MAGIC = 0x31544847  # "GHT1"
+HDR = struct.Struct("<IIII")
+REC = struct.Struct("<IBBH")
+
+EVENTS = {
+    1: "mqtt_rx",
+    2: "relay_matched",
+    3: "safety_begin",
+    4: "safety_end",
+    5: "relay_begin",
+    6: "relay_end",
+    7: "publish_begin",
+    8: "publish_end",
+}
+
+# (name, from event, to event)
+STAGES = [
+    ("dispatch", "mqtt_rx", "relay_matched"),
+    ("handoff", "relay_matched", "safety_begin"),  # parse + control queue
+    ("safety_can_turn_on", "safety_begin", "safety_end"),
+    ("relay_set_channel", "relay_begin", "relay_end"),
+    ("safety_bookkeeping", "relay_end", "publish_begin"),
+    ("state_publish", "publish_begin", "publish_end"),
+    ("total", "mqtt_rx", "publish_end"),
+]
+
+
+def decode(blob):
+    if len(blob) < HDR.size:
+        sys.exit("dump too short")
+    magic, count, total, now_us = HDR.unpack_from(blob)
+    if magic != MAGIC:
+        sys.exit("bad magic 0x%08x" % magic)
+    if len(blob) < HDR.size + count * REC.size:
+        sys.exit("truncated dump: %d of %d records" % ((len(blob) - HDR.size) // REC.size, count))
+    recs = [REC.unpack_from(blob, HDR.size + i * REC.size) for i in range(count)]
+    return total, now_us, recs
+
+
+def group(recs):
+    """Command id -> {event name: timestamp}. Ids are 16-bit and wrap, so a
+    group is closed when its id shows up again with mqtt_rx."""
+    done, open_ = [], {}
+    for ts, ev, _core, arg in recs:
+        name = EVENTS.get(ev)
+        if not name:
+            continue
+        if name == "mqtt_rx" and arg in open_:
+            done.append(open_.pop(arg))
+        open_.setdefault(arg, {})[name] = ts
+    return done + list(open_.values())
+
+
+def pct(values, p):
+    s = sorted(values)
+    k = max(0, min(len(s) - 1, math.ceil(p / 100.0 * len(s)) - 1))  # nearest rank
+    return s[k]
+
+
+def report(rows, title):
+    print(title)
+    print("  %-20s %6s %9s %9s %9s %9s" % ("stage", "n", "p50_us", "p90_us", "p99_us", "max_us"))
+    for name, vals in rows:
+        if not vals:
+            print("  %-20s %6d" % (name, 0))
+            continue
+        print("  %-20s %6d %9d %9d %9d %9d" % (name, len(vals), pct(vals, 50), pct(vals, 90), pct(vals, 99), max(vals)))
+
+
+def stages(groups):
+    rows = []
+    for name, a, b in STAGES:
+        # Timestamps are the low 32 bits of esp_timer; deltas are taken mod 2^32
+        vals = [(g[b] - g[a]) & 0xFFFFFFFF for g in groups if a in g and b in g]
+        rows.append((name, vals))
+    return rows
+
+
+def fetch(args):
+    import threading
+    import paho.mqtt.client as mqtt
+
+    got = threading.Event()
+    state = threading.Condition()
+    blob = []
+    echoes = []
+    c = mqtt.Client()
+    if args.username:
+        c.username_pw_set(args.username, args.password)
+
+    def on_message(_c, _u, msg):
+        if msg.topic == args.device + "/trace":
+            blob.append(msg.payload)
+            got.set()
+        else:
+            with state:
+                echoes.append((time.monotonic(), msg.payload.decode(errors="replace")))
+                state.notify_all()
+
+    c.on_message = on_message
+    c.connect(args.host, args.port)
+    c.subscribe(args.device + "/trace", 0)
+    rtts = []
+    if args.probe:
+        state_t = "%s/relay/%d/state" % (args.device, args.channel)
+        c.subscribe(state_t, 1)
+        c.loop_start()
+        time.sleep(1.0)  # retained state arrives first
+        with state:
+            echoes.clear()
+        for i in range(args.probe):
+            want = "ON" if i % 2 == 0 else "OFF"
+            with state:
+                echoes.clear()
+                t0 = time.monotonic()
+                c.publish("%s/relay/%d/set" % (args.device, args.channel), want, qos=1)
+                if state.wait_for(lambda: any(p == want for _, p in echoes), timeout=5.0):
+                    t1 = next(t for t, p in echoes if p == want)
+                    rtts.append(int((t1 - t0) * 1e6))
+            time.sleep(args.gap)
+        c.publish("%s/relay/%d/set" % (args.device, args.channel), "OFF", qos=1)
+    else:
+        c.loop_start()
+    c.publish(args.device + "/trace/dump", "1", qos=0)
+    if not got.wait(10.0):
+        sys.exit("no trace dump received")
+    c.loop_stop()
+    c.disconnect()
+    return blob[0], rtts
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    ap.add_argument("dump", nargs="?", help="binary dump file (omit to fetch over MQTT)")
+    ap.add_argument("--host", default="localhost")
+    ap.add_argument("--port", type=int, default=1883)
+    ap.add_argument("--username")
+    ap.add_argument("--password")
+    ap.add_argument("--device", help="device base topic, e.g. greenhouse/esp32s3-a1b2c3")
+    ap.add_argument("--probe", type=int, default=0, help="relay commands to send before dumping")
+    ap.add_argument("--channel", type=int, default=0, help="relay channel used by --probe")
+    ap.add_argument("--gap", type=float, default=0.2, help="seconds between probe commands")
+    args = ap.parse_args()
+
+    rtts = []
+    if args.dump:
+        blob = open(args.dump, "rb").read()
+    else:
+        if not args.device:
+            ap.error("--device is required without a dump file")
+        if args.probe and not 1 <= args.channel <= 4:
+            ap.error("--probe needs --channel 1..4")
+        blob, rtts = fetch(args)
+
+    total, _now, recs = decode(blob)
+    groups = [g for g in group(recs) if "relay_matched" in g]
+    print("%d records in dump (%d written since boot), %d relay commands" % (len(recs), total, len(groups)))
+    if total > len(recs):
+        print("ring wrapped: the oldest %d records were overwritten" % (total - len(recs)))
+    report(stages(groups), "On-device stages:")
+    if rtts:
+        dev = sorted(v for name, vals in stages(groups) if name == "total" for v in vals)
+        report([("round_trip", rtts)], "Client view (publish -> state echo):")
+        if dev:
+            off = [max(0, r - pct(dev, 50)) for r in rtts]
+            report([("outside_device", off)], "Round trip minus median on-device total:")
+
+
+if __name__ == "__main__":
+    main()